@@ -49,6 +49,7 @@
 #include <stdint.h>
 
 #include "ethernet.h"
+#include "net_timer.h"
 
 
 
@@ -63,6 +64,34 @@
 
 
 
+/* Address probe and announcement states (RFC 5227) */
+typedef enum _arp_probe_states
+{
+    ARP_PROBE_IDLE       = 0,  /*!< Not started                                   */
+    ARP_PROBE_PROBING    = 1,  /*!< Probing, address must not be used yet         */
+    ARP_PROBE_ANNOUNCING = 2,  /*!< Address in use, gratuitous ARPs being sent    */
+    ARP_PROBE_BOUND      = 3,  /*!< Announcements done                            */
+    ARP_PROBE_CONFLICT   = 4,  /*!< Address used by another host, (conflict_mac) */
+
+}arp_probe_state_t;
+
+
+
+/* Address probe handle, (allocated by user, run from ether_arp_probe_poll) */
+typedef struct _arp_probe
+{
+    ethernet_handle_t *ethernet;                      /*!< Ethernet handle                          */
+    arp_probe_state_t  state;                         /*!< Probe state                              */
+    uint8_t            ip_address[ETHER_IPV4_SIZE];   /*!< Address probed and announced             */
+    uint8_t            conflict_mac[ETHER_MAC_SIZE];  /*!< MAC address of conflicting host          */
+    uint8_t            count;                         /*!< Probes or announcements sent             */
+    uint8_t            timer_events;                  /*!< Expired timer not yet serviced           */
+    net_timer_t        timer;                         /*!< Probe and announcement interval timer    */
+
+}arp_probe_t;
+
+
+
 
 /******************************************************************************/
 /*                                                                            */
@@ -117,5 +146,91 @@ uint8_t ether_arp_resolve_address(ethernet_handle_t *ethernet, uint8_t *destinat
 
 
 
+/***********************************************************************
+ * @brief  Function to get MAC address for sending to destination IP
+ *         address, off link destinations resolve to gateway MAC
+ *         (next hop from routing table, searches local ARP table)
+ * @param  *ethernet        : reference to the Ethernet handle
+ * @param  *destination_mac : next hop mac_address
+ * @param  *destination_ip  : destination ip address
+ * @retval  uint8_t         : Success = 1 device found else 0 for not found
+ ***********************************************************************/
+uint8_t ether_arp_resolve_next_hop(ethernet_handle_t *ethernet, uint8_t *destination_mac, uint8_t *destination_ip);
+
+
+
+
+/***********************************************************************
+ * @brief  Function to add address to ARP table, (cached entries
+ *         restored at boot)
+ * @param  *ethernet    : reference to the Ethernet handle
+ * @param  *ip_address  : device ip address
+ * @param  *mac_address : device mac_address
+ * @retval  uint8_t     : Success = 0 (device added), 1 (device already exists)
+ ***********************************************************************/
+uint8_t ether_arp_add_entry(ethernet_handle_t *ethernet, uint8_t *ip_address, uint8_t *mac_address);
+
+
+
+
+/***********************************************************************
+ * @brief  Function to learn addresses from received frame, (ARP
+ *         packets and IPv4 packets to host from local subnet),
+ *         called on every frame read by ether_get_data()
+ * @param  *ethernet : reference to the Ethernet handle
+ * @retval uint8_t   : Error = 0, Success = 1 (address learned)
+ ***********************************************************************/
+uint8_t ether_arp_snoop(ethernet_handle_t *ethernet);
+
+
+
+
+/***********************************************************************
+ * @brief  Function to start address probe and announcement,
+ *         (RFC 5227), probes and announcements are sent from
+ *         ether_arp_probe_poll()
+ * @param  *ethernet    : reference to the Ethernet handle
+ * @param  *probe       : reference to probe handle
+ * @param  *ip_address  : address to probe and announce
+ * @param  probe_first  : 1 = probe then announce, 0 = announce only
+ * @retval int8_t       : Error = 0, Success = 1
+ ***********************************************************************/
+int8_t ether_arp_probe_start(ethernet_handle_t *ethernet, arp_probe_t *probe, uint8_t *ip_address, uint8_t probe_first);
+
+
+
+
+/***********************************************************************
+ * @brief  Function to stop address probe or announcement
+ * @param  *probe : reference to probe handle
+ * @retval int8_t : Error = 0, Success = 1
+ ***********************************************************************/
+int8_t ether_arp_probe_stop(arp_probe_t *probe);
+
+
+
+
+/***********************************************************************
+ * @brief  Function to run address probe, call from application
+ *         poll loop, reads network only while probing
+ * @param  *probe        : reference to probe handle
+ * @param  *network_data : network data from PHY
+ * @retval int8_t        : Error = 0, Success = probe state
+ ***********************************************************************/
+int8_t ether_arp_probe_poll(arp_probe_t *probe, uint8_t *network_data);
+
+
+
+
+/***********************************************************************
+ * @brief  Function to set device pattern filter to ARP packets for
+ *         host address, (broadcast filter can be disabled)
+ * @param  *ethernet : reference to the Ethernet handle
+ * @retval int8_t    : Error = -1, Success = 0
+ ***********************************************************************/
+int8_t ether_arp_set_rx_pattern(ethernet_handle_t *ethernet);
+
+
+
 
 #endif /* ARP_H_ */
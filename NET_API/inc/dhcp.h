@@ -50,6 +50,8 @@
 #include <stdint.h>
 
 #include "ethernet.h"
+#include "net_timer.h"
+#include "arp.h"
 
 
 
@@ -62,6 +64,14 @@
 
 
 
+#define DHCP_MAX_DNS_SERVERS  2   /*!< DNS servers kept from option 6  */
+#define DHCP_MAX_NTP_SERVERS  2   /*!< NTP servers kept from option 42 */
+
+#define DHCP_FRAME_SIZE       240                                /*!< DHCP header, up to options      */
+#define DHCP_OPTIONS_SIZE     (APP_BUFF_SIZE - DHCP_FRAME_SIZE)  /*!< DHCP options kept from reply    */
+
+
+
 /* DHCP states */
 typedef enum _dhcp_state_values
 {
@@ -71,11 +81,99 @@ typedef enum _dhcp_state_values
     DHCP_REQUESTING_STATE = 4,
     DHCP_ACK_STATE        = 5,
     DHCP_BOUND_STATE      = 6,
+    DHCP_RENEWING_STATE   = 7,
+    DHCP_REBINDING_STATE  = 8,
+    DHCP_REBOOTING_STATE  = 9,
 
 }dhcp_states;
 
 
 
+/* DHCP client events, passed to address change callback */
+typedef enum _dhcp_events
+{
+    DHCP_EVENT_BOUND   = 1,  /*!< Address assigned or changed    */
+    DHCP_EVENT_RENEWED = 2,  /*!< Lease of same address extended */
+    DHCP_EVENT_LOST    = 3,  /*!< Lease expired or NAK received  */
+
+}dhcp_event_t;
+
+
+
+/* DHCP options present in server reply */
+typedef enum _dhcp_option_flags
+{
+    DHCP_OPT_MESSAGE_TYPE  = 0x0001,
+    DHCP_OPT_SERVER_ID     = 0x0002,
+    DHCP_OPT_SUBNET_MASK   = 0x0004,
+    DHCP_OPT_ROUTER        = 0x0008,
+    DHCP_OPT_DNS_SERVER    = 0x0010,
+    DHCP_OPT_NTP_SERVER    = 0x0020,
+    DHCP_OPT_INTERFACE_MTU = 0x0040,
+    DHCP_OPT_LEASE_TIME    = 0x0080,
+    DHCP_OPT_RENEWAL_TIME  = 0x0100,
+    DHCP_OPT_REBIND_TIME   = 0x0200,
+
+}dhcp_option_flags_t;
+
+
+
+/* DHCP options of server reply, (parsed in one pass) */
+typedef struct _dhcp_options
+{
+    uint16_t present;                                            /*!< Options found, dhcp_option_flags_t  */
+    uint8_t  message_type;                                       /*!< DHCP message type (53)              */
+    uint8_t  server_id[ETHER_IPV4_SIZE];                         /*!< Server identifier (54)              */
+    uint8_t  subnet_mask[ETHER_IPV4_SIZE];                       /*!< Subnet mask (1)                     */
+    uint8_t  router[ETHER_IPV4_SIZE];                            /*!< First router (3)                    */
+    uint8_t  dns_server[DHCP_MAX_DNS_SERVERS][ETHER_IPV4_SIZE];  /*!< DNS servers (6)                     */
+    uint8_t  dns_count;                                          /*!< Number of DNS servers               */
+    uint8_t  ntp_server[DHCP_MAX_NTP_SERVERS][ETHER_IPV4_SIZE];  /*!< NTP servers (42)                    */
+    uint8_t  ntp_count;                                          /*!< Number of NTP servers               */
+    uint16_t interface_mtu;                                      /*!< Interface MTU (26)                  */
+    uint32_t lease_time;                                         /*!< Lease time, s (51)                  */
+    uint32_t renew_time;                                         /*!< Renewal time T1, s (58)             */
+    uint32_t rebind_time;                                        /*!< Rebinding time T2, s (59)           */
+
+}dhcp_options_t;
+
+
+
+/* Address change callback, called from ether_dhcp_poll() */
+typedef void (*dhcp_callback_t)(ethernet_handle_t *ethernet, dhcp_event_t event);
+
+
+
+/* DHCP client handle, (allocated by user, run from ether_dhcp_poll) */
+typedef struct _dhcp_client
+{
+    ethernet_handle_t *ethernet;                     /*!< Ethernet handle                                  */
+    dhcp_states        state;                        /*!< DHCP client state                                */
+    uint32_t           transaction_id;               /*!< Transaction ID of current exchange               */
+    uint8_t            your_ip[ETHER_IPV4_SIZE];     /*!< Offered or leased IP address                     */
+    uint8_t            server_ip[ETHER_IPV4_SIZE];   /*!< DHCP server identifier                           */
+    uint32_t           lease_time;                   /*!< Lease time (s)                                   */
+    uint32_t           renew_time;                   /*!< Renewal time T1 from lease start (s)             */
+    uint32_t           rebind_time;                  /*!< Rebinding time T2 from lease start (s)           */
+    uint32_t           lease_start;                  /*!< Time lease was granted (ms)                      */
+    uint32_t           exchange_start;               /*!< Time current exchange started, secs field (ms)   */
+    uint32_t           retransmit_timeout;           /*!< Retransmission timeout, with backoff (ms)        */
+    uint8_t            retries;                      /*!< Requests sent in REQUESTING or REBOOTING state   */
+    uint8_t            lease_saved;                  /*!< Lease saved with gateway MAC, (fast boot)        */
+    uint8_t            timer_events;                 /*!< Expired timers not yet serviced                  */
+    net_timer_t        retransmit_timer;             /*!< DISCOVER and REQUEST retransmission timer        */
+    net_timer_t        lease_timer;                  /*!< T1, T2 and lease expiry timer                    */
+    dhcp_callback_t    callback;                     /*!< Address change callback (optional)               */
+    dhcp_options_t     options;                      /*!< Options of last ACK, (DNS, NTP servers)          */
+    arp_probe_t        arp_probe;                    /*!< Gratuitous ARP announcement of leased address    */
+    uint8_t            rx_type;                      /*!< Type of server reply read by net_poll, 0 = none  */
+    uint8_t            rx_your_ip[ETHER_IPV4_SIZE];  /*!< 'your IP' of server reply read by net_poll       */
+    uint8_t            rx_options[DHCP_OPTIONS_SIZE];/*!< Options of server reply read by net_poll         */
+
+}dhcp_client_t;
+
+
+
 
 /******************************************************************************/
 /*                                                                            */
@@ -146,15 +244,57 @@ int8_t ether_dhcp_send_request(ethernet_handle_t *ethernet, uint32_t transaction
 
 
 /*************************************************************
- * @brief   Function to get IP though DHCP state machine
+ * @brief   Function to parse DHCP options in one pass,
+ *          options are bounds checked, unknown options
+ *          and options of invalid length are skipped
+ * @param   *options : DHCP options data
+ * @param   length   : DHCP options data length
+ * @param   *parsed  : parsed options
+ * @retval  int8_t   : Error = 0 (no message type), Success = 1
+ *************************************************************/
+int8_t ether_dhcp_parse_options(uint8_t *options, uint16_t length, dhcp_options_t *parsed);
+
+
+
+
+/*************************************************************
+ * @brief   Function to start non blocking DHCP client,
+ *          DISCOVER is sent from ether_dhcp_poll(), lease
+ *          saved in nonvolatile storage is requested first
+ *          (INIT-REBOOT) and its gateway added to ARP table
+ * @param   *ethernet : reference to the Ethernet handle
+ * @param   *dhcp     : reference to DHCP client handle
+ * @param   callback  : address change callback (optional)
+ * @retval  int8_t    : Error = 0, Success = 1
+ *************************************************************/
+int8_t ether_dhcp_start(ethernet_handle_t *ethernet, dhcp_client_t *dhcp, dhcp_callback_t callback);
+
+
+
+
+/*************************************************************
+ * @brief   Function to run DHCP client, call from the
+ *          application poll loop, sends and retransmits
+ *          DHCP messages, renews (T1) and rebinds (T2) lease,
+ *          handles server reply read by net_poll()
+ * @param   *dhcp         : reference to DHCP client handle
+ * @param   *network_data : network data from PHY
+ * @retval  int8_t        : Error = 0, Success = DHCP state
+ *************************************************************/
+int8_t ether_dhcp_poll(dhcp_client_t *dhcp, uint8_t *network_data);
+
+
+
+
+/*************************************************************
+ * @brief   Function to get IP though DHCP state machine,
+ *          blocks until bound, lease is renewed only by
+ *          client from ether_dhcp_start()
  * @param   *ethernet     : reference to the Ethernet handle
  * @param   *network_data : network data from PHY
- *
- * @param   dhcp_state    : DHCP state machine states
  * @retval  uint8_t       : Error = NA, Success = NA
  *************************************************************/
-int8_t ether_get_dhcp_ip(ethernet_handle_t *ethernet, uint8_t *network_data, uint8_t *mac_address,
-                         dhcp_states dhcp_state);
+int8_t ether_get_dhcp_ip(ethernet_handle_t *ethernet, uint8_t *network_data);
 
 
 
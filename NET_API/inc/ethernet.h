@@ -57,10 +57,6 @@
 /*                                                                            */
 /******************************************************************************/
 
-/* structure padding */
-#define pragma pack(1)
-
-
 #define ETHER_PHY_DATA_OFFSET 4
 
 #define ETHER_MAC_SIZE    6     /*!< Size of MAC address        */
@@ -68,7 +64,16 @@
 #define ETHER_IPV4_SIZE   4     /*!< IP protocol version 4 size */
 #define ARP_TABLE_SIZE    5     /*!< ARP Table size define      */
 #define ETHER_MTU_SIZE    1460  /*!< MAX MTU size               */
+#define ETHER_DEFAULT_MTU 1500  /*!< Interface MTU, IP packet   */
 #define APP_BUFF_SIZE     500   /*!< Application buffer size    */
+#define ETHER_MAX_INTERFACES   1   /*!< Network interfaces, ~2.2 KB RAM each (handle, application and loopback buffers) */
+#define ETHER_MULTICAST_GROUPS 4   /*!< Multicast groups in receive filter  */
+#define ETHER_PATTERN_SIZE     64  /*!< Receive pattern match window size   */
+#define ETHER_RX_HEADER_SIZE   64  /*!< Bytes read before frame is accepted */
+#define ETHER_POLL_BUDGET      8   /*!< Frames read by one net_poll() call  */
+#define ETHER_TX_QUEUE_SIZE    2   /*!< Frames queued while device sends (ACK and data segment), ~1.5 KB RAM each      */
+#define ETHER_TX_PORTS         4   /*!< Ports in interactive transmit class */
+#define ETHER_TX_WEIGHT        4   /*!< Interactive frames per bulk frame   */
 
 
 /* Function define for random number generator function */
@@ -96,10 +101,52 @@ typedef struct _ether_frame
 
 
 
+/* Parsed received packet, built once per frame by ether_get_data(), offsets are from IP header */
+typedef struct _net_packet
+{
+    uint8_t  parsed      : 1;          /*!< Descriptor describes frame in network buffer      */
+    uint8_t  ip_valid    : 1;          /*!< IPv4 header, lengths and header checksum valid    */
+    uint8_t  l4_checked  : 1;          /*!< Transport checksum computed                       */
+    uint8_t  l4_valid    : 1;          /*!< Transport checksum valid (TCP, UDP)               */
+    uint8_t  reserved    : 4;
+    uint8_t  ip_protocol;              /*!< IP protocol type                                  */
+    uint16_t ether_type;               /*!< Ethernet frame type (host order)                  */
+    uint16_t frame_length;             /*!< Bytes received or sent from Ethernet header       */
+    uint16_t ip_length;                /*!< IP total length, validated against frame length   */
+    uint8_t  ip_header_length;         /*!< IP header size, transport header offset           */
+    uint8_t  l4_header_length;         /*!< TCP or UDP header size, data offset from l4       */
+    uint16_t l4_length;                /*!< Transport header and data length                  */
+    uint16_t data_length;              /*!< Transport data length                             */
+    uint16_t source_port;              /*!< Transport source port (host order)                */
+    uint16_t destination_port;         /*!< Transport destination port (host order)           */
+    uint8_t  source_ip[ETHER_IPV4_SIZE];       /*!< IP source address                         */
+    uint8_t  destination_ip[ETHER_IPV4_SIZE];  /*!< IP destination address                    */
+
+}net_packet_t;
+
+
+/* Data fragment for gather (sendv) functions */
+typedef struct _net_iovec
+{
+    void     *data;    /*!< Fragment data    */
+    uint16_t  length;  /*!< Fragment length  */
+
+}net_iovec_t;
+
+
+
 /* Ethernet Handle type defined */
 typedef struct _ethernet_handle ethernet_handle_t;
 
 
+/* Transport receive handler, called by net_poll() for each frame (batch_end = 0) and after the batch (batch_end = 1) */
+typedef uint8_t (*net_input_handler_t)(ethernet_handle_t *ethernet, void *context, uint8_t batch_end);
+
+
+/* ARP address probe, (arp.h) */
+struct _arp_probe;
+
+
 /* ARP Table */
 typedef struct _arp_table
 {
@@ -109,6 +156,43 @@ typedef struct _arp_table
 }arp_table_t;
 
 
+/* Receive filter flags, frame is accepted if any enabled filter matches */
+typedef enum _ether_filter_flags
+{
+    ETHER_FILTER_UNICAST   = 0x01,  /*!< Frames to host MAC address              */
+    ETHER_FILTER_BROADCAST = 0x02,  /*!< Broadcast frames                        */
+    ETHER_FILTER_MULTICAST = 0x04,  /*!< All multicast frames                    */
+    ETHER_FILTER_HASH      = 0x08,  /*!< Multicast groups, (hash table)          */
+    ETHER_FILTER_PATTERN   = 0x10,  /*!< Frames matching pattern                 */
+
+}ether_filter_flags_t;
+
+
+/* Receive filter, programmed into network device by set_rx_filter operation */
+typedef struct _ether_rx_filter
+{
+    uint8_t  flags;                                          /*!< Enabled filters, ether_filter_flags_t              */
+    uint8_t  hash_table[8];                                  /*!< Multicast hash, bit = CRC-32 bits 28:23 of MAC     */
+    uint8_t  pattern_mask[ETHER_PATTERN_SIZE / 8];           /*!< Pattern window bytes checked, bit 0 = first byte   */
+    uint16_t pattern_offset;                                 /*!< Pattern window offset from Ethernet header         */
+    uint16_t pattern_checksum;                               /*!< Checksum of checked pattern bytes                  */
+    uint8_t  group_count;                                    /*!< Multicast groups joined                            */
+    uint8_t  groups[ETHER_MULTICAST_GROUPS][ETHER_MAC_SIZE]; /*!< Multicast group MAC addresses                      */
+
+}ether_rx_filter_t;
+
+
+/* Transmit classes, control has strict priority, interactive and bulk are weighted */
+typedef enum _ether_tx_class
+{
+    ETHER_TX_CONTROL     = 0,  /*!< ARP, ICMP, TCP segments without data     */
+    ETHER_TX_INTERACTIVE = 1,  /*!< Data of ports set by ether_tx_port_class */
+    ETHER_TX_BULK        = 2,  /*!< Other data                               */
+    ETHER_TX_CLASSES     = 3,
+
+}ether_tx_class_t;
+
+
 /* */
 typedef struct _network_timer_operations
 {
@@ -129,6 +213,15 @@ typedef struct _ethernet_operations
     uint16_t (*random_gen_seed)(void);                               /*!< Seed value return function for random number generation                */
     int16_t  (*ether_send_packet)(uint8_t *data, uint16_t length);   /*!< Callback function to send Ethernet packet                              */
     uint16_t (*ether_recv_packet)(uint8_t *data, uint16_t length);   /*!< Callback function to receive Ethernet packet                           */
+    uint32_t (*get_time_ms)(void);                                   /*!< Monotonic millisecond time, used by protocol timers (optional)         */
+    uint8_t  (*nv_read)(uint16_t offset, void *data, uint16_t length);   /*!< Read nonvolatile storage, saved DHCP lease (optional)        */
+    uint8_t  (*nv_write)(uint16_t offset, void *data, uint16_t length);  /*!< Write nonvolatile storage, saved DHCP lease (optional)       */
+    uint8_t  (*set_rx_filter)(ether_rx_filter_t *filter);            /*!< Program device receive filters (optional)                              */
+    uint16_t (*ether_recv_header)(uint8_t *data, uint16_t length);   /*!< Read start of packet, returns packet length (optional)                 */
+    uint16_t (*ether_recv_remaining)(uint8_t *data, uint16_t length);/*!< Read rest of packet after header read (optional)                       */
+    void     (*ether_drop_packet)(void);                             /*!< Discard rest of packet after header read (optional)                    */
+    uint8_t  (*ether_rx_pending)(void);                              /*!< Number of packets waiting in device (optional)                         */
+    uint8_t  (*ether_tx_busy)(void);                                 /*!< Device still sending last packet, send returns at start (optional)     */
 
 }ether_operations_t;
 
@@ -142,7 +235,8 @@ typedef struct _network_status
     uint8_t mode_dhcp_bound     : 1;
     uint8_t mode_read_blocking  : 1;
     uint8_t net_app_data_rdy    : 1;
-    uint8_t reserved            : 2;
+    uint8_t rx_batch            : 1;
+    uint8_t reserved            : 1;
 
 }net_status_t;
 
@@ -155,6 +249,27 @@ struct _ethernet_handle
     net_status_t       status;                     /*!< Ethernet status fields                          */
     ether_operations_t *ether_commands;            /*!< Network Operations                              */
     arp_table_t        arp_table[ARP_TABLE_SIZE];  /*!< ARP Table                                       */
+    uint8_t            arp_next;                   /*!< ARP Table entry replaced next when full         */
+    struct _arp_probe  *arp_probe;                 /*!< Address probe in progress, conflict detection   */
+    net_packet_t       packet;                     /*!< Parsed received frame                           */
+    uint8_t            if_index;                   /*!< Interface index, order of creation              */
+    ether_rx_filter_t  rx_filter;                  /*!< Device receive filters                          */
+    uint32_t           rx_frames;                  /*!< Frames read from device                         */
+    uint32_t           rx_bytes;                   /*!< Bytes read from device, (filter effect)         */
+    uint32_t           rx_dropped;                 /*!< Frames dropped after header read                */
+    net_input_handler_t tcp_input;                 /*!< TCP receive handler, set by TCP client          */
+    void               *tcp_context;               /*!< TCP receive handler context                     */
+    net_input_handler_t udp_input;                 /*!< UDP receive handler, set by DHCP client         */
+    void               *udp_context;               /*!< UDP receive handler context                     */
+    uint8_t            tx_order;                   /*!< Order of next queued frame                      */
+    uint8_t            tx_queued;                  /*!< Frames in transmit queue                        */
+    uint8_t            tx_run;                     /*!< Interactive frames sent while bulk waits        */
+    uint16_t           tx_last_flow[ETHER_TX_CLASSES]; /*!< Last port sent per class, (round robin)      */
+    uint16_t           tx_ports[ETHER_TX_PORTS];   /*!< Interactive ports                               */
+    uint8_t            tx_port_count;              /*!< Number of interactive ports                     */
+    uint16_t           loopback_length;            /*!< Looped back frame in loopback slot, 0 = none    */
+    uint32_t           loopback_frames;            /*!< Frames looped back, (not sent to device)        */
+    uint32_t           loopback_dropped;           /*!< Loopback sends refused, (frame already held)    */
 
     uint16_t ip_identifier;                  /*!< */
     uint16_t source_port;                    /*!< Ethernet source port, gets random source port value  */
@@ -166,6 +281,8 @@ struct _ethernet_handle
     uint8_t  broadcast_ip[ETHER_IPV4_SIZE];  /*!< Broadcast IP address                                 */
     uint8_t  subnet_mask[ETHER_IPV4_SIZE];   /*!< SUBNET mask, gets value from DHCP sever              */
     uint8_t  gateway_ip[ETHER_IPV4_SIZE];    /*!< Gateway or DHCP Server IP, from DHCP server          */
+    uint8_t  dns_ip[ETHER_IPV4_SIZE];        /*!< DNS server IP, from DHCP server                      */
+    uint16_t mtu;                            /*!< Interface MTU, from DHCP server                      */
     uint32_t lease_time;                     /*!< IP lease time, from DHCP server                      */
 
 };
@@ -223,6 +340,7 @@ typedef enum _network_error_codes
     NET_TCP_SEND_ERROR     = -12, /*!< */
     NET_TCP_READ_ERROR     = -13, /*!< */
     NET_FUNC_NO_RDWR       = -14, /*!< */
+    NET_UDP_RATE_LIMIT     = -15, /*!< UDP send over destination port rate limit */
 
 }network_erro_codes_t;
 
@@ -249,6 +367,57 @@ int8_t ether_sum_words(uint32_t *sum, void *data, uint16_t size_in_bytes);
 
 
 
+/******************************************************
+ * @brief  Function to copy data and sum it in one
+ *         pass, (same sum as ether_sum_words), data
+ *         must not partly overlap destination
+ * @param  *sum          : Total 32 bit sum
+ * @param  *destination  : copy of data
+ * @param  *source       : data to be copied and summed
+ * @param  size_in_bytes : size of the data
+ * @retval int8_t        : Error = -1, Success = 0
+ ******************************************************/
+int8_t ether_copy_sum(uint32_t *sum, void *destination, void *source, uint16_t size_in_bytes);
+
+
+
+/******************************************************
+ * @brief  Function to add sum of data that starts at
+ *         offset from summed data, sum of data at odd
+ *         offset is byte swapped (RFC 1071)
+ * @param  *sum     : Total 32 bit sum
+ * @param  part_sum : Sum of data at offset
+ * @param  offset   : Offset of data, (bytes)
+ * @retval int8_t   : Error = -1, Success = 0
+ ******************************************************/
+int8_t ether_sum_combine(uint32_t *sum, uint32_t part_sum, uint16_t offset);
+
+
+
+/******************************************************
+ * @brief  Function to get total length of fragments
+ * @param  *fragments     : Data fragments
+ * @param  fragment_count : Number of fragments
+ * @retval uint32_t       : Total length (bytes)
+ ******************************************************/
+uint32_t ether_iovec_length(net_iovec_t *fragments, uint8_t fragment_count);
+
+
+
+/******************************************************
+ * @brief  Function to gather data fragments in order
+ *         into destination, data summed in the same
+ *         pass if sum is given (ether_copy_sum)
+ * @param  *destination   : Gathered data
+ * @param  *fragments     : Data fragments
+ * @param  fragment_count : Number of fragments
+ * @param  *sum           : Total 32 bit sum, NULL = copy only
+ * @retval uint32_t       : Bytes gathered
+ ******************************************************/
+uint32_t ether_gather(uint8_t *destination, net_iovec_t *fragments, uint8_t fragment_count, uint32_t *sum);
+
+
+
 /******************************************************
  * @brief  Function to get checksum of network packet
  * @param  *sum          : Total 32 bit sum
@@ -284,7 +453,8 @@ int32_t get_random_port_l(ethernet_handle_t *ethernet, uint32_t lower_bound);
 
 /**************************************************************************
  * @brief  constructor function to create Ethernet handle
- *         (Multiple exit points)
+ *         (Multiple exit points), one handle per interface,
+ *         up to ETHER_MAX_INTERFACES
  * @param  *network_data  : reference to the network data buffer
  * @param  *mac_address   : MAC address (string)
  * @param  *ip_address    : ip address (string)
@@ -297,6 +467,18 @@ ethernet_handle_t* create_ethernet_handle(uint8_t *network_data, char *mac_addre
 
 
 
+
+/**********************************************************
+ * @brief  Function to get network interface by index,
+ *         (order of create_ethernet_handle() calls)
+ * @param  index              : interface index
+ * @retval ethernet_handle_t* : Error = NULL, Success = handle
+ **********************************************************/
+ethernet_handle_t* ether_get_interface(uint8_t index);
+
+
+
+
 uint8_t ether_control(ethernet_handle_t *ethernet, ether_control_t ether_mode);
 
 
@@ -322,7 +504,45 @@ uint8_t ether_get_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t data
 
 
 /***********************************************************
- * @brief  Function send Ethernet network data
+ * @brief  Function to read and handle up to budget frames
+ *         waiting in network device, ARP, ICMP and TCP are
+ *         handled, TCP data is held for application read,
+ *         one ACK is sent for data of the batch
+ * @param  *ethernet     : reference to the Ethernet handle
+ * @param  *network_data : network data
+ * @param  budget        : max frames read
+ * @retval int16_t       : Error = -1, Success = frames left in device
+ ***********************************************************/
+int16_t net_poll(ethernet_handle_t *ethernet, uint8_t *network_data, uint8_t budget);
+
+
+
+/***********************************************************
+ * @brief  Function to send queued frames while network
+ *         device is idle, control frames first
+ * @param  *ethernet : reference to the Ethernet handle
+ * @retval uint8_t   : frames left in transmit queue
+ ***********************************************************/
+uint8_t ether_tx_service(ethernet_handle_t *ethernet);
+
+
+
+/***********************************************************
+ * @brief  Function to set transmit class of TCP/UDP data
+ *         frames of a local or remote port
+ * @param  *ethernet : reference to the Ethernet handle
+ * @param  port      : TCP/UDP port
+ * @param  tx_class  : ETHER_TX_INTERACTIVE or ETHER_TX_BULK
+ * @retval int8_t    : Error = -1, Success = 0
+ ***********************************************************/
+int8_t ether_tx_port_class(ethernet_handle_t *ethernet, uint16_t port, ether_tx_class_t tx_class);
+
+
+
+/***********************************************************
+ * @brief  Function send Ethernet network data, frame to
+ *         host itself is looped back, (one frame held until
+ *         read, loopback send fails while it is held)
  * @param  *ethernet    : reference to the Ethernet handle
  * @param  *data        : network data
  * @param  *data_length : source MAC address
@@ -344,6 +564,52 @@ int8_t fill_ether_frame(ethernet_handle_t *ethernet, uint8_t *destination_mac_ad
 
 
 
+/***********************************************************
+ * @brief  Function to enable or disable broadcast frames
+ *         in device receive filter
+ * @param  *ethernet : reference to the Ethernet handle
+ * @param  enable    : 1 = accept broadcast, 0 = drop
+ * @retval int8_t    : Error = -1, Success = 0
+ ***********************************************************/
+int8_t ether_filter_broadcast(ethernet_handle_t *ethernet, uint8_t enable);
+
+
+
+/***********************************************************
+ * @brief  Function to join multicast group, group MAC is
+ *         added to device hash table filter
+ * @param  *ethernet  : reference to the Ethernet handle
+ * @param  *group_mac : multicast MAC address
+ * @retval int8_t     : Error = -1 (not multicast, full), Success = 0
+ ***********************************************************/
+int8_t ether_filter_add_multicast(ethernet_handle_t *ethernet, uint8_t *group_mac);
+
+
+
+/***********************************************************
+ * @brief  Function to leave multicast group
+ * @param  *ethernet  : reference to the Ethernet handle
+ * @param  *group_mac : multicast MAC address
+ * @retval int8_t     : Error = -1 (not joined), Success = 0
+ ***********************************************************/
+int8_t ether_filter_remove_multicast(ethernet_handle_t *ethernet, uint8_t *group_mac);
+
+
+
+/***********************************************************
+ * @brief  Function to set pattern match filter, frames
+ *         with pattern bytes selected by mask are accepted
+ * @param  *ethernet : reference to the Ethernet handle
+ * @param  offset    : window offset from Ethernet header
+ * @param  *pattern  : window bytes (ETHER_PATTERN_SIZE),
+ *                     NULL = disable pattern filter
+ * @param  *mask     : bytes checked, bit 0 = first byte
+ * @retval int8_t    : Error = -1, Success = 0
+ ***********************************************************/
+int8_t ether_filter_set_pattern(ethernet_handle_t *ethernet, uint16_t offset, uint8_t *pattern, uint8_t *mask);
+
+
+
 /***********************************************************
  * @brief  Function get ethernet protocol type
  * @param  *ethernet     : reference to the Ethernet handle
@@ -65,6 +65,9 @@
 #define IP_DF_SET         0x4000  /*!< Don't Fragment set value                 */
 #define IP_TTL_VALUE      64      /*!< Time to Live value                       */
 #define IP_HEADER_SIZE    20      /*!< IP header size                           */
+#define IP_ROUTE_TABLE_SIZE 8    /*!< Routing table size (static routes)       */
+#define IP_ROUTE_CACHE_SIZE 4    /*!< Destination cache size                   */
+#define IP_LOOPBACK_NET   127     /*!< Loopback network 127.0.0.0/8 (first byte) */
 
 /* IP version and header length fields */
 typedef struct _ip_ver_size
@@ -112,9 +115,75 @@ typedef enum _ip_protocol_type
 
 
 
+/****************************************************************
+ * @brief  Function to parse received frame into the packet
+ *         descriptor, lengths are validated against the frame
+ *         and the IP header checksum is verified, (called once
+ *         per frame by ether_get_data())
+ * @param  *ethernet     : reference to the Ethernet handle
+ * @param  frame_length  : bytes in buffer from Ethernet header
+ * @retval uint8_t       : Not valid IPv4 = 0, Success = 1
+ ****************************************************************/
+uint8_t ip_parse_packet(ethernet_handle_t *ethernet, uint16_t frame_length);
+
+
+
+
+/****************************************************************
+ * @brief  Function to get packet descriptor of frame in the
+ *         network buffer, frame is parsed if buffer was
+ *         written after the last read (sent frame)
+ * @param  *ethernet     : reference to the Ethernet handle
+ * @retval net_packet_t* : reference to the packet descriptor
+ ****************************************************************/
+net_packet_t* ether_get_packet(ethernet_handle_t *ethernet);
+
+
+
+
+/****************************************************************
+ * @brief  Function to validate TCP or UDP checksum of received
+ *         packet, (pseudo header + segment), computed once per
+ *         frame and cached in the packet descriptor
+ * @param  *ethernet  : reference to the Ethernet handle
+ * @retval uint8_t    : Error = 0, Success = 1
+ ****************************************************************/
+uint8_t ip_transport_checksum_valid(ethernet_handle_t *ethernet);
+
+
+
+/****************************************************************
+ * @brief  Function to validate TCP or UDP checksum of received
+ *         packet with sum of leading transport data already
+ *         summed by caller (ether_copy_sum), rest of data is
+ *         summed here, result cached in the packet descriptor
+ * @param  *ethernet  : reference to the Ethernet handle
+ * @param  data_sum   : Sum of leading transport data
+ * @param  sum_length : Length of leading transport data summed
+ * @retval uint8_t    : Error = 0, Success = 1
+ ****************************************************************/
+uint8_t ip_transport_checksum_valid_sum(ethernet_handle_t *ethernet, uint32_t data_sum, uint16_t sum_length);
+
+
+
+/****************************************************************
+ * @brief  Function to copy transport data (TCP, UDP) of received
+ *         packet and validate transport checksum in the same
+ *         pass over data, (data is copied even if invalid)
+ * @param  *ethernet     : reference to the Ethernet handle
+ * @param  *destination  : copy of transport data
+ * @param  length        : Bytes copied from start of data
+ * @retval uint8_t       : Error = 0, Success = 1
+ ****************************************************************/
+uint8_t ip_transport_copy_data(ethernet_handle_t *ethernet, void *destination, uint16_t length);
+
+
+
+
 /**************************************************************
  * @brief  Function to get IP data for current host device
- *         validates IP Checksum, (Only handles UNICAST)
+ *         uses checksum validated by packet parser,
+ *         (Only handles UNICAST)
  * @param  *ethernet  : reference to the Ethernet handle
  * @retval int16_t    : Error   = -4, -5,
  *                      Success = 1 (UNICAST),
@@ -150,4 +219,68 @@ int8_t fill_ip_frame(net_ip_t *ip, uint16_t *id, uint8_t *destination_ip, uint8_
 
 
 
+
+
+/******************************************************************
+ * @brief  Function to add route, replaces route to same network
+ *         on the interface, (interface address routes are added
+ *         implicitly: connected subnet and default gateway)
+ * @param  *ethernet    : reference to the outgoing interface
+ * @param  *destination : destination network
+ * @param  *netmask     : destination network mask
+ * @param  *gateway     : next hop, NULL or 0.0.0.0 = on link
+ * @retval int8_t       : Error = -1 (table full), Success = 0
+ ******************************************************************/
+int8_t ip_route_add(ethernet_handle_t *ethernet, uint8_t *destination, uint8_t *netmask, uint8_t *gateway);
+
+
+
+
+/******************************************************************
+ * @brief  Function to delete route
+ * @param  *ethernet    : reference to the outgoing interface
+ * @param  *destination : destination network
+ * @param  *netmask     : destination network mask
+ * @retval int8_t       : Error = -1 (not found), Success = 0
+ ******************************************************************/
+int8_t ip_route_delete(ethernet_handle_t *ethernet, uint8_t *destination, uint8_t *netmask);
+
+
+
+
+/******************************************************************
+ * @brief  Function to clear destination cache, called when routes
+ *         or interface addresses change
+ * @retval int8_t : Success = 0
+ ******************************************************************/
+int8_t ip_route_cache_flush(void);
+
+
+
+
+/******************************************************************
+ * @brief  Function to get outgoing interface and next hop for
+ *         destination, (longest prefix match, cached)
+ * @param  *destination_ip    : destination IP address
+ * @param  *next_hop          : gateway or destination IP address
+ * @retval ethernet_handle_t* : No route = NULL, Success = interface
+ ******************************************************************/
+ethernet_handle_t* ip_route_lookup(uint8_t *destination_ip, uint8_t *next_hop);
+
+
+
+
+/******************************************************************
+ * @brief  Function to get next hop for destination on interface,
+ *         off link destinations go through the gateway, without
+ *         a route (or broadcast) destination is on link
+ * @param  *ethernet       : reference to the Ethernet handle
+ * @param  *destination_ip : destination IP address
+ * @param  *next_hop       : gateway or destination IP address
+ * @retval uint8_t         : On link (no route) = 0, Success = 1
+ ******************************************************************/
+uint8_t ip_route_next_hop(ethernet_handle_t *ethernet, uint8_t *destination_ip, uint8_t *next_hop);
+
+
+
 #endif /* IPV4_H_ */
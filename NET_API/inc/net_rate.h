@@ -0,0 +1,136 @@
+/**
+ ******************************************************************************
+ * @file    net_rate.h
+ * @author  Aditya Mall,
+ * @brief   Network rate limiting (token bucket) header file
+ *
+ *  Info
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * <h2><center>&copy; COPYRIGHT(c) 2019 Aditya Mall, MIT License </center></h2>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Aditya Mall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************
+ */
+
+
+
+#ifndef NET_RATE_H_
+#define NET_RATE_H_
+
+
+/*
+ * Standard header and API header files
+ */
+#include <stdint.h>
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                      Data Structures and Defines                           */
+/*                                                                            */
+/******************************************************************************/
+
+
+#define NET_RATE_MAX_BURST  4000000  /*!< Max bucket size (bytes), tokens are kept in milli-bytes */
+
+
+/* Token bucket, (allocated by user, rate = 0 disables limit) */
+typedef struct _net_rate
+{
+    uint32_t rate;        /*!< Fill rate (bytes per second)                  */
+    uint32_t burst;       /*!< Bucket size (bytes)                           */
+    uint32_t tokens;      /*!< Available tokens (milli-bytes)                */
+    uint32_t last_time;   /*!< Time of last refill (ms)                      */
+    uint8_t  time_valid;  /*!< Refill time set, (bucket starts full)         */
+
+}net_rate_t;
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                     Rate Limit Function Prototypes                         */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+/*****************************************************************
+ * @brief  Function to initialize token bucket, bucket starts
+ *         full
+ * @param  *bucket : Reference to token bucket
+ * @param  rate    : Fill rate (bytes per second), 0 = no limit
+ * @param  burst   : Bucket size (bytes)
+ * @retval int8_t  : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_rate_init(net_rate_t *bucket, uint32_t rate, uint32_t burst);
+
+
+
+
+/*****************************************************************
+ * @brief  Function to change token bucket rate and size,
+ *         available tokens are kept
+ * @param  *bucket : Reference to token bucket
+ * @param  rate    : Fill rate (bytes per second), 0 = no limit
+ * @param  burst   : Bucket size (bytes)
+ * @retval int8_t  : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_rate_set(net_rate_t *bucket, uint32_t rate, uint32_t burst);
+
+
+
+
+/*****************************************************************
+ * @brief  Function to get time until bytes can be sent, packets
+ *         larger than bucket wait for a full bucket
+ * @param  *bucket  : Reference to token bucket
+ * @param  bytes    : Packet length (bytes)
+ * @param  time_ms  : Current monotonic time (ms)
+ * @retval uint32_t : Send now = 0, else wait time (ms)
+ *****************************************************************/
+uint32_t net_rate_delay(net_rate_t *bucket, uint32_t bytes, uint32_t time_ms);
+
+
+
+
+/*****************************************************************
+ * @brief  Function to take tokens for packet if available
+ * @param  *bucket : Reference to token bucket
+ * @param  bytes   : Packet length (bytes)
+ * @param  time_ms : Current monotonic time (ms)
+ * @retval uint8_t : Over limit = 0, Send = 1
+ *****************************************************************/
+uint8_t net_rate_consume(net_rate_t *bucket, uint32_t bytes, uint32_t time_ms);
+
+
+
+
+#endif /* NET_RATE_H_ */
@@ -0,0 +1,236 @@
+/**
+ ******************************************************************************
+ * @file    net_task.h
+ * @author  Aditya Mall,
+ * @brief   Cooperative tasks (protothreads) header file
+ *
+ *  Info
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * <h2><center>&copy; COPYRIGHT(c) 2019 Aditya Mall, MIT License </center></h2>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Aditya Mall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************
+ */
+
+
+
+#ifndef NET_TASK_H_
+#define NET_TASK_H_
+
+
+/*
+ * Standard header and API header files
+ */
+#include <stdint.h>
+
+#include "net_timer.h"
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                      Data Structures and Defines                           */
+/*                                                                            */
+/******************************************************************************/
+
+
+/*
+ * Protothreads, stackless coroutines (based on A. Dunkels protothreads)
+ *
+ * Thread function returns at every wait and resumes from the same line on
+ * next call, local variables are not kept across waits (use task context).
+ * switch statements can not be used in code that waits, PT_BEGIN() is a
+ * switch on the resume line.
+ */
+
+
+/* Thread state returned by thread functions */
+typedef enum _net_pt_state
+{
+    PT_WAITING = 0,  /*!< Thread waits for condition */
+    PT_YIELDED = 1,  /*!< Thread gave up processor   */
+    PT_EXITED  = 2,  /*!< Thread exited              */
+    PT_ENDED   = 3,  /*!< Thread reached PT_END      */
+
+}net_pt_state_t;
+
+
+/* Protothread, (resume line) */
+typedef struct _net_pt
+{
+    uint16_t lc;  /*!< Local continuation, line to resume from */
+
+}net_pt_t;
+
+
+/* Initialize thread, runs from PT_BEGIN on next call */
+#define PT_INIT(pt)   ((pt)->lc = 0)
+
+
+/* Start of thread body */
+#define PT_BEGIN(pt)  { uint8_t pt_yield_flag = 1; (void)pt_yield_flag; switch((pt)->lc) { case 0:
+
+
+/* End of thread body */
+#define PT_END(pt)    } pt_yield_flag = 0; PT_INIT(pt); return PT_ENDED; }
+
+
+/* Wait until condition is true, condition is checked on every call */
+#define PT_WAIT_UNTIL(pt, condition)          \
+    do                                        \
+    {                                         \
+        (pt)->lc = __LINE__; case __LINE__:   \
+        if(!(condition))                      \
+            return PT_WAITING;                \
+    }while(0)
+
+
+/* Wait while condition is true */
+#define PT_WAIT_WHILE(pt, condition)  PT_WAIT_UNTIL((pt), !(condition))
+
+
+/* Give up processor once, other tasks run before thread resumes */
+#define PT_YIELD(pt)                          \
+    do                                        \
+    {                                         \
+        pt_yield_flag = 0;                    \
+        (pt)->lc = __LINE__; case __LINE__:   \
+        if(pt_yield_flag == 0)                \
+            return PT_YIELDED;                \
+    }while(0)
+
+
+/* Exit thread, runs from PT_BEGIN on next call */
+#define PT_EXIT(pt)                           \
+    do                                        \
+    {                                         \
+        PT_INIT(pt);                          \
+        return PT_EXITED;                     \
+    }while(0)
+
+
+/* Restart thread from PT_BEGIN */
+#define PT_RESTART(pt)                        \
+    do                                        \
+    {                                         \
+        PT_INIT(pt);                          \
+        return PT_WAITING;                    \
+    }while(0)
+
+
+/* Wait for child thread to exit or end */
+#define PT_WAIT_THREAD(pt, thread)  PT_WAIT_WHILE((pt), (thread) < PT_EXITED)
+
+
+/* Start child thread and wait for it to exit or end */
+#define PT_SPAWN(pt, child_pt, thread)        \
+    do                                        \
+    {                                         \
+        PT_INIT(child_pt);                    \
+        PT_WAIT_THREAD((pt), (thread));       \
+    }while(0)
+
+
+
+/* Network task type defined */
+typedef struct _net_task net_task_t;
+
+
+/* Task thread function, (PT_BEGIN(&task->pt) ... PT_END(&task->pt)) */
+typedef int8_t (*net_task_function_t)(net_task_t *task, void *context);
+
+
+/* Network task, (allocated by user, linked into task list while running) */
+struct _net_task
+{
+    net_pt_t             pt;         /*!< Task protothread                        */
+    net_task_function_t  function;   /*!< Task thread function                    */
+    void                *context;    /*!< User context passed to thread function  */
+    net_timer_t          timer;      /*!< Sleep timer                             */
+    uint8_t              sleeping;   /*!< Task sleeps, not run until timer expiry */
+    net_task_t          *next;       /*!< Next task in task list                  */
+
+};
+
+
+/* Sleep task for timeout (ms), task is not run until timer expires */
+#define NET_TASK_SLEEP(task, timeout_ms)                      \
+    do                                                        \
+    {                                                         \
+        (task)->sleeping = 1;                                 \
+        net_timer_start(&(task)->timer, (timeout_ms));        \
+        PT_WAIT_UNTIL(&(task)->pt, (task)->sleeping == 0);    \
+    }while(0)
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                        Task Function Prototypes                            */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+/*****************************************************************
+ * @brief  Function to create task and add it to task list
+ * @param  *task     : Reference to network task
+ * @param  function  : Task thread function
+ * @param  *context  : User context passed to thread function
+ * @retval int8_t    : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_task_create(net_task_t *task, net_task_function_t function, void *context);
+
+
+
+
+/*****************************************************************
+ * @brief  Function to remove task from task list
+ * @param  *task   : Reference to network task
+ * @retval int8_t  : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_task_kill(net_task_t *task);
+
+
+
+
+/*****************************************************************
+ * @brief  Function to run network timers and tasks once, called
+ *         from application poll loop, waiting tasks are run on
+ *         every call and check their wait condition, sleeping
+ *         tasks run after their timer expires
+ * @param  time_ms  : Current monotonic time (ms)
+ * @retval uint8_t  : Number of tasks in task list
+ *****************************************************************/
+uint8_t net_task_run(uint32_t time_ms);
+
+
+
+
+#endif /* NET_TASK_H_ */
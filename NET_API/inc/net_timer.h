@@ -0,0 +1,151 @@
+/**
+ ******************************************************************************
+ * @file    net_timer.h
+ * @author  Aditya Mall,
+ * @brief   Network protocol timers header file
+ *
+ *  Info
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * <h2><center>&copy; COPYRIGHT(c) 2019 Aditya Mall, MIT License </center></h2>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Aditya Mall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************
+ */
+
+
+
+#ifndef NET_TIMER_H_
+#define NET_TIMER_H_
+
+
+/*
+ * Standard header and API header files
+ */
+#include <stdint.h>
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                      Data Structures and Defines                           */
+/*                                                                            */
+/******************************************************************************/
+
+
+#define NET_TIMER_TICK_MS     10  /*!< Timer wheel resolution (ms)         */
+#define NET_TIMER_LEVELS      4   /*!< Timer wheel levels                  */
+#define NET_TIMER_SLOT_BITS   6   /*!< Slots per level = 2^NET_TIMER_SLOT_BITS */
+#define NET_TIMER_SLOTS       (1 << NET_TIMER_SLOT_BITS)
+
+
+/* Network timer type defined */
+typedef struct _net_timer net_timer_t;
+
+
+/* Timer expiry function, called from net_timer_run() */
+typedef void (*net_timer_callback_t)(net_timer_t *timer, void *context);
+
+
+/* Network timer, (allocated by user, linked into timer wheel while pending) */
+struct _net_timer
+{
+    net_timer_t          *next;      /*!< Next timer in wheel slot                     */
+    net_timer_t         **pprev;     /*!< Link pointing to this timer, NULL = stopped  */
+    uint32_t              expires;   /*!< Expiry time (wheel ticks)                    */
+    net_timer_callback_t  callback;  /*!< Expiry function                              */
+    void                 *context;   /*!< User context passed to expiry function       */
+
+};
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                        Timer Function Prototypes                           */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+/*****************************************************************
+ * @brief  Function to initialize network timer
+ * @param  *timer    : Reference to network timer
+ * @param  callback  : Expiry function
+ * @param  *context  : User context passed to expiry function
+ * @retval int8_t    : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_timer_init(net_timer_t *timer, net_timer_callback_t callback, void *context);
+
+
+
+
+/*****************************************************************
+ * @brief  Function to start or restart network timer, timeout
+ *         is counted from last net_timer_run() call
+ * @param  *timer     : Reference to network timer
+ * @param  timeout_ms : Timeout (ms)
+ * @retval int8_t     : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_timer_start(net_timer_t *timer, uint32_t timeout_ms);
+
+
+
+
+/*****************************************************************
+ * @brief  Function to stop network timer
+ * @param  *timer  : Reference to network timer
+ * @retval int8_t  : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_timer_stop(net_timer_t *timer);
+
+
+
+
+/*****************************************************************
+ * @brief  Function to check if network timer is running
+ * @param  *timer  : Reference to network timer
+ * @retval uint8_t : Stopped = 0, Running = 1
+ *****************************************************************/
+uint8_t net_timer_pending(net_timer_t *timer);
+
+
+
+
+/*****************************************************************
+ * @brief  Function to advance timer wheel to current time and
+ *         call expiry functions of expired timers
+ * @param  time_ms  : Current monotonic time (ms)
+ * @retval uint16_t : Number of timers expired
+ *****************************************************************/
+uint16_t net_timer_run(uint32_t time_ms);
+
+
+
+
+#endif /* NET_TIMER_H_ */
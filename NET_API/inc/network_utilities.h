@@ -95,6 +95,26 @@ uint32_t htonl(uint32_t x);
 
 
 
+/************************************************************************
+ * @brief  Function to load 16 bit network order field, byte loads so
+ *         field may be at any address in the frame
+ * @param  *data    : reference to the field
+ * @retval uint16_t : field value (host order)
+ ************************************************************************/
+uint16_t net_load_u16(const void *data);
+
+
+
+/************************************************************************
+ * @brief  Function to load 32 bit network order field, byte loads so
+ *         field may be at any address in the frame
+ * @param  *data    : reference to the field
+ * @retval uint32_t : field value (host order)
+ ************************************************************************/
+uint32_t net_load_u32(const void *data);
+
+
+
 /********************************************************
  * @brief  Function to set mac address
  * @param  *device_mac  : device mac address (Hex)
@@ -48,7 +48,12 @@
  * Standard header and API header files
  */
 #include <stdint.h>
+#include <stddef.h>
 #include "ethernet.h"
+#include "ipv4.h"
+#include "tcp_cc.h"
+#include "net_timer.h"
+#include "net_rate.h"
 
 
 /******************************************************************************/
@@ -75,28 +80,99 @@ typedef enum _tcp_control_flags
 }tcp_ctl_flags_t;
 
 
-typedef enum _tcp_read_state
+/* TCP header, options follow in data */
+typedef struct _net_tcp
 {
-    TCP_READ_BLOCKING  = 1,
-    TCP_READ_NONBLOCK  = 2,
+    uint16_t source_port;      /*!< TCP source port                 */
+    uint16_t destination_port; /*!< TCP destination port            */
+    uint32_t sequence_number;  /*!< TCP packet sequence number      */
+    uint32_t ack_number;       /*!< TCP acknowledgment number       */
+    uint8_t  data_offset;      /*!< TCP data offset (header length) */
+    uint8_t  control_bits;     /*!< TCP control flags               */
+    uint16_t window;           /*!< TCP window size                 */
+    uint16_t checksum;         /*!< TCP checksum                    */
+    uint16_t urgent_pointer;   /*!< TCP urgent pointer              */
+    uint8_t  data;             /*!< TCP data, also contains options */
 
-}tcp_read_state_t;
+}net_tcp_t;
+
+
+#define TCP_TS_OPTS_SIZE    12             /*!< NOP, NOP and timestamps option                     */
+#define TCP_SEND_BUFF_SIZE  512            /*!< Send buffer size for coalesced writes              */
+#define TCP_RECV_BUFF_SIZE  APP_BUFF_SIZE  /*!< Out of order receive buffer, max advertised window */
+#define TCP_SACK_MAX_BLOCKS 4              /*!< Max SACK blocks kept for receive queue and sender  */
+
+/* Cached Ethernet, IP and TCP header size, with timestamps option */
+#define TCP_HEADER_CACHE    (ETHER_FRAME_SIZE + sizeof(net_ip_t) + offsetof(net_tcp_t, data) + TCP_TS_OPTS_SIZE)
+
+
+/* TCP client control modes */
+typedef enum _tcp_control_modes
+{
+    TCP_READ_BLOCKING  = 1,  /*!< Read waits for server data (default)                  */
+    TCP_READ_NONBLOCK  = 2,  /*!< Read returns if no data is available                  */
+    TCP_SEND_BLOCKING  = 3,  /*!< Send waits for server ACK (default)                   */
+    TCP_SEND_NONBLOCK  = 4,  /*!< Send returns once data is buffered or sent            */
+    TCP_NAGLE          = 5,  /*!< Hold small writes while data is unacknowledged (default) */
+    TCP_NODELAY        = 6,  /*!< Send small writes immediately                         */
+    TCP_DELAYED_ACK    = 7,  /*!< ACK every second segment or after ACK delay timeout   */
+    TCP_QUICK_ACK      = 8,  /*!< ACK every segment immediately (default)               */
+    TCP_CC_NEWRENO     = 9,  /*!< NewReno congestion control (default)                  */
+    TCP_CC_CUBIC       = 10, /*!< CUBIC congestion control                              */
+    TCP_PACING         = 11, /*!< Spread congestion window over smoothed RTT            */
+    TCP_NO_PACING      = 12, /*!< Send congestion window as a burst (default)           */
+
+}tcp_control_t;
+
+
+/* Read modes, kept for existing applications */
+typedef tcp_control_t tcp_read_state_t;
 
 
 /* TCP client handle flags */
 typedef struct _tcp_client_flags
 {
-    uint8_t connect_request     : 1;
-    uint8_t connect_established : 1;
-    uint8_t server_tcp_reset    : 1;
-    uint8_t server_close        : 1;
-    uint8_t client_close        : 1;
-    uint8_t client_blocking     : 1;
-    uint8_t reserved            : 2;
+    uint16_t connect_request     : 1;
+    uint16_t connect_established : 1;
+    uint16_t server_tcp_reset    : 1;
+    uint16_t server_close        : 1;
+    uint16_t client_close        : 1;
+    uint16_t client_blocking     : 1;
+    uint16_t send_nonblock       : 1;
+    uint16_t nagle               : 1;
+    uint16_t delayed_ack         : 1;
+    uint16_t sack_permitted      : 1;
+    uint16_t window_scaling      : 1;
+    uint16_t timestamps          : 1;
+    uint16_t fast_recovery       : 1;
+    uint16_t pacing              : 1;
+    uint16_t connect_aborted     : 1;
+    uint16_t reserved            : 1;
 
 }tcp_client_flags_t;
 
 
+/* TCP SACK block, sequence number range [start, end) */
+typedef struct _tcp_sack_block
+{
+    uint32_t start;  /*!< First sequence number of block     */
+    uint32_t end;    /*!< Sequence number following block    */
+
+}tcp_sack_block_t;
+
+
+/* Cached headers of connection, addresses and ports are fixed for connection */
+typedef struct _tcp_header_cache
+{
+    uint8_t  header[TCP_HEADER_CACHE];  /*!< Ethernet, IP and TCP header, timestamps option    */
+    uint32_t ip_sum;                    /*!< IP header sum, without length and identifier      */
+    uint32_t tcp_sum;                   /*!< TCP pseudo header sum, without length, and ports  */
+    uint8_t  options_length;            /*!< Cached options length, (0 or timestamps)          */
+    uint8_t  valid;                     /*!< Headers built with resolved next hop MAC          */
+
+}tcp_header_cache_t;
+
+
 /* TCP client handle */
 typedef struct _tcp_handle
 {
@@ -108,6 +184,50 @@ typedef struct _tcp_handle
 
     tcp_client_flags_t client_flags;
 
+    uint16_t server_mss;           /*!< Server maximum segment size, from SYN ACK options */
+    uint8_t  server_window_scale;  /*!< Server window scale shift, from SYN ACK options   */
+    uint32_t server_window;        /*!< Server receive window (scaled)                     */
+
+    uint32_t send_unacked;                     /*!< Oldest unacknowledged sequence number          */
+    uint32_t send_max;                         /*!< Highest sequence number sent                   */
+    char    *send_data;                        /*!< Data being sent, send buffer or large write    */
+    uint32_t send_data_seq;                    /*!< Sequence number of first byte of send data     */
+    uint32_t send_data_length;                 /*!< Send data length (unacknowledged + unsent)     */
+    char     send_buffer[TCP_SEND_BUFF_SIZE];  /*!< Send buffer for coalesced writes               */
+
+    uint8_t  ack_pending;                      /*!< Received segments not yet acknowledged         */
+    uint8_t  timer_events;                     /*!< Expired timers not yet serviced                */
+    net_timer_t ack_timer;                     /*!< Delayed ACK timer                              */
+    net_timer_t retransmit_timer;              /*!< Retransmission timer                           */
+    net_timer_t pace_timer;                    /*!< Rate limit and pacing timer, resumes output    */
+    uint32_t retransmit_timeout;               /*!< Retransmission timeout, with backoff (ms)      */
+    uint8_t  retransmit_count;                 /*!< Consecutive retransmission timeouts            */
+    uint16_t recv_window;                      /*!< Last advertised receive window (bytes)         */
+
+    uint32_t smoothed_rtt;                     /*!< Smoothed RTT (ms, scaled by 8)                 */
+    uint32_t rtt_variance;                     /*!< RTT variance (ms, scaled by 4)                 */
+    uint32_t rto;                              /*!< Retransmission timeout from RTT (ms)           */
+    uint8_t  rtt_timing;                       /*!< RTT measurement in progress, (no timestamps)   */
+    uint32_t rtt_seq;                          /*!< Sequence number being timed                    */
+    uint32_t rtt_time;                         /*!< Time timed sequence number was sent (ms)       */
+
+    uint32_t ts_recent;                        /*!< Latest server timestamp value (TS.Recent)      */
+    uint32_t last_ack_sent;                    /*!< ACK number of last segment sent                */
+
+    tcp_cc_t congestion;                       /*!< Congestion control state                       */
+    uint8_t  dup_acks;                         /*!< Duplicate ACK count                            */
+    uint32_t recover;                          /*!< Highest sequence sent when recovery started    */
+
+    net_rate_t rate_limit;                     /*!< User rate limit, (rate = 0 no limit)           */
+    net_rate_t pace_rate;                      /*!< Pacing rate, congestion window per RTT         */
+
+    tcp_header_cache_t header_cache;           /*!< Headers and checksum seeds of connection       */
+
+    char             recv_buffer[TCP_RECV_BUFF_SIZE];       /*!< Out of order data, offset from next expected sequence */
+    tcp_sack_block_t recv_blocks[TCP_SACK_MAX_BLOCKS];      /*!< Out of order ranges, most recent first (SACK blocks)  */
+    uint8_t          recv_block_count;                      /*!< Number of out of order ranges                         */
+    tcp_sack_block_t sack_scoreboard[TCP_SACK_MAX_BLOCKS];  /*!< Ranges SACKed by server, in sequence order            */
+    uint8_t          sack_count;                            /*!< Number of SACKed ranges                               */
 
 }tcp_handle_t;
 
@@ -154,11 +274,15 @@ uint8_t tcp_init_client(tcp_handle_t *client,
 
 
 /**********************************************************
- * @brief  Function to establish connection to TCP server
+ * @brief  Function to establish connection to TCP server,
+ *         non blocking client (TCP_READ_NONBLOCK) sends SYN
+ *         once and is called again until connected, SYN is
+ *         resent on retransmission timeout
  * @param  *ethernet     : Reference to Ethernet handle
  * @param  *network_data : Network data
  * @param  *client       : reference to TCP client handle
- * @retval int8_t        : Error = -11, Success = 1
+ * @retval int8_t        : Error = -11, Success = 1,
+ *                         0 = connect pending (non blocking)
  **********************************************************/
 int8_t ether_tcp_connect(ethernet_handle_t *ethernet, uint8_t *network_data ,tcp_handle_t *client);
 
@@ -166,19 +290,48 @@ int8_t ether_tcp_connect(ethernet_handle_t *ethernet, uint8_t *network_data ,tcp
 
 
 /*****************************************************************
- * @brief  Function to control TCP read behavior
+ * @brief  Function to control TCP read, send and ACK behavior
+ * @param  *client      : Reference to TCP handle
+ * @param  control_mode : TCP control mode (tcp_control_t)
+ * @retval int8_t       : Error = 0, Success = 1
+ ****************************************************************/
+int8_t tcp_control(tcp_handle_t *client, tcp_control_t control_mode);
+
+
+
+
+
+/*****************************************************************
+ * @brief  Function to set TCP congestion control algorithm,
+ *         (TCP_CC_NEWRENO, TCP_CC_CUBIC or user defined)
  * @param  *client     : Reference to TCP handle
- * @param  app_state   : TCP read type (blocking or non blocking)
+ * @param  *cc_ops     : Congestion control algorithm operations
  * @retval int8_t      : Error = 0, Success = 1
  ****************************************************************/
-int8_t tcp_control(tcp_handle_t *client, tcp_read_state_t app_state);
+int8_t tcp_set_congestion_control(tcp_handle_t *client, const tcp_cc_ops_t *cc_ops);
+
+
+
+
 
+/*****************************************************************
+ * @brief  Function to set TCP send rate limit (token bucket),
+ *         segments over limit are held and sent from timer
+ * @param  *client : Reference to TCP handle
+ * @param  rate    : Send rate (bytes per second), 0 = no limit
+ * @param  burst   : Max burst (bytes)
+ * @retval int8_t  : Error = 0, Success = 1
+ ****************************************************************/
+int8_t tcp_set_rate_limit(tcp_handle_t *client, uint32_t rate, uint32_t burst);
 
 
 
 
 /***************************************************************
- * @brief  Function for sending TCP data
+ * @brief  Function for sending TCP data, data larger than the
+ *         send buffer is split into MSS sized segments.
+ *         In TCP_SEND_NONBLOCK mode small writes are buffered
+ *         and coalesced (Nagle) unless TCP_NODELAY is set
  * @param  *ethernet         : Reference to the Ethernet Handle
  * @param  *network_data     : Network data
  * @param  *client           : Reference to TCP client handle
@@ -186,13 +339,38 @@ int8_t tcp_control(tcp_handle_t *client, tcp_read_state_t app_state);
  * @param  data_length       : application data length
  * @retval int8_t            : Error   = -12,
  *                             Success =  1
- *                                       -14(Connection closed)
+ *                                        0 (Connection closed)
  ***************************************************************/
 int32_t ether_tcp_send_data(ethernet_handle_t *ethernet,
                             uint8_t           *network_data,
                             tcp_handle_t      *client,
                             char              *application_data,
-                            uint16_t           data_length);
+                            uint32_t           data_length);
+
+
+
+
+/***************************************************************
+ * @brief  Function for sending TCP data gathered from data
+ *         fragments, (protocol headers and payload kept in
+ *         separate buffers), fragments are gathered in the
+ *         send buffer and sent as one write, total larger than
+ *         send buffer (TCP_SEND_BUFF_SIZE) is rejected, (large
+ *         writes use ether_tcp_send_data)
+ * @param  *ethernet       : Reference to the Ethernet Handle
+ * @param  *network_data   : Network data
+ * @param  *client         : Reference to TCP client handle
+ * @param  *fragments      : Application data fragments, in order
+ * @param  fragment_count  : Number of fragments
+ * @retval int32_t         : Error   = -12, (also total too large)
+ *                           Success =  1
+ *                                      0 (Connection closed)
+ ***************************************************************/
+int32_t ether_tcp_send_datav(ethernet_handle_t *ethernet,
+                             uint8_t           *network_data,
+                             tcp_handle_t      *client,
+                             net_iovec_t       *fragments,
+                             uint8_t            fragment_count);
 
 
 
@@ -218,11 +396,17 @@ int32_t ether_tcp_read_data(ethernet_handle_t *ethernet,
 
 
 /***************************************************************
- * @brief  Function for close socket
+ * @brief  Function for close socket, buffered data is sent
+ *         and acknowledged before FIN, connection is
+ *         aborted (RST) if data or FIN is not acknowledged
+ *         after max retransmissions, non blocking client
+ *         (TCP_READ_NONBLOCK) reads once and is called again
+ *         until FIN is acknowledged or connect_aborted is set
  * @param  *ethernet         : Reference to the Ethernet Handle
  * @param  *network_data     : Network data
  * @param  *client           : Reference to TCP handle
- * @retval uint16_t          : Error = 0, Success = 1;
+ * @retval uint16_t          : Error = 0 (aborted), Success = 1,
+ *                             0 = close pending (non blocking)
  ***************************************************************/
 uint8_t ether_tcp_close(ethernet_handle_t *ethernet, uint8_t *network_data, tcp_handle_t *client);
 
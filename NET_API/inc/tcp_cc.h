@@ -0,0 +1,100 @@
+/**
+ ******************************************************************************
+ * @file    tcp_cc.h
+ * @author  Aditya Mall,
+ * @brief   TCP congestion control header file
+ *
+ *  Info
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * <h2><center>&copy; COPYRIGHT(c) 2019 Aditya Mall, MIT License </center></h2>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Aditya Mall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************
+ */
+
+
+
+#ifndef TCP_CC_H_
+#define TCP_CC_H_
+
+
+/*
+ * Standard header and API header files
+ */
+#include <stdint.h>
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                      Data Structures and Defines                           */
+/*                                                                            */
+/******************************************************************************/
+
+
+struct _tcp_cc_operations;
+
+
+/* TCP congestion control state (per connection) */
+typedef struct _tcp_congestion_control
+{
+    const struct _tcp_cc_operations *ops;  /*!< Congestion control algorithm                    */
+    uint32_t cwnd;                         /*!< Congestion window (bytes)                       */
+    uint32_t ssthresh;                     /*!< Slow start threshold (bytes)                    */
+    uint32_t bytes_acked;                  /*!< Bytes acknowledged in congestion avoidance      */
+    uint16_t mss;                          /*!< Sender maximum segment size (bytes)             */
+    uint8_t  epoch_started;                /*!< CUBIC congestion avoidance epoch started        */
+    uint32_t epoch_start;                  /*!< CUBIC congestion avoidance epoch start (ms)     */
+    uint32_t w_max;                        /*!< CUBIC window before last reduction (bytes)      */
+    uint32_t w_est;                        /*!< CUBIC Reno friendly window estimate (bytes)     */
+    uint32_t k;                            /*!< CUBIC time to reach w_max from epoch start (ms) */
+
+}tcp_cc_t;
+
+
+/* TCP congestion control operations, called by TCP with the connection state */
+typedef struct _tcp_cc_operations
+{
+    uint8_t (*init)(tcp_cc_t *cc, uint16_t mss);                               /*!< Initialize state at connection establishment */
+    uint8_t (*ack)(tcp_cc_t *cc, uint32_t bytes_acked, uint32_t time_ms);      /*!< New data acknowledged                        */
+    uint8_t (*loss)(tcp_cc_t *cc, uint32_t flight_size, uint32_t time_ms);     /*!< Loss detected by duplicate ACKs              */
+    uint8_t (*timeout)(tcp_cc_t *cc, uint32_t flight_size, uint32_t time_ms);  /*!< Retransmission timeout                       */
+
+}tcp_cc_ops_t;
+
+
+
+/* Congestion control algorithms */
+extern const tcp_cc_ops_t tcp_cc_newreno;  /*!< NewReno, RFC 5681 (default) */
+extern const tcp_cc_ops_t tcp_cc_cubic;    /*!< CUBIC, RFC 9438             */
+
+
+
+
+#endif /* TCP_CC_H_ */
@@ -79,7 +79,8 @@ uint8_t ether_get_udp_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t
 /*******************************************************************
  * @brief  Raw Function to send UPD packets
  *         UDP data dependent upon total data allocated to
- *         ethernet object
+ *         ethernet object, send to host fails while looped
+ *         back frame is unread
  * @param  *ethernet        : Reference to the Ethernet handle
  * @param  *source_addr     : Reference to source address structure
  * @param  *destination_ip  : Destination IP address
@@ -87,7 +88,7 @@ uint8_t ether_get_udp_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t
  * @param  destination_port : UDP destination port
  * @param  *data            : UDP data
  * @param  data_length      : Length of UDP data
- * @retval int8_t           : Error = -9, Success = 0
+ * @retval int8_t           : Error = -9, -15 (over rate limit), Success = 0
  *******************************************************************/
 int8_t ether_send_udp_raw(ethernet_handle_t *ethernet, ether_source_t *source_addr, uint8_t *destination_ip,
                       uint8_t *destination_mac, uint16_t destination_port, uint8_t *data, uint16_t data_length);
@@ -131,7 +132,7 @@ uint8_t ether_read_udp(ethernet_handle_t *ethernet, uint8_t *network_data, char
  * @param  destination_port  : UDP destination port
  * @param  *application_data : UDP data
  * @param  data_length       : Length of UDP data
- * @retval int8_t            : Error = -10, Success = 0
+ * @retval int8_t            : Error = -10, -15 (over rate limit), Success = 0
  **************************************************************/
 int8_t ether_send_udp(ethernet_handle_t *ethernet, uint8_t *destination_ip, uint16_t destination_port,
                       char *application_data, uint16_t data_length);
@@ -139,6 +140,26 @@ int8_t ether_send_udp(ethernet_handle_t *ethernet, uint8_t *destination_ip, uint
 
 
 
+/**************************************************************
+ * @brief  Function to send UPD packet gathered from data
+ *         fragments, fragments are copied to network data
+ *         buffer with UDP checksum summed in the same pass,
+ *         total larger than one frame (interface MTU or
+ *         network data buffer) is rejected, send to host
+ *         fails while looped back frame is unread
+ * @param  *ethernet        : Reference to the Ethernet handle
+ * @param  *destination_ip  : Destination IP address
+ * @param  destination_port : UDP destination port
+ * @param  *fragments       : UDP data fragments, in order
+ * @param  fragment_count   : Number of fragments
+ * @retval int8_t           : Error = -10, -15 (over rate limit), Success = 0
+ **************************************************************/
+int8_t ether_send_udpv(ethernet_handle_t *ethernet, uint8_t *destination_ip, uint16_t destination_port,
+                       net_iovec_t *fragments, uint8_t fragment_count);
+
+
+
+
 
 /**************************************************************
  * @brief  Function to read UDP packet
@@ -158,4 +179,19 @@ uint16_t ether_read_udp_raw(ethernet_handle_t *ethernet, uint8_t *network_data,
 
 
 
+/**************************************************************
+ * @brief  Function to set UDP send rate limit (token bucket)
+ *         for destination port, packets over limit are not
+ *         sent (-15 from send functions)
+ * @param  destination_port : UDP destination port
+ * @param  rate             : Send rate (bytes per second),
+ *                            0 = remove limit
+ * @param  burst            : Max burst (bytes)
+ * @retval int8_t           : Error = 0, Success = 1
+ **************************************************************/
+int8_t udp_set_rate_limit(uint16_t destination_port, uint32_t rate, uint32_t burst);
+
+
+
+
 #endif /* UDP_H_ */
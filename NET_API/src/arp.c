@@ -48,6 +48,7 @@
 
 
 #include "arp.h"
+#include "ipv4.h"
 #include "network_utilities.h"
 
 
@@ -60,6 +61,16 @@
 
 
 
+/* Address probe and announcement timing, (RFC 5227 1.1) */
+#define ARP_PROBE_WAIT          1000  /*!< Random wait before first probe, max (ms)   */
+#define ARP_PROBE_NUM           3     /*!< Number of probes                            */
+#define ARP_PROBE_MIN           1000  /*!< Min random interval between probes (ms)     */
+#define ARP_PROBE_MAX           2000  /*!< Max random interval between probes (ms)     */
+#define ARP_ANNOUNCE_WAIT       2000  /*!< Wait after last probe (ms)                  */
+#define ARP_ANNOUNCE_NUM        2     /*!< Number of announcements                     */
+#define ARP_ANNOUNCE_INTERVAL   2000  /*!< Interval between announcements (ms)         */
+
+
 /* ARP protocol structure */
 typedef struct _net_arp
 {
@@ -140,7 +151,8 @@ static int8_t set_broadcast_mac_addr(uint8_t *mac_address)
 
 
 /******************************************************************************
- * @brief  Static Function to update ARP table
+ * @brief  Static Function to update ARP table, MAC address of
+ *         existing entry is refreshed, oldest entry replaced if full
  * @param  *ethernet    : reference to the Ethernet handle
  * @param  *ip_address  : device ip address
  * @param  *mac_address : device mac_address
@@ -156,6 +168,8 @@ static uint8_t update_arp_table(ethernet_handle_t *ethernet, uint8_t *ip_address
 
     uint8_t found = 0;
 
+    uint8_t empty_ip[ETHER_IPV4_SIZE] = {0};
+
     if(ethernet->ether_obj == NULL)
     {
         func_retval = 0;
@@ -169,9 +183,12 @@ static uint8_t update_arp_table(ethernet_handle_t *ethernet, uint8_t *ip_address
             {
                 found = 1;
 
+                /* Host may have changed interface */
+                memcpy(ethernet->arp_table[index].mac_address, mac_address, ETHER_MAC_SIZE);
+
                 break;
             }
-            else if( (strncmp((char*)ethernet->arp_table[index].ip_address, 0, ETHER_IPV4_SIZE) == 0) )
+            else if( (memcmp(ethernet->arp_table[index].ip_address, empty_ip, ETHER_IPV4_SIZE) == 0) )
             {
                 found = 0;
 
@@ -191,6 +208,15 @@ static uint8_t update_arp_table(ethernet_handle_t *ethernet, uint8_t *ip_address
             }
         }
 
+        /* Table full, replace entries in turn */
+        if(index == ARP_TABLE_SIZE)
+        {
+            memcpy(ethernet->arp_table[ethernet->arp_next].ip_address, ip_address, ETHER_IPV4_SIZE);
+            memcpy(ethernet->arp_table[ethernet->arp_next].mac_address, mac_address, ETHER_MAC_SIZE);
+
+            ethernet->arp_next = (ethernet->arp_next + 1) % ARP_TABLE_SIZE;
+        }
+
         func_retval = found;
     }
 
@@ -241,6 +267,117 @@ static int8_t search_arp_table(ethernet_handle_t *ethernet, uint8_t *mac_address
 
 
 
+/******************************************************************************
+ * @brief  Static Function to send ARP probe or announcement,
+ *         (ARP request, target hardware address zero, RFC 5227 2.1)
+ * @param  *ethernet  : reference to the Ethernet handle
+ * @param  *sender_ip : sender ip address, 0 for probe
+ * @param  *target_ip : address probed or announced
+ * @retval uint8_t    : Error = 0, Success = 1
+ ******************************************************************************/
+static uint8_t ether_send_arp_probe(ethernet_handle_t *ethernet, uint8_t *sender_ip, uint8_t *target_ip)
+{
+    uint8_t func_retval = 0;
+
+    net_arp_t *arp;
+
+    if(ethernet->ether_obj == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        arp = (void*)&ethernet->ether_obj->data;
+
+        fill_ether_frame(ethernet, ethernet->broadcast_mac, ethernet->host_mac, ETHER_ARP);
+
+        arp->hardware_type = htons(ARP_HRD_ETHERNET);
+        arp->protocol_type = htons(ARP_PRO_IPV4);
+        arp->hardware_size = ARP_HLN;
+        arp->protocol_size = ARP_PLN;
+        arp->opcode        = htons(ARP_REQUEST);
+
+        memcpy(arp->sender_hw_addr, ethernet->host_mac, ETHER_MAC_SIZE);
+        memcpy(arp->sender_ip, sender_ip, ETHER_IPV4_SIZE);
+        memset(arp->target_hw_addr, 0, ETHER_MAC_SIZE);
+        memcpy(arp->target_ip, target_ip, ETHER_IPV4_SIZE);
+
+        func_retval = ether_send_data(ethernet, (uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + ARP_FRAME_SIZE);
+    }
+
+    return func_retval;
+}
+
+
+
+
+/******************************************************************************
+ * @brief  Static Function to check received ARP packet against
+ *         probed address, (RFC 5227 2.1.1, 2.4)
+ * @param  *probe : reference to probe handle
+ * @param  *arp   : received ARP packet
+ * @retval None
+ ******************************************************************************/
+static void arp_probe_check(arp_probe_t *probe, net_arp_t *arp)
+{
+    uint8_t empty_ip[ETHER_IPV4_SIZE] = {0};
+
+    /* Own packets looped back by switch are ignored */
+    if(memcmp(arp->sender_hw_addr, probe->ethernet->host_mac, ETHER_MAC_SIZE) != 0)
+    {
+        /* Address in use, or probed by another host at same time */
+        if(memcmp(arp->sender_ip, probe->ip_address, ETHER_IPV4_SIZE) == 0 || \
+           (probe->state == ARP_PROBE_PROBING && memcmp(arp->sender_ip, empty_ip, ETHER_IPV4_SIZE) == 0 && \
+            memcmp(arp->target_ip, probe->ip_address, ETHER_IPV4_SIZE) == 0))
+        {
+            memcpy(probe->conflict_mac, arp->sender_hw_addr, ETHER_MAC_SIZE);
+
+            net_timer_stop(&probe->timer);
+
+            probe->state = ARP_PROBE_CONFLICT;
+
+            probe->ethernet->arp_probe = NULL;
+        }
+    }
+}
+
+
+
+
+/******************************************************************************
+ * @brief  Static expiry function of ARP probe timer
+ * @param  *timer   : Reference to network timer
+ * @param  *context : Reference to probe handle
+ * @retval None
+ ******************************************************************************/
+static void arp_probe_timeout(net_timer_t *timer, void *context)
+{
+    arp_probe_t *probe = context;
+
+    (void)timer;
+
+    probe->timer_events = 1;
+}
+
+
+
+
+/******************************************************************************
+ * @brief  Static Function to get random interval
+ * @param  *ethernet : reference to the Ethernet handle
+ * @param  min_ms    : interval min (ms)
+ * @param  max_ms    : interval max (ms)
+ * @retval uint32_t  : interval (ms)
+ ******************************************************************************/
+static uint32_t arp_random_interval(ethernet_handle_t *ethernet, uint32_t min_ms, uint32_t max_ms)
+{
+    return min_ms + (uint32_t)get_random_port_l(ethernet, 0) % (max_ms - min_ms + 1);
+}
+
+
+
+
+
 /******************************************************************************/
 /*                                                                            */
 /*                           ARP Functions                                    */
@@ -303,7 +440,8 @@ int16_t ether_send_arp_req(ethernet_handle_t *ethernet, uint8_t *sender_ip, uint
         }
 
         /* Send packet (uses callback) */
-        ether_send_data(ethernet, (uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + ARP_FRAME_SIZE);
+        if(ether_send_data(ethernet, (uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + ARP_FRAME_SIZE) == 0)
+            func_retval = NET_ARP_REQ_ERROR;
     }
 
     return func_retval;
@@ -428,7 +566,8 @@ int16_t ether_handle_arp_resp_req(ethernet_handle_t *ethernet)
                 }
 
                 /* Send packet (uses callback) */
-                ether_send_data(ethernet, (uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + 28);
+                if(ether_send_data(ethernet, (uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + 28) == 0)
+                    func_retval = NET_ARP_RESP_ERROR;
             }
 
             /* Handle APR reply */
@@ -475,4 +614,342 @@ uint8_t ether_arp_resolve_address(ethernet_handle_t *ethernet, uint8_t *destinat
 
 
 
+/***********************************************************************
+ * @brief  Function to get MAC address for sending to destination IP
+ *         address, off link destinations resolve to gateway MAC
+ *         (next hop from routing table, searches local ARP table)
+ * @param  *ethernet        : reference to the Ethernet handle
+ * @param  *destination_mac : next hop mac_address
+ * @param  *destination_ip  : destination ip address
+ * @retval  uint8_t         : Success = 1 device found else 0 for not found
+ ***********************************************************************/
+uint8_t ether_arp_resolve_next_hop(ethernet_handle_t *ethernet, uint8_t *destination_mac, uint8_t *destination_ip)
+{
+
+    uint8_t func_retval = 0;
+
+    uint8_t next_hop[ETHER_IPV4_SIZE] = {0};
+
+    ip_route_next_hop(ethernet, destination_ip, next_hop);
+
+    func_retval = search_arp_table(ethernet, destination_mac, next_hop);
+
+
+    return func_retval;
+}
+
+
+
+
+/***********************************************************************
+ * @brief  Function to add address to ARP table, (cached entries
+ *         restored at boot)
+ * @param  *ethernet    : reference to the Ethernet handle
+ * @param  *ip_address  : device ip address
+ * @param  *mac_address : device mac_address
+ * @retval  uint8_t     : Success = 0 (device added), 1 (device already exists)
+ ***********************************************************************/
+uint8_t ether_arp_add_entry(ethernet_handle_t *ethernet, uint8_t *ip_address, uint8_t *mac_address)
+{
+
+    uint8_t func_retval = 0;
+
+    func_retval = update_arp_table(ethernet, ip_address, mac_address);
+
+
+    return func_retval;
+}
+
+
+
+
+/***********************************************************************
+ * @brief  Function to learn addresses from received frame, (ARP
+ *         packets and IPv4 packets to host from local subnet),
+ *         called on every frame read by ether_get_data()
+ * @param  *ethernet : reference to the Ethernet handle
+ * @retval uint8_t   : Error = 0, Success = 1 (address learned)
+ ***********************************************************************/
+uint8_t ether_arp_snoop(ethernet_handle_t *ethernet)
+{
+    uint8_t func_retval = 0;
+
+    net_arp_t    *arp;
+    net_packet_t *packet;
+
+    uint8_t mac_address[ETHER_MAC_SIZE] = {0};
+    uint8_t empty_ip[ETHER_IPV4_SIZE]   = {0};
+    uint8_t index = 0;
+    uint8_t local = 1;
+
+    if(ethernet->ether_obj == NULL)
+    {
+        func_retval = 0;
+    }
+    else if(ethernet->ether_obj->type == htons(ETHER_ARP))
+    {
+        arp = (void*)&ethernet->ether_obj->data;
+
+        if(ethernet->arp_probe != NULL)
+            arp_probe_check(ethernet->arp_probe, arp);
+
+        /* Merge sender into table if known or if request is for host (RFC 826), probes have no sender */
+        if(memcmp(arp->sender_ip, empty_ip, ETHER_IPV4_SIZE) != 0 && \
+           memcmp(arp->sender_hw_addr, ethernet->host_mac, ETHER_MAC_SIZE) != 0 && \
+           (search_arp_table(ethernet, mac_address, arp->sender_ip) || \
+            memcmp(arp->target_ip, ethernet->host_ip, ETHER_IPV4_SIZE) == 0))
+        {
+            update_arp_table(ethernet, arp->sender_ip, arp->sender_hw_addr);
+
+            func_retval = 1;
+        }
+    }
+    else if(ether_get_packet(ethernet)->ip_valid && memcmp(ethernet->host_ip, empty_ip, ETHER_IPV4_SIZE) != 0)
+    {
+        packet = ether_get_packet(ethernet);
+
+        /* Sender on local subnet, (remote senders come through gateway) */
+        for(index = 0; index < ETHER_IPV4_SIZE; index++)
+        {
+            if( (packet->source_ip[index] & ethernet->subnet_mask[index]) != (ethernet->host_ip[index] & ethernet->subnet_mask[index]) )
+                local = 0;
+        }
+
+        if(memcmp(packet->destination_ip, ethernet->host_ip, ETHER_IPV4_SIZE) == 0 && local && \
+           memcmp(packet->source_ip, empty_ip, ETHER_IPV4_SIZE) != 0 && (ethernet->ether_obj->source_mac_addr[0] & 0x01) == 0)
+        {
+            /* Skip table write if unchanged */
+            if(search_arp_table(ethernet, mac_address, packet->source_ip) == 0 || \
+               memcmp(mac_address, ethernet->ether_obj->source_mac_addr, ETHER_MAC_SIZE) != 0)
+            {
+                update_arp_table(ethernet, packet->source_ip, ethernet->ether_obj->source_mac_addr);
+            }
+
+            func_retval = 1;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+
+/***********************************************************************
+ * @brief  Function to start address probe and announcement,
+ *         (RFC 5227), probes and announcements are sent from
+ *         ether_arp_probe_poll()
+ * @param  *ethernet    : reference to the Ethernet handle
+ * @param  *probe       : reference to probe handle
+ * @param  *ip_address  : address to probe and announce
+ * @param  probe_first  : 1 = probe then announce, 0 = announce only
+ * @retval int8_t       : Error = 0, Success = 1
+ ***********************************************************************/
+int8_t ether_arp_probe_start(ethernet_handle_t *ethernet, arp_probe_t *probe, uint8_t *ip_address, uint8_t probe_first)
+{
+    int8_t func_retval = 0;
+
+    uint32_t time_now = 0;
+
+    if(ethernet == NULL || probe == NULL || ip_address == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        /* Restart, (timer may be linked) */
+        if(ethernet->arp_probe == probe)
+            ether_arp_probe_stop(probe);
+
+        memset(probe, 0, sizeof(arp_probe_t));
+
+        probe->ethernet = ethernet;
+
+        memcpy(probe->ip_address, ip_address, ETHER_IPV4_SIZE);
+
+        net_timer_init(&probe->timer, arp_probe_timeout, probe);
+
+        time_now = ethernet->ether_commands->get_time_ms();
+
+        net_timer_run(time_now);
+
+        ethernet->arp_probe = probe;
+
+        if(probe_first)
+        {
+            /* Random wait, hosts powered on together do not probe together */
+            probe->state = ARP_PROBE_PROBING;
+
+            net_timer_start(&probe->timer, arp_random_interval(ethernet, 0, ARP_PROBE_WAIT));
+        }
+        else
+        {
+            /* Address already checked, (DHCP server), announce now */
+            probe->state = ARP_PROBE_ANNOUNCING;
+            probe->count = 1;
+
+            ether_send_arp_probe(ethernet, probe->ip_address, probe->ip_address);
+
+            net_timer_start(&probe->timer, ARP_ANNOUNCE_INTERVAL);
+        }
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/***********************************************************************
+ * @brief  Function to stop address probe or announcement
+ * @param  *probe : reference to probe handle
+ * @retval int8_t : Error = 0, Success = 1
+ ***********************************************************************/
+int8_t ether_arp_probe_stop(arp_probe_t *probe)
+{
+    int8_t func_retval = 0;
+
+    if(probe == NULL || probe->ethernet == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        net_timer_stop(&probe->timer);
+
+        if(probe->ethernet->arp_probe == probe)
+            probe->ethernet->arp_probe = NULL;
+
+        probe->timer_events = 0;
+        probe->state        = ARP_PROBE_IDLE;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/***********************************************************************
+ * @brief  Function to run address probe, call from application
+ *         poll loop, reads network only while probing
+ * @param  *probe        : reference to probe handle
+ * @param  *network_data : network data from PHY
+ * @retval int8_t        : Error = 0, Success = probe state
+ ***********************************************************************/
+int8_t ether_arp_probe_poll(arp_probe_t *probe, uint8_t *network_data)
+{
+    int8_t func_retval = 0;
+
+    ethernet_handle_t *ethernet;
+
+    uint8_t empty_ip[ETHER_IPV4_SIZE] = {0};
+    uint8_t read_blocking = 0;
+
+    if(probe == NULL || probe->ethernet == NULL || network_data == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        ethernet = probe->ethernet;
+
+        net_timer_run(ethernet->ether_commands->get_time_ms());
+
+        /* Conflicts found by ether_arp_snoop() on read */
+        if(probe->state == ARP_PROBE_PROBING && ethernet->ether_commands->network_interface_status())
+        {
+            read_blocking = ethernet->status.mode_read_blocking;
+
+            ethernet->status.mode_read_blocking = ETHER_READ_NONBLOCK;
+
+            ether_get_data(ethernet, network_data, ETHER_MTU_SIZE);
+
+            ethernet->status.mode_read_blocking = read_blocking;
+        }
+
+        if(probe->timer_events)
+        {
+            probe->timer_events = 0;
+
+            if(probe->state == ARP_PROBE_PROBING && probe->count < ARP_PROBE_NUM)
+            {
+                ether_send_arp_probe(ethernet, empty_ip, probe->ip_address);
+
+                probe->count++;
+
+                if(probe->count < ARP_PROBE_NUM)
+                    net_timer_start(&probe->timer, arp_random_interval(ethernet, ARP_PROBE_MIN, ARP_PROBE_MAX));
+                else
+                    net_timer_start(&probe->timer, ARP_ANNOUNCE_WAIT);
+            }
+            else if(probe->state == ARP_PROBE_PROBING)
+            {
+                /* No conflict, address can be used */
+                probe->state = ARP_PROBE_ANNOUNCING;
+                probe->count = 0;
+            }
+
+            if(probe->state == ARP_PROBE_ANNOUNCING)
+            {
+                ether_send_arp_probe(ethernet, probe->ip_address, probe->ip_address);
+
+                probe->count++;
+
+                if(probe->count < ARP_ANNOUNCE_NUM)
+                {
+                    net_timer_start(&probe->timer, ARP_ANNOUNCE_INTERVAL);
+                }
+                else
+                {
+                    probe->state = ARP_PROBE_BOUND;
+
+                    ethernet->arp_probe = NULL;
+                }
+            }
+        }
+
+        func_retval = probe->state;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/***********************************************************************
+ * @brief  Function to set device pattern filter to ARP packets for
+ *         host address, (broadcast filter can be disabled)
+ * @param  *ethernet : reference to the Ethernet handle
+ * @retval int8_t    : Error = -1, Success = 0
+ ***********************************************************************/
+int8_t ether_arp_set_rx_pattern(ethernet_handle_t *ethernet)
+{
+    int8_t func_retval = 0;
+
+    uint8_t pattern[ETHER_PATTERN_SIZE] = {0};
+    uint8_t mask[ETHER_PATTERN_SIZE / 8] = {0};
+
+    /* Window starts at Ethernet type field */
+    pattern[0] = (uint8_t)(ETHER_ARP >> 8);
+    pattern[1] = (uint8_t)(ETHER_ARP & 0xFF);
+
+    mask[0] = 0x03;
+
+    /* Target protocol address, (ARP offset 24) */
+    memcpy(&pattern[26], ethernet->host_ip, ETHER_IPV4_SIZE);
+
+    mask[3] = 0x3C;
+
+    func_retval = ether_filter_set_pattern(ethernet, ETHER_MAC_SIZE * 2, pattern, mask);
+
+    return func_retval;
+}
+
+
 
@@ -49,6 +49,7 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "ipv4.h"
 #include "udp.h"
 #include "network_utilities.h"
 #include "dhcp.h"
@@ -65,9 +66,24 @@
 
 #pragma pack(1)
 
-#define DHCP_FRAME_SIZE         240
-#define DHCP_DISCOVER_OPTS_SIZE 18
-#define DHCP_REQUEST_OPTS_SIZE  36
+#define DHCP_MESSAGE_SIZE       300      /*!< DHCP message buffer, (BOOTP minimum message size) */
+#define DHCP_MIN_MTU            576      /*!< Smallest interface MTU accepted (RFC 2132 5.1)    */
+
+#define DHCP_INITIAL_RTO        4000     /*!< First DISCOVER/REQUEST retransmission (ms), RFC 2131 4.1 */
+#define DHCP_MAX_RTO            64000    /*!< Max retransmission timeout after backoff (ms)            */
+#define DHCP_RTO_JITTER         1000     /*!< Retransmission randomization, +/- (ms)                   */
+#define DHCP_MIN_RENEW_RTO      60000    /*!< Min RENEWING/REBINDING retransmission (ms)               */
+#define DHCP_REQUEST_RETRIES    4        /*!< REQUESTs without ACK before restart from INIT            */
+#define DHCP_NAK_DELAY          10000    /*!< Wait before DISCOVER after NAK (ms)                      */
+#define DHCP_REBOOT_RETRIES     2        /*!< INIT-REBOOT REQUESTs before DISCOVER                     */
+#define DHCP_INFINITE_LEASE     0xFFFFFFFF
+#define DHCP_MAX_LEASE          (UINT32_MAX / 1000)  /*!< Max lease timer (s), timer is in ms    */
+
+#define DHCP_TIMER_RETRANSMIT   0x01     /*!< Retransmission timer expired */
+#define DHCP_TIMER_LEASE        0x02     /*!< Lease timer expired          */
+
+#define DHCP_LEASE_NV_OFFSET    0           /*!< Saved lease offset in nonvolatile storage */
+#define DHCP_LEASE_MAGIC        0x44484350  /*!< Saved lease marker, "DHCP"                */
 
 
 
@@ -107,170 +123,317 @@ typedef struct _net_dhcp
 
 
 
-/************* DHCP Discover options structures **************/
-
-/* DHCP Option message type */
-typedef struct _opts_53
+/* DHCP options iterator, (TLV walk of options data) */
+typedef struct _dhcp_option_iterator
 {
-    uint8_t option_number;
-    uint8_t length;
-    uint8_t dhcp;
+    uint8_t  *options;  /*!< DHCP options data         */
+    uint16_t  length;   /*!< DHCP options data length  */
+    uint16_t  index;    /*!< Offset of next option     */
 
-}dhcp_option_53_t;
+}dhcp_opt_iter_t;
 
 
-/* DHCP Option parameter request list  */
-typedef struct _opts_55
+
+/* DHCP options builder, (appends TLV options to message) */
+typedef struct _dhcp_option_builder
 {
-    uint8_t option_number;
-    uint8_t length;
-    uint8_t req_item[3];
+    uint8_t  *options;  /*!< DHCP options buffer                        */
+    uint16_t  size;     /*!< DHCP options buffer size                   */
+    uint16_t  length;   /*!< Options written, (END option not included) */
+
+}dhcp_opt_builder_t;
 
-}dhcp_option_55_t;
 
 
-/* DHCP Option client identifier */
-typedef struct _opts_61
+/* Lease saved in nonvolatile storage, (38 bytes) */
+typedef struct _dhcp_lease_record
 {
-    uint8_t option_number;
-    uint8_t length;
-    uint8_t hw_type;
-    uint8_t client_mac[ETHER_MAC_SIZE];
+    uint32_t magic;                                /*!< DHCP_LEASE_MAGIC                  */
+    uint8_t  host_mac[ETHER_MAC_SIZE];             /*!< Lease owner, (board MAC)          */
+    uint8_t  your_ip[ETHER_IPV4_SIZE];             /*!< Leased IP address                 */
+    uint8_t  server_ip[ETHER_IPV4_SIZE];           /*!< DHCP server identifier            */
+    uint8_t  subnet_mask[ETHER_IPV4_SIZE];         /*!< Subnet mask                       */
+    uint8_t  gateway_ip[ETHER_IPV4_SIZE];          /*!< Gateway IP address                */
+    uint8_t  gateway_mac[ETHER_MAC_SIZE];          /*!< Gateway MAC address, 0 if unknown */
+    uint32_t lease_time;                           /*!< Lease time (s)                    */
+    uint16_t checksum;                             /*!< Record checksum                   */
 
-}dhcp_option_61_t;
+}dhcp_lease_record_t;
 
 
 
-/* DHCP Discover options (18 bytes) */
-typedef struct _dhcp_discover_options
+/* */
+typedef enum _dhcp_boot_message
 {
-    dhcp_option_53_t message_type;
-    dhcp_option_55_t param_request_list;
-    dhcp_option_61_t client_identifier;
-    uint8_t          options_end;
-
-}dhcp_discover_opts_t;
+    DHCP_BOOT_REQ   = 1,
+    DHCP_BOOT_REPLY = 2,
+    DHCP_DISCOVER   = 1,
+    DHCP_OFFER      = 2,
+    DHCP_REQUEST    = 3,
+    DHCP_ACK        = 5,
+    DHCP_NAK        = 6,
 
+}dhcp_boot_msg_t;
 
 
-/************* DHCP Offer options structures **************/
 
 /* */
-typedef struct _opts_54
+typedef enum _dhcp_option_types
 {
-    uint8_t option_number;
-    uint8_t length;
-    uint8_t server_ip[ETHER_IPV4_SIZE];
+    DHCP_PAD               = 0,
+    DHCP_SUBNET_MASK       = 1,
+    DHCP_ROUTER            = 3,
+    DHCP_DNS_SERVER        = 6,
+    DHCP_INTERFACE_MTU     = 26,
+    DHCP_NTP_SERVER        = 42,
+    DHCP_REQUESTED_IP      = 50,
+    DHCP_ADDR_LEASE_TIME   = 51,
+    DHCP_MESSAGE_TYPE      = 53,
+    DHCP_SERVER_IDENTIFIER = 54,
+    DHCP_PARAM_REQ_LIST    = 55,
+    DHCP_RENEWAL_TIME      = 58,
+    DHCP_REBINDING_TIME    = 59,
+    DHCP_CLIENT_IDENTIFIER = 61,
+    DHCP_OPTION_END        = 255,
 
-}dhcp_option_54_t;
+}dhcp_options_types_t;
 
-/* */
-typedef struct _opts_51
-{
-    uint8_t option_number;
-    uint8_t length;
-    uint32_t lease_time;
 
-}dhcp_option_51_t;
 
-/* */
-typedef struct _opts_1
+/******************************************************************************/
+/*                                                                            */
+/*                              DHCP Functions                                */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+
+/***************************************************************
+ * @brief   Static function to start DHCP options iterator
+ * @param   *iter    : reference to options iterator
+ * @param   *options : DHCP options data
+ * @param   length   : DHCP options data length
+ * @retval  None
+ ***************************************************************/
+static void dhcp_option_iter_init(dhcp_opt_iter_t *iter, uint8_t *options, uint16_t length)
 {
-    uint8_t option_number;
-    uint8_t length;
-    uint8_t subnet_mask[ETHER_IPV4_SIZE];
+    iter->options = options;
+    iter->length  = length;
+    iter->index   = 0;
+}
 
-}dhcp_option_1_t;
 
-/* */
-typedef struct _opts_3
+
+
+/***************************************************************
+ * @brief   Static function to get next DHCP option, pad
+ *          options are skipped, option data must lie inside
+ *          options data
+ * @param   *iter    : reference to options iterator
+ * @param   *code    : option code
+ * @param   *length  : option data length
+ * @param   **value  : option data
+ * @retval  uint8_t  : End = 0 (END option, or truncated), Success = 1
+ ***************************************************************/
+static uint8_t dhcp_option_next(dhcp_opt_iter_t *iter, uint8_t *code, uint8_t *length, uint8_t **value)
 {
-    uint8_t option_number;
-    uint8_t length;
-    uint8_t router[ETHER_IPV4_SIZE];
+    uint8_t func_retval = 0;
+
+    uint8_t *options = iter->options;
+
+    /* Pad option has no length */
+    while(iter->index < iter->length && options[iter->index] == DHCP_PAD)
+        iter->index++;
+
+    if(iter->index + 2 > iter->length || options[iter->index] == DHCP_OPTION_END)
+    {
+        func_retval = 0;
+    }
+    else if(iter->index + 2 + options[iter->index + 1] > iter->length)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        *code   = options[iter->index];
+        *length = options[iter->index + 1];
+        *value  = &options[iter->index + 2];
+
+        iter->index += 2 + *length;
+
+        func_retval = 1;
+    }
+
+    /* Stop walk after END or truncated option */
+    if(func_retval == 0)
+        iter->index = iter->length;
+
+    return func_retval;
+}
 
-}dhcp_option_3_t;
 
 
 
-/* DHCP Offer options */
-typedef struct _dhcp_offer_options
+/***************************************************************
+ * @brief   Static function to find DHCP option
+ * @param   *options     : DHCP options data
+ * @param   length       : DHCP options data length
+ * @param   option_code  : DHCP option code
+ * @retval  uint8_t*     : Error = NULL, Success = option data
+ ***************************************************************/
+static uint8_t* dhcp_get_option(uint8_t *options, uint16_t length, uint8_t option_code)
 {
-    dhcp_option_53_t message_type;
-    dhcp_option_54_t server_identifier;
-    dhcp_option_51_t lease_time;
-    dhcp_option_1_t  subnet_mask;
-    dhcp_option_3_t  router;
-    uint8_t          options_end;
+    uint8_t *func_retval = NULL;
 
-}dhcp_offer_opts_t;
+    dhcp_opt_iter_t iter;
 
+    uint8_t  code   = 0;
+    uint8_t  size   = 0;
+    uint8_t *value  = NULL;
 
-/************* DHCP Offer Request structures **************/
+    dhcp_option_iter_init(&iter, options, length);
 
+    while(dhcp_option_next(&iter, &code, &size, &value))
+    {
+        if(code == option_code)
+        {
+            func_retval = value;
 
-/* */
-typedef struct _opts_50
+            break;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+
+/***************************************************************
+ * @brief   Static function to start DHCP options builder, magic
+ *          cookie is written before options
+ * @param   *builder : reference to options builder
+ * @param   *message : DHCP message
+ * @param   size     : DHCP message buffer size
+ * @retval  None
+ ***************************************************************/
+static void dhcp_option_builder_init(dhcp_opt_builder_t *builder, net_dhcp_t *message, uint16_t size)
 {
-    uint8_t option_number;
-    uint8_t length;
-    uint8_t requested_ip[ETHER_IPV4_SIZE];
+    /* Configure magic cookie value */
+    message->magic_cookie[0] = 0x63;
+    message->magic_cookie[1] = 0x82;
+    message->magic_cookie[2] = 0x53;
+    message->magic_cookie[3] = 0x63;
+
+    builder->options = &message->options;
+    builder->size    = size - DHCP_FRAME_SIZE;
+    builder->length  = 0;
+}
 
-}dhcp_option_50_t;
 
 
 
-/* DHCP Request options */
-typedef struct _dhcp_request_options
+/***************************************************************
+ * @brief   Static function to append DHCP option, space for
+ *          END option is kept
+ * @param   *builder : reference to options builder
+ * @param   code     : DHCP option code
+ * @param   length   : option data length
+ * @param   *value   : option data
+ * @retval  uint8_t  : Error = 0 (no space), Success = 1
+ ***************************************************************/
+static uint8_t dhcp_option_add(dhcp_opt_builder_t *builder, uint8_t code, uint8_t length, const void *value)
 {
-    dhcp_option_51_t lease_time;
-    dhcp_option_53_t message_type;
-    dhcp_option_55_t param_request_list;
-    dhcp_option_61_t client_identifier;
-    dhcp_option_50_t requested_ip;
-    dhcp_option_54_t server_identifier;
-    uint8_t          options_end;
+    uint8_t func_retval = 0;
+
+    if(builder->length + 2 + length + 1 > builder->size)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        builder->options[builder->length]     = code;
+        builder->options[builder->length + 1] = length;
 
-}dhcp_request_opts_t;
+        memcpy(&builder->options[builder->length + 2], value, length);
 
+        builder->length += 2 + length;
 
+        func_retval = 1;
+    }
 
-/* */
-typedef enum _dhcp_boot_message
+    return func_retval;
+}
+
+
+
+
+/***************************************************************
+ * @brief   Static function to append 32 bit DHCP option,
+ *          (network byte order)
+ * @param   *builder : reference to options builder
+ * @param   code     : DHCP option code
+ * @param   value    : option value
+ * @retval  uint8_t  : Error = 0 (no space), Success = 1
+ ***************************************************************/
+static uint8_t dhcp_option_add_u32(dhcp_opt_builder_t *builder, uint8_t code, uint32_t value)
 {
-    DHCP_BOOT_REQ   = 1,
-    DHCP_BOOT_REPLY = 2,
-    DHCP_DISCOVER   = 1,
-    DHCP_OFFER      = 2,
-    DHCP_REQUEST    = 3,
-    DHCP_ACK        = 5,
+    value = htonl(value);
 
-}dhcp_boot_msg_t;
+    return dhcp_option_add(builder, code, 4, &value);
+}
 
 
 
-/* */
-typedef enum _dhcp_option_types
+
+/***************************************************************
+ * @brief   Static function to append options of every client
+ *          message, message type, parameter request list and
+ *          client identifier
+ * @param   *builder     : reference to options builder
+ * @param   message_type : DHCP message type
+ * @param   *mac_address : client MAC address
+ * @retval  uint8_t      : Error = 0 (no space), Success = 1
+ ***************************************************************/
+static uint8_t dhcp_option_add_client(dhcp_opt_builder_t *builder, uint8_t message_type, uint8_t *mac_address)
 {
-    DHCP_SUBNET_MASK       = 1,
-    DHCP_ROUTER            = 3,
-    DHCP_REQUESTED_IP      = 50,
-    DHCP_ADDR_LEASE_TIME   = 51,
-    DHCP_MESSAGE_TYPE      = 53,
-    DHCP_SERVER_IDENTIFIER = 54,
-    DHCP_PARAM_REQ_LIST    = 55,
-    DHCP_CLIENT_IDENTIFIER = 61,
-    DHCP_OPTION_END        = 255,
+    uint8_t func_retval = 0;
 
-}dhcp_options_types_t;
+    uint8_t client_id[1 + ETHER_MAC_SIZE] = {0};
 
+    static const uint8_t param_request_list[] =
+    {
+        DHCP_SUBNET_MASK, DHCP_ROUTER, DHCP_DNS_SERVER, DHCP_INTERFACE_MTU,
+        DHCP_NTP_SERVER, DHCP_ADDR_LEASE_TIME, DHCP_RENEWAL_TIME, DHCP_REBINDING_TIME,
+    };
 
+    /* Hardware type ethernet, MAC address */
+    client_id[0] = 1;
 
-/******************************************************************************/
-/*                                                                            */
-/*                              DHCP Functions                                */
-/*                                                                            */
-/******************************************************************************/
+    memcpy(&client_id[1], mac_address, ETHER_MAC_SIZE);
+
+    func_retval = dhcp_option_add(builder, DHCP_MESSAGE_TYPE, 1, &message_type) && \
+                  dhcp_option_add(builder, DHCP_PARAM_REQ_LIST, sizeof(param_request_list), param_request_list) && \
+                  dhcp_option_add(builder, DHCP_CLIENT_IDENTIFIER, sizeof(client_id), client_id);
+
+    return func_retval;
+}
+
+
+
+
+/***************************************************************
+ * @brief   Static function to end DHCP options
+ * @param   *builder : reference to options builder
+ * @retval  uint16_t : DHCP message length, (header + options)
+ ***************************************************************/
+static uint16_t dhcp_option_end(dhcp_opt_builder_t *builder)
+{
+    builder->options[builder->length] = DHCP_OPTION_END;
+
+    return DHCP_FRAME_SIZE + builder->length + 1;
+}
 
 
 
@@ -289,14 +452,16 @@ int8_t ether_dhcp_send_discover(ethernet_handle_t *ethernet, uint32_t transactio
 
     int8_t func_retval = 0;
 
-    net_dhcp_t           *dhcp_discover;
-    dhcp_discover_opts_t *discover_opts;
-    ether_source_t        dhcp_client;
+    net_dhcp_t         *dhcp_discover;
+    dhcp_opt_builder_t  discover_opts;
+    ether_source_t      dhcp_client;
 
     uint8_t destination_ip[4]  = {0};
     uint8_t destination_mac[6] = {0};
 
-    char data[258] = {0};
+    uint16_t message_length = 0;
+
+    char data[DHCP_MESSAGE_SIZE] = {0};
 
     if(ethernet == NULL)
     {
@@ -327,37 +492,12 @@ int8_t ether_dhcp_send_discover(ethernet_handle_t *ethernet, uint32_t transactio
         /* Client Server host name         = 0 */
         /* Client file name                = 0 */
 
-        /* Configure magic cookie value */
-        dhcp_discover->magic_cookie[0] = 0x63;
-        dhcp_discover->magic_cookie[1] = 0x82;
-        dhcp_discover->magic_cookie[2] = 0x53;
-        dhcp_discover->magic_cookie[3] = 0x63;
-
-
-        /* Configure DHCP options */
-        discover_opts = (void*)&dhcp_discover->options;
-
-        /* option (53) */
-        discover_opts->message_type.option_number = DHCP_MESSAGE_TYPE;
-        discover_opts->message_type.length        = 1;
-        discover_opts->message_type.dhcp          = DHCP_DISCOVER;
+        /* Configure DHCP options, (53, 55, 61) */
+        dhcp_option_builder_init(&discover_opts, dhcp_discover, DHCP_MESSAGE_SIZE);
 
-        /* option (55) */
-        discover_opts->param_request_list.option_number = DHCP_PARAM_REQ_LIST;
-        discover_opts->param_request_list.length        = 3;
-        discover_opts->param_request_list.req_item[0]   = DHCP_SUBNET_MASK;
-        discover_opts->param_request_list.req_item[1]   = DHCP_ROUTER;
-        discover_opts->param_request_list.req_item[2]   = DHCP_ADDR_LEASE_TIME;
+        dhcp_option_add_client(&discover_opts, DHCP_DISCOVER, ethernet->host_mac);
 
-        /* option (61) */
-        discover_opts->client_identifier.option_number = DHCP_CLIENT_IDENTIFIER;
-        discover_opts->client_identifier.length        = 7;
-        discover_opts->client_identifier.hw_type       = 1;
-
-        memcpy((char*)discover_opts->client_identifier.client_mac, (char*)ethernet->host_mac, ETHER_MAC_SIZE);
-
-        /* option end */
-        discover_opts->options_end = DHCP_OPTION_END;
+        message_length = dhcp_option_end(&discover_opts);
 
         /* Configure sources */
         memset(&dhcp_client, 0, sizeof(ether_source_t));
@@ -374,7 +514,7 @@ int8_t ether_dhcp_send_discover(ethernet_handle_t *ethernet, uint32_t transactio
 
         /* Send DHCP packet as UPD message */
         ether_send_udp_raw(ethernet, &dhcp_client, destination_ip, destination_mac, DHCP_DESTINATION_PORT,
-                           (uint8_t*)dhcp_discover, (DHCP_FRAME_SIZE + DHCP_DISCOVER_OPTS_SIZE));
+                           (uint8_t*)dhcp_discover, message_length);
     }
 
     return func_retval;
@@ -384,56 +524,64 @@ int8_t ether_dhcp_send_discover(ethernet_handle_t *ethernet, uint32_t transactio
 
 
 /************************************************************
- * @brief   Function read DHCP offer
- * @param   *ethernet     : reference to the Ethernet handle
- * @param   *network_data : network_data from PHY
- * @param   *your_ip      : 'your IP' address
- *
- * @param   *dhcp_options : DHCP options data
- * @retval  uint8_t       : Error = 0, Success = DHCP type
+ * @brief   Static function to read DHCP server reply from
+ *          UDP packet read by ether_get_data()
+ * @param   *ethernet          : reference to the Ethernet handle
+ * @param   *your_ip           : 'your IP' address
+ * @param   client_transac_id  : transaction ID of exchange
+ * @param   *dhcp_options      : DHCP options data
+ * @retval  int8_t             : Error = 0, Success = DHCP type
  ************************************************************/
-int8_t ether_dhcp_read(ethernet_handle_t *ethernet, uint8_t *network_data, uint8_t *your_ip, uint32_t client_transac_id, uint8_t *dhcp_options)
+static int8_t dhcp_read_reply(ethernet_handle_t *ethernet, uint8_t *your_ip, uint32_t client_transac_id, uint8_t *dhcp_options)
 {
     int8_t   func_retval        = 0;
     uint16_t udp_message_length = 0;
 
-    net_dhcp_t *dhcp_reply;
-    dhcp_offer_opts_t *dhcp_opts;
+    net_packet_t *packet;
+    net_dhcp_t   *dhcp_reply;
 
-    uint16_t udp_src_port  = 0;
-    uint16_t udp_dest_port = 0;
+    uint8_t *message_type;
+    uint16_t options_length = 0;
+
+    static const uint8_t magic_cookie[4] = {0x63, 0x82, 0x53, 0x63};
 
     char dhcp_data[APP_BUFF_SIZE] = {0};
 
-    if(ethernet == NULL || network_data == NULL)
+    packet = ether_get_packet(ethernet);
+
+    udp_message_length = packet->data_length;
+
+    if(udp_message_length > APP_BUFF_SIZE)
+        udp_message_length = APP_BUFF_SIZE;
+
+    /* Check if UDP source ports = DHCP destination port, UDP checksum validated with copy */
+    if(packet->ip_protocol != IP_UDP || packet->source_port != DHCP_DESTINATION_PORT || packet->destination_port != DHCP_SOURCE_PORT || \
+            udp_message_length <= DHCP_FRAME_SIZE)
     {
         func_retval = 0;
     }
-    else
+    else if(ip_transport_copy_data(ethernet, dhcp_data, udp_message_length))
     {
-        /* read UDP packet */
-        udp_message_length = ether_read_udp_raw(ethernet, network_data, ETHER_MTU_SIZE, &udp_src_port, &udp_dest_port, dhcp_data, APP_BUFF_SIZE);
-
+        dhcp_reply = (void*)dhcp_data;
 
-        /* Check if UDP source ports = DHCP destination port */
-        if(udp_src_port == DHCP_DESTINATION_PORT && udp_dest_port == DHCP_SOURCE_PORT && udp_message_length)
-        {
-            dhcp_reply = (void*)dhcp_data;
+        options_length = udp_message_length - DHCP_FRAME_SIZE;
 
-            if(client_transac_id == ntohl(dhcp_reply->transaction_id))
-            {
+        if(options_length > DHCP_OPTIONS_SIZE)
+            options_length = DHCP_OPTIONS_SIZE;
 
-                /* Get your_ip from DHCP standard header*/
-                strncpy((char*)your_ip, (char*)dhcp_reply->your_ip, ETHER_IPV4_SIZE);
+        message_type = dhcp_get_option(&dhcp_reply->options, options_length, DHCP_MESSAGE_TYPE);
 
-                /* Get server_ip, SUBNET mask, lease time from DHCP offer options */
-                dhcp_opts = (void*)&dhcp_reply->options;
+        if(client_transac_id == ntohl(dhcp_reply->transaction_id) && message_type != NULL && \
+           memcmp(dhcp_reply->magic_cookie, magic_cookie, sizeof(magic_cookie)) == 0)
+        {
 
-                func_retval = dhcp_opts->message_type.dhcp;
+            /* Get your_ip from DHCP standard header, (may contain zero bytes) */
+            memcpy((char*)your_ip, (char*)dhcp_reply->your_ip, ETHER_IPV4_SIZE);
 
-                memcpy(dhcp_options, (uint8_t*)dhcp_opts, (udp_message_length - DHCP_FRAME_SIZE));
-            }
+            /* Options in any order, parsed by ether_dhcp_parse_options() */
+            func_retval = *message_type;
 
+            memcpy(dhcp_options, (uint8_t*)&dhcp_reply->options, options_length);
         }
 
     }
@@ -444,31 +592,18 @@ int8_t ether_dhcp_read(ethernet_handle_t *ethernet, uint8_t *network_data, uint8
 
 
 
-
-
 /************************************************************
- * @brief   Function read DHCP offer (Depreciated)
+ * @brief   Function read DHCP offer
  * @param   *ethernet     : reference to the Ethernet handle
  * @param   *network_data : network_data from PHY
  * @param   *your_ip      : 'your IP' address
- * @param   *server_ip    : server IP address
- * @param   *subnet_mask  : SUBNET mask
- * @param   *lease_time   : IP address lease time
- * @retval  uint8_t       : Error = 0, Success = 1
+ *
+ * @param   *dhcp_options : DHCP options data
+ * @retval  uint8_t       : Error = 0, Success = DHCP type
  ************************************************************/
-int8_t ether_dhcp_read_offer(ethernet_handle_t *ethernet, uint8_t *network_data, uint8_t *your_ip, uint8_t *server_ip,
-                             uint8_t *subnet_mask, uint8_t *lease_time)
+int8_t ether_dhcp_read(ethernet_handle_t *ethernet, uint8_t *network_data, uint8_t *your_ip, uint32_t client_transac_id, uint8_t *dhcp_options)
 {
     int8_t func_retval = 0;
-    uint8_t api_retval = 0;
-
-    net_dhcp_t *dhcp_offer;
-    dhcp_offer_opts_t *offer_opts;
-
-    uint16_t udp_src_port  = 0;
-    uint16_t udp_dest_port = 0;
-
-    char    dhcp_data[300] = {0};
 
     if(ethernet == NULL || network_data == NULL)
     {
@@ -477,31 +612,10 @@ int8_t ether_dhcp_read_offer(ethernet_handle_t *ethernet, uint8_t *network_data,
     else
     {
         /* read UDP packet */
-        api_retval = ether_read_udp_raw(ethernet, network_data, 350, &udp_src_port, &udp_dest_port, dhcp_data, 300);
-
-
-        /* Check if UDP source ports = DHCP destination port */
-        if(udp_src_port == DHCP_DESTINATION_PORT && udp_dest_port == DHCP_SOURCE_PORT && api_retval)
+        if(ether_is_udp(ethernet, network_data, ETHER_MTU_SIZE))
         {
-            dhcp_offer = (void*)dhcp_data;
-
-            /* Get your_ip from DHCP standard header*/
-            memcpy((char*)your_ip, (char*)dhcp_offer->your_ip, ETHER_IPV4_SIZE);
-
-
-            /* Get server_ip, SUBNET mask, lease time from DHCP offer options */
-            offer_opts = (void*)&dhcp_offer->options;
-
-            memcpy((char*)server_ip, (char*)offer_opts->server_identifier.server_ip, ETHER_IPV4_SIZE);
-
-            memcpy((char*)lease_time, (char*)offer_opts->lease_time.lease_time, ETHER_IPV4_SIZE);
-
-            memcpy((char*)subnet_mask, (char*)offer_opts->subnet_mask.subnet_mask, ETHER_IPV4_SIZE);
-
-
-            func_retval = 1;
+            func_retval = dhcp_read_reply(ethernet, your_ip, client_transac_id, dhcp_options);
         }
-
     }
 
     return func_retval;
@@ -511,129 +625,619 @@ int8_t ether_dhcp_read_offer(ethernet_handle_t *ethernet, uint8_t *network_data,
 
 
 
+
 /*************************************************************
- * @brief   Function Send DHCP Request
- * @param   *ethernet       : reference to the Ethernet handle
- * @param   transaction_id  : random transaction ID
- * @param   seconds_elapsed : number of seconds elapsed
- * @param   *server_ip      : DHCP server IP
- * @param   *requested_ip   : IP request to the server
- * @param   *lease_time     : Lease time
- * @retval  uint8_t         : Error = -1, Success = 0
+ * @brief   Function to parse DHCP options in one pass,
+ *          options are bounds checked, unknown options
+ *          and options of invalid length are skipped
+ * @param   *options : DHCP options data
+ * @param   length   : DHCP options data length
+ * @param   *parsed  : parsed options
+ * @retval  int8_t   : Error = 0 (no message type), Success = 1
  *************************************************************/
-int8_t ether_dhcp_send_request(ethernet_handle_t *ethernet, uint32_t transaction_id, uint16_t seconds_elapsed,
-                               uint8_t *server_ip, uint8_t *requested_ip, uint32_t lease_time)
+int8_t ether_dhcp_parse_options(uint8_t *options, uint16_t length, dhcp_options_t *parsed)
 {
-
     int8_t func_retval = 0;
 
-    net_dhcp_t          *dhcp_request;
-    dhcp_request_opts_t *request_opts;
-    ether_source_t        dhcp_client;
-
-    uint8_t destination_ip[4]  = {0};
-    uint8_t destination_mac[6] = {0};
+    dhcp_opt_iter_t iter;
 
-    char data[280] = {0};
+    uint8_t  code   = 0;
+    uint8_t  size   = 0;
+    uint8_t *value  = NULL;
+    uint32_t number = 0;
 
-    if(ethernet == NULL)
+    if(options == NULL || parsed == NULL)
     {
-        func_retval = -1;
+        func_retval = 0;
     }
     else
     {
-        /* Configure DHCP fields */
-        dhcp_request = (net_dhcp_t*)data;
+        memset(parsed, 0, sizeof(dhcp_options_t));
 
-        dhcp_request->op_code        = DHCP_BOOT_REQ;
-        dhcp_request->hw_type        = 1;
-        dhcp_request->hw_length      = ETHER_MAC_SIZE;
-        dhcp_request->hops           = 0;
-        dhcp_request->transaction_id = htonl(transaction_id);
-        dhcp_request->seconds        = htons(seconds_elapsed);
-        dhcp_request->flags          = htons(0x8000);
+        dhcp_option_iter_init(&iter, options, length);
 
-        /* client  IP address  = 0  */
-        /* your    IP address  = 0  */
-        /* server  IP address  = 0  */
-        /* gateway IP address  = 0  */
+        while(dhcp_option_next(&iter, &code, &size, &value))
+        {
+            switch(code)
+            {
 
-        /* client hardware address */
-        strncpy((char*)dhcp_request->client_hw_addr, (char*)ethernet->host_mac, ETHER_MAC_SIZE);
+            case DHCP_MESSAGE_TYPE:
 
-        /* Client hardware address padding = 0 */
-        /* Client Server host name         = 0 */
-        /* Client file name                = 0 */
+                if(size == 1)
+                {
+                    parsed->message_type = value[0];
+                    parsed->present     |= DHCP_OPT_MESSAGE_TYPE;
+                }
 
-        /* Configure magic cookie value */
-        dhcp_request->magic_cookie[0] = 0x63;
-        dhcp_request->magic_cookie[1] = 0x82;
-        dhcp_request->magic_cookie[2] = 0x53;
-        dhcp_request->magic_cookie[3] = 0x63;
+                break;
 
 
-        /* Configure DHCP options */
-        request_opts = (void*)&dhcp_request->options;
+            case DHCP_SERVER_IDENTIFIER:
 
+                if(size == ETHER_IPV4_SIZE)
+                {
+                    memcpy(parsed->server_id, value, ETHER_IPV4_SIZE);
+                    parsed->present |= DHCP_OPT_SERVER_ID;
+                }
 
-        /* options (51) */
-        request_opts->lease_time.option_number = DHCP_ADDR_LEASE_TIME;
-        request_opts->lease_time.length        = 4;
-        //memcpy((char*)request_opts->lease_time.lease_time, (char*)lease_time, 4);
-        request_opts->lease_time.lease_time  = htonl(lease_time);
+                break;
 
 
-        /* option (53) */
-        request_opts->message_type.option_number = DHCP_MESSAGE_TYPE;
-        request_opts->message_type.length        = 1;
-        request_opts->message_type.dhcp          = DHCP_REQUEST;
+            case DHCP_SUBNET_MASK:
 
-        /* option (55) */
-        request_opts->param_request_list.option_number = DHCP_PARAM_REQ_LIST;
-        request_opts->param_request_list.length        = 3;
-        request_opts->param_request_list.req_item[0]   = DHCP_SUBNET_MASK;
-        request_opts->param_request_list.req_item[1]   = DHCP_ROUTER;
-        request_opts->param_request_list.req_item[2]   = DHCP_ADDR_LEASE_TIME;
+                if(size == ETHER_IPV4_SIZE)
+                {
+                    memcpy(parsed->subnet_mask, value, ETHER_IPV4_SIZE);
+                    parsed->present |= DHCP_OPT_SUBNET_MASK;
+                }
 
-        /* option (61) */
-        request_opts->client_identifier.option_number = DHCP_CLIENT_IDENTIFIER;
-        request_opts->client_identifier.length        = 7;
-        request_opts->client_identifier.hw_type       = 1;
-        memcpy((char*)request_opts->client_identifier.client_mac, (char*)ethernet->host_mac, ETHER_MAC_SIZE);
+                break;
 
 
-        /* options (50) */
-        request_opts->requested_ip.option_number = DHCP_REQUESTED_IP;
-        request_opts->requested_ip.length        = 4;
-        memcpy((char*)request_opts->requested_ip.requested_ip, (char*)requested_ip, ETHER_IPV4_SIZE);
+            case DHCP_ROUTER:
 
+                /* List of routers, first is used */
+                if(size >= ETHER_IPV4_SIZE && size % ETHER_IPV4_SIZE == 0)
+                {
+                    memcpy(parsed->router, value, ETHER_IPV4_SIZE);
+                    parsed->present |= DHCP_OPT_ROUTER;
+                }
 
-        /* options (54) */
-        request_opts->server_identifier.option_number = DHCP_SERVER_IDENTIFIER;
-        request_opts->server_identifier.length        = 4;
-        memcpy((char*)request_opts->server_identifier.server_ip, (char*)server_ip, ETHER_IPV4_SIZE);
+                break;
 
 
-        /* option end */
-        request_opts->options_end = DHCP_OPTION_END;
+            case DHCP_DNS_SERVER:
 
+                while(size >= ETHER_IPV4_SIZE && parsed->dns_count < DHCP_MAX_DNS_SERVERS)
+                {
+                    memcpy(parsed->dns_server[parsed->dns_count++], value, ETHER_IPV4_SIZE);
+                    parsed->present |= DHCP_OPT_DNS_SERVER;
 
-        /* Configure sources */
-        memset(&dhcp_client, 0, sizeof(ether_source_t));
+                    value += ETHER_IPV4_SIZE;
+                    size  -= ETHER_IPV4_SIZE;
+                }
 
-        dhcp_client.identifier  = 1;
-        dhcp_client.source_port = DHCP_SOURCE_PORT;
+                break;
+
+
+            case DHCP_NTP_SERVER:
+
+                while(size >= ETHER_IPV4_SIZE && parsed->ntp_count < DHCP_MAX_NTP_SERVERS)
+                {
+                    memcpy(parsed->ntp_server[parsed->ntp_count++], value, ETHER_IPV4_SIZE);
+                    parsed->present |= DHCP_OPT_NTP_SERVER;
+
+                    value += ETHER_IPV4_SIZE;
+                    size  -= ETHER_IPV4_SIZE;
+                }
+
+                break;
+
+
+            case DHCP_INTERFACE_MTU:
+
+                if(size == 2)
+                {
+                    parsed->interface_mtu = (value[0] << 8) | value[1];
+                    parsed->present      |= DHCP_OPT_INTERFACE_MTU;
+                }
+
+                break;
+
+
+            case DHCP_ADDR_LEASE_TIME:
+            case DHCP_RENEWAL_TIME:
+            case DHCP_REBINDING_TIME:
+
+                if(size == 4)
+                {
+                    memcpy(&number, value, 4);
+
+                    number = ntohl(number);
+
+                    if(code == DHCP_ADDR_LEASE_TIME)
+                    {
+                        parsed->lease_time = number;
+                        parsed->present   |= DHCP_OPT_LEASE_TIME;
+                    }
+                    else if(code == DHCP_RENEWAL_TIME)
+                    {
+                        parsed->renew_time = number;
+                        parsed->present   |= DHCP_OPT_RENEWAL_TIME;
+                    }
+                    else
+                    {
+                        parsed->rebind_time = number;
+                        parsed->present    |= DHCP_OPT_REBIND_TIME;
+                    }
+                }
+
+                break;
+
+
+            default:
+
+                break;
+
+            }
+        }
+
+        func_retval = (parsed->present & DHCP_OPT_MESSAGE_TYPE) ? 1 : 0;
+    }
+
+    return func_retval;
+}
+
+
+
+
+
+
+/************************************************************
+ * @brief   Function read DHCP offer (Depreciated)
+ * @param   *ethernet     : reference to the Ethernet handle
+ * @param   *network_data : network_data from PHY
+ * @param   *your_ip      : 'your IP' address
+ * @param   *server_ip    : server IP address
+ * @param   *subnet_mask  : SUBNET mask
+ * @param   *lease_time   : IP address lease time
+ * @retval  uint8_t       : Error = 0, Success = 1
+ ************************************************************/
+int8_t ether_dhcp_read_offer(ethernet_handle_t *ethernet, uint8_t *network_data, uint8_t *your_ip, uint8_t *server_ip,
+                             uint8_t *subnet_mask, uint8_t *lease_time)
+{
+    int8_t   func_retval = 0;
+    uint16_t api_retval  = 0;
+
+    net_dhcp_t     *dhcp_offer;
+    dhcp_options_t  offer_opts;
+
+    uint32_t offer_lease_time = 0;
+
+    uint16_t udp_src_port  = 0;
+    uint16_t udp_dest_port = 0;
+
+    char    dhcp_data[300] = {0};
+
+    if(ethernet == NULL || network_data == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        /* read UDP packet */
+        api_retval = ether_read_udp_raw(ethernet, network_data, 350, &udp_src_port, &udp_dest_port, dhcp_data, 300);
+
+
+        /* Check if UDP source ports = DHCP destination port */
+        if(udp_src_port == DHCP_DESTINATION_PORT && udp_dest_port == DHCP_SOURCE_PORT && api_retval > DHCP_FRAME_SIZE)
+        {
+            dhcp_offer = (void*)dhcp_data;
+
+            /* Get your_ip from DHCP standard header*/
+            memcpy((char*)your_ip, (char*)dhcp_offer->your_ip, ETHER_IPV4_SIZE);
+
+
+            /* Get server_ip, SUBNET mask, lease time from DHCP offer options */
+            ether_dhcp_parse_options(&dhcp_offer->options, api_retval - DHCP_FRAME_SIZE, &offer_opts);
+
+            memcpy((char*)server_ip, (char*)offer_opts.server_id, ETHER_IPV4_SIZE);
+
+            offer_lease_time = htonl(offer_opts.lease_time);
+
+            memcpy((char*)lease_time, (char*)&offer_lease_time, ETHER_IPV4_SIZE);
+
+            memcpy((char*)subnet_mask, (char*)offer_opts.subnet_mask, ETHER_IPV4_SIZE);
+
+
+            func_retval = 1;
+        }
+
+    }
+
+    return func_retval;
+}
+
+
+
+
+
+/*************************************************************
+ * @brief   Function Send DHCP Request
+ * @param   *ethernet       : reference to the Ethernet handle
+ * @param   transaction_id  : random transaction ID
+ * @param   seconds_elapsed : number of seconds elapsed
+ * @param   *server_ip      : DHCP server IP
+ * @param   *requested_ip   : IP request to the server
+ * @param   *lease_time     : Lease time
+ * @retval  uint8_t         : Error = -1, Success = 0
+ *************************************************************/
+int8_t ether_dhcp_send_request(ethernet_handle_t *ethernet, uint32_t transaction_id, uint16_t seconds_elapsed,
+                               uint8_t *server_ip, uint8_t *requested_ip, uint32_t lease_time)
+{
+
+    int8_t func_retval = 0;
+
+    net_dhcp_t         *dhcp_request;
+    dhcp_opt_builder_t  request_opts;
+    ether_source_t      dhcp_client;
+
+    uint8_t destination_ip[4]  = {0};
+    uint8_t destination_mac[6] = {0};
+
+    uint16_t message_length = 0;
+
+    char data[DHCP_MESSAGE_SIZE] = {0};
+
+    if(ethernet == NULL)
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        /* Configure DHCP fields */
+        dhcp_request = (net_dhcp_t*)data;
+
+        dhcp_request->op_code        = DHCP_BOOT_REQ;
+        dhcp_request->hw_type        = 1;
+        dhcp_request->hw_length      = ETHER_MAC_SIZE;
+        dhcp_request->hops           = 0;
+        dhcp_request->transaction_id = htonl(transaction_id);
+        dhcp_request->seconds        = htons(seconds_elapsed);
+        dhcp_request->flags          = htons(0x8000);
+
+        /* client  IP address  = 0  */
+        /* your    IP address  = 0  */
+        /* server  IP address  = 0  */
+        /* gateway IP address  = 0  */
+
+        /* client hardware address */
+        memcpy((char*)dhcp_request->client_hw_addr, (char*)ethernet->host_mac, ETHER_MAC_SIZE);
+
+        /* Client hardware address padding = 0 */
+        /* Client Server host name         = 0 */
+        /* Client file name                = 0 */
+
+        /* Configure DHCP options, (53, 55, 61, 50, 54, 51) */
+        dhcp_option_builder_init(&request_opts, dhcp_request, DHCP_MESSAGE_SIZE);
+
+        dhcp_option_add_client(&request_opts, DHCP_REQUEST, ethernet->host_mac);
+
+        dhcp_option_add(&request_opts, DHCP_REQUESTED_IP, ETHER_IPV4_SIZE, requested_ip);
+        dhcp_option_add(&request_opts, DHCP_SERVER_IDENTIFIER, ETHER_IPV4_SIZE, server_ip);
+
+        if(lease_time)
+            dhcp_option_add_u32(&request_opts, DHCP_ADDR_LEASE_TIME, lease_time);
+
+        message_length = dhcp_option_end(&request_opts);
+
+
+        /* Configure sources */
+        memset(&dhcp_client, 0, sizeof(ether_source_t));
+
+        dhcp_client.identifier  = 1;
+        dhcp_client.source_port = DHCP_SOURCE_PORT;
+
+        memcpy((char*)dhcp_client.source_mac, (char*)ethernet->host_mac, ETHER_MAC_SIZE);
+
+        /* Configure destination address */
+        memcpy((char*)destination_ip, (char*)ethernet->broadcast_ip, ETHER_IPV4_SIZE);
+        memcpy((char*)destination_mac, (char*)ethernet->broadcast_mac, ETHER_MAC_SIZE);
+
+
+        /* Send DHCP packet as UPD message */
+        ether_send_udp_raw(ethernet, &dhcp_client, destination_ip, destination_mac, DHCP_DESTINATION_PORT,
+                           (uint8_t*)dhcp_request, message_length);
+    }
+
+    return func_retval;
+}
+
+
+
+
+
+/*************************************************************
+ * @brief   Static function to send DHCP renew request, unicast
+ *          to server when renewing, broadcast when rebinding
+ *          (client IP set, no server identifier, RFC 2131),
+ *          broadcast with requested IP when rebooting
+ * @param   *dhcp           : reference to DHCP client handle
+ * @param   seconds_elapsed : number of seconds elapsed
+ * @retval  int8_t          : Error = -1, Success = 0
+ *************************************************************/
+static int8_t ether_dhcp_send_renew(dhcp_client_t *dhcp, uint16_t seconds_elapsed)
+{
+    int8_t func_retval = 0;
+
+    ethernet_handle_t    *ethernet;
+    net_dhcp_t         *dhcp_request;
+    dhcp_opt_builder_t  renew_opts;
+    ether_source_t      dhcp_client;
+
+    uint8_t destination_ip[4]  = {0};
+    uint8_t destination_mac[6] = {0};
+
+    uint16_t message_length = 0;
+
+    char data[DHCP_MESSAGE_SIZE] = {0};
+
+    if(dhcp == NULL || dhcp->ethernet == NULL)
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        ethernet = dhcp->ethernet;
+
+        /* Configure DHCP fields */
+        dhcp_request = (net_dhcp_t*)data;
+
+        dhcp_request->op_code        = DHCP_BOOT_REQ;
+        dhcp_request->hw_type        = 1;
+        dhcp_request->hw_length      = ETHER_MAC_SIZE;
+        dhcp_request->hops           = 0;
+        dhcp_request->transaction_id = htonl(dhcp->transaction_id);
+        dhcp_request->seconds        = htons(seconds_elapsed);
+        dhcp_request->flags          = 0;
+
+        /* client IP address, lease is extended for this address, 0 when rebooting */
+        if(dhcp->state == DHCP_REBOOTING_STATE)
+            dhcp_request->flags = htons(0x8000);
+        else
+            memcpy((char*)dhcp_request->client_ip, (char*)ethernet->host_ip, ETHER_IPV4_SIZE);
+
+        /* client hardware address */
+        memcpy((char*)dhcp_request->client_hw_addr, (char*)ethernet->host_mac, ETHER_MAC_SIZE);
+
+        /* Configure DHCP options, (53, 55, 61) */
+        dhcp_option_builder_init(&renew_opts, dhcp_request, DHCP_MESSAGE_SIZE);
+
+        dhcp_option_add_client(&renew_opts, DHCP_REQUEST, ethernet->host_mac);
+
+        /* option (50), saved address requested when rebooting (RFC 2131 3.2) */
+        if(dhcp->state == DHCP_REBOOTING_STATE)
+            dhcp_option_add(&renew_opts, DHCP_REQUESTED_IP, ETHER_IPV4_SIZE, dhcp->your_ip);
+
+        message_length = dhcp_option_end(&renew_opts);
+
+        /* Configure sources */
+        memset(&dhcp_client, 0, sizeof(ether_source_t));
+
+        dhcp_client.identifier  = 1;
+        dhcp_client.source_port = DHCP_SOURCE_PORT;
 
         memcpy((char*)dhcp_client.source_mac, (char*)ethernet->host_mac, ETHER_MAC_SIZE);
+        memcpy((char*)dhcp_client.source_ip, (char*)ethernet->host_ip, ETHER_IPV4_SIZE);
+
+        /* Configure destination address, server MAC from ARP table or broadcast */
+        if(dhcp->state == DHCP_RENEWING_STATE)
+        {
+            memcpy((char*)destination_ip, (char*)dhcp->server_ip, ETHER_IPV4_SIZE);
+
+            if(ether_arp_resolve_next_hop(ethernet, destination_mac, destination_ip) == 0)
+                memcpy((char*)destination_mac, (char*)ethernet->broadcast_mac, ETHER_MAC_SIZE);
+        }
+        else
+        {
+            memcpy((char*)destination_ip, (char*)ethernet->broadcast_ip, ETHER_IPV4_SIZE);
+            memcpy((char*)destination_mac, (char*)ethernet->broadcast_mac, ETHER_MAC_SIZE);
+        }
+
+
+        /* Send DHCP packet as UPD message */
+        ether_send_udp_raw(ethernet, &dhcp_client, destination_ip, destination_mac, DHCP_DESTINATION_PORT,
+                           (uint8_t*)dhcp_request, message_length);
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*************************************************************
+ * @brief   Static function to get saved lease checksum
+ * @param   *record : reference to saved lease
+ * @retval  uint16_t : checksum
+ *************************************************************/
+static uint16_t dhcp_lease_checksum(dhcp_lease_record_t *record)
+{
+    uint32_t sum = 0;
+
+    ether_sum_words(&sum, record, sizeof(dhcp_lease_record_t) - sizeof(record->checksum));
+
+    return ether_get_checksum(sum);
+}
+
+
+
+
+/*************************************************************
+ * @brief   Static function to save bound lease and gateway
+ *          MAC address to nonvolatile storage, written only
+ *          if changed
+ * @param   *dhcp : reference to DHCP client handle
+ * @retval  int8_t : Error = 0, Success = 1
+ *************************************************************/
+static int8_t dhcp_save_lease(dhcp_client_t *dhcp)
+{
+    int8_t func_retval = 0;
+
+    ethernet_handle_t  *ethernet;
+    dhcp_lease_record_t record;
+    dhcp_lease_record_t saved_record;
+
+    ethernet = dhcp->ethernet;
+
+    memset(&record, 0, sizeof(dhcp_lease_record_t));
+
+    record.magic      = DHCP_LEASE_MAGIC;
+    record.lease_time = dhcp->lease_time;
+
+    memcpy(record.host_mac, ethernet->host_mac, ETHER_MAC_SIZE);
+    memcpy(record.your_ip, dhcp->your_ip, ETHER_IPV4_SIZE);
+    memcpy(record.server_ip, dhcp->server_ip, ETHER_IPV4_SIZE);
+    memcpy(record.subnet_mask, ethernet->subnet_mask, ETHER_IPV4_SIZE);
+    memcpy(record.gateway_ip, ethernet->gateway_ip, ETHER_IPV4_SIZE);
+
+    dhcp->lease_saved = ether_arp_resolve_address(ethernet, record.gateway_mac, record.gateway_ip);
+
+    record.checksum = dhcp_lease_checksum(&record);
+
+    /* Skip write if unchanged, (EEPROM wear) */
+    if(ethernet->ether_commands->nv_read(DHCP_LEASE_NV_OFFSET, &saved_record, sizeof(dhcp_lease_record_t)) && \
+       memcmp(&saved_record, &record, sizeof(dhcp_lease_record_t)) == 0)
+    {
+        func_retval = 1;
+    }
+    else
+    {
+        func_retval = ethernet->ether_commands->nv_write(DHCP_LEASE_NV_OFFSET, &record, sizeof(dhcp_lease_record_t));
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*************************************************************
+ * @brief   Static function to load lease saved for this host,
+ *          saved gateway is added to ARP table
+ * @param   *dhcp : reference to DHCP client handle
+ * @retval  int8_t : Error = 0 (no saved lease), Success = 1
+ *************************************************************/
+static int8_t dhcp_load_lease(dhcp_client_t *dhcp)
+{
+    int8_t func_retval = 0;
+
+    ethernet_handle_t  *ethernet;
+    dhcp_lease_record_t record;
+
+    uint8_t empty_mac[ETHER_MAC_SIZE] = {0};
+
+    ethernet = dhcp->ethernet;
+
+    if(ethernet->ether_commands->nv_read(DHCP_LEASE_NV_OFFSET, &record, sizeof(dhcp_lease_record_t)) == 0)
+    {
+        func_retval = 0;
+    }
+    else if(record.magic != DHCP_LEASE_MAGIC || record.checksum != dhcp_lease_checksum(&record) || \
+            memcmp(record.host_mac, ethernet->host_mac, ETHER_MAC_SIZE) != 0)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        memcpy(dhcp->your_ip, record.your_ip, ETHER_IPV4_SIZE);
+        memcpy(dhcp->server_ip, record.server_ip, ETHER_IPV4_SIZE);
+
+        dhcp->lease_time = record.lease_time;
+
+        memcpy(ethernet->subnet_mask, record.subnet_mask, ETHER_IPV4_SIZE);
+        memcpy(ethernet->gateway_ip, record.gateway_ip, ETHER_IPV4_SIZE);
+
+        ip_route_cache_flush();
+
+        /* Gateway reachable without ARP request after ACK */
+        if(memcmp(record.gateway_mac, empty_mac, ETHER_MAC_SIZE) != 0)
+            ether_arp_add_entry(ethernet, record.gateway_ip, record.gateway_mac);
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*************************************************************
+ * @brief   Static expiry function of DHCP retransmission timer
+ * @param   *timer   : Reference to network timer
+ * @param   *context : Reference to DHCP client handle
+ * @retval  None
+ *************************************************************/
+static void dhcp_retransmit_timeout(net_timer_t *timer, void *context)
+{
+    dhcp_client_t *dhcp = context;
+
+    (void)timer;
+
+    dhcp->timer_events |= DHCP_TIMER_RETRANSMIT;
+}
+
+
+
+
+/*************************************************************
+ * @brief   Static expiry function of DHCP lease timer
+ * @param   *timer   : Reference to network timer
+ * @param   *context : Reference to DHCP client handle
+ * @retval  None
+ *************************************************************/
+static void dhcp_lease_timeout(net_timer_t *timer, void *context)
+{
+    dhcp_client_t *dhcp = context;
+
+    (void)timer;
+
+    dhcp->timer_events |= DHCP_TIMER_LEASE;
+}
+
+
+
+
+/*************************************************************
+ * @brief   Static function to start DHCP lease timer, lease
+ *          times are seconds from lease start
+ * @param   *dhcp      : reference to DHCP client handle
+ * @param   time_now   : current time (ms)
+ * @param   lease_mark : T1, T2 or lease time (s)
+ * @retval  int8_t     : Error = 0, Success = 1
+ *************************************************************/
+static int8_t dhcp_start_lease_timer(dhcp_client_t *dhcp, uint32_t time_now, uint32_t lease_mark)
+{
+    int8_t func_retval = 0;
+
+    uint32_t elapsed = 0;
+
+    if(dhcp == NULL || dhcp->lease_time == DHCP_INFINITE_LEASE)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        if(lease_mark > DHCP_MAX_LEASE)
+            lease_mark = DHCP_MAX_LEASE;
 
-        /* Configure destination address */
-        memcpy((char*)destination_ip, (char*)ethernet->broadcast_ip, ETHER_IPV4_SIZE);
-        memcpy((char*)destination_mac, (char*)ethernet->broadcast_mac, ETHER_MAC_SIZE);
+        elapsed = time_now - dhcp->lease_start;
 
+        if(elapsed > lease_mark * 1000)
+            elapsed = lease_mark * 1000;
 
-        /* Send DHCP packet as UPD message */
-        ether_send_udp_raw(ethernet, &dhcp_client, destination_ip, destination_mac, DHCP_DESTINATION_PORT,
-                           (uint8_t*)dhcp_request, (DHCP_FRAME_SIZE + DHCP_REQUEST_OPTS_SIZE));
+        func_retval = net_timer_start(&dhcp->lease_timer, lease_mark * 1000 - elapsed);
     }
 
     return func_retval;
@@ -642,162 +1246,591 @@ int8_t ether_dhcp_send_request(ethernet_handle_t *ethernet, uint32_t transaction
 
 
 
-
 /*************************************************************
- * @brief   Function to get IP though DHCP state machine
- * @param   *ethernet     : reference to the Ethernet handle
- * @param   *network_data : network data from PHY
- *
- * @param   dhcp_state    : DHCP state machine states
- * @retval  uint8_t       : Error = NA, Success = NA
+ * @brief   Static function to send DHCP message of current
+ *          state and start retransmission timer, DISCOVER and
+ *          REQUEST back off exponentially, renew and rebind
+ *          requests are resent after half the time left
+ * @param   *dhcp    : reference to DHCP client handle
+ * @param   time_now : current time (ms)
+ * @retval  int8_t   : Error = 0, Success = 1
  *************************************************************/
-int8_t ether_get_dhcp_ip(ethernet_handle_t *ethernet, uint8_t *network_data, uint8_t *mac_address,
-                         dhcp_states dhcp_state)
+static int8_t dhcp_send(dhcp_client_t *dhcp, uint32_t time_now)
 {
+    int8_t func_retval = 0;
 
-    dhcp_offer_opts_t *offer_options;
-
-    uint8_t your_ip[4]       = {0};
-    uint8_t server_ip[4]     = {0};
-    uint8_t subnet_mask[4]   = {0};
-    uint8_t dhcp_options[60] = {0};
-
-    int8_t   dhcp_type         = 0;
-    uint8_t  dhcp_request_flag = 0;
-    uint8_t  dhcp_loop         = 1;
+    ethernet_handle_t *ethernet;
 
-    uint32_t dhcp_transac_id   = get_random_port_l(ethernet, 65535);
+    uint16_t seconds_elapsed = 0;
+    uint32_t time_left       = 0;
+    int32_t  jitter          = 0;
 
-    dhcp_state = DHCP_INIT_STATE;
+    if(dhcp == NULL || dhcp->ethernet == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        ethernet = dhcp->ethernet;
 
-    uint32_t lease_time = 0;
+        seconds_elapsed = (time_now - dhcp->exchange_start) / 1000;
 
-    while(dhcp_loop)
-    {
-        switch(dhcp_state)
+        switch(dhcp->state)
         {
 
         case DHCP_INIT_STATE:
+        case DHCP_SELECTING_STATE:
 
-            ethernet->status.mode_dhcp_init = 1;
+            ether_dhcp_send_discover(ethernet, dhcp->transaction_id, ethernet->host_mac, seconds_elapsed);
 
-            dhcp_state = DHCP_SELECTING_STATE;
+            dhcp->state = DHCP_SELECTING_STATE;
 
             break;
 
 
-        case DHCP_SELECTING_STATE:
+        case DHCP_REQUESTING_STATE:
 
-            ether_dhcp_send_discover(ethernet, dhcp_transac_id, mac_address, 0);
+            /* No ACK, restart from INIT (RFC 2131 4.4.1) */
+            if(dhcp->retries >= DHCP_REQUEST_RETRIES)
+            {
+                dhcp->state              = DHCP_SELECTING_STATE;
+                dhcp->retries            = 0;
+                dhcp->retransmit_timeout = DHCP_INITIAL_RTO;
 
-            dhcp_state = DHCP_READ_STATE;
+                ether_dhcp_send_discover(ethernet, dhcp->transaction_id, ethernet->host_mac, seconds_elapsed);
+            }
+            else
+            {
+                ether_dhcp_send_request(ethernet, dhcp->transaction_id, seconds_elapsed, dhcp->server_ip,
+                                        dhcp->your_ip, dhcp->lease_time);
 
-            break;
+                dhcp->retries++;
+            }
 
+            break;
 
-        case DHCP_READ_STATE:
 
-            dhcp_type = ether_dhcp_read(ethernet, (uint8_t*)network_data, your_ip, dhcp_transac_id, dhcp_options);
+        case DHCP_RENEWING_STATE:
+        case DHCP_REBINDING_STATE:
 
-            /* Handle DHCP offer */
-            if(dhcp_type == DHCP_OFFER && ethernet->status.mode_dhcp_init == 1 &&  dhcp_request_flag == 0)
-            {
-                /* Get server_ip, SUBNET mask, lease time from DHCP offer options */
-                offer_options = (void*)dhcp_options;
+            ether_dhcp_send_renew(dhcp, seconds_elapsed);
 
-                memcpy(server_ip, offer_options->server_identifier.server_ip, ETHER_IPV4_SIZE);
-                memcpy(subnet_mask, offer_options->subnet_mask.subnet_mask, ETHER_IPV4_SIZE);
+            break;
 
-                lease_time = ntohl(offer_options->lease_time.lease_time);
 
-                dhcp_state = DHCP_REQUESTING_STATE;
-                break;
+        case DHCP_REBOOTING_STATE:
 
-            }
-            /* Handle DHCP ACK */
-            else if(dhcp_type == DHCP_ACK &&  dhcp_request_flag == 1)
-            {
-                dhcp_state = DHCP_ACK_STATE;
-                break;
-            }
-            /* Handle DHCP offer or request not received conditions */
-            else if(dhcp_request_flag == 1)
+            /* No reply to saved address, server may be down or moved, discover */
+            if(dhcp->retries >= DHCP_REBOOT_RETRIES)
             {
-                dhcp_state = DHCP_REQUESTING_STATE;
-                break;
+                dhcp->state              = DHCP_SELECTING_STATE;
+                dhcp->transaction_id     = get_random_port_l(ethernet, 65535);
+                dhcp->exchange_start     = time_now;
+                dhcp->retries            = 0;
+                dhcp->retransmit_timeout = DHCP_INITIAL_RTO;
+
+                ether_dhcp_send_discover(ethernet, dhcp->transaction_id, ethernet->host_mac, 0);
             }
-            else if(ethernet->status.mode_dhcp_init == 1)
+            else
             {
-                dhcp_state = DHCP_SELECTING_STATE;
+                ether_dhcp_send_renew(dhcp, seconds_elapsed);
+
+                dhcp->retries++;
             }
 
+            break;
+
+
+        default:
 
             break;
 
+        }
 
-        case DHCP_REQUESTING_STATE:
 
-            ether_dhcp_send_request(ethernet, dhcp_transac_id, 1, server_ip, your_ip, lease_time);
+        if(dhcp->state == DHCP_RENEWING_STATE || dhcp->state == DHCP_REBINDING_STATE)
+        {
+            /* Half the time to T2 or lease expiry, at least 60 s (RFC 2131 4.4.5) */
+            time_left = (dhcp->state == DHCP_RENEWING_STATE ? dhcp->rebind_time : dhcp->lease_time);
 
-            dhcp_request_flag = 1;
+            if(time_left > DHCP_MAX_LEASE)
+                time_left = DHCP_MAX_LEASE;
 
-            dhcp_state = DHCP_READ_STATE;
+            if(time_left * 1000 > time_now - dhcp->lease_start)
+                time_left = time_left * 1000 - (time_now - dhcp->lease_start);
+            else
+                time_left = 0;
 
-            break;
+            dhcp->retransmit_timeout = time_left / 2;
 
+            if(dhcp->retransmit_timeout < DHCP_MIN_RENEW_RTO)
+                dhcp->retransmit_timeout = DHCP_MIN_RENEW_RTO;
 
-        case DHCP_ACK_STATE:
+            net_timer_start(&dhcp->retransmit_timer, dhcp->retransmit_timeout);
+        }
+        else
+        {
+            /* Exponential backoff, randomized by +/- 1 s */
+            jitter = (int32_t)(get_random_port_l(ethernet, 0) % (2 * DHCP_RTO_JITTER + 1)) - DHCP_RTO_JITTER;
 
-            dhcp_request_flag = 0;
+            net_timer_start(&dhcp->retransmit_timer, dhcp->retransmit_timeout + jitter);
 
-            memcpy((char*)ethernet->host_ip, (char*)your_ip, 4);
+            dhcp->retransmit_timeout <<= 1;
 
-            memcpy((char*)ethernet->gateway_ip, (char*)server_ip, 4);
+            if(dhcp->retransmit_timeout > DHCP_MAX_RTO)
+                dhcp->retransmit_timeout = DHCP_MAX_RTO;
+        }
 
-            memcpy((char*)ethernet->subnet_mask, (char*)subnet_mask, 4);
+        func_retval = 1;
+    }
 
-            ethernet->lease_time = lease_time;
+    return func_retval;
+}
 
-            dhcp_state = DHCP_BOUND_STATE;
 
-            break;
 
 
-        case DHCP_BOUND_STATE:
+/*************************************************************
+ * @brief   Static function to restart DHCP client from INIT,
+ *          leased address is released
+ * @param   *dhcp     : reference to DHCP client handle
+ * @param   time_now  : current time (ms)
+ * @param   delay_ms  : DISCOVER delay (ms), 0 = send now
+ * @retval  int8_t    : Error = 0, Success = 1
+ *************************************************************/
+static int8_t dhcp_restart(dhcp_client_t *dhcp, uint32_t time_now, uint32_t delay_ms)
+{
+    int8_t func_retval = 0;
 
-            ethernet->status.mode_dhcp_init  = 0;
-            ethernet->status.mode_dhcp_bound = 1;
-            ethernet->status.mode_dynamic    = 1;
+    ethernet_handle_t *ethernet;
 
-            dhcp_loop =  0;
+    if(dhcp == NULL || dhcp->ethernet == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        ethernet = dhcp->ethernet;
 
-            ether_send_arp_req(ethernet, ethernet->host_ip, ethernet->gateway_ip);
+        net_timer_stop(&dhcp->lease_timer);
 
-            if(ether_is_arp(ethernet, (uint8_t*)network_data, 128))
-            {
+        ether_arp_probe_stop(&dhcp->arp_probe);
 
-                ether_handle_arp_resp_req(ethernet);
+        /* Address lost, stop using it */
+        if(ethernet->status.mode_dhcp_bound)
+        {
+            memset(ethernet->host_ip, 0, ETHER_IPV4_SIZE);
 
-            }
+            ethernet->lease_time = 0;
 
+            ip_route_cache_flush();
 
-            break;
+            ethernet->status.mode_dhcp_bound = 0;
 
+            if(dhcp->callback != NULL)
+                dhcp->callback(ethernet, DHCP_EVENT_LOST);
+        }
 
-        default:
+        ethernet->status.mode_dhcp_init = 1;
 
-            dhcp_loop =  0;
+        dhcp->state              = DHCP_INIT_STATE;
+        dhcp->transaction_id     = get_random_port_l(ethernet, 65535);
+        dhcp->exchange_start     = time_now;
+        dhcp->retransmit_timeout = DHCP_INITIAL_RTO;
+        dhcp->retries            = 0;
 
-            break;
+        if(delay_ms)
+        {
+            /* DISCOVER sent on retransmission timeout */
+            dhcp->state = DHCP_SELECTING_STATE;
 
+            func_retval = net_timer_start(&dhcp->retransmit_timer, delay_ms);
         }
+        else
+        {
+            func_retval = dhcp_send(dhcp, time_now);
+        }
+    }
+
+    return func_retval;
+}
+
+
 
+
+/*************************************************************
+ * @brief   Static function to handle DHCP server reply
+ * @param   *dhcp      : reference to DHCP client handle
+ * @param   *your_ip   : 'your IP' address from reply
+ * @param   *options   : DHCP options data
+ * @param   time_now   : current time (ms)
+ * @retval  int8_t     : Error = 0, Success = 1
+ *************************************************************/
+static int8_t dhcp_input(dhcp_client_t *dhcp, uint8_t *your_ip, uint8_t *options, uint32_t time_now)
+{
+    int8_t func_retval = 0;
+
+    ethernet_handle_t *ethernet;
+    dhcp_event_t       event;
+    dhcp_options_t     parsed;
+
+    ethernet = dhcp->ethernet;
+
+    if(ether_dhcp_parse_options(options, DHCP_OPTIONS_SIZE, &parsed) == 0)
+    {
+        func_retval = 0;
     }
+    else if(parsed.message_type == DHCP_OFFER && dhcp->state == DHCP_SELECTING_STATE && \
+            (parsed.present & DHCP_OPT_SERVER_ID))
+    {
+        /* First offer is accepted */
+        memcpy(dhcp->your_ip, your_ip, ETHER_IPV4_SIZE);
+        memcpy(dhcp->server_ip, parsed.server_id, ETHER_IPV4_SIZE);
 
+        dhcp->lease_time = parsed.lease_time;
 
-    return 0;
+        dhcp->state              = DHCP_REQUESTING_STATE;
+        dhcp->retransmit_timeout = DHCP_INITIAL_RTO;
+        dhcp->retries            = 0;
+
+        func_retval = dhcp_send(dhcp, time_now);
+    }
+    else if(parsed.message_type == DHCP_ACK && (dhcp->state == DHCP_REQUESTING_STATE || dhcp->state == DHCP_REBOOTING_STATE || \
+            dhcp->state == DHCP_RENEWING_STATE || dhcp->state == DHCP_REBINDING_STATE))
+    {
+        net_timer_stop(&dhcp->retransmit_timer);
+
+        /* New address or lease extended for same address */
+        event = DHCP_EVENT_BOUND;
+
+        if(ethernet->status.mode_dhcp_bound && memcmp(ethernet->host_ip, your_ip, ETHER_IPV4_SIZE) == 0)
+            event = DHCP_EVENT_RENEWED;
+
+        memcpy(dhcp->your_ip, your_ip, ETHER_IPV4_SIZE);
+
+        if(parsed.present & DHCP_OPT_SERVER_ID)
+            memcpy(dhcp->server_ip, parsed.server_id, ETHER_IPV4_SIZE);
+
+        if(parsed.present & DHCP_OPT_LEASE_TIME)
+            dhcp->lease_time = parsed.lease_time;
+
+        /* Lease times, T1 = 0.5 and T2 = 0.875 of lease by default (RFC 2131 4.4.5) */
+        dhcp->renew_time  = dhcp->lease_time / 2;
+        dhcp->rebind_time = dhcp->lease_time - dhcp->lease_time / 8;
+
+        if((parsed.present & DHCP_OPT_REBIND_TIME) && parsed.rebind_time < dhcp->lease_time)
+            dhcp->rebind_time = parsed.rebind_time;
+
+        if((parsed.present & DHCP_OPT_RENEWAL_TIME) && parsed.renew_time < dhcp->rebind_time)
+            dhcp->renew_time = parsed.renew_time;
+
+        /* Server T1 after default T2, (T2 only given) */
+        if(dhcp->renew_time >= dhcp->rebind_time)
+            dhcp->renew_time = dhcp->rebind_time / 2;
+
+        dhcp->lease_start = time_now;
+
+        memcpy(&dhcp->options, &parsed, sizeof(dhcp_options_t));
+
+        /* Configure interface, gateway is router option or DHCP server */
+        memcpy((char*)ethernet->host_ip, (char*)dhcp->your_ip, ETHER_IPV4_SIZE);
+
+        if(parsed.present & DHCP_OPT_SUBNET_MASK)
+            memcpy((char*)ethernet->subnet_mask, (char*)parsed.subnet_mask, ETHER_IPV4_SIZE);
+
+        if(parsed.present & DHCP_OPT_ROUTER)
+            memcpy((char*)ethernet->gateway_ip, (char*)parsed.router, ETHER_IPV4_SIZE);
+        else
+            memcpy((char*)ethernet->gateway_ip, (char*)dhcp->server_ip, ETHER_IPV4_SIZE);
+
+        if(parsed.present & DHCP_OPT_DNS_SERVER)
+            memcpy((char*)ethernet->dns_ip, (char*)parsed.dns_server[0], ETHER_IPV4_SIZE);
+
+        /* Interface routes changed, (subnet and gateway) */
+        ip_route_cache_flush();
+
+        /* Smaller MTU on this network, (TCP MSS follows) */
+        if((parsed.present & DHCP_OPT_INTERFACE_MTU) && parsed.interface_mtu >= DHCP_MIN_MTU && \
+           parsed.interface_mtu <= ETHER_DEFAULT_MTU)
+        {
+            ethernet->mtu = parsed.interface_mtu;
+        }
+
+        ethernet->lease_time = dhcp->lease_time;
+
+        ethernet->status.mode_dhcp_init  = 0;
+        ethernet->status.mode_dhcp_bound = 1;
+        ethernet->status.mode_dynamic    = 1;
+
+        dhcp->state = DHCP_BOUND_STATE;
+
+        dhcp_start_lease_timer(dhcp, time_now, dhcp->renew_time);
+
+        if(event == DHCP_EVENT_BOUND || dhcp->lease_saved == 0)
+            dhcp_save_lease(dhcp);
+
+        /* Update neighbour caches, server has checked address (RFC 5227 2.3) */
+        if(event == DHCP_EVENT_BOUND)
+            ether_arp_probe_start(ethernet, &dhcp->arp_probe, dhcp->your_ip, 0);
+
+        if(dhcp->callback != NULL)
+            dhcp->callback(ethernet, event);
+
+        func_retval = 1;
+    }
+    else if(parsed.message_type == DHCP_NAK && dhcp->state == DHCP_REBOOTING_STATE)
+    {
+        /* Saved address not valid on this network, discover now (RFC 2131 3.2) */
+        func_retval = dhcp_restart(dhcp, time_now, 0);
+    }
+    else if(parsed.message_type == DHCP_NAK && (dhcp->state == DHCP_REQUESTING_STATE || \
+            dhcp->state == DHCP_RENEWING_STATE || dhcp->state == DHCP_REBINDING_STATE))
+    {
+        /* Address refused, wait before next DISCOVER, (server may refuse every request) */
+        func_retval = dhcp_restart(dhcp, time_now, DHCP_NAK_DELAY);
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*************************************************************
+ * @brief   Static function to queue DHCP server reply read
+ *          by net_poll(), handled by ether_dhcp_poll(), first
+ *          reply kept until handled
+ * @param   *ethernet : reference to the Ethernet handle
+ * @param   *context  : reference to DHCP client handle
+ * @param   batch_end : 1 = end of net_poll() batch
+ * @retval  uint8_t   : Not consumed = 0, Consumed = 1
+ *************************************************************/
+static uint8_t dhcp_net_input(ethernet_handle_t *ethernet, void *context, uint8_t batch_end)
+{
+    uint8_t func_retval = 0;
+
+    dhcp_client_t *dhcp = context;
+
+    int8_t reply_type = 0;
+
+    /* Server reply expected only while not bound */
+    if(batch_end == 0 && dhcp->state != DHCP_BOUND_STATE && dhcp->rx_type == 0)
+    {
+        reply_type = dhcp_read_reply(ethernet, dhcp->rx_your_ip, dhcp->transaction_id, dhcp->rx_options);
+
+        if(reply_type > 0)
+        {
+            dhcp->rx_type = reply_type;
+
+            func_retval = 1;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*************************************************************
+ * @brief   Function to start non blocking DHCP client,
+ *          DISCOVER is sent from ether_dhcp_poll()
+ * @param   *ethernet : reference to the Ethernet handle
+ * @param   *dhcp     : reference to DHCP client handle
+ * @param   callback  : address change callback (optional)
+ * @retval  int8_t    : Error = 0, Success = 1
+ *************************************************************/
+int8_t ether_dhcp_start(ethernet_handle_t *ethernet, dhcp_client_t *dhcp, dhcp_callback_t callback)
+{
+    int8_t func_retval = 0;
+
+    if(ethernet == NULL || dhcp == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        /* Announcement of previous lease still linked to handle */
+        if(ethernet->arp_probe == &dhcp->arp_probe)
+            ether_arp_probe_stop(&dhcp->arp_probe);
+
+        memset(dhcp, 0, sizeof(dhcp_client_t));
+
+        dhcp->ethernet = ethernet;
+        dhcp->callback = callback;
+        dhcp->state    = DHCP_INIT_STATE;
+
+        net_timer_init(&dhcp->retransmit_timer, dhcp_retransmit_timeout, dhcp);
+        net_timer_init(&dhcp->lease_timer, dhcp_lease_timeout, dhcp);
+
+        /* Server replies read by net_poll() */
+        ethernet->udp_input   = dhcp_net_input;
+        ethernet->udp_context = dhcp;
+
+        /* Fast boot, request saved address first, REQUEST sent from ether_dhcp_poll() */
+        if(dhcp_load_lease(dhcp))
+        {
+            ethernet->status.mode_dhcp_init = 1;
+
+            dhcp->state              = DHCP_REBOOTING_STATE;
+            dhcp->transaction_id     = get_random_port_l(ethernet, 65535);
+            dhcp->retransmit_timeout = DHCP_INITIAL_RTO;
+        }
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*************************************************************
+ * @brief   Function to run DHCP client, call from the
+ *          application poll loop, sends and retransmits
+ *          DHCP messages, renews (T1) and rebinds (T2) lease,
+ *          handles server reply read by net_poll()
+ * @param   *dhcp         : reference to DHCP client handle
+ * @param   *network_data : network data from PHY
+ * @retval  int8_t        : Error = 0, Success = DHCP state
+ *************************************************************/
+int8_t ether_dhcp_poll(dhcp_client_t *dhcp, uint8_t *network_data)
+{
+    int8_t func_retval = 0;
+
+    ethernet_handle_t *ethernet;
+
+    uint8_t gateway_mac[ETHER_MAC_SIZE] = {0};
+
+    uint32_t time_now = 0;
+
+    if(dhcp == NULL || dhcp->ethernet == NULL || network_data == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        ethernet = dhcp->ethernet;
+
+        time_now = ethernet->ether_commands->get_time_ms();
+
+        net_timer_run(time_now);
+
+        if(dhcp->state == DHCP_INIT_STATE)
+        {
+            dhcp_restart(dhcp, time_now, 0);
+        }
+        else if(dhcp->state == DHCP_REBOOTING_STATE && dhcp->retries == 0)
+        {
+            dhcp->exchange_start = time_now;
+
+            dhcp_send(dhcp, time_now);
+        }
+
+        /* Second gratuitous ARP */
+        if(dhcp->arp_probe.state == ARP_PROBE_ANNOUNCING)
+            ether_arp_probe_poll(&dhcp->arp_probe, network_data);
+
+        /* Save gateway MAC once resolved, used on next boot */
+        if(dhcp->state == DHCP_BOUND_STATE && dhcp->lease_saved == 0 && \
+           ether_arp_resolve_address(ethernet, gateway_mac, ethernet->gateway_ip))
+        {
+            dhcp_save_lease(dhcp);
+        }
+
+        /* T1 renew, T2 rebind, lease expiry */
+        if(dhcp->timer_events & DHCP_TIMER_LEASE)
+        {
+            dhcp->timer_events &= ~DHCP_TIMER_LEASE;
+
+            if(dhcp->state == DHCP_BOUND_STATE)
+            {
+                dhcp->state          = DHCP_RENEWING_STATE;
+                dhcp->transaction_id = get_random_port_l(ethernet, 65535);
+                dhcp->exchange_start = time_now;
+
+                dhcp_start_lease_timer(dhcp, time_now, dhcp->rebind_time);
+
+                dhcp_send(dhcp, time_now);
+            }
+            else if(dhcp->state == DHCP_RENEWING_STATE)
+            {
+                dhcp->state = DHCP_REBINDING_STATE;
+
+                dhcp_start_lease_timer(dhcp, time_now, dhcp->lease_time);
+
+                dhcp_send(dhcp, time_now);
+            }
+            else if(dhcp->state == DHCP_REBINDING_STATE)
+            {
+                dhcp_restart(dhcp, time_now, 0);
+            }
+        }
+
+        /* Retransmission, stale expiry after state change is ignored */
+        if(dhcp->timer_events & DHCP_TIMER_RETRANSMIT)
+        {
+            dhcp->timer_events &= ~DHCP_TIMER_RETRANSMIT;
+
+            if(dhcp->state != DHCP_BOUND_STATE)
+                dhcp_send(dhcp, time_now);
+        }
+
+        /* Server reply queued by net_poll() */
+        if(dhcp->rx_type)
+        {
+            if(dhcp->state != DHCP_BOUND_STATE)
+                dhcp_input(dhcp, dhcp->rx_your_ip, dhcp->rx_options, time_now);
+
+            dhcp->rx_type = 0;
+        }
+
+        func_retval = dhcp->state;
+    }
+
+    return func_retval;
 }
 
 
 
 
+/*************************************************************
+ * @brief   Function to get IP though DHCP state machine,
+ *          blocks until bound, lease is renewed only by
+ *          client from ether_dhcp_start()
+ * @param   *ethernet     : reference to the Ethernet handle
+ * @param   *network_data : network data from PHY
+ * @retval  uint8_t       : Error = NA, Success = NA
+ *************************************************************/
+int8_t ether_get_dhcp_ip(ethernet_handle_t *ethernet, uint8_t *network_data)
+{
+
+    dhcp_client_t dhcp_client;
+
+    ether_dhcp_start(ethernet, &dhcp_client, NULL);
+
+    while(ether_dhcp_poll(&dhcp_client, network_data) != DHCP_BOUND_STATE)
+        net_poll(ethernet, network_data, ETHER_POLL_BUDGET);
+
+    /* Timers and receive handler are on the stack, not renewed */
+    net_timer_stop(&dhcp_client.retransmit_timer);
+    net_timer_stop(&dhcp_client.lease_timer);
+
+    ethernet->udp_input   = NULL;
+    ethernet->udp_context = NULL;
+
+    ether_arp_probe_stop(&dhcp_client.arp_probe);
+
+    ether_send_arp_req(ethernet, ethernet->host_ip, ethernet->gateway_ip);
+
+    if(ether_is_arp(ethernet, (uint8_t*)network_data, 128))
+    {
+
+        ether_handle_arp_resp_req(ethernet);
+
+    }
+
+
+    return 0;
+}
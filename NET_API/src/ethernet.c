@@ -45,12 +45,57 @@
  * Standard header and api header files
  */
 
+/* clock_gettime() and CLOCK_MONOTONIC with strict C99 host builds */
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <stdio.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "ethernet.h"
 #include "network_utilities.h"
+#include "arp.h"
+#include "ipv4.h"
+#include "icmp.h"
+
+
+
+
+/* Network interfaces, given by create_ethernet_handle() */
+static ethernet_handle_t interfaces[ETHER_MAX_INTERFACES];
+static uint8_t           interface_count = 0;
+
+
+
+/* Transmit queue slot, frame is copied while network device sends */
+typedef struct _ether_tx_slot
+{
+    ethernet_handle_t *ethernet;                                     /*!< Interface of queued frame, NULL = free */
+    uint16_t           length;                                       /*!< Frame length                           */
+    uint16_t           flow;                                         /*!< Local TCP/UDP port, (round robin)      */
+    uint8_t            tx_class;                                     /*!< Transmit class, ether_tx_class_t       */
+    uint8_t            order;                                        /*!< Queue order                            */
+    uint8_t            data[ETHER_MTU_SIZE - ETHER_PHY_DATA_OFFSET]; /*!< Frame, (largest frame of ether_obj)    */
+
+}ether_tx_slot_t;
+
+
+/* Transmit queue, shared by interfaces */
+static ether_tx_slot_t tx_queue[ETHER_TX_QUEUE_SIZE];
+
+
+/* Looped back frame of each interface, held until read by ether_get_data() */
+static uint8_t loopback_frame[ETHER_MAX_INTERFACES][ETHER_MTU_SIZE - ETHER_PHY_DATA_OFFSET];
 
 
 
@@ -67,6 +112,8 @@
 
 __attribute__((weak))int16_t ethernet_send_packet(uint8_t *data, uint16_t length)
 {
+    (void)data;
+    (void)length;
 
     return 0;
 }
@@ -74,6 +121,60 @@ __attribute__((weak))int16_t ethernet_send_packet(uint8_t *data, uint16_t length
 
 
 __attribute__((weak))uint16_t ethernet_recv_packet(uint8_t *data, uint16_t length)
+{
+    (void)data;
+    (void)length;
+
+    return 0;
+}
+
+
+
+__attribute__((weak))uint8_t ethernet_set_rx_filter(ether_rx_filter_t *filter)
+{
+    (void)filter;
+
+    return 0;
+}
+
+
+
+__attribute__((weak))uint16_t ethernet_recv_header(uint8_t *data, uint16_t length)
+{
+    (void)data;
+    (void)length;
+
+    return 0;
+}
+
+
+
+__attribute__((weak))uint16_t ethernet_recv_remaining(uint8_t *data, uint16_t length)
+{
+    (void)data;
+    (void)length;
+
+    return 0;
+}
+
+
+
+__attribute__((weak))void ethernet_drop_packet(void)
+{
+
+}
+
+
+
+__attribute__((weak))uint8_t ethernet_rx_pending(void)
+{
+
+    return 0;
+}
+
+
+
+__attribute__((weak))uint8_t ethernet_tx_busy(void)
 {
 
     return 0;
@@ -89,6 +190,151 @@ __attribute__((weak))uint16_t random_seed(void)
 
 
 
+__attribute__((weak))uint32_t network_time_ms(void)
+{
+#if defined(__unix__) || defined(__APPLE__)
+
+    /* Host builds, monotonic clock */
+    struct timespec time_now;
+
+    clock_gettime(CLOCK_MONOTONIC, &time_now);
+
+    return (uint32_t)(time_now.tv_sec * 1000 + time_now.tv_nsec / 1000000);
+#else
+
+    return 0;
+#endif
+}
+
+
+
+#if defined(__unix__) || defined(__APPLE__)
+
+/* Host builds, nonvolatile storage file */
+#define NETWORK_NV_FILE "network_nv.bin"
+
+#endif
+
+
+__attribute__((weak))uint8_t network_nv_read(uint16_t offset, void *data, uint16_t length)
+{
+    uint8_t func_retval = 0;
+
+#if defined(__unix__) || defined(__APPLE__)
+
+    FILE *nv_file;
+
+    nv_file = fopen(NETWORK_NV_FILE, "rb");
+
+    if(nv_file != NULL)
+    {
+        if(fseek(nv_file, offset, SEEK_SET) == 0 && fread(data, 1, length, nv_file) == length)
+            func_retval = 1;
+
+        fclose(nv_file);
+    }
+
+#endif
+
+    return func_retval;
+}
+
+
+
+__attribute__((weak))uint8_t network_nv_write(uint16_t offset, void *data, uint16_t length)
+{
+    uint8_t func_retval = 0;
+
+#if defined(__unix__) || defined(__APPLE__)
+
+    FILE *nv_file;
+
+    nv_file = fopen(NETWORK_NV_FILE, "r+b");
+
+    if(nv_file == NULL)
+        nv_file = fopen(NETWORK_NV_FILE, "w+b");
+
+    if(nv_file != NULL)
+    {
+        if(fseek(nv_file, offset, SEEK_SET) == 0 && fwrite(data, 1, length, nv_file) == length)
+            func_retval = 1;
+
+        fclose(nv_file);
+    }
+
+#endif
+
+    return func_retval;
+}
+
+
+
+
+/******************************************************
+ * @brief  Static function to sum data as 16 bit words,
+ *         first byte low (little endian targets), data
+ *         is copied to destination in the same pass.
+ *         Word wide, 16 bytes per step with SSE2 (host)
+ * @param  *sum          : Total 32 bit sum
+ * @param  *destination  : copy of data, NULL = sum only
+ * @param  *source       : data to be summed
+ * @param  size_in_bytes : size of the data
+ * @retval None
+ ******************************************************/
+static void ether_sum_block(uint32_t *sum, uint8_t *destination, uint8_t *source, uint16_t size_in_bytes)
+{
+    uint32_t total = 0;
+    uint32_t word  = 0;
+    uint16_t index = 0;
+
+#if defined(__SSE2__)
+
+    __m128i  block;
+    __m128i  lanes = _mm_setzero_si128();
+    __m128i  zero  = _mm_setzero_si128();
+    uint32_t lane_sum[4];
+
+    /* Words widened to 32 bit lanes, (no carry out for 64 KB) */
+    for(; index + 16 <= size_in_bytes; index += 16)
+    {
+        block = _mm_loadu_si128((__m128i*)(source + index));
+
+        if(destination != NULL)
+            _mm_storeu_si128((__m128i*)(destination + index), block);
+
+        lanes = _mm_add_epi32(lanes, _mm_unpacklo_epi16(block, zero));
+        lanes = _mm_add_epi32(lanes, _mm_unpackhi_epi16(block, zero));
+    }
+
+    _mm_storeu_si128((__m128i*)lane_sum, lanes);
+
+    total = lane_sum[0] + lane_sum[1] + lane_sum[2] + lane_sum[3];
+
+#endif
+
+    /* Unaligned 32 bit loads and stores, (memcpy of 4 bytes is one load or store) */
+    for(; index + 4 <= size_in_bytes; index += 4)
+    {
+        memcpy(&word, source + index, 4);
+
+        if(destination != NULL)
+            memcpy(destination + index, &word, 4);
+
+        total += (word & 0xFFFF) + (word >> 16);
+    }
+
+    for(; index < size_in_bytes; index++)
+    {
+        if(destination != NULL)
+            destination[index] = source[index];
+
+        total += (index & 1) ? (uint32_t)source[index] << 8 : source[index];
+    }
+
+    *sum += total;
+}
+
+
 
 /******************************************************
  * @brief  Function to sum the data in network packet
@@ -102,35 +348,150 @@ int8_t ether_sum_words(uint32_t *sum, void *data, uint16_t size_in_bytes)
 
     int8_t func_retval = 0;
 
-    uint8_t  *data_ptr = (uint8_t *)data;
+    if(data == NULL)
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        ether_sum_block(sum, NULL, data, size_in_bytes);
+    }
+
+    return func_retval;
+}
+
 
-    uint16_t data_temp;
-    uint8_t  phase = 0;
 
-    uint16_t i     = 0;
 
-    if(data == NULL)
+/******************************************************
+ * @brief  Function to copy data and sum it in one
+ *         pass, (same sum as ether_sum_words), data
+ *         must not partly overlap destination
+ * @param  *sum          : Total 32 bit sum
+ * @param  *destination  : copy of data
+ * @param  *source       : data to be copied and summed
+ * @param  size_in_bytes : size of the data
+ * @retval int8_t        : Error = -1, Success = 0
+ ******************************************************/
+int8_t ether_copy_sum(uint32_t *sum, void *destination, void *source, uint16_t size_in_bytes)
+{
+    int8_t func_retval = 0;
+
+    if(destination == NULL || source == NULL)
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        /* Data built in place is summed only */
+        ether_sum_block(sum, destination == source ? NULL : destination, source, size_in_bytes);
+    }
+
+    return func_retval;
+}
+
+
+
+
+/******************************************************
+ * @brief  Function to add sum of data that starts at
+ *         offset from summed data, sum of data at odd
+ *         offset is byte swapped (RFC 1071)
+ * @param  *sum     : Total 32 bit sum
+ * @param  part_sum : Sum of data at offset
+ * @param  offset   : Offset of data, (bytes)
+ * @retval int8_t   : Error = -1, Success = 0
+ ******************************************************/
+int8_t ether_sum_combine(uint32_t *sum, uint32_t part_sum, uint16_t offset)
+{
+    int8_t func_retval = 0;
+
+    if(sum == NULL)
     {
         func_retval = -1;
     }
     else
     {
-        for(i = 0; i < size_in_bytes; i++)
+        if(offset & 1)
+        {
+            while((part_sum >> 16) > 0)
+                part_sum = (part_sum & 0xFFFF) + (part_sum >> 16);
+
+            part_sum = ((part_sum & 0xFF) << 8) | (part_sum >> 8);
+        }
+
+        *sum += part_sum;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/******************************************************
+ * @brief  Function to get total length of fragments
+ * @param  *fragments     : Data fragments
+ * @param  fragment_count : Number of fragments
+ * @retval uint32_t       : Total length (bytes)
+ ******************************************************/
+uint32_t ether_iovec_length(net_iovec_t *fragments, uint8_t fragment_count)
+{
+    uint32_t func_retval = 0;
+
+    uint8_t index = 0;
+
+    if(fragments != NULL)
+    {
+        for(index = 0; index < fragment_count; index++)
+            func_retval += fragments[index].length;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/******************************************************
+ * @brief  Function to gather data fragments in order
+ *         into destination, data summed in the same
+ *         pass if sum is given (ether_copy_sum)
+ * @param  *destination   : Gathered data
+ * @param  *fragments     : Data fragments
+ * @param  fragment_count : Number of fragments
+ * @param  *sum           : Total 32 bit sum, NULL = copy only
+ * @retval uint32_t       : Bytes gathered
+ ******************************************************/
+uint32_t ether_gather(uint8_t *destination, net_iovec_t *fragments, uint8_t fragment_count, uint32_t *sum)
+{
+    uint32_t func_retval = 0;
+
+    uint32_t part_sum = 0;
+    uint8_t  index    = 0;
+
+    if(destination != NULL && fragments != NULL)
+    {
+        for(index = 0; index < fragment_count; index++)
         {
-            if(phase)
+            if(fragments[index].data == NULL || fragments[index].length == 0)
+                continue;
+
+            if(sum != NULL)
             {
-                data_temp = *data_ptr;
+                /* Fragment at odd offset is summed byte swapped */
+                part_sum = 0;
 
-                *sum += data_temp << 8;
+                ether_copy_sum(&part_sum, destination + func_retval, fragments[index].data, fragments[index].length);
+
+                ether_sum_combine(sum, part_sum, func_retval);
             }
             else
             {
-                *sum += *data_ptr;
+                memcpy(destination + func_retval, fragments[index].data, fragments[index].length);
             }
 
-            phase = 1 - phase;
-
-            data_ptr++;
+            func_retval += fragments[index].length;
         }
     }
 
@@ -244,7 +605,8 @@ int32_t get_random_port_l(ethernet_handle_t *ethernet, uint32_t lower_bound)
 
 /**************************************************************************
  * @brief  constructor function to create Ethernet handle
- *         (Multiple exit points)
+ *         (Multiple exit points), one handle per interface,
+ *         up to ETHER_MAX_INTERFACES
  * @param  *network_data  : reference to the network data buffer
  * @param  *mac_address   : MAC address (string)
  * @param  *ip_address    : ip address (string)
@@ -254,36 +616,46 @@ int32_t get_random_port_l(ethernet_handle_t *ethernet, uint32_t lower_bound)
 ethernet_handle_t* create_ethernet_handle(uint8_t *network_data, char *mac_address, char *ip_address, ether_operations_t *ether_ops)
 {
 
-    static ethernet_handle_t ethernet;
+    static char application_buffer[ETHER_MAX_INTERFACES][APP_BUFF_SIZE] = {{0}};
 
-    static char application_buffer[APP_BUFF_SIZE] = {0};
+    ethernet_handle_t *interface;
 
     int8_t api_retval = 0;
 
-    if(network_data == NULL)
+    if(network_data == NULL || interface_count >= ETHER_MAX_INTERFACES)
     {
         return NULL;
     }
     else
     {
+        /* Next free interface, (handles are not released) */
+        interface = &interfaces[interface_count];
+
+        interface->if_index = interface_count;
+
         /* Give starting address of network data to*/
-        ethernet.ether_obj = (void*)network_data;
+        interface->ether_obj = (void*)network_data;
 
         /* Set source addresses */
-        api_retval = set_mac_address(ethernet.host_mac, mac_address);
+        api_retval = set_mac_address(interface->host_mac, mac_address);
 
-        api_retval = set_ip_address(ethernet.host_ip, ip_address);
+        api_retval = set_ip_address(interface->host_ip, ip_address);
 
         /* Set default modes */
-        ethernet.status.mode_static        = 1;
-        ethernet.status.mode_dynamic       = 0;
-        ethernet.status.mode_dhcp_init     = 0;
-        ethernet.status.mode_read_blocking = ETHER_READ_BLOCK;
+        interface->status.mode_static        = 1;
+        interface->status.mode_dynamic       = 0;
+        interface->status.mode_dhcp_init     = 0;
+        interface->status.mode_read_blocking = ETHER_READ_BLOCK;
+
+        interface->mtu = ETHER_DEFAULT_MTU;
+
+        /* Device filters set by open, (unicast and broadcast) */
+        interface->rx_filter.flags = ETHER_FILTER_UNICAST | ETHER_FILTER_BROADCAST;
 
         /* Configure broadcast addresses */
-        set_broadcast_address(ethernet.broadcast_mac, ETHER_MAC_SIZE);
+        set_broadcast_address(interface->broadcast_mac, ETHER_MAC_SIZE);
 
-        set_broadcast_address(ethernet.broadcast_ip, ETHER_IPV4_SIZE);
+        set_broadcast_address(interface->broadcast_ip, ETHER_IPV4_SIZE);
 
 
         if(api_retval < 0)
@@ -291,41 +663,88 @@ ethernet_handle_t* create_ethernet_handle(uint8_t *network_data, char *mac_addre
 
 
         /* Configure application buffer */
-        ethernet.net_application_data = application_buffer;
+        interface->net_application_data = application_buffer[interface_count];
 
         /* Configure network operations and weak linking of default functions */
-        ethernet.ether_commands = ether_ops;
+        interface->ether_commands = ether_ops;
 
-        if(ethernet.ether_commands->open == NULL)
+        if(interface->ether_commands->open == NULL)
             return NULL;
 
-        if(ethernet.ether_commands->network_interface_status == NULL)
+        if(interface->ether_commands->network_interface_status == NULL)
             return NULL;
 
-        if(ethernet.ether_commands->random_gen_seed == NULL)
-            ethernet.ether_commands->random_gen_seed = random_seed;
+        if(interface->ether_commands->random_gen_seed == NULL)
+            interface->ether_commands->random_gen_seed = random_seed;
+
+        if(interface->ether_commands->ether_send_packet == NULL)
+            interface->ether_commands->ether_send_packet = ethernet_send_packet;
+
+        if(interface->ether_commands->ether_recv_packet == NULL)
+            interface->ether_commands->ether_recv_packet = ethernet_recv_packet;
+
+        if(interface->ether_commands->get_time_ms == NULL)
+            interface->ether_commands->get_time_ms = network_time_ms;
+
+        if(interface->ether_commands->nv_read == NULL)
+            interface->ether_commands->nv_read = network_nv_read;
 
-        if(ethernet.ether_commands->ether_send_packet == NULL)
-            ethernet.ether_commands->ether_send_packet = ethernet_send_packet;
+        if(interface->ether_commands->nv_write == NULL)
+            interface->ether_commands->nv_write = network_nv_write;
 
-        if(ethernet.ether_commands->ether_recv_packet == NULL)
-            ethernet.ether_commands->ether_recv_packet = ethernet_recv_packet;
+        if(interface->ether_commands->set_rx_filter == NULL)
+            interface->ether_commands->set_rx_filter = ethernet_set_rx_filter;
+
+        if(interface->ether_commands->ether_recv_header == NULL)
+            interface->ether_commands->ether_recv_header = ethernet_recv_header;
+
+        if(interface->ether_commands->ether_recv_remaining == NULL)
+            interface->ether_commands->ether_recv_remaining = ethernet_recv_remaining;
+
+        if(interface->ether_commands->ether_drop_packet == NULL)
+            interface->ether_commands->ether_drop_packet = ethernet_drop_packet;
+
+        if(interface->ether_commands->ether_rx_pending == NULL)
+            interface->ether_commands->ether_rx_pending = ethernet_rx_pending;
+
+        if(interface->ether_commands->ether_tx_busy == NULL)
+            interface->ether_commands->ether_tx_busy = ethernet_tx_busy;
 
 
         /* Functions called after linking  */
 
         /* configure sources */
-        ethernet.ip_identifier = get_unique_id(&ethernet, 2000);
-        ethernet.source_port   = get_random_port(&ethernet, 2000);
+        interface->ip_identifier = get_unique_id(interface, 2000);
+        interface->source_port   = get_random_port(interface, 2000);
 
 
         /* Initialize Ethernet */
-        ethernet.ether_commands->open(ethernet.host_mac);
+        interface->ether_commands->open(interface->host_mac);
 
+        interface_count++;
 
     }
 
-    return &ethernet;
+    return interface;
+}
+
+
+
+
+/**********************************************************
+ * @brief  Function to get network interface by index,
+ *         (order of create_ethernet_handle() calls)
+ * @param  index              : interface index
+ * @retval ethernet_handle_t* : Error = NULL, Success = handle
+ **********************************************************/
+ethernet_handle_t* ether_get_interface(uint8_t index)
+{
+    ethernet_handle_t *func_retval = NULL;
+
+    if(index < interface_count)
+        func_retval = &interfaces[index];
+
+    return func_retval;
 }
 
 
@@ -361,7 +780,12 @@ uint8_t ether_module_status(ethernet_handle_t *ethernet)
     }
     else
     {
-        if(ethernet->ether_commands->function_lock == 0)
+        /* Looped back frame waits in network buffer */
+        if(ethernet->loopback_length)
+        {
+            func_retval = 1;
+        }
+        else if(ethernet->ether_commands->function_lock == 0)
         {
             ethernet->ether_commands->function_lock = 1;
 
@@ -377,31 +801,243 @@ uint8_t ether_module_status(ethernet_handle_t *ethernet)
 
 
 /***********************************************************
- * @brief  Function  Ethernet network data
- * @param  *ethernet    : reference to the Ethernet handle
- * @param  *data        : network data
- * @param  *data_length : source MAC address
- * @retval  uint8_t     : Error = 0, Success = 1
+ * @brief  Static function to check headers of received
+ *         frame, frames not for host and other protocols
+ *         are dropped
+ * @param  *ethernet : reference to the Ethernet handle
+ * @param  *frame    : Ethernet frame, (headers)
+ * @param  length    : frame bytes read
+ * @retval uint8_t   : Drop = 0, Accept = 1
  ***********************************************************/
-uint8_t ether_get_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t data_length)
+static uint8_t ether_rx_accept(ethernet_handle_t *ethernet, ether_frame_t *frame, uint16_t length)
 {
+    uint8_t func_retval = 1;
 
-    uint8_t func_retval = 0;
+    net_ip_t *ip;
 
-    if(ethernet->ether_obj == NULL || data == NULL || data_length == 0 || data_length > UINT16_MAX)
+    uint8_t index = 0;
+
+    /* Destination MAC, hash table filter also passes other groups */
+    if(frame->destination_mac_addr[0] & 0x01)
+    {
+        if(memcmp(frame->destination_mac_addr, ethernet->broadcast_mac, ETHER_MAC_SIZE) != 0 &&
+           (ethernet->rx_filter.flags & ETHER_FILTER_MULTICAST) == 0)
+        {
+            for(index = 0; index < ethernet->rx_filter.group_count; index++)
+            {
+                if(memcmp(frame->destination_mac_addr, ethernet->rx_filter.groups[index], ETHER_MAC_SIZE) == 0)
+                    break;
+            }
+
+            if(index == ethernet->rx_filter.group_count)
+                func_retval = 0;
+        }
+    }
+    else if(memcmp(frame->destination_mac_addr, ethernet->host_mac, ETHER_MAC_SIZE) != 0)
     {
         func_retval = 0;
     }
-    else
+
+    if(func_retval)
     {
-        if(ether_module_status(ethernet))
+        if(ntohs(frame->type) == ETHER_IPV4)
         {
-            ethernet->ether_commands->function_lock = 1;
+            ip = (void*)&frame->data;
 
-            /* get data from network including PHY module frame */
-            ethernet->ether_commands->ether_recv_packet(data, data_length);
-
-            func_retval = 1;
+            /* Loopback addresses never come from network (RFC 1122) */
+            if(length >= ETHER_FRAME_SIZE + IP_HEADER_SIZE &&
+               (ip->destination_ip[0] == IP_LOOPBACK_NET || ip->source_ip[0] == IP_LOOPBACK_NET))
+                func_retval = 0;
+
+            /* Unicast to other hosts dropped once address is configured, (multicast filtered by MAC) */
+            if(func_retval && length >= ETHER_FRAME_SIZE + IP_HEADER_SIZE && ip->destination_ip[0] < 224 &&
+               net_load_u32(ethernet->host_ip) != 0 && memcmp(ip->destination_ip, ethernet->host_ip, ETHER_IPV4_SIZE) != 0 &&
+               memcmp(ip->destination_ip, ethernet->broadcast_ip, ETHER_IPV4_SIZE) != 0)
+            {
+                /* Subnet broadcast */
+                for(index = 0; index < ETHER_IPV4_SIZE; index++)
+                {
+                    if(ip->destination_ip[index] != (ethernet->host_ip[index] | (uint8_t)~ethernet->subnet_mask[index]))
+                        break;
+                }
+
+                if(index < ETHER_IPV4_SIZE)
+                    func_retval = 0;
+            }
+        }
+        else if(ntohs(frame->type) != ETHER_ARP)
+        {
+            func_retval = 0;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Static function to check if frame is sent to
+ *         host itself, (host IP or 127.0.0.0/8)
+ * @param  *ethernet : reference to the Ethernet handle
+ * @param  *data     : Ethernet frame
+ * @param  length    : frame length
+ * @retval uint8_t   : Device = 0, Loopback = 1
+ ***********************************************************/
+static uint8_t ether_is_loopback(ethernet_handle_t *ethernet, uint8_t *data, uint16_t length)
+{
+    uint8_t func_retval = 0;
+
+    ether_frame_t *frame = (void*)data;
+    net_ip_t      *ip;
+
+    if(length >= ETHER_FRAME_SIZE + IP_HEADER_SIZE && length <= ETHER_MTU_SIZE - ETHER_PHY_DATA_OFFSET &&
+       ntohs(frame->type) == ETHER_IPV4)
+    {
+        ip = (void*)&frame->data;
+
+        if(ip->destination_ip[0] == IP_LOOPBACK_NET ||
+           (net_load_u32(ethernet->host_ip) != 0 && memcmp(ip->destination_ip, ethernet->host_ip, ETHER_IPV4_SIZE) == 0))
+        {
+            func_retval = 1;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Static function to receive looped back frame,
+ *         frame is copied from loopback slot to network
+ *         buffer
+ * @param  *ethernet : reference to the Ethernet handle
+ * @retval uint8_t   : Error = 0, Success = 1
+ ***********************************************************/
+static uint8_t ether_loopback_input(ethernet_handle_t *ethernet)
+{
+    uint8_t func_retval = 0;
+
+    uint16_t frame_length = 0;
+
+    frame_length = ethernet->loopback_length;
+
+    ethernet->loopback_length = 0;
+
+    memcpy(ethernet->ether_obj, loopback_frame[ethernet->if_index], frame_length);
+
+    ip_parse_packet(ethernet, frame_length);
+
+    /* Built by this host, transport checksum is not verified again */
+    if(ethernet->packet.ip_valid)
+    {
+        ethernet->packet.l4_checked = 1;
+        ethernet->packet.l4_valid   = 1;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Function  Ethernet network data
+ * @param  *ethernet    : reference to the Ethernet handle
+ * @param  *data        : network data
+ * @param  *data_length : source MAC address
+ * @retval  uint8_t     : Error = 0, Success = 1
+ ***********************************************************/
+uint8_t ether_get_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t data_length)
+{
+
+    uint8_t func_retval = 0;
+
+    uint16_t header_length = 0;
+    uint16_t frame_length  = 0;
+
+    if(ethernet->ether_obj == NULL || data == NULL || data_length == 0 || data_length > UINT16_MAX)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        /* Queued frames go out while application polls */
+        if(ethernet->tx_queued)
+            ether_tx_service(ethernet);
+
+        if(ethernet->loopback_length)
+        {
+            func_retval = ether_loopback_input(ethernet);
+        }
+        else if(ether_module_status(ethernet))
+        {
+            ethernet->ether_commands->function_lock = 1;
+
+            /* Read headers first, rest of frame is read only if frame is accepted */
+            header_length = data_length < ETHER_RX_HEADER_SIZE ? data_length : ETHER_RX_HEADER_SIZE;
+
+            frame_length = ethernet->ether_commands->ether_recv_header(data, header_length);
+
+            if(frame_length == 0)
+            {
+                /* get data from network including PHY module frame */
+                frame_length = ethernet->ether_commands->ether_recv_packet(data, data_length);
+
+                ethernet->rx_bytes += frame_length;
+
+                func_retval = 1;
+            }
+            else
+            {
+                if(frame_length < header_length)
+                    header_length = frame_length;
+
+                func_retval = ether_rx_accept(ethernet, (void*)(data + ETHER_PHY_DATA_OFFSET), header_length - ETHER_PHY_DATA_OFFSET);
+
+                ethernet->rx_bytes += header_length;
+
+                /* Packet released by device when header read got all of it */
+                if(frame_length > header_length)
+                {
+                    if(func_retval)
+                    {
+                        ethernet->rx_bytes += ethernet->ether_commands->ether_recv_remaining(data + header_length,
+                                                                                             data_length - header_length);
+                    }
+                    else
+                    {
+                        ethernet->ether_commands->ether_drop_packet();
+                    }
+                }
+            }
+
+            /* Received length from device status, (not buffer size) */
+            if(frame_length > data_length)
+                frame_length = data_length;
+
+            frame_length = frame_length > ETHER_PHY_DATA_OFFSET ? frame_length - ETHER_PHY_DATA_OFFSET : 0;
+
+            if(func_retval)
+            {
+                ethernet->rx_frames++;
+
+                /* Parse headers once, handlers use the packet descriptor */
+                ip_parse_packet(ethernet, frame_length);
+
+                /* Learn peer address, reply needs no ARP round trip */
+                ether_arp_snoop(ethernet);
+            }
+            else
+            {
+                /* Buffer holds headers of dropped frame */
+                ethernet->packet.parsed       = 0;
+                ethernet->packet.frame_length = header_length - ETHER_PHY_DATA_OFFSET;
+
+                ethernet->rx_dropped++;
+            }
 
             ethernet->ether_commands->function_lock = 0;
         }
@@ -414,7 +1050,355 @@ uint8_t ether_get_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t data
 
 
 /***********************************************************
- * @brief  Function send Ethernet network data
+ * @brief  Static function to get transmit class of frame,
+ *         TCP segments with FIN stay in order with data
+ * @param  *ethernet : reference to the Ethernet handle
+ * @param  *data     : Ethernet frame
+ * @param  length    : frame length
+ * @param  *flow     : local TCP/UDP port, 0 = other
+ * @retval ether_tx_class_t : transmit class
+ ***********************************************************/
+static ether_tx_class_t ether_tx_classify(ethernet_handle_t *ethernet, uint8_t *data, uint16_t length, uint16_t *flow)
+{
+    ether_tx_class_t func_retval = ETHER_TX_BULK;
+
+    ether_frame_t *frame = (void*)data;
+    net_ip_t      *ip;
+
+    uint8_t *transport;
+    uint8_t  index            = 0;
+    uint16_t ip_header_length = 0;
+    uint16_t header_length    = 0;
+
+    *flow = 0;
+
+    if(length < ETHER_FRAME_SIZE)
+    {
+        func_retval = ETHER_TX_BULK;
+    }
+    else if(ntohs(frame->type) == ETHER_ARP)
+    {
+        func_retval = ETHER_TX_CONTROL;
+    }
+    else if(ntohs(frame->type) == ETHER_IPV4 && length >= ETHER_FRAME_SIZE + IP_HEADER_SIZE)
+    {
+        ip = (void*)&frame->data;
+
+        ip_header_length = ip->version_length.header_length * 4;
+
+        transport = (uint8_t*)ip + ip_header_length;
+
+        if(ip->protocol == IP_ICMP)
+        {
+            func_retval = ETHER_TX_CONTROL;
+        }
+        else if((ip->protocol == IP_TCP && length >= ETHER_FRAME_SIZE + ip_header_length + 20) ||
+                (ip->protocol == IP_UDP && length >= ETHER_FRAME_SIZE + ip_header_length + 8))
+        {
+            *flow = net_load_u16(transport);
+
+            /* TCP data offset, UDP header */
+            header_length = (ip->protocol == IP_TCP) ? (transport[12] >> 4) * 4 : 8;
+
+            /* ACK, SYN and RST without data */
+            if(ip->protocol == IP_TCP && ntohs(ip->total_length) == ip_header_length + header_length && (transport[13] & 0x01) == 0)
+            {
+                func_retval = ETHER_TX_CONTROL;
+            }
+            else
+            {
+                for(index = 0; index < ethernet->tx_port_count; index++)
+                {
+                    if(ethernet->tx_ports[index] == *flow || ethernet->tx_ports[index] == net_load_u16(transport + 2))
+                        func_retval = ETHER_TX_INTERACTIVE;
+                }
+            }
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Static function to copy frame to transmit queue
+ * @param  *ethernet : reference to the Ethernet handle
+ * @param  *data     : Ethernet frame
+ * @param  length    : frame length
+ * @param  tx_class  : transmit class
+ * @param  flow      : local TCP/UDP port
+ * @retval uint8_t   : Error = 0 (queue full), Success = 1
+ ***********************************************************/
+static uint8_t ether_tx_enqueue(ethernet_handle_t *ethernet, uint8_t *data, uint16_t length,
+                                ether_tx_class_t tx_class, uint16_t flow)
+{
+    uint8_t func_retval = 0;
+
+    uint8_t index = 0;
+
+    if(length <= sizeof(tx_queue[0].data))
+    {
+        for(index = 0; index < ETHER_TX_QUEUE_SIZE; index++)
+        {
+            if(tx_queue[index].ethernet == NULL)
+            {
+                memcpy(tx_queue[index].data, data, length);
+
+                tx_queue[index].ethernet = ethernet;
+                tx_queue[index].length   = length;
+                tx_queue[index].flow     = flow;
+                tx_queue[index].tx_class = tx_class;
+                tx_queue[index].order    = ethernet->tx_order++;
+
+                ethernet->tx_queued++;
+
+                func_retval = 1;
+
+                break;
+            }
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Static function to select next queued frame,
+ *         control frames first, interactive frames with
+ *         one bulk frame every ETHER_TX_WEIGHT frames,
+ *         ports of a class take turns
+ * @param  *ethernet : reference to the Ethernet handle
+ * @retval ether_tx_slot_t* : Error = NULL, Success = queue slot
+ ***********************************************************/
+static ether_tx_slot_t* ether_tx_next(ethernet_handle_t *ethernet)
+{
+    ether_tx_slot_t *func_retval = NULL;
+
+    ether_tx_slot_t *oldest[ETHER_TX_CLASSES] = {NULL};
+    ether_tx_slot_t *turn[ETHER_TX_CLASSES]   = {NULL};
+    ether_tx_slot_t *slot;
+
+    uint8_t index = 0;
+    uint8_t age   = 0;
+
+    for(index = 0; index < ETHER_TX_QUEUE_SIZE; index++)
+    {
+        slot = &tx_queue[index];
+
+        if(slot->ethernet != ethernet)
+            continue;
+
+        age = ethernet->tx_order - slot->order;
+
+        if(oldest[slot->tx_class] == NULL || age > (uint8_t)(ethernet->tx_order - oldest[slot->tx_class]->order))
+            oldest[slot->tx_class] = slot;
+
+        /* Oldest frame of other ports, frames of a port stay in order */
+        if(slot->flow != ethernet->tx_last_flow[slot->tx_class] && \
+           (turn[slot->tx_class] == NULL || age > (uint8_t)(ethernet->tx_order - turn[slot->tx_class]->order)))
+            turn[slot->tx_class] = slot;
+    }
+
+    for(index = 0; index < ETHER_TX_CLASSES; index++)
+    {
+        if(turn[index] != NULL)
+            oldest[index] = turn[index];
+    }
+
+    if(oldest[ETHER_TX_CONTROL] != NULL)
+    {
+        func_retval = oldest[ETHER_TX_CONTROL];
+    }
+    else if(oldest[ETHER_TX_INTERACTIVE] != NULL && (oldest[ETHER_TX_BULK] == NULL || ethernet->tx_run < ETHER_TX_WEIGHT))
+    {
+        func_retval = oldest[ETHER_TX_INTERACTIVE];
+
+        if(oldest[ETHER_TX_BULK] != NULL)
+            ethernet->tx_run++;
+    }
+    else
+    {
+        func_retval = oldest[ETHER_TX_BULK];
+
+        ethernet->tx_run = 0;
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Function to send queued frames while network
+ *         device is idle, control frames first
+ * @param  *ethernet : reference to the Ethernet handle
+ * @retval uint8_t   : frames left in transmit queue
+ ***********************************************************/
+uint8_t ether_tx_service(ethernet_handle_t *ethernet)
+{
+    uint8_t func_retval = 0;
+
+    ether_tx_slot_t *slot;
+
+    if(ethernet == NULL || ethernet->ether_commands == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        while(ethernet->tx_queued && ethernet->ether_commands->ether_tx_busy() == 0)
+        {
+            slot = ether_tx_next(ethernet);
+
+            ethernet->ether_commands->ether_send_packet(slot->data, slot->length);
+
+            ethernet->tx_last_flow[slot->tx_class] = slot->flow;
+
+            slot->ethernet = NULL;
+
+            ethernet->tx_queued--;
+        }
+
+        func_retval = ethernet->tx_queued;
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Function to set transmit class of TCP/UDP data
+ *         frames of a local or remote port
+ * @param  *ethernet : reference to the Ethernet handle
+ * @param  port      : TCP/UDP port
+ * @param  tx_class  : ETHER_TX_INTERACTIVE or ETHER_TX_BULK
+ * @retval int8_t    : Error = -1, Success = 0
+ ***********************************************************/
+int8_t ether_tx_port_class(ethernet_handle_t *ethernet, uint16_t port, ether_tx_class_t tx_class)
+{
+    int8_t func_retval = 0;
+
+    uint8_t index = 0;
+
+    if(ethernet == NULL || tx_class == ETHER_TX_CONTROL || tx_class >= ETHER_TX_CLASSES)
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        for(index = 0; index < ethernet->tx_port_count; index++)
+        {
+            if(ethernet->tx_ports[index] == port)
+                break;
+        }
+
+        if(tx_class == ETHER_TX_INTERACTIVE && index == ethernet->tx_port_count)
+        {
+            if(ethernet->tx_port_count < ETHER_TX_PORTS)
+                ethernet->tx_ports[ethernet->tx_port_count++] = port;
+            else
+                func_retval = -1;
+        }
+        else if(tx_class == ETHER_TX_BULK && index < ethernet->tx_port_count)
+        {
+            ethernet->tx_port_count--;
+
+            ethernet->tx_ports[index] = ethernet->tx_ports[ethernet->tx_port_count];
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Function to read and handle up to budget frames
+ *         waiting in network device, ARP, ICMP, TCP and UDP
+ *         (DHCP client) are handled, TCP data is held for
+ *         application read, one ACK is sent for data of the
+ *         batch
+ * @param  *ethernet     : reference to the Ethernet handle
+ * @param  *network_data : network data
+ * @param  budget        : max frames read
+ * @retval int16_t       : Error = -1, Success = frames left in device
+ ***********************************************************/
+int16_t net_poll(ethernet_handle_t *ethernet, uint8_t *network_data, uint8_t budget)
+{
+    int16_t func_retval = 0;
+
+    uint8_t frames = 0;
+
+    int16_t comm_type = 0;
+
+    if(ethernet == NULL || ethernet->ether_obj == NULL || network_data == NULL)
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        /* Transport work deferred to end of batch */
+        ethernet->status.rx_batch = 1;
+
+        while(frames < budget && ether_module_status(ethernet))
+        {
+            frames++;
+
+            ether_tx_service(ethernet);
+
+            /* Frames dropped after header read are counted against budget */
+            if(ether_get_data(ethernet, network_data, ETHER_MTU_SIZE) == 0)
+                continue;
+
+            if(get_ether_protocol_type(ethernet) == ETHER_ARP)
+            {
+                ether_handle_arp_resp_req(ethernet);
+            }
+            else if(get_ether_protocol_type(ethernet) == ETHER_IPV4)
+            {
+                /* UNICAST = 1, BROADCAST = 2 */
+                comm_type = get_ip_communication_type(ethernet);
+
+                if(comm_type == 1 && get_ip_protocol_type(ethernet) == IP_ICMP)
+                {
+                    ether_send_icmp_reply(ethernet);
+                }
+                else if(comm_type == 1 && get_ip_protocol_type(ethernet) == IP_TCP && ethernet->tcp_input != NULL)
+                {
+                    ethernet->tcp_input(ethernet, ethernet->tcp_context, 0);
+                }
+                else if((comm_type == 1 || comm_type == 2) && get_ip_protocol_type(ethernet) == IP_UDP && ethernet->udp_input != NULL)
+                {
+                    ethernet->udp_input(ethernet, ethernet->udp_context, 0);
+                }
+            }
+        }
+
+        ethernet->status.rx_batch = 0;
+
+        /* ACKs and timers, once per batch */
+        if(ethernet->tcp_input != NULL)
+            ethernet->tcp_input(ethernet, ethernet->tcp_context, 1);
+
+        if(ethernet->udp_input != NULL)
+            ethernet->udp_input(ethernet, ethernet->udp_context, 1);
+
+        func_retval = ethernet->ether_commands->ether_rx_pending() + (ethernet->loopback_length != 0);
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Function send Ethernet network data, frame to
+ *         host itself is looped back, (one frame held until
+ *         read, loopback send fails while it is held)
  * @param  *ethernet    : reference to the Ethernet handle
  * @param  *data        : network data
  * @param  *data_length : source MAC address
@@ -425,6 +1409,13 @@ uint8_t ether_send_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t dat
 
     uint8_t func_retval = 0;
 
+    ether_tx_class_t tx_class;
+
+    ether_frame_t *loopback;
+
+    uint16_t flow   = 0;
+    uint8_t  queued = 0;
+
     if(ethernet->ether_obj == NULL || data == NULL || data_length == 0 || data_length > UINT16_MAX)
     {
         func_retval = 0;
@@ -433,9 +1424,62 @@ uint8_t ether_send_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t dat
     {
         ethernet->ether_commands->function_lock = 1;
 
-        ethernet->ether_commands->ether_send_packet(data, data_length);
+        if(ether_is_loopback(ethernet, data, data_length))
+        {
+            /* Frame to host itself is held in loopback slot and read by ether_get_data(), (no device access) */
+            if(ethernet->loopback_length || data_length > sizeof(loopback_frame[0]))
+            {
+                /* Held frame is not replaced, sender retries after it is read */
+                ethernet->loopback_dropped++;
+
+                func_retval = 0;
+            }
+            else
+            {
+                memcpy(loopback_frame[ethernet->if_index], data, data_length);
 
-        func_retval = 1;
+                loopback = (void*)loopback_frame[ethernet->if_index];
+
+                memcpy(loopback->destination_mac_addr, ethernet->host_mac, ETHER_MAC_SIZE);
+                memcpy(loopback->source_mac_addr, ethernet->host_mac, ETHER_MAC_SIZE);
+
+                ethernet->loopback_length = data_length;
+
+                ethernet->loopback_frames++;
+
+                func_retval = 1;
+            }
+        }
+        else
+        {
+
+            ether_tx_service(ethernet);
+
+            tx_class = ether_tx_classify(ethernet, data, data_length, &flow);
+
+            /* Frame is copied to queue while device sends */
+            if(ethernet->tx_queued || ethernet->ether_commands->ether_tx_busy())
+                queued = ether_tx_enqueue(ethernet, data, data_length, tx_class, flow);
+
+            if(queued == 0)
+            {
+                /* Device idle, queue full or frame larger than queue slot, control frame goes before queued data */
+                while((tx_class != ETHER_TX_CONTROL && ethernet->tx_queued) || ethernet->ether_commands->ether_tx_busy())
+                    ether_tx_service(ethernet);
+
+                ethernet->ether_commands->ether_send_packet(data, data_length);
+
+                ethernet->tx_last_flow[tx_class] = flow;
+            }
+
+            func_retval = 1;
+        }
+
+        /* Network buffer no longer holds the received frame */
+        ethernet->packet.parsed = 0;
+
+        if(data == (uint8_t*)ethernet->ether_obj)
+            ethernet->packet.frame_length = data_length;
 
         ethernet->ether_commands->function_lock = 0;
 
@@ -482,6 +1526,265 @@ int8_t fill_ether_frame(ethernet_handle_t *ethernet, uint8_t *destination_mac_ad
 
 
 
+/***********************************************************
+ * @brief  Static function to get multicast hash table bit
+ *         of MAC address, (CRC-32 bits 28:23, ENC28J60)
+ * @param  *mac_address : MAC address
+ * @retval uint8_t      : hash table bit (0 - 63)
+ ***********************************************************/
+static uint8_t ether_mac_hash(uint8_t *mac_address)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    uint8_t index = 0;
+    uint8_t bit   = 0;
+    uint8_t data  = 0;
+
+    for(index = 0; index < ETHER_MAC_SIZE; index++)
+    {
+        data = mac_address[index];
+
+        /* Bits shifted in LSB first */
+        for(bit = 0; bit < 8; bit++)
+        {
+            if( ((crc >> 31) ^ data) & 0x01 )
+                crc = (crc << 1) ^ 0x04C11DB7;
+            else
+                crc = crc << 1;
+
+            data >>= 1;
+        }
+    }
+
+    return (uint8_t)((crc >> 23) & 0x3F);
+}
+
+
+
+/***********************************************************
+ * @brief  Static function to rebuild hash table and
+ *         program device receive filters
+ * @param  *ethernet : reference to the Ethernet handle
+ * @retval int8_t    : Error = -1, Success = 0
+ ***********************************************************/
+static int8_t ether_filter_update(ethernet_handle_t *ethernet)
+{
+    int8_t func_retval = 0;
+
+    ether_rx_filter_t *filter = &ethernet->rx_filter;
+
+    uint8_t index = 0;
+    uint8_t hash  = 0;
+
+    memset(filter->hash_table, 0, sizeof(filter->hash_table));
+
+    for(index = 0; index < filter->group_count; index++)
+    {
+        hash = ether_mac_hash(filter->groups[index]);
+
+        filter->hash_table[hash >> 3] |= (1 << (hash & 0x07));
+    }
+
+    if(filter->group_count)
+        filter->flags |= ETHER_FILTER_HASH;
+    else
+        filter->flags &= ~ETHER_FILTER_HASH;
+
+    if(ethernet->ether_commands->set_rx_filter(filter) == 0)
+        func_retval = -1;
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Function to enable or disable broadcast frames
+ *         in device receive filter
+ * @param  *ethernet : reference to the Ethernet handle
+ * @param  enable    : 1 = accept broadcast, 0 = drop
+ * @retval int8_t    : Error = -1, Success = 0
+ ***********************************************************/
+int8_t ether_filter_broadcast(ethernet_handle_t *ethernet, uint8_t enable)
+{
+    int8_t func_retval = 0;
+
+    if(ethernet == NULL)
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        if(enable)
+            ethernet->rx_filter.flags |= ETHER_FILTER_BROADCAST;
+        else
+            ethernet->rx_filter.flags &= ~ETHER_FILTER_BROADCAST;
+
+        func_retval = ether_filter_update(ethernet);
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Function to join multicast group, group MAC is
+ *         added to device hash table filter
+ * @param  *ethernet  : reference to the Ethernet handle
+ * @param  *group_mac : multicast MAC address
+ * @retval int8_t     : Error = -1 (not multicast, full), Success = 0
+ ***********************************************************/
+int8_t ether_filter_add_multicast(ethernet_handle_t *ethernet, uint8_t *group_mac)
+{
+    int8_t func_retval = 0;
+
+    ether_rx_filter_t *filter;
+
+    uint8_t index = 0;
+
+    if(ethernet == NULL || group_mac == NULL || (group_mac[0] & 0x01) == 0)
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        filter = &ethernet->rx_filter;
+
+        for(index = 0; index < filter->group_count; index++)
+        {
+            if(memcmp(filter->groups[index], group_mac, ETHER_MAC_SIZE) == 0)
+                break;
+        }
+
+        /* New group */
+        if(index == filter->group_count)
+        {
+            if(filter->group_count < ETHER_MULTICAST_GROUPS)
+            {
+                memcpy(filter->groups[filter->group_count], group_mac, ETHER_MAC_SIZE);
+
+                filter->group_count++;
+
+                func_retval = ether_filter_update(ethernet);
+            }
+            else
+            {
+                func_retval = -1;
+            }
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Function to leave multicast group
+ * @param  *ethernet  : reference to the Ethernet handle
+ * @param  *group_mac : multicast MAC address
+ * @retval int8_t     : Error = -1 (not joined), Success = 0
+ ***********************************************************/
+int8_t ether_filter_remove_multicast(ethernet_handle_t *ethernet, uint8_t *group_mac)
+{
+    int8_t func_retval = -1;
+
+    ether_rx_filter_t *filter;
+
+    uint8_t index = 0;
+
+    if(ethernet == NULL || group_mac == NULL)
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        filter = &ethernet->rx_filter;
+
+        for(index = 0; index < filter->group_count; index++)
+        {
+            if(memcmp(filter->groups[index], group_mac, ETHER_MAC_SIZE) == 0)
+            {
+                /* Keep groups packed, last group moved to free entry */
+                filter->group_count--;
+
+                memcpy(filter->groups[index], filter->groups[filter->group_count], ETHER_MAC_SIZE);
+
+                func_retval = ether_filter_update(ethernet);
+
+                break;
+            }
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/***********************************************************
+ * @brief  Function to set pattern match filter, frames
+ *         with pattern bytes selected by mask are accepted
+ * @param  *ethernet : reference to the Ethernet handle
+ * @param  offset    : window offset from Ethernet header
+ * @param  *pattern  : window bytes (ETHER_PATTERN_SIZE),
+ *                     NULL = disable pattern filter
+ * @param  *mask     : bytes checked, bit 0 = first byte
+ * @retval int8_t    : Error = -1, Success = 0
+ ***********************************************************/
+int8_t ether_filter_set_pattern(ethernet_handle_t *ethernet, uint16_t offset, uint8_t *pattern, uint8_t *mask)
+{
+    int8_t func_retval = 0;
+
+    ether_rx_filter_t *filter;
+
+    uint8_t  selected[ETHER_PATTERN_SIZE];
+    uint8_t  count = 0;
+    uint8_t  index = 0;
+    uint32_t sum   = 0;
+
+    if(ethernet == NULL || (pattern != NULL && mask == NULL))
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        filter = &ethernet->rx_filter;
+
+        if(pattern == NULL)
+        {
+            filter->flags &= ~ETHER_FILTER_PATTERN;
+
+            memset(filter->pattern_mask, 0, sizeof(filter->pattern_mask));
+        }
+        else
+        {
+            /* Device checks checksum of selected bytes, (IP checksum, in window order) */
+            for(index = 0; index < ETHER_PATTERN_SIZE; index++)
+            {
+                if(mask[index >> 3] & (1 << (index & 0x07)))
+                    selected[count++] = pattern[index];
+            }
+
+            ether_sum_words(&sum, selected, count);
+
+            memcpy(filter->pattern_mask, mask, sizeof(filter->pattern_mask));
+
+            filter->pattern_offset   = offset;
+            filter->pattern_checksum = ntohs(ether_get_checksum(sum));
+
+            filter->flags |= ETHER_FILTER_PATTERN;
+        }
+
+        func_retval = ether_filter_update(ethernet);
+    }
+
+    return func_retval;
+}
+
+
+
 /***********************************************************
  * @brief  Function get ethernet protocol type
  * @param  *ethernet     : reference to the Ethernet handle
@@ -498,7 +1801,7 @@ ether_type_t get_ether_protocol_type(ethernet_handle_t *ethernet)
     }
     else
     {
-        func_retval = (ether_type_t)(ntohs(ethernet->ether_obj->type));
+        func_retval = (ether_type_t)(ether_get_packet(ethernet)->ether_type);
     }
 
     return func_retval;
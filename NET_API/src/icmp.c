@@ -146,7 +146,8 @@ int8_t ether_send_icmp_reply(ethernet_handle_t *ethernet)
             icmp->checksum = ether_get_checksum(sum);
 
             /* Send ICMP response packet(uses callback) */
-            ether_send_data(ethernet, (uint8_t*)ethernet->ether_obj, ip_packet_length + ETHER_FRAME_SIZE);
+            if(ether_send_data(ethernet, (uint8_t*)ethernet->ether_obj, ip_packet_length + ETHER_FRAME_SIZE) == 0)
+                func_retval = NET_ICMP_RESP_ERROR;
 
         }
         else
@@ -185,6 +186,9 @@ int8_t ether_send_icmp_req(ethernet_handle_t *ethernet, icmp_type_t icmp_type, u
     uint16_t icmp_packet_size = 0;
     uint16_t ip_id            = 0;
 
+    /* Echo request is the only type sent */
+    (void)icmp_type;
+
     if(ethernet->ether_obj == NULL)
     {
         func_retval = NET_ICMP_REQ_ERROR;
@@ -228,7 +232,8 @@ int8_t ether_send_icmp_req(ethernet_handle_t *ethernet, icmp_type_t icmp_type, u
 
 
         /* Send ICMP data */
-        ether_send_data(ethernet, (uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + htons(ip->total_length));
+        if(ether_send_data(ethernet, (uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + htons(ip->total_length)) == 0)
+            func_retval = NET_ICMP_REQ_ERROR;
 
     }
 
@@ -58,6 +58,225 @@
 /******************************************************************************/
 
 
+#define IP_FRAGMENT_MASK   0x3FFF  /*!< More fragments flag and fragment offset  */
+#define IP_TCP_HEADER_MIN  20      /*!< TCP header size without options          */
+#define IP_UDP_HEADER_SIZE 8       /*!< UDP header size                          */
+
+
+
+/* IPv4 route, (gateway 0.0.0.0 = destination is on link) */
+typedef struct _ip_route
+{
+    uint8_t           destination[ETHER_IPV4_SIZE];  /*!< Destination network          */
+    uint8_t           netmask[ETHER_IPV4_SIZE];      /*!< Destination network mask     */
+    uint8_t           gateway[ETHER_IPV4_SIZE];      /*!< Next hop for the network     */
+    uint8_t           prefix_length;                 /*!< Mask length, longest matched */
+    ethernet_handle_t *interface;                    /*!< Outgoing interface, NULL = unused entry */
+
+}ip_route_t;
+
+
+/* Destination cache entry, result of last lookups */
+typedef struct _ip_route_cache
+{
+    uint8_t           destination[ETHER_IPV4_SIZE];  /*!< Destination address             */
+    uint8_t           next_hop[ETHER_IPV4_SIZE];     /*!< Gateway or destination address  */
+    ethernet_handle_t *scope;                        /*!< Lookup interface, NULL = any     */
+    ethernet_handle_t *interface;                    /*!< Outgoing interface, NULL = unused entry */
+
+}ip_route_cache_t;
+
+
+
+static ip_route_t       route_table[IP_ROUTE_TABLE_SIZE];
+static ip_route_cache_t route_cache[IP_ROUTE_CACHE_SIZE];
+static uint8_t          route_cache_next = 0;
+
+
+
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                              Private Functions                             */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+/**********************************************************
+ * @brief  Static function to get network mask length
+ * @param  *netmask : network mask
+ * @retval uint8_t  : prefix length (leading one bits)
+ **********************************************************/
+static uint8_t ip_prefix_length(uint8_t *netmask)
+{
+    uint8_t func_retval = 0;
+    uint8_t bit         = 0x80;
+    uint8_t index       = 0;
+
+    while(index < ETHER_IPV4_SIZE && (netmask[index] & bit))
+    {
+        func_retval++;
+
+        bit >>= 1;
+
+        if(bit == 0)
+        {
+            bit = 0x80;
+            index++;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/**********************************************************
+ * @brief  Static function to check address is in network
+ * @param  *ip_address  : IP address
+ * @param  *network     : network address
+ * @param  *netmask     : network mask
+ * @retval uint8_t      : No match = 0, Match = 1
+ **********************************************************/
+static uint8_t ip_network_match(uint8_t *ip_address, uint8_t *network, uint8_t *netmask)
+{
+    uint8_t func_retval = 1;
+    uint8_t index       = 0;
+
+    for(index = 0; index < ETHER_IPV4_SIZE; index++)
+    {
+        if( (ip_address[index] & netmask[index]) != (network[index] & netmask[index]) )
+            func_retval = 0;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function for longest prefix match, table routes
+ *         and interface routes from interface address (connected
+ *         subnet and default gateway), table wins equal prefixes
+ * @param  *scope          : interface to use, NULL = any interface
+ * @param  *destination_ip : destination IP address
+ * @param  *next_hop       : gateway or destination IP address
+ * @retval ethernet_handle_t* : No route = NULL, Success = interface
+ ******************************************************************/
+static ethernet_handle_t* ip_route_find(ethernet_handle_t *scope, uint8_t *destination_ip, uint8_t *next_hop)
+{
+    ethernet_handle_t *func_retval = NULL;
+    ethernet_handle_t *interface;
+
+    uint8_t empty_ip[ETHER_IPV4_SIZE] = {0};
+    uint8_t index      = 0;
+    uint8_t prefix     = 0;
+    int8_t  best       = -1;
+
+    for(index = 0; index < IP_ROUTE_TABLE_SIZE; index++)
+    {
+        if(route_table[index].interface != NULL && (scope == NULL || route_table[index].interface == scope) && \
+           (int8_t)route_table[index].prefix_length > best && \
+           ip_network_match(destination_ip, route_table[index].destination, route_table[index].netmask))
+        {
+            best = route_table[index].prefix_length;
+
+            if(memcmp(route_table[index].gateway, empty_ip, ETHER_IPV4_SIZE) == 0)
+                memcpy(next_hop, destination_ip, ETHER_IPV4_SIZE);
+            else
+                memcpy(next_hop, route_table[index].gateway, ETHER_IPV4_SIZE);
+
+            func_retval = route_table[index].interface;
+        }
+    }
+
+    for(index = 0; (interface = ether_get_interface(index)) != NULL; index++)
+    {
+        if( (scope != NULL && interface != scope) || memcmp(interface->host_ip, empty_ip, ETHER_IPV4_SIZE) == 0 )
+            continue;
+
+        /* Connected subnet */
+        prefix = ip_prefix_length(interface->subnet_mask);
+
+        if((int8_t)prefix > best && ip_network_match(destination_ip, interface->host_ip, interface->subnet_mask))
+        {
+            best = prefix;
+
+            memcpy(next_hop, destination_ip, ETHER_IPV4_SIZE);
+
+            func_retval = interface;
+        }
+
+        /* Default gateway */
+        if(best < 0 && memcmp(interface->gateway_ip, empty_ip, ETHER_IPV4_SIZE) != 0)
+        {
+            best = 0;
+
+            memcpy(next_hop, interface->gateway_ip, ETHER_IPV4_SIZE);
+
+            func_retval = interface;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to look up destination in route cache,
+ *         routes are looked up and cached on miss
+ * @param  *scope          : interface to use, NULL = any interface
+ * @param  *destination_ip : destination IP address
+ * @param  *next_hop       : gateway or destination IP address
+ * @retval ethernet_handle_t* : No route = NULL, Success = interface
+ ******************************************************************/
+static ethernet_handle_t* ip_route_cached(ethernet_handle_t *scope, uint8_t *destination_ip, uint8_t *next_hop)
+{
+    ethernet_handle_t *func_retval = NULL;
+
+    ip_route_cache_t *entry;
+
+    uint8_t index = 0;
+
+    for(index = 0; index < IP_ROUTE_CACHE_SIZE; index++)
+    {
+        entry = &route_cache[index];
+
+        if(entry->interface != NULL && entry->scope == scope && memcmp(entry->destination, destination_ip, ETHER_IPV4_SIZE) == 0)
+        {
+            memcpy(next_hop, entry->next_hop, ETHER_IPV4_SIZE);
+
+            func_retval = entry->interface;
+
+            break;
+        }
+    }
+
+    if(func_retval == NULL)
+    {
+        func_retval = ip_route_find(scope, destination_ip, next_hop);
+
+        if(func_retval != NULL)
+        {
+            entry = &route_cache[route_cache_next];
+
+            memcpy(entry->destination, destination_ip, ETHER_IPV4_SIZE);
+            memcpy(entry->next_hop, next_hop, ETHER_IPV4_SIZE);
+
+            entry->scope     = scope;
+            entry->interface = func_retval;
+
+            route_cache_next = (route_cache_next + 1) % IP_ROUTE_CACHE_SIZE;
+        }
+    }
+
+    return func_retval;
+}
+
 
 
 
@@ -69,9 +288,243 @@
 
 
 
+/****************************************************************
+ * @brief  Function to parse received frame into the packet
+ *         descriptor, lengths are validated against the frame
+ *         and the IP header checksum is verified, (called once
+ *         per frame by ether_get_data())
+ * @param  *ethernet     : reference to the Ethernet handle
+ * @param  frame_length  : bytes in buffer from Ethernet header
+ * @retval uint8_t       : Not valid IPv4 = 0, Success = 1
+ ****************************************************************/
+uint8_t ip_parse_packet(ethernet_handle_t *ethernet, uint16_t frame_length)
+{
+    uint8_t func_retval = 0;
+
+    net_packet_t *packet;
+
+    uint8_t *ip;
+    uint8_t *transport;
+
+    uint32_t sum = 0;
+
+    if(ethernet->ether_obj == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        packet = &ethernet->packet;
+
+        memset(packet, 0, sizeof(net_packet_t));
+
+        packet->parsed       = 1;
+        packet->frame_length = frame_length;
+
+        ip = &ethernet->ether_obj->data;
+
+        if(frame_length >= ETHER_FRAME_SIZE)
+            packet->ether_type = net_load_u16(&ethernet->ether_obj->type);
+
+        /* IPv4 header, total length must be inside the frame */
+        if(packet->ether_type == ETHER_IPV4 && frame_length >= ETHER_FRAME_SIZE + IP_HEADER_SIZE)
+        {
+            packet->ip_header_length = (ip[0] & 0x0F) << 2;
+            packet->ip_length        = net_load_u16(&ip[2]);
+            packet->ip_protocol      = ip[9];
+
+            memcpy(packet->source_ip, &ip[12], ETHER_IPV4_SIZE);
+            memcpy(packet->destination_ip, &ip[16], ETHER_IPV4_SIZE);
+
+            if( (ip[0] >> 4) == IP_VERSION && packet->ip_header_length >= IP_HEADER_SIZE && \
+                packet->ip_length >= packet->ip_header_length && packet->ip_length <= frame_length - ETHER_FRAME_SIZE )
+            {
+                ether_sum_words(&sum, ip, packet->ip_header_length);
+
+                packet->ip_valid = (ether_get_checksum(sum) == 0);
+            }
+        }
+
+        /* Transport header, fragments are not reassembled */
+        if(packet->ip_valid && (net_load_u16(&ip[6]) & IP_FRAGMENT_MASK) == 0)
+        {
+            transport = ip + packet->ip_header_length;
+
+            packet->l4_length = packet->ip_length - packet->ip_header_length;
+
+            if(packet->ip_protocol == IP_TCP && packet->l4_length >= IP_TCP_HEADER_MIN)
+            {
+                packet->l4_header_length = (transport[12] >> 4) << 2;
+
+                if(packet->l4_header_length < IP_TCP_HEADER_MIN || packet->l4_header_length > packet->l4_length)
+                    packet->l4_header_length = 0;
+            }
+            else if(packet->ip_protocol == IP_UDP && packet->l4_length >= IP_UDP_HEADER_SIZE)
+            {
+                /* UDP length may be shorter than IP payload (padding) */
+                if(net_load_u16(&transport[4]) >= IP_UDP_HEADER_SIZE && net_load_u16(&transport[4]) <= packet->l4_length)
+                {
+                    packet->l4_length        = net_load_u16(&transport[4]);
+                    packet->l4_header_length = IP_UDP_HEADER_SIZE;
+                }
+            }
+
+            if(packet->l4_header_length)
+            {
+                packet->source_port      = net_load_u16(&transport[0]);
+                packet->destination_port = net_load_u16(&transport[2]);
+                packet->data_length      = packet->l4_length - packet->l4_header_length;
+            }
+        }
+
+        func_retval = packet->ip_valid;
+    }
+
+    return func_retval;
+}
+
+
+
+/****************************************************************
+ * @brief  Function to get packet descriptor of frame in the
+ *         network buffer, frame is parsed if buffer was
+ *         written after the last read (sent frame)
+ * @param  *ethernet     : reference to the Ethernet handle
+ * @retval net_packet_t* : reference to the packet descriptor
+ ****************************************************************/
+net_packet_t* ether_get_packet(ethernet_handle_t *ethernet)
+{
+    if(ethernet->packet.parsed == 0)
+        ip_parse_packet(ethernet, ethernet->packet.frame_length);
+
+    return &ethernet->packet;
+}
+
+
+
+/****************************************************************
+ * @brief  Function to validate TCP or UDP checksum of received
+ *         packet, (pseudo header + segment), computed once per
+ *         frame and cached in the packet descriptor
+ * @param  *ethernet  : reference to the Ethernet handle
+ * @retval uint8_t    : Error = 0, Success = 1
+ ****************************************************************/
+uint8_t ip_transport_checksum_valid(ethernet_handle_t *ethernet)
+{
+    return ip_transport_checksum_valid_sum(ethernet, 0, 0);
+}
+
+
+
+/****************************************************************
+ * @brief  Function to validate TCP or UDP checksum of received
+ *         packet with sum of leading transport data already
+ *         summed by caller (ether_copy_sum), rest of data is
+ *         summed here, result cached in the packet descriptor
+ * @param  *ethernet  : reference to the Ethernet handle
+ * @param  data_sum   : Sum of leading transport data
+ * @param  sum_length : Length of leading transport data summed
+ * @retval uint8_t    : Error = 0, Success = 1
+ ****************************************************************/
+uint8_t ip_transport_checksum_valid_sum(ethernet_handle_t *ethernet, uint32_t data_sum, uint16_t sum_length)
+{
+    net_packet_t *packet;
+
+    uint8_t *transport;
+
+    uint32_t sum      = 0;
+    uint32_t rest_sum = 0;
+    uint16_t data_length = 0;
+
+    packet = ether_get_packet(ethernet);
+
+    if(packet->l4_checked == 0 && packet->l4_header_length)
+    {
+        transport = &ethernet->ether_obj->data + packet->ip_header_length;
+
+        /* UDP checksum is optional, zero when not sent */
+        if(packet->ip_protocol == IP_UDP && net_load_u16(&transport[6]) == 0)
+        {
+            packet->l4_valid = 1;
+        }
+        else
+        {
+            data_length = packet->l4_length - packet->l4_header_length;
+
+            if(sum_length > data_length)
+            {
+                data_sum   = 0;
+                sum_length = 0;
+            }
+
+            ether_sum_words(&sum, packet->source_ip, 8);
+
+            sum += ( (uint16_t)packet->ip_protocol << 8 );
+
+            sum += htons(packet->l4_length);
+
+            /* Header length is a multiple of 4, data starts at even offset */
+            ether_sum_words(&sum, transport, packet->l4_header_length);
+
+            sum += data_sum;
+
+            ether_sum_words(&rest_sum, transport + packet->l4_header_length + sum_length, data_length - sum_length);
+
+            ether_sum_combine(&sum, rest_sum, sum_length);
+
+            packet->l4_valid = (ether_get_checksum(sum) == 0);
+        }
+    }
+
+    packet->l4_checked = 1;
+
+    return packet->l4_valid;
+}
+
+
+
+/****************************************************************
+ * @brief  Function to copy transport data (TCP, UDP) of received
+ *         packet and validate transport checksum in the same
+ *         pass over data, (data is copied even if invalid)
+ * @param  *ethernet     : reference to the Ethernet handle
+ * @param  *destination  : copy of transport data
+ * @param  length        : Bytes copied from start of data
+ * @retval uint8_t       : Error = 0, Success = 1
+ ****************************************************************/
+uint8_t ip_transport_copy_data(ethernet_handle_t *ethernet, void *destination, uint16_t length)
+{
+    net_packet_t *packet;
+
+    uint8_t *data;
+
+    uint32_t data_sum = 0;
+
+    packet = ether_get_packet(ethernet);
+
+    data = &ethernet->ether_obj->data + packet->ip_header_length + packet->l4_header_length;
+
+    if(packet->l4_checked)
+    {
+        memcpy(destination, data, length);
+    }
+    else
+    {
+        ether_copy_sum(&data_sum, destination, data, length);
+
+        ip_transport_checksum_valid_sum(ethernet, data_sum, length);
+    }
+
+    return packet->l4_valid;
+}
+
+
+
+
 /**************************************************************
  * @brief  Function to get IP data for current host device
- *         validates IP Checksum, (Only handles UNICAST)
+ *         uses checksum validated by packet parser,
+ *         (Only handles UNICAST)
  * @param  *ethernet  : reference to the Ethernet handle
  * @retval int16_t    : Error   = -4, -5,
  *                      Success = 1 (UNICAST),
@@ -81,9 +534,7 @@ int16_t get_ip_communication_type(ethernet_handle_t *ethernet)
 {
     int16_t func_retval = 0;
 
-    net_ip_t *ip;
-
-    uint32_t sum = 0;
+    net_packet_t *packet;
 
     if(ethernet->ether_obj == NULL)
     {
@@ -91,21 +542,19 @@ int16_t get_ip_communication_type(ethernet_handle_t *ethernet)
     }
     else
     {
-        ip = (void*)&ethernet->ether_obj->data;
+        packet = ether_get_packet(ethernet);
 
-        /* Validate IP header checksum */
-        ether_sum_words(&sum, ip, (ip->version_length.header_length) * 4);
-
-        if( (ether_get_checksum(sum) == 0)  )
+        if(packet->ip_valid)
         {
             /* Check if UNICAST (temporarily make UNICAST unaccessible when requesting IP through DHCP, dynamic IP) */
             /* mode_dhcp_req bit is cleared by DHCP state machine, done for better throughput during requesting.    */
-            if( (strncmp((char*)ip->destination_ip, (char*)ethernet->host_ip, 4) == 0) && ethernet->status.mode_dhcp_init != 1 )
+            if( (memcmp(packet->destination_ip, ethernet->host_ip, ETHER_IPV4_SIZE) == 0 || packet->destination_ip[0] == IP_LOOPBACK_NET) \
+                    && ethernet->status.mode_dhcp_init != 1 )
             {
                 func_retval = 1;
             }
             /* Check if BROADCAST */
-            else if( strncmp((char*)ip->destination_ip, (char*)ethernet->broadcast_ip, 4) == 0 )
+            else if( memcmp(packet->destination_ip, ethernet->broadcast_ip, ETHER_IPV4_SIZE) == 0 )
             {
                 func_retval = 2;
             }
@@ -132,11 +581,7 @@ ip_protocol_type_t get_ip_protocol_type(ethernet_handle_t *ethernet)
 {
     ip_protocol_type_t protocol;
 
-    net_ip_t *ip;
-
-    ip = (void*)&ethernet->ether_obj->data;
-
-    protocol = (ip_protocol_type_t)ip->protocol;
+    protocol = (ip_protocol_type_t)ether_get_packet(ethernet)->ip_protocol;
 
     return protocol;
 }
@@ -208,7 +653,166 @@ int8_t fill_ip_frame(net_ip_t *ip, uint16_t *id, uint8_t *destination_ip, uint8_
 
 
 
+/******************************************************************
+ * @brief  Function to add route, replaces route to same network
+ *         on the interface, (interface address routes are added
+ *         implicitly: connected subnet and default gateway)
+ * @param  *ethernet    : reference to the outgoing interface
+ * @param  *destination : destination network
+ * @param  *netmask     : destination network mask
+ * @param  *gateway     : next hop, NULL or 0.0.0.0 = on link
+ * @retval int8_t       : Error = -1 (table full), Success = 0
+ ******************************************************************/
+int8_t ip_route_add(ethernet_handle_t *ethernet, uint8_t *destination, uint8_t *netmask, uint8_t *gateway)
+{
+    int8_t func_retval = -1;
 
+    ip_route_t *route = NULL;
 
+    uint8_t index = 0;
+
+    if(ethernet == NULL || destination == NULL || netmask == NULL)
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        for(index = 0; index < IP_ROUTE_TABLE_SIZE; index++)
+        {
+            if(route_table[index].interface == ethernet && memcmp(route_table[index].netmask, netmask, ETHER_IPV4_SIZE) == 0 && \
+               ip_network_match(destination, route_table[index].destination, netmask))
+            {
+                route = &route_table[index];
+
+                break;
+            }
+            else if(route == NULL && route_table[index].interface == NULL)
+            {
+                route = &route_table[index];
+            }
+        }
+
+        if(route != NULL)
+        {
+            memset(route, 0, sizeof(ip_route_t));
+
+            for(index = 0; index < ETHER_IPV4_SIZE; index++)
+                route->destination[index] = destination[index] & netmask[index];
+
+            memcpy(route->netmask, netmask, ETHER_IPV4_SIZE);
+
+            if(gateway != NULL)
+                memcpy(route->gateway, gateway, ETHER_IPV4_SIZE);
+
+            route->prefix_length = ip_prefix_length(netmask);
+            route->interface     = ethernet;
+
+            ip_route_cache_flush();
+
+            func_retval = 0;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Function to delete route
+ * @param  *ethernet    : reference to the outgoing interface
+ * @param  *destination : destination network
+ * @param  *netmask     : destination network mask
+ * @retval int8_t       : Error = -1 (not found), Success = 0
+ ******************************************************************/
+int8_t ip_route_delete(ethernet_handle_t *ethernet, uint8_t *destination, uint8_t *netmask)
+{
+    int8_t func_retval = -1;
+
+    uint8_t index = 0;
+
+    if(ethernet == NULL || destination == NULL || netmask == NULL)
+    {
+        func_retval = -1;
+    }
+    else
+    {
+        for(index = 0; index < IP_ROUTE_TABLE_SIZE; index++)
+        {
+            if(route_table[index].interface == ethernet && memcmp(route_table[index].netmask, netmask, ETHER_IPV4_SIZE) == 0 && \
+               ip_network_match(destination, route_table[index].destination, netmask))
+            {
+                memset(&route_table[index], 0, sizeof(ip_route_t));
+
+                func_retval = 0;
+            }
+        }
+
+        ip_route_cache_flush();
+    }
+
+    return func_retval;
+}
 
 
+
+/******************************************************************
+ * @brief  Function to clear destination cache, called when routes
+ *         or interface addresses change
+ * @retval int8_t : Success = 0
+ ******************************************************************/
+int8_t ip_route_cache_flush(void)
+{
+    memset(route_cache, 0, sizeof(route_cache));
+
+    route_cache_next = 0;
+
+    return 0;
+}
+
+
+
+/******************************************************************
+ * @brief  Function to get outgoing interface and next hop for
+ *         destination, (longest prefix match, cached)
+ * @param  *destination_ip    : destination IP address
+ * @param  *next_hop          : gateway or destination IP address
+ * @retval ethernet_handle_t* : No route = NULL, Success = interface
+ ******************************************************************/
+ethernet_handle_t* ip_route_lookup(uint8_t *destination_ip, uint8_t *next_hop)
+{
+    ethernet_handle_t *func_retval = NULL;
+
+    if(destination_ip != NULL && next_hop != NULL)
+        func_retval = ip_route_cached(NULL, destination_ip, next_hop);
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Function to get next hop for destination on interface,
+ *         off link destinations go through the gateway, without
+ *         a route (or broadcast) destination is on link
+ * @param  *ethernet       : reference to the Ethernet handle
+ * @param  *destination_ip : destination IP address
+ * @param  *next_hop       : gateway or destination IP address
+ * @retval uint8_t         : On link (no route) = 0, Success = 1
+ ******************************************************************/
+uint8_t ip_route_next_hop(ethernet_handle_t *ethernet, uint8_t *destination_ip, uint8_t *next_hop)
+{
+    uint8_t func_retval = 0;
+
+    if(memcmp(destination_ip, ethernet->broadcast_ip, ETHER_IPV4_SIZE) != 0 && \
+       ip_route_cached(ethernet, destination_ip, next_hop) != NULL)
+    {
+        func_retval = 1;
+    }
+    else
+    {
+        memcpy(next_hop, destination_ip, ETHER_IPV4_SIZE);
+    }
+
+    return func_retval;
+}
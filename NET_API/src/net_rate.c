@@ -0,0 +1,254 @@
+/**
+ ******************************************************************************
+ * @file    net_rate.c
+ * @author  Aditya Mall,
+ * @brief   Network rate limiting (token bucket) source file
+ *
+ *  Info
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * <h2><center>&copy; COPYRIGHT(c) 2019 Aditya Mall, MIT License </center></h2>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Aditya Mall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************
+ */
+
+
+
+
+/*
+ * Standard header and api header files
+ */
+#include <stdlib.h>
+
+#include "net_rate.h"
+
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                              Private Functions                             */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+
+/*****************************************************************
+ * @brief  Static function to add tokens for time elapsed since
+ *         last refill, up to bucket size
+ * @param  *bucket : Reference to token bucket
+ * @param  time_ms : Current monotonic time (ms)
+ * @retval int8_t  : Error = 0, Success = 1
+ *****************************************************************/
+static int8_t net_rate_refill(net_rate_t *bucket, uint32_t time_ms)
+{
+    int8_t func_retval = 0;
+
+    uint64_t tokens  = 0;
+    uint32_t elapsed = 0;
+
+    if(bucket == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        if(bucket->time_valid)
+        {
+            elapsed = time_ms - bucket->last_time;
+
+            /* rate (bytes/s) x elapsed (ms) = milli-bytes */
+            tokens = bucket->tokens + (uint64_t)bucket->rate * elapsed;
+
+            if(tokens > (uint64_t)bucket->burst * 1000)
+                tokens = (uint64_t)bucket->burst * 1000;
+
+            bucket->tokens = (uint32_t)tokens;
+        }
+
+        bucket->last_time  = time_ms;
+        bucket->time_valid = 1;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                            Rate Limit Functions                            */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+
+/*****************************************************************
+ * @brief  Function to initialize token bucket, bucket starts
+ *         full
+ * @param  *bucket : Reference to token bucket
+ * @param  rate    : Fill rate (bytes per second), 0 = no limit
+ * @param  burst   : Bucket size (bytes)
+ * @retval int8_t  : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_rate_init(net_rate_t *bucket, uint32_t rate, uint32_t burst)
+{
+    int8_t func_retval = 0;
+
+    if(bucket == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        bucket->time_valid = 0;
+
+        func_retval = net_rate_set(bucket, rate, burst);
+
+        bucket->tokens = bucket->burst * 1000;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*****************************************************************
+ * @brief  Function to change token bucket rate and size,
+ *         available tokens are kept
+ * @param  *bucket : Reference to token bucket
+ * @param  rate    : Fill rate (bytes per second), 0 = no limit
+ * @param  burst   : Bucket size (bytes)
+ * @retval int8_t  : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_rate_set(net_rate_t *bucket, uint32_t rate, uint32_t burst)
+{
+    int8_t func_retval = 0;
+
+    if(bucket == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        if(burst > NET_RATE_MAX_BURST)
+            burst = NET_RATE_MAX_BURST;
+
+        bucket->rate  = rate;
+        bucket->burst = burst;
+
+        if(bucket->tokens > burst * 1000)
+            bucket->tokens = burst * 1000;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*****************************************************************
+ * @brief  Function to get time until bytes can be sent, packets
+ *         larger than bucket wait for a full bucket
+ * @param  *bucket  : Reference to token bucket
+ * @param  bytes    : Packet length (bytes)
+ * @param  time_ms  : Current monotonic time (ms)
+ * @retval uint32_t : Send now = 0, else wait time (ms)
+ *****************************************************************/
+uint32_t net_rate_delay(net_rate_t *bucket, uint32_t bytes, uint32_t time_ms)
+{
+    uint32_t func_retval = 0;
+
+    uint32_t needed = 0;
+
+    if(bucket == NULL || bucket->rate == 0)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        net_rate_refill(bucket, time_ms);
+
+        if(bytes > bucket->burst)
+            bytes = bucket->burst;
+
+        needed = bytes * 1000;
+
+        if(bucket->tokens >= needed)
+            func_retval = 0;
+        else
+            func_retval = (needed - bucket->tokens + bucket->rate - 1) / bucket->rate;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*****************************************************************
+ * @brief  Function to take tokens for packet if available
+ * @param  *bucket : Reference to token bucket
+ * @param  bytes   : Packet length (bytes)
+ * @param  time_ms : Current monotonic time (ms)
+ * @retval uint8_t : Over limit = 0, Send = 1
+ *****************************************************************/
+uint8_t net_rate_consume(net_rate_t *bucket, uint32_t bytes, uint32_t time_ms)
+{
+    uint8_t func_retval = 0;
+
+    if(bucket == NULL || bucket->rate == 0)
+    {
+        func_retval = 1;
+    }
+    else if(net_rate_delay(bucket, bytes, time_ms))
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        if(bytes > bucket->burst)
+            bytes = bucket->burst;
+
+        bucket->tokens -= bytes * 1000;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
@@ -0,0 +1,234 @@
+/**
+ ******************************************************************************
+ * @file    net_task.c
+ * @author  Aditya Mall,
+ * @brief   Cooperative tasks (protothreads) source file
+ *
+ *  Info
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * <h2><center>&copy; COPYRIGHT(c) 2019 Aditya Mall, MIT License </center></h2>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Aditya Mall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************
+ */
+
+
+
+
+/*
+ * Standard header and api header files
+ */
+#include <stdlib.h>
+
+#include "net_task.h"
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                      Data Structures and Defines                           */
+/*                                                                            */
+/******************************************************************************/
+
+
+/* Task list, tasks are run in creation order */
+static net_task_t *task_list;
+
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                              Private Functions                             */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+
+/*****************************************************************
+ * @brief  Static expiry function of task sleep timer
+ * @param  *timer   : Reference to network timer
+ * @param  *context : Reference to network task
+ * @retval None
+ *****************************************************************/
+static void net_task_wakeup(net_timer_t *timer, void *context)
+{
+    net_task_t *task = context;
+
+    (void)timer;
+
+    task->sleeping = 0;
+}
+
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                               Task Functions                               */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+
+/*****************************************************************
+ * @brief  Function to create task and add it to task list
+ * @param  *task     : Reference to network task
+ * @param  function  : Task thread function
+ * @param  *context  : User context passed to thread function
+ * @retval int8_t    : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_task_create(net_task_t *task, net_task_function_t function, void *context)
+{
+    int8_t func_retval = 0;
+
+    net_task_t **link;
+
+    if(task == NULL || function == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        PT_INIT(&task->pt);
+
+        task->function = function;
+        task->context  = context;
+        task->sleeping = 0;
+        task->next     = NULL;
+
+        net_timer_init(&task->timer, net_task_wakeup, task);
+
+        /* Add to end of list */
+        link = &task_list;
+
+        while(*link != NULL)
+            link = &(*link)->next;
+
+        *link = task;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*****************************************************************
+ * @brief  Function to remove task from task list
+ * @param  *task   : Reference to network task
+ * @retval int8_t  : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_task_kill(net_task_t *task)
+{
+    int8_t func_retval = 0;
+
+    net_task_t **link;
+
+    if(task == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        link = &task_list;
+
+        while(*link != NULL && *link != task)
+            link = &(*link)->next;
+
+        if(*link == task)
+        {
+            *link = task->next;
+
+            task->next = NULL;
+
+            net_timer_stop(&task->timer);
+
+            func_retval = 1;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*****************************************************************
+ * @brief  Function to run network timers and tasks once, called
+ *         from application poll loop, waiting tasks are run on
+ *         every call and check their wait condition, sleeping
+ *         tasks run after their timer expires
+ * @param  time_ms  : Current monotonic time (ms)
+ * @retval uint8_t  : Number of tasks in task list
+ *****************************************************************/
+uint8_t net_task_run(uint32_t time_ms)
+{
+    uint8_t func_retval = 0;
+
+    net_task_t *task;
+    net_task_t *next;
+
+    int8_t thread_state = 0;
+
+    /* Expired timers wake sleeping tasks */
+    net_timer_run(time_ms);
+
+    task = task_list;
+
+    while(task != NULL)
+    {
+        /* Task may kill itself */
+        next = task->next;
+
+        if(task->sleeping == 0)
+        {
+            thread_state = task->function(task, task->context);
+
+            /* Exited and ended tasks are removed */
+            if(thread_state >= PT_EXITED)
+                net_task_kill(task);
+            else
+                func_retval++;
+        }
+        else
+        {
+            func_retval++;
+        }
+
+        task = next;
+    }
+
+    return func_retval;
+}
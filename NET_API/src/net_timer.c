@@ -0,0 +1,405 @@
+/**
+ ******************************************************************************
+ * @file    net_timer.c
+ * @author  Aditya Mall,
+ * @brief   Network protocol timers (hierarchical timer wheel) source file
+ *
+ *  Info
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * <h2><center>&copy; COPYRIGHT(c) 2019 Aditya Mall, MIT License </center></h2>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Aditya Mall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************
+ */
+
+
+
+
+/*
+ * Standard header and api header files
+ */
+#include <stdlib.h>
+
+#include "net_timer.h"
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                      Data Structures and Defines                           */
+/*                                                                            */
+/******************************************************************************/
+
+
+#define NET_TIMER_SLOT_MASK  (NET_TIMER_SLOTS - 1)
+
+/* Max timeout in wheel ticks, longer timers are cascaded again from last level */
+#define NET_TIMER_MAX_TICKS  ((uint32_t)1 << (NET_TIMER_LEVELS * NET_TIMER_SLOT_BITS))
+
+
+/* Hierarchical timer wheel, level 0 slots are one tick, each next level slot covers a full lower level */
+typedef struct _net_timer_wheel
+{
+    net_timer_t *slots[NET_TIMER_LEVELS][NET_TIMER_SLOTS];  /*!< Timer lists per level and slot         */
+    uint32_t     tick;                                      /*!< Current wheel tick                     */
+    uint32_t     time_ms;                                   /*!< Time of current wheel tick (ms)        */
+    uint16_t     timer_count;                               /*!< Number of running timers               */
+    uint8_t      time_valid;                                /*!< Wheel time synchronized to clock       */
+
+}net_timer_wheel_t;
+
+
+/* Timer wheel shared by all protocols */
+static net_timer_wheel_t timer_wheel;
+
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                              Private Functions                             */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+
+/*****************************************************************
+ * @brief  Static function to link timer into wheel slot from
+ *         time left to expiry
+ * @param  *timer : Reference to network timer
+ * @retval int8_t : Error = 0, Success = 1
+ *****************************************************************/
+static int8_t net_timer_link(net_timer_t *timer)
+{
+    int8_t func_retval = 0;
+
+    net_timer_t **slot;
+
+    uint32_t ticks   = 0;
+    uint32_t expires = 0;
+    uint8_t  level   = 0;
+
+    if(timer == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        expires = timer->expires;
+        ticks   = expires - timer_wheel.tick;
+
+        /* Expired timers go to current slot, (cascaded timers due now) */
+        if((int32_t)ticks < 0)
+        {
+            expires = timer_wheel.tick;
+            ticks   = 0;
+        }
+
+        /* Timers beyond wheel range are placed in last slot and cascaded again */
+        if(ticks >= NET_TIMER_MAX_TICKS)
+        {
+            expires = timer_wheel.tick + NET_TIMER_MAX_TICKS - 1;
+            ticks   = NET_TIMER_MAX_TICKS - 1;
+        }
+
+        /* Level with slot size below time left */
+        while(level < NET_TIMER_LEVELS - 1 && ticks >= ((uint32_t)1 << ((level + 1) * NET_TIMER_SLOT_BITS)))
+            level++;
+
+        slot = &timer_wheel.slots[level][(expires >> (level * NET_TIMER_SLOT_BITS)) & NET_TIMER_SLOT_MASK];
+
+        /* Insert at head */
+        timer->next  = *slot;
+        timer->pprev = slot;
+
+        if(*slot != NULL)
+            (*slot)->pprev = &timer->next;
+
+        *slot = timer;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/*****************************************************************
+ * @brief  Static function to unlink timer from wheel slot
+ * @param  *timer : Reference to network timer
+ * @retval int8_t : Error = 0, Success = 1
+ *****************************************************************/
+static int8_t net_timer_unlink(net_timer_t *timer)
+{
+    int8_t func_retval = 0;
+
+    if(timer == NULL || timer->pprev == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        *timer->pprev = timer->next;
+
+        if(timer->next != NULL)
+            timer->next->pprev = timer->pprev;
+
+        timer->next  = NULL;
+        timer->pprev = NULL;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/*****************************************************************
+ * @brief  Static function to move timers of higher level slot
+ *         to lower levels
+ * @param  level   : Timer wheel level
+ * @param  index   : Slot index
+ * @retval uint8_t : Slot index (0 = cascade next level)
+ *****************************************************************/
+static uint8_t net_timer_cascade(uint8_t level, uint8_t index)
+{
+    net_timer_t *timer;
+    net_timer_t *next;
+
+    timer = timer_wheel.slots[level][index];
+
+    timer_wheel.slots[level][index] = NULL;
+
+    while(timer != NULL)
+    {
+        next = timer->next;
+
+        net_timer_link(timer);
+
+        timer = next;
+    }
+
+    return index;
+}
+
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                               Timer Functions                              */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+
+/*****************************************************************
+ * @brief  Function to initialize network timer
+ * @param  *timer    : Reference to network timer
+ * @param  callback  : Expiry function
+ * @param  *context  : User context passed to expiry function
+ * @retval int8_t    : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_timer_init(net_timer_t *timer, net_timer_callback_t callback, void *context)
+{
+    int8_t func_retval = 0;
+
+    if(timer == NULL || callback == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        timer->next     = NULL;
+        timer->pprev    = NULL;
+        timer->expires  = 0;
+        timer->callback = callback;
+        timer->context  = context;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*****************************************************************
+ * @brief  Function to start or restart network timer, timeout
+ *         is counted from last net_timer_run() call
+ * @param  *timer     : Reference to network timer
+ * @param  timeout_ms : Timeout (ms)
+ * @retval int8_t     : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_timer_start(net_timer_t *timer, uint32_t timeout_ms)
+{
+    int8_t func_retval = 0;
+
+    uint32_t ticks = 0;
+
+    if(timer == NULL || timer->callback == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        if(net_timer_unlink(timer) == 0)
+            timer_wheel.timer_count++;
+
+        /* Round up, timer never expires early, (at least next tick) */
+        ticks = (timeout_ms + NET_TIMER_TICK_MS - 1) / NET_TIMER_TICK_MS;
+
+        if(ticks == 0)
+            ticks = 1;
+
+        timer->expires = timer_wheel.tick + ticks;
+
+        func_retval = net_timer_link(timer);
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*****************************************************************
+ * @brief  Function to stop network timer
+ * @param  *timer  : Reference to network timer
+ * @retval int8_t  : Error = 0, Success = 1
+ *****************************************************************/
+int8_t net_timer_stop(net_timer_t *timer)
+{
+    int8_t func_retval = 0;
+
+    if(net_timer_unlink(timer))
+    {
+        timer_wheel.timer_count--;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+
+/*****************************************************************
+ * @brief  Function to check if network timer is running
+ * @param  *timer  : Reference to network timer
+ * @retval uint8_t : Stopped = 0, Running = 1
+ *****************************************************************/
+uint8_t net_timer_pending(net_timer_t *timer)
+{
+    return (timer != NULL && timer->pprev != NULL);
+}
+
+
+
+
+/*****************************************************************
+ * @brief  Function to advance timer wheel to current time and
+ *         call expiry functions of expired timers
+ * @param  time_ms  : Current monotonic time (ms)
+ * @retval uint16_t : Number of timers expired
+ *****************************************************************/
+uint16_t net_timer_run(uint32_t time_ms)
+{
+    uint16_t func_retval = 0;
+
+    net_timer_t *timer;
+    net_timer_t *expired;
+
+    uint32_t ticks = 0;
+    uint8_t  index = 0;
+    uint8_t  level = 0;
+
+    /* First call sets wheel time, timers started before run from here */
+    if(timer_wheel.time_valid == 0)
+    {
+        timer_wheel.time_ms    = time_ms;
+        timer_wheel.time_valid = 1;
+    }
+
+    ticks = (time_ms - timer_wheel.time_ms) / NET_TIMER_TICK_MS;
+
+    timer_wheel.time_ms += ticks * NET_TIMER_TICK_MS;
+
+    while(ticks)
+    {
+        /* No timers, skip to current tick */
+        if(timer_wheel.timer_count == 0)
+        {
+            timer_wheel.tick += ticks;
+
+            break;
+        }
+
+        timer_wheel.tick++;
+        ticks--;
+
+        /* Lower level wrapped, cascade next level slot */
+        index = timer_wheel.tick & NET_TIMER_SLOT_MASK;
+
+        for(level = 1; index == 0 && level < NET_TIMER_LEVELS; level++)
+            index = net_timer_cascade(level, (timer_wheel.tick >> (level * NET_TIMER_SLOT_BITS)) & NET_TIMER_SLOT_MASK);
+
+        /* Detach expired list, timers restarted by expiry function are linked from next tick */
+        index = timer_wheel.tick & NET_TIMER_SLOT_MASK;
+
+        expired = timer_wheel.slots[0][index];
+
+        timer_wheel.slots[0][index] = NULL;
+
+        if(expired != NULL)
+            expired->pprev = &expired;
+
+        while(expired != NULL)
+        {
+            timer = expired;
+
+            net_timer_unlink(timer);
+
+            timer_wheel.timer_count--;
+
+            timer->callback(timer, timer->context);
+
+            func_retval++;
+        }
+    }
+
+    return func_retval;
+}
@@ -142,6 +142,38 @@ uint32_t htonl(uint32_t x)
 
 
 
+/************************************************************************
+ * @brief  Function to load 16 bit network order field, byte loads so
+ *         field may be at any address in the frame
+ * @param  *data    : reference to the field
+ * @retval uint16_t : field value (host order)
+ ************************************************************************/
+uint16_t net_load_u16(const void *data)
+{
+    const uint8_t *bytes = data;
+
+    return (uint16_t)( ((uint16_t)bytes[0] << 8) | bytes[1] );
+}
+
+
+
+
+/************************************************************************
+ * @brief  Function to load 32 bit network order field, byte loads so
+ *         field may be at any address in the frame
+ * @param  *data    : reference to the field
+ * @retval uint32_t : field value (host order)
+ ************************************************************************/
+uint32_t net_load_u32(const void *data)
+{
+    const uint8_t *bytes = data;
+
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+
+
+
 
 
 /********************************************************
@@ -65,32 +65,49 @@
 
 
 #define TCP_FRAME_SIZE    20
-#define TCP_SYN_OPTS_SIZE 12
+#define TCP_SYN_OPTS_SIZE 20
 
-/**/
-typedef struct _net_tcp
-{
-    uint16_t source_port;      /*!< TCP source port                 */
-    uint16_t destination_port; /*!< TCP destination port            */
-    uint32_t sequence_number;  /*!< TCP packet sequence number      */
-    uint32_t ack_number;       /*!< TCP acknowledgment number       */
-    uint8_t  data_offset;      /*!< TCP data offset (header length) */
-    uint8_t  control_bits;     /*!< TCP control flags               */
-    uint16_t window;           /*!< TCP window size                 */
-    uint16_t checksum;         /*!< TCP checksum                    */
-    uint16_t urgent_pointer;   /*!< TCP urgent pointer              */
-    uint8_t  data;             /*!< TCP data, also contains options */
+#define TCP_DEFAULT_MSS   536  /*!< Server MSS when SYN ACK carries no MSS option */
+#define TCP_MAX_WIN_SCALE 14   /*!< Max window scale shift (RFC 7323)             */
+#define TCP_WINDOW_SCALE  0    /*!< Window scale shift sent in SYN, (window <= APP_BUFF_SIZE) */
+
+#define TCP_SACK_BLOCK_SIZE 8  /*!< SACK block size in SACK option (start, end)   */
+#define TCP_MAX_OPTS_SIZE   40 /*!< Max TCP options length                        */
+
+#define TCP_ACK_DELAY     200    /*!< Delayed ACK timeout (ms), RFC 1122 limit is 500 ms */
+#define TCP_ACK_SEGMENTS  2      /*!< ACK at least every second segment              */
+#define TCP_INITIAL_RTO   1000   /*!< Initial retransmission timeout (ms)            */
+#define TCP_MIN_RTO       200    /*!< Min retransmission timeout from RTT (ms)       */
+#define TCP_MAX_RTO       60000  /*!< Max retransmission timeout after backoff (ms)  */
+#define TCP_MAX_RETRIES   8      /*!< Retransmission timeouts before connection abort */
+#define TCP_DUPACK_THRESHOLD 3   /*!< Duplicate ACKs before fast retransmit (RFC 5681) */
 
-}net_tcp_t;
+#define TCP_TIMER_ACK     0x01   /*!< Delayed ACK timer expired                      */
+#define TCP_TIMER_RTO     0x02   /*!< Retransmission timer expired                   */
+#define TCP_TIMER_PACE    0x04   /*!< Rate limit or pacing delay expired             */
+#define TCP_PACE_SEGMENTS 2      /*!< Pacing burst (segments)                        */
 
+/* Max TCP payload that fits in network data buffer along with PHY, Ethernet, IP and TCP headers */
+#define TCP_SEGMENT_MAX_DATA (ETHER_MTU_SIZE - ETHER_PHY_DATA_OFFSET - ETHER_FRAME_SIZE - IP_HEADER_SIZE - TCP_FRAME_SIZE)
+
+/* MSS sent in SYN, server segments carrying timestamps must still fit in network data buffer */
+#define TCP_RECV_MSS (TCP_SEGMENT_MAX_DATA - TCP_TS_OPTS_SIZE)
+
+/* Sequence number comparison (modulo 2^32) */
+#define TCP_SEQ_LT(a, b)  ((int32_t)((a) - (b)) < 0)
+#define TCP_SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
+#define TCP_SEQ_GT(a, b)  ((int32_t)((a) - (b)) > 0)
+#define TCP_SEQ_GEQ(a, b) ((int32_t)((a) - (b)) >= 0)
 
 /* TCP Option value */
 typedef enum _tcp_option_kinds
 {
+    TCP_END_OF_OPTIONS   = 0,  /*!< End of options list  */
     TCP_NO_OPERATION     = 1,  /*!< No operation option   */
     TCP_MAX_SEGMENT_SIZE = 2,  /*!< MAX segment size      */
     TCP_WINDOW_SCALING   = 3,  /*!< Window scaling offset */
-    TCP_SACK_PERMITTED   = 4,  /*!< */
+    TCP_SACK_PERMITTED   = 4,  /*!< SACK permitted        */
+    TCP_SACK             = 5,  /*!< SACK blocks           */
     TCP_TIMESTAMPS       = 8,  /*!< TCP time stamp        */
 
 }tcp_opts_kind;
@@ -133,19 +150,56 @@ typedef struct tcp_window_scaling
 }tcp_win_scale_t;
 
 
+/* Timestamps option, (byte arrays, option is not aligned) */
+typedef struct tcp_timestamps
+{
+    uint8_t option_kind;    /*!< */
+    uint8_t length;         /*!< */
+    uint8_t value[4];       /*!< Timestamp value (TSval)        */
+    uint8_t echo_reply[4];  /*!< Timestamp echo reply (TSecr)   */
+
+}tcp_timestamp_t;
+
+
 /**/
 typedef struct _tcp_syn_options
 {
     tcp_mss_t       mss;           /*!< */
-//    tcp_sack_t      sack;          /*!< */
+    tcp_sack_t      sack;          /*!< */
+    tcp_timestamp_t timestamp;     /*!< */
     tcp_nop_t       nop;           /*!< */
-//    tcp_nop_t       nop1;          /*!< */
-//    tcp_nop_t       nop2;          /*!< */
     tcp_win_scale_t window_scale;  /*!< */
 
 }tcp_syn_opts_t;
 
 
+/* Received TCP segment */
+typedef struct _tcp_segment
+{
+    uint32_t        sequence_number;  /*!< Segment sequence number       */
+    uint32_t        ack_number;       /*!< Segment acknowledgment number */
+    uint16_t        data_length;      /*!< Segment data length           */
+    tcp_ctl_flags_t control_bits;     /*!< Segment control flags         */
+    uint8_t         timestamps;       /*!< Segment has timestamps option */
+    uint32_t        ts_value;         /*!< Server timestamp value        */
+    uint32_t        ts_echo;          /*!< Echoed client timestamp       */
+    uint32_t        bytes_acked;      /*!< Bytes newly acknowledged      */
+    uint8_t         dup_ack;          /*!< Segment is a duplicate ACK    */
+
+}tcp_segment_t;
+
+
+/* Prebuilt Ethernet, IP and TCP headers for sending data segments */
+typedef struct _tcp_segment_template
+{
+    uint8_t  header[TCP_HEADER_CACHE];  /*!< Ethernet, IP and TCP header template  */
+    uint8_t  tcp_header_length;         /*!< TCP header length, with options       */
+    uint32_t ip_sum;                    /*!< IP header sum, without length and id  */
+    uint32_t tcp_sum;                   /*!< TCP header sum, without length and SEQ */
+
+}tcp_template_t;
+
+
 
 
 /******************************************************************************/
@@ -211,41 +265,21 @@ static uint16_t get_tcp_checksum(net_ip_t *ip, net_tcp_t *tcp, uint16_t data_len
 
 
 /******************************************************
- * @brief  Static function to validate TCP checksum
- * @param  *ip     : Reference to IP frame structure
- * @param  *udp    : Reference to TCP frame structure
- * @retval uint8_t : Error = 0, Success = 1
+ * @brief  Static function to get TCP header of
+ *         received packet, (after IP options)
+ * @param  *ethernet  : Reference to Ethernet handle
+ * @retval net_tcp_t* : Reference to TCP header
  ******************************************************/
-static uint8_t validate_tcp_checksum(net_ip_t *ip, net_tcp_t *tcp)
+static net_tcp_t* tcp_get_header(ethernet_handle_t *ethernet)
 {
-    uint8_t func_retval      = 0;
-    uint32_t sum             = 0;
-    uint16_t pseudo_protocol = 0;
-    uint16_t tcp_length      = 0;
-
-    if(ip == NULL || tcp == NULL)
-    {
-        func_retval = 0;
-    }
-    else
-    {
-        /* validate TCP checksum */
-        sum = 0;
-
-        ether_sum_words(&sum, &ip->source_ip, 8);
-
-        pseudo_protocol = ip->protocol;
+    net_tcp_t *func_retval;
 
-        sum += ( (pseudo_protocol & 0xFF) << 8 );
-
-        tcp_length = ( ntohs(ip->total_length) - IP_HEADER_SIZE );
+    uint8_t ip_header_length = ether_get_packet(ethernet)->ip_header_length;
 
-        sum += htons(tcp_length);
+    if(ip_header_length == 0)
+        ip_header_length = IP_HEADER_SIZE;
 
-        ether_sum_words(&sum, tcp, tcp_length);
-
-        func_retval = (ether_get_checksum(sum) == 0);
-    }
+    func_retval = (void*)( &ethernet->ether_obj->data + ip_header_length );
 
     return func_retval;
 }
@@ -331,6 +365,8 @@ static int8_t ether_send_tcp_syn(ethernet_handle_t *ethernet,
     net_tcp_t *tcp;
     tcp_syn_opts_t *syn_option;
 
+    uint32_t time_value = 0;
+
     /* Ethernet Frame related variables */
     uint8_t  destination_mac[ETHER_MAC_SIZE] = {0};
 
@@ -353,10 +389,14 @@ static int8_t ether_send_tcp_syn(ethernet_handle_t *ethernet,
         tcp->ack_number       = htonl(ack_number);
 
         /* Shift data offset to Big-Endian MSB (4 bits) */
-        tcp->data_offset      = ((TCP_FRAME_SIZE + 12) >> 2) << 4;
+        tcp->data_offset      = ((TCP_FRAME_SIZE + TCP_SYN_OPTS_SIZE) >> 2) << 4;
         tcp->control_bits     = TCP_SYN;
 
-        tcp->window           = ntohs(1);
+        /* Window in SYN is never scaled, space left in application buffer */
+        if(ethernet->net_app_data_length < APP_BUFF_SIZE)
+            tcp->window       = htons(APP_BUFF_SIZE - ethernet->net_app_data_length);
+        else
+            tcp->window       = 0;
         tcp->urgent_pointer   = 0;
 
         /* Configure TCP options */
@@ -364,18 +404,28 @@ static int8_t ether_send_tcp_syn(ethernet_handle_t *ethernet,
 
         syn_option->mss.option_kind = TCP_MAX_SEGMENT_SIZE;
         syn_option->mss.length      = 4;
-        syn_option->mss.value       = ntohs(1460);
+        syn_option->mss.value       = htons(TCP_RECV_MSS);
+
+        if(TCP_RECV_MSS > ethernet->mtu - IP_HEADER_SIZE - TCP_FRAME_SIZE)
+            syn_option->mss.value = htons(ethernet->mtu - IP_HEADER_SIZE - TCP_FRAME_SIZE);
+
+        syn_option->sack.option_kind = TCP_SACK_PERMITTED;
+        syn_option->sack.length      = 2;
 
-//        syn_option->sack.option_kind = TCP_SACK_PERMITTED;
-//        syn_option->sack.length      = 2;
+        /* Timestamp value from platform clock, no echo in SYN */
+        syn_option->timestamp.option_kind = TCP_TIMESTAMPS;
+        syn_option->timestamp.length      = 10;
+
+        time_value = htonl(ethernet->ether_commands->get_time_ms());
+
+        memcpy(syn_option->timestamp.value, &time_value, 4);
+        memset(syn_option->timestamp.echo_reply, 0, 4);
 
         syn_option->nop.option_kind  = TCP_NO_OPERATION;
-//        syn_option->nop1.option_kind = TCP_NO_OPERATION;
-//        syn_option->nop2.option_kind = TCP_NO_OPERATION;
 
         syn_option->window_scale.option_kind = TCP_WINDOW_SCALING;
         syn_option->window_scale.length      = 3;
-        syn_option->window_scale.value       = 7;
+        syn_option->window_scale.value       = TCP_WINDOW_SCALE;
 
 
         /* fill IP frame before TCP checksum calculation */
@@ -385,15 +435,13 @@ static int8_t ether_send_tcp_syn(ethernet_handle_t *ethernet,
         tcp->checksum = get_tcp_checksum(ip, tcp, TCP_SYN_OPTS_SIZE);
 
         /* Get MAC address from ARP table */
-        ether_arp_resolve_address(ethernet, destination_mac, destination_ip);
+        ether_arp_resolve_next_hop(ethernet, destination_mac, destination_ip);
 
         /* Fill Ethernet frame */
         fill_ether_frame(ethernet, destination_mac, ethernet->host_mac, ETHER_IPV4);
 
         /*Send TCP data */
-        ether_send_data(ethernet,(uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + htons(ip->total_length));
-
-        func_retval = 1;
+        func_retval = ether_send_data(ethernet,(uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + htons(ip->total_length));
 
     }
 
@@ -424,13 +472,8 @@ static tcp_ctl_flags_t ether_get_tcp_server_ack(ethernet_handle_t *ethernet,
 
     tcp_ctl_flags_t func_retval = (tcp_ctl_flags_t)0;
 
-    net_ip_t  *ip;
-    net_tcp_t *tcp;
-
-    uint8_t validate = 0;
-
-    uint16_t sender_src_port  = 0;
-    uint16_t sender_dest_port = 0;
+    net_packet_t *packet;
+    net_tcp_t    *tcp;
 
     if(ethernet->ether_obj == NULL || sever_ip == NULL)
     {
@@ -438,25 +481,19 @@ static tcp_ctl_flags_t ether_get_tcp_server_ack(ethernet_handle_t *ethernet,
     }
     else
     {
-        ip  = (void*)&ethernet->ether_obj->data;
-
-        tcp = (void*)( (uint8_t*)ip + IP_HEADER_SIZE );
+        packet = ether_get_packet(ethernet);
 
-        validate = validate_tcp_checksum(ip, tcp);
+        tcp = tcp_get_header(ethernet);
 
-        if(validate && ( memcmp(sever_ip, ip->source_ip, 4) == 0 ) )
+        /* Addresses and ports from descriptor, checksum last */
+        if(packet->ip_protocol == IP_TCP && packet->l4_header_length && memcmp(sever_ip, packet->source_ip, 4) == 0 && \
+           server_src_port == packet->source_port && client_src_port == packet->destination_port && \
+           ip_transport_checksum_valid(ethernet))
         {
-            sender_src_port  = ntohs(tcp->source_port);
-            sender_dest_port = ntohs(tcp->destination_port);
-
-            if(server_src_port == sender_src_port && client_src_port == sender_dest_port)
-            {
-                *sequence_number = ntohl(tcp->sequence_number);
-                *ack_number      = ntohl(tcp->ack_number);
-
-                func_retval = (tcp_ctl_flags_t)tcp->control_bits;
-            }
+            *sequence_number = net_load_u32(&tcp->sequence_number);
+            *ack_number      = net_load_u32(&tcp->ack_number);
 
+            func_retval = (tcp_ctl_flags_t)tcp->control_bits;
         }
     }
 
@@ -465,79 +502,57 @@ static tcp_ctl_flags_t ether_get_tcp_server_ack(ethernet_handle_t *ethernet,
 
 
 
-/**********************************************************
- * @brief  Function for sending TCP ACK packet
- *         sequence number and ACK number are swapped,
- *         then passed as parameters by user.
- * @param  *ethernet        : Reference to Ethernet handle
- * @param  source_port      : TCP source port
- * @param  destination_port : TCP destination port
- * @param  sequence_number  : TCP sequence number
- * @param  ack_number       : TCP acknowledgment number
- * @param  *destination_ip  : Destination server IP
- * @param  ack_type         : TCP ACK value
- * @retval int8_t           : Error = 0, Success = 1
- **********************************************************/
-static int8_t ether_send_tcp_ack(ethernet_handle_t *ethernet,
-                                 uint16_t           source_port,
-                                 uint16_t           destination_port,
-                                 uint32_t           sequence_number,
-                                 uint32_t           ack_number,
-                                 uint8_t           *destination_ip,
-                                 tcp_ctl_flags_t    ack_type)
+/*****************************************************************
+ * @brief  Static function to find option in TCP header
+ * @param  *tcp        : Reference to TCP frame structure
+ * @param  option_kind : TCP option kind
+ * @retval uint8_t*    : Error = NULL, Success = Reference to option
+ *****************************************************************/
+static uint8_t* tcp_get_option(net_tcp_t *tcp, tcp_opts_kind option_kind)
 {
+    uint8_t *func_retval = NULL;
 
-    int8_t func_retval = 0;
-
-    net_ip_t  *ip;
-    net_tcp_t *tcp;
-
-    /* Ethernet Frame related variables */
-    uint8_t  destination_mac[ETHER_MAC_SIZE] = {0};
-
+    uint8_t *options;
+    uint8_t  header_length  = 0;
+    uint8_t  options_length = 0;
+    uint8_t  index          = 0;
 
-    if(ethernet->ether_obj == NULL || destination_ip == NULL)
+    if(tcp == NULL)
     {
-        func_retval = 0;
+        func_retval = NULL;
     }
     else
     {
-        ip  = (void*)&ethernet->ether_obj->data;
-
-        tcp = (void*)( (uint8_t*)ip + IP_HEADER_SIZE );
-
-        /* Fill TCP frame */
-        tcp->source_port      = htons(source_port);
-        tcp->destination_port = htons(destination_port);
-
-        tcp->sequence_number  = htonl(sequence_number);
-        tcp->ack_number       = htonl(ack_number);
-
-        /* Shift data offset to Big-endian MSB (4 bits) */
-        tcp->data_offset      = ((TCP_FRAME_SIZE) >> 2) << 4;
-        tcp->control_bits     = (uint8_t)ack_type;
-
-        tcp->window           = ntohs(1);
-        tcp->urgent_pointer   = 0;
+        /* Get options length from data offset (Big-Endian MSB 4 bits) */
+        header_length = (tcp->data_offset >> 4) << 2;
 
-        /* Fill IP frame before TCP checksum calculation */
-        fill_ip_frame(ip, &ethernet->ip_identifier, destination_ip, ethernet->host_ip, IP_TCP, TCP_FRAME_SIZE);
+        if(header_length > TCP_FRAME_SIZE)
+            options_length = header_length - TCP_FRAME_SIZE;
 
-        /*Get TCP checksum */
-        tcp->checksum = get_tcp_checksum(ip, tcp, 0);
+        options = &tcp->data;
 
-        /* Get MAC address from ARP table */
-        ether_arp_resolve_address(ethernet, destination_mac, destination_ip);
+        while(index < options_length && options[index] != TCP_END_OF_OPTIONS)
+        {
+            if(options[index] == TCP_NO_OPERATION)
+            {
+                index++;
 
-        /* Fill Ethernet frame */
-        fill_ether_frame(ethernet, destination_mac, ethernet->host_mac, ETHER_IPV4);
+                continue;
+            }
 
-        /*Send TCP data */
-        ether_send_data(ethernet,(uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + htons(ip->total_length));
+            /* Stop on malformed option length */
+            if(index + 1 >= options_length || options[index + 1] < 2 || index + options[index + 1] > options_length)
+                break;
 
+            if(options[index] == option_kind)
+            {
+                func_retval = &options[index];
 
-        func_retval = 1;
+                break;
+            }
 
+            index += options[index + 1];
+        }
     }
 
     return func_retval;
@@ -545,44 +560,80 @@ static int8_t ether_send_tcp_ack(ethernet_handle_t *ethernet,
 
 
 
-
-/***************************************************************
- * @brief  Function to get PSH ACK packet (TCP data packet)
- * @param  *ethernet          : Reference to Ethernet handle
- * @param  *tcp_data          : TCP data / payload
- * @param  data_buffer_length : Data buffer length
- * @retval int8_t             : Error = 0, Success = bytes read
- ***************************************************************/
-static uint16_t ether_get_tcp_psh_ack(ethernet_handle_t *ethernet, char *tcp_data, uint16_t data_buffer_length)
+/*****************************************************************
+ * @brief  Static function to get server SYN ACK options
+ *         (MSS, window scale, SACK permitted, timestamps)
+ *         and initial server window
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @retval uint8_t   : Error = 0, Success = 1
+ *****************************************************************/
+static uint8_t tcp_get_syn_options(ethernet_handle_t *ethernet, tcp_handle_t *client)
 {
-    uint16_t func_retval = 0;
+    uint8_t func_retval = 0;
 
-    net_ip_t  *ip;
     net_tcp_t *tcp;
 
-    uint16_t tcp_packet_length = 0;
-    uint16_t tcp_data_length   = 0;
+    uint8_t *option;
 
-    if(ethernet->ether_obj == NULL || tcp_data == NULL || data_buffer_length > UINT16_MAX)
+    if(ethernet->ether_obj == NULL || client == NULL)
     {
         func_retval = 0;
     }
     else
     {
-        ip  = (void*)&ethernet->ether_obj->data;
+        tcp = tcp_get_header(ethernet);
 
-        tcp = (void*)( (uint8_t*)ip + IP_HEADER_SIZE );
+        /* Defaults if options are not present */
+        client->server_mss          = TCP_DEFAULT_MSS;
+        client->server_window_scale = 0;
+
+        client->client_flags.window_scaling = 0;
+        client->client_flags.sack_permitted = 0;
+        client->client_flags.timestamps     = 0;
+
+        option = tcp_get_option(tcp, TCP_MAX_SEGMENT_SIZE);
+
+        if(option != NULL && option[1] == 4)
+            client->server_mss = (option[2] << 8) | option[3];
+
+        /* Segments must also fit interface MTU, (may be lowered by DHCP) */
+        if(client->server_mss > ethernet->mtu - IP_HEADER_SIZE - TCP_FRAME_SIZE)
+            client->server_mss = ethernet->mtu - IP_HEADER_SIZE - TCP_FRAME_SIZE;
+
+        option = tcp_get_option(tcp, TCP_WINDOW_SCALING);
+
+        if(option != NULL && option[1] == 3)
+        {
+            client->server_window_scale = option[2];
 
-        tcp_packet_length = ( ntohs(ip->total_length) - IP_HEADER_SIZE );
+            if(client->server_window_scale > TCP_MAX_WIN_SCALE)
+                client->server_window_scale = TCP_MAX_WIN_SCALE;
 
-        tcp_data_length = abs(tcp_packet_length - TCP_FRAME_SIZE);
+            /* Both sides sent window scale, our window is scaled too */
+            client->client_flags.window_scaling = 1;
+        }
+
+        option = tcp_get_option(tcp, TCP_SACK_PERMITTED);
+
+        if(option != NULL && option[1] == 2)
+            client->client_flags.sack_permitted = 1;
+
+        option = tcp_get_option(tcp, TCP_TIMESTAMPS);
 
-        if(data_buffer_length > tcp_data_length)
-            data_buffer_length = tcp_data_length;
+        if(option != NULL && option[1] == 10)
+        {
+            memcpy(&client->ts_recent, &option[2], 4);
+
+            client->ts_recent = ntohl(client->ts_recent);
+
+            client->client_flags.timestamps = 1;
+        }
 
-        memcpy(tcp_data, &tcp->data, data_buffer_length);
+        /* Window in SYN ACK is never scaled */
+        client->server_window = ntohs(tcp->window);
 
-        func_retval = tcp_data_length;
+        func_retval = 1;
     }
 
     return func_retval;
@@ -590,233 +641,2521 @@ static uint16_t ether_get_tcp_psh_ack(ethernet_handle_t *ethernet, char *tcp_dat
 
 
 
-/****************************************************************
- * @brief  Function for sending TCP PSH ACK packet (data packet)
- *         sequence number and ACK number are swapped,
- *         then passed as parameters by user.
- * @param  *ethernet        : Reference to Ethernet handle
- * @param  source_port      : TCP source port
- * @param  destination_port : TCP destination port
- * @param  sequence_number  : TCP sequence number
- * @param  ack_number       : TCP acknowledgment number
- * @param  *destination_ip  : Destination server IP
- * @param  *tcp_data        : TCP data / payload
- * @param  data_length      : TCP data length
- * @retval int8_t           : Error = 0, Success = 1
- ****************************************************************/
-static int8_t ether_send_tcp_psh_ack(ethernet_handle_t *ethernet,
-                                     uint16_t           source_port,
-                                     uint16_t           destination_port,
-                                     uint32_t           sequence_number,
-                                     uint32_t           ack_number,
-                                     uint8_t           *destination_ip,
-                                     char              *tcp_data,
-                                     uint16_t           data_length)
+/*****************************************************************
+ * @brief  Static function to get server window from TCP packet
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @retval uint32_t  : Server window (scaled)
+ *****************************************************************/
+static uint32_t tcp_get_server_window(ethernet_handle_t *ethernet, tcp_handle_t *client)
 {
+    uint32_t func_retval = 0;
 
-    int8_t func_retval = 0;
-    uint16_t index     = 0;
-
-    net_ip_t  *ip;
     net_tcp_t *tcp;
-    uint8_t   *data_copy;
-
-    /* Ethernet Frame related variables */
-    uint8_t  destination_mac[ETHER_MAC_SIZE] = {0};
 
-    if(ethernet->ether_obj == NULL || destination_ip == NULL || data_length > ETHER_MTU_SIZE || data_length > UINT16_MAX)
+    if(ethernet->ether_obj == NULL || client == NULL)
     {
         func_retval = 0;
     }
     else
     {
-        ip  = (void*)&ethernet->ether_obj->data;
-
-        tcp = (void*)( (uint8_t*)ip + IP_HEADER_SIZE );
-
-        /* Fill TCP frame */
-        tcp->source_port      = htons(source_port);
-        tcp->destination_port = htons(destination_port);
-
-        tcp->sequence_number  = htonl(sequence_number);
-        tcp->ack_number       = htonl(ack_number);
+        tcp = tcp_get_header(ethernet);
 
-        /* Shift data offset to Big-Endian MSB (4 bits) */
-        tcp->data_offset      = ((TCP_FRAME_SIZE) >> 2) << 4;
-        tcp->control_bits     = (uint8_t)(TCP_PSH_ACK);
-
-        tcp->window           = ntohs(1);
-        tcp->urgent_pointer   = 0;
-
-        /* Copy TCP data */
-        data_copy = &tcp->data;
+        func_retval = (uint32_t)net_load_u16(&tcp->window) << client->server_window_scale;
+    }
 
-        for(index = 0; index < data_length; index++)
-        {
-            data_copy[index] = (uint8_t)(tcp_data[index]);
-        }
+    return func_retval;
+}
 
-        /* fill IP frame before TCP checksum calculation */
-        fill_ip_frame(ip, &ethernet->ip_identifier, destination_ip, ethernet->host_ip, IP_TCP, TCP_FRAME_SIZE + data_length);
 
-        /*Get TCP checksum */
-        tcp->checksum = get_tcp_checksum(ip, tcp, data_length);
 
-        /* Get MAC address from ARP table */
-        ether_arp_resolve_address(ethernet, destination_mac, destination_ip);
+/*****************************************************************
+ * @brief  Static function to get receive window to advertise,
+ *         space left in application buffer for held data,
+ *         (scaled if server accepted window scaling, shift is 0)
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @retval uint16_t  : Receive window (network byte order)
+ *****************************************************************/
+static uint16_t tcp_get_recv_window(ethernet_handle_t *ethernet, tcp_handle_t *client)
+{
+    uint16_t func_retval = 0;
 
-        /* Fill Ethernet frame */
-        fill_ether_frame(ethernet, destination_mac, ethernet->host_mac, ETHER_IPV4);
+    uint16_t recv_space = 0;
 
-        /*Send TCP data */
-        ether_send_data(ethernet,(uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + htons(ip->total_length));
+    if(ethernet->net_app_data_length < APP_BUFF_SIZE)
+        recv_space = APP_BUFF_SIZE - ethernet->net_app_data_length;
 
-        func_retval = 1;
+    /* Window update sent when application read opens window */
+    client->recv_window = recv_space;
 
-    }
+    if(client->client_flags.window_scaling)
+        func_retval = htons(recv_space >> TCP_WINDOW_SCALE);
+    else
+        func_retval = htons(recv_space);
 
     return func_retval;
 }
 
 
-/************************************************************************
- * @brief  helper function for reading TCP data
- * @param  *ethernet         : Reference to the Ethernet Handle
- * @param  *network_data     : Network data
- * @param  *client           : Reference to TCP client handle
- * @param  *application_data : application_data
- * @param  data_length       : application data length
- * @retval uint16_t          : Error = 0, Success = number of bytes read
- *                                              1 = ACK received
- ************************************************************************/
-static int32_t ether_tcp_read_data_hf(ethernet_handle_t *ethernet,
-                                      uint8_t           *network_data,
-                                      tcp_handle_t      *client,
-                                      char              *application_data,
-                                      uint16_t           data_length)
-{
 
-    int32_t func_retval      = NET_FUNC_NO_RDWR;
-    uint8_t tcp_read_loop    = 0;
-    uint16_t tcp_data_length = 0;
+/*****************************************************************
+ * @brief  Static function to put timestamps option in TCP header,
+ *         (NOP NOP aligned, RFC 7323 Appendix A)
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @param  *option   : Reference to TCP options
+ * @retval uint8_t   : Options length, 0 = timestamps not in use
+ *****************************************************************/
+static uint8_t tcp_put_timestamps(ethernet_handle_t *ethernet, tcp_handle_t *client, uint8_t *option)
+{
+    uint8_t func_retval = 0;
 
-    tcp_ctl_flags_t ack_type;
+    uint32_t time_value = 0;
 
-    if(ethernet->ether_obj == NULL || client == NULL || data_length > UINT16_MAX || data_length > ETHER_MTU_SIZE)
+    if(client->client_flags.timestamps)
     {
-        func_retval = NET_TCP_READ_ERROR;
-    }
-    else
-    {
-        tcp_read_loop = 1;
-
-        while(tcp_read_loop)
-        {
-            /* Set loop state if blocking or non block read */
-            tcp_read_loop = client->client_flags.client_blocking;
-
-            if(ether_get_data(ethernet, network_data, ETHER_MTU_SIZE) && client->client_flags.connect_established == 1)
-            {
+        option[0] = TCP_NO_OPERATION;
+        option[1] = TCP_NO_OPERATION;
+        option[2] = TCP_TIMESTAMPS;
+        option[3] = 10;
 
-                /* handle transport layer protocol type packets */
-                if(get_ether_protocol_type(ethernet) == ETHER_IPV4 && (get_ip_communication_type(ethernet) == 1))
-                {
+        time_value = htonl(ethernet->ether_commands->get_time_ms());
+        memcpy(&option[4], &time_value, 4);
 
-                    /* Handle TCP packets */
-                    if(get_ip_protocol_type(ethernet) == IP_TCP)
-                    {
+        time_value = htonl(client->ts_recent);
+        memcpy(&option[8], &time_value, 4);
 
-                        /* Read ACK from the TCP server */
-                        ack_type = ether_get_tcp_server_ack(ethernet, &client->sequence_number, &client->acknowledgement_number,
-                                                            client->destination_port, client->source_port, client->server_ip);
+        func_retval = TCP_TS_OPTS_SIZE;
+    }
 
-                        switch(ack_type)
-                        {
+    return func_retval;
+}
 
 
-                        case TCP_ACK:
 
-                            func_retval = 1;
+/*****************************************************************
+ * @brief  Static function to get TCP segment data size,
+ *         limited by server MSS and network data buffer,
+ *         (less timestamps option if in use)
+ * @param  *client  : Reference to TCP client handle
+ * @retval uint16_t : Segment data size
+ *****************************************************************/
+static uint16_t tcp_get_segment_size(tcp_handle_t *client)
+{
+    uint16_t func_retval = TCP_SEGMENT_MAX_DATA;
 
-                            break;
+    if(client->server_mss != 0 && client->server_mss < TCP_SEGMENT_MAX_DATA)
+        func_retval = client->server_mss;
 
+    if(client->client_flags.timestamps)
+        func_retval -= TCP_TS_OPTS_SIZE;
 
-                        case TCP_PSH_ACK:
+    return func_retval;
+}
 
-                            tcp_data_length = ether_get_tcp_psh_ack(ethernet, application_data, data_length);
 
-                            client->sequence_number += tcp_data_length;
 
-                            ether_send_tcp_ack(ethernet, client->source_port, client->destination_port, client->acknowledgement_number,
-                                               client->sequence_number, client->server_ip, TCP_ACK);
+/****************************************************************
+ * @brief  Static function to put headers of connection in network
+ *         data buffer, headers and checksum seeds of fixed fields
+ *         (next hop MAC, IP addresses, ports) are built once and
+ *         cached in client handle, other TCP fields are zero,
+ *         timestamps option is cached while in use and headers
+ *         are rebuilt when it changes, (SACK blocks are added
+ *         after cached options per ACK)
+ * @param  *ethernet  : Reference to Ethernet handle
+ * @param  *client    : Reference to TCP client handle
+ * @retval net_tcp_t* : Reference to TCP header
+ ****************************************************************/
+static net_tcp_t* tcp_put_headers(ethernet_handle_t *ethernet, tcp_handle_t *client)
+{
+    net_ip_t  *ip;
+    net_tcp_t *tcp;
 
-                            tcp_read_loop = 0;
-                            func_retval   = tcp_data_length;
+    tcp_header_cache_t *cache = &client->header_cache;
 
-                            break;
+    uint16_t ip_identifier  = 0;
+    uint8_t  options_length = 0;
 
+    /* Ethernet Frame related variables */
+    uint8_t  destination_mac[ETHER_MAC_SIZE] = {0};
 
-                        case TCP_FIN_ACK:
+    ip  = (void*)&ethernet->ether_obj->data;
 
-                            /* Increment the sequence number and pass it as acknowledgment number*/
-                            client->sequence_number += 1;
+    tcp = (void*)( (uint8_t*)ip + IP_HEADER_SIZE );
 
-                            ether_send_tcp_ack(ethernet, client->source_port, client->destination_port, client->acknowledgement_number,
-                                               client->sequence_number, client->server_ip, TCP_FIN_ACK);
+    if(client->client_flags.timestamps)
+        options_length = TCP_TS_OPTS_SIZE;
 
-                            client->client_flags.server_close        = 1;
-                            client->client_flags.connect_established = 0;
+    if(cache->valid && cache->options_length == options_length)
+    {
+        memcpy(ethernet->ether_obj, cache->header, ETHER_FRAME_SIZE + IP_HEADER_SIZE + TCP_FRAME_SIZE + options_length);
+    }
+    else
+    {
+        /* Get MAC address from ARP table, rebuilt until next hop is resolved */
+        cache->valid = ether_arp_resolve_next_hop(ethernet, destination_mac, client->server_ip);
 
-                            tcp_read_loop = 0;
-                            func_retval   = 0;
+        /* Fill Ethernet frame */
+        fill_ether_frame(ethernet, destination_mac, ethernet->host_mac, ETHER_IPV4);
 
-                            break;
+        /* Fill IP frame, length and identifier are patched per segment */
+        fill_ip_frame(ip, &ip_identifier, client->server_ip, ethernet->host_ip, IP_TCP, TCP_FRAME_SIZE);
 
+        /* Fill TCP frame ports */
+        memset(tcp, 0, TCP_FRAME_SIZE + TCP_TS_OPTS_SIZE);
 
-                        case TCP_FIN_PSH_ACK:
+        tcp->source_port      = htons(client->source_port);
+        tcp->destination_port = htons(client->destination_port);
 
-                            /* Increment thetcp_read_loop = 0; sequence number and pass it as acknowledgment number*/
-                            client->sequence_number += 1;
+        /* Timestamps option kind, values are filled per segment */
+        if(options_length)
+        {
+            (&tcp->data)[0] = TCP_NO_OPERATION;
+            (&tcp->data)[1] = TCP_NO_OPERATION;
+            (&tcp->data)[2] = TCP_TIMESTAMPS;
+            (&tcp->data)[3] = 10;
+        }
 
-                            /* not handled correctly*/
-                            ether_send_tcp_ack(ethernet, client->source_port, client->destination_port, client->acknowledgement_number,
-                                               client->sequence_number, client->server_ip, TCP_FIN_ACK);
+        cache->options_length = options_length;
 
-                            client->client_flags.server_close        = 1;
-                            client->client_flags.connect_established = 0;
+        memcpy(cache->header, ethernet->ether_obj, TCP_HEADER_CACHE);
 
-                            tcp_read_loop = 0;
-                            func_retval   = 0;
+        /* IP header sum of version, service type, flags, TTL, protocol and addresses */
+        cache->ip_sum = 0;
 
-                            break;
+        ether_sum_words(&cache->ip_sum, &ip->version_length, 2);
+        ether_sum_words(&cache->ip_sum, &ip->flags_offset, 4);
+        ether_sum_words(&cache->ip_sum, ip->source_ip, 8);
 
+        /* TCP pseudo header sum (without length) and ports */
+        cache->tcp_sum = 0;
 
-                        default:
+        ether_sum_words(&cache->tcp_sum, ip->source_ip, 8);
 
-                            /* NOP */
+        cache->tcp_sum += ( (IP_TCP & 0xFF) << 8 );
 
-                            break;
+        ether_sum_words(&cache->tcp_sum, &tcp->source_port, 4);
+    }
 
-                        }
+    return tcp;
+}
 
-                    } /* IP is TCP condition */
 
-#if ARP_ICMP_READ_HANDLE
-                    /* Handle ICMP packets */
-                    else if(get_ip_protocol_type(ethernet) == IP_ICMP)
-                    {
-                        ether_send_icmp_reply(ethernet);
-                    }
-#endif
-                } /* ETHER is IP packet condition */
 
-#if ARP_ICMP_READ_HANDLE
-                /* Handle ARP requests */
-                else if(get_ether_protocol_type(ethernet) == ETHER_ARP)
+/**********************************************************
+ * @brief  Function for sending TCP ACK packet, SACK blocks
+ *         of out of order data are added if permitted
+ *         (SEQ and ACK numbers swapped in client handle)
+ * @param  *ethernet        : Reference to Ethernet handle
+ * @param  *client          : Reference to TCP client handle
+ * @param  ack_type         : TCP ACK value
+ * @retval int8_t           : Error = 0, Success = 1
+ **********************************************************/
+static int8_t ether_send_tcp_ack(ethernet_handle_t *ethernet, tcp_handle_t *client, tcp_ctl_flags_t ack_type)
+{
+
+    int8_t func_retval = 0;
+
+    net_ip_t  *ip;
+    net_tcp_t *tcp;
+
+    uint8_t *sack_option;
+    uint8_t  options_length = 0;
+    uint8_t  block_count    = 0;
+    uint8_t  index          = 0;
+    uint32_t block_edge     = 0;
+    uint32_t sum            = 0;
+
+
+    if(ethernet->ether_obj == NULL || client == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        ip  = (void*)&ethernet->ether_obj->data;
+
+        /* Cached Ethernet, IP and TCP headers, only per segment fields are filled */
+        tcp = tcp_put_headers(ethernet, client);
+
+        /* Fill TCP frame */
+        tcp->sequence_number  = htonl(client->acknowledgement_number);
+        tcp->ack_number       = htonl(client->sequence_number);
+
+        client->last_ack_sent = client->sequence_number;
+
+        options_length = tcp_put_timestamps(ethernet, client, &tcp->data);
+
+        /* SACK option, NOP NOP aligned, most recent block first (RFC 2018) */
+        if(client->client_flags.sack_permitted && client->recv_block_count)
+        {
+            sack_option = &tcp->data + options_length;
+
+            /* Options space is 40 bytes, 3 blocks fit with timestamps */
+            block_count = client->recv_block_count;
+
+            if(block_count > (TCP_MAX_OPTS_SIZE - options_length - 4) / TCP_SACK_BLOCK_SIZE)
+                block_count = (TCP_MAX_OPTS_SIZE - options_length - 4) / TCP_SACK_BLOCK_SIZE;
+
+            sack_option[0] = TCP_NO_OPERATION;
+            sack_option[1] = TCP_NO_OPERATION;
+            sack_option[2] = TCP_SACK;
+            sack_option[3] = 2 + TCP_SACK_BLOCK_SIZE * block_count;
+
+            for(index = 0; index < block_count; index++)
+            {
+                block_edge = htonl(client->recv_blocks[index].start);
+                memcpy(&sack_option[4 + index * TCP_SACK_BLOCK_SIZE], &block_edge, 4);
+
+                block_edge = htonl(client->recv_blocks[index].end);
+                memcpy(&sack_option[8 + index * TCP_SACK_BLOCK_SIZE], &block_edge, 4);
+            }
+
+            options_length += 2 + sack_option[3];
+        }
+
+        /* Shift data offset to Big-endian MSB (4 bits) */
+        tcp->data_offset      = ((TCP_FRAME_SIZE + options_length) >> 2) << 4;
+        tcp->control_bits     = (uint8_t)ack_type;
+
+        tcp->window           = tcp_get_recv_window(ethernet, client);
+
+        /* Patch IP frame */
+        ip->total_length = htons(IP_HEADER_SIZE + TCP_FRAME_SIZE + options_length);
+
+        ip->id = htons(ethernet->ip_identifier);
+
+        ethernet->ip_identifier++;
+
+        sum = client->header_cache.ip_sum;
+
+        ether_sum_words(&sum, &ip->total_length, 4);
+
+        ip->header_checksum = ether_get_checksum(sum);
+
+        /*Get TCP checksum, from seed of fixed fields */
+        sum = client->header_cache.tcp_sum;
+
+        sum += htons(TCP_FRAME_SIZE + options_length);
+
+        ether_sum_words(&sum, &tcp->sequence_number, TCP_FRAME_SIZE - 4 + options_length);
+
+        tcp->checksum = ether_get_checksum(sum);
+
+        /*Send TCP data */
+        func_retval = ether_send_data(ethernet,(uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + htons(ip->total_length));
+
+    }
+
+    return func_retval;
+}
+
+
+
+
+/***************************************************************
+ * @brief  Static function to get TCP data / payload of
+ *         received packet (after TCP options)
+ * @param  *ethernet : Reference to Ethernet handle
+ * @retval uint8_t*  : Error = NULL, Success = Reference to data
+ ***************************************************************/
+static uint8_t* tcp_get_payload(ethernet_handle_t *ethernet)
+{
+    uint8_t *func_retval = NULL;
+
+    net_tcp_t *tcp;
+
+    if(ethernet->ether_obj == NULL)
+    {
+        func_retval = NULL;
+    }
+    else
+    {
+        tcp = tcp_get_header(ethernet);
+
+        /* Skip TCP options, header length validated by packet parser */
+        func_retval = (uint8_t*)tcp + ether_get_packet(ethernet)->l4_header_length;
+    }
+
+    return func_retval;
+}
+
+
+
+/****************************************************************
+ * @brief  Static function to build the header template used for
+ *         sending data segments, (Ethernet, IP, TCP PSH ACK)
+ *         and the partial checksums of the fixed header fields,
+ *         from cached headers of connection
+ * @param  *ethernet         : Reference to Ethernet handle
+ * @param  *client           : Reference to TCP client handle
+ * @param  *segment_template : Reference to header template
+ * @retval int8_t            : Error = 0, Success = 1
+ ****************************************************************/
+static int8_t tcp_build_template(ethernet_handle_t *ethernet, tcp_handle_t *client, tcp_template_t *segment_template)
+{
+    int8_t func_retval = 0;
+
+    net_tcp_t *tcp;
+
+    if(ethernet->ether_obj == NULL || client == NULL || segment_template == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        /* Cached Ethernet, IP and TCP headers of connection */
+        tcp = tcp_put_headers(ethernet, client);
+
+        /* Fill TCP frame, sequence number is patched per segment */
+        tcp->ack_number       = htonl(client->sequence_number);
+
+        client->last_ack_sent = client->sequence_number;
+
+        /* Timestamp value is the same for all segments of the template */
+        segment_template->tcp_header_length = TCP_FRAME_SIZE + tcp_put_timestamps(ethernet, client, &tcp->data);
+
+        /* Shift data offset to Big-Endian MSB (4 bits) */
+        tcp->data_offset      = ((segment_template->tcp_header_length) >> 2) << 4;
+        tcp->control_bits     = (uint8_t)(TCP_PSH_ACK);
+
+        tcp->window           = tcp_get_recv_window(ethernet, client);
+
+        memcpy(segment_template->header, ethernet->ether_obj, sizeof(segment_template->header));
+
+        /* IP header sum from connection seed */
+        segment_template->ip_sum = client->header_cache.ip_sum;
+
+        /* TCP pseudo header and ports sum from connection seed, ACK number, flags, window and options added */
+        segment_template->tcp_sum = client->header_cache.tcp_sum;
+
+        ether_sum_words(&segment_template->tcp_sum, &tcp->ack_number, 4);
+        ether_sum_words(&segment_template->tcp_sum, &tcp->data_offset, 4);
+        ether_sum_words(&segment_template->tcp_sum, &tcp->urgent_pointer, segment_template->tcp_header_length - 18);
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/****************************************************************
+ * @brief  Static function for sending one TCP segment from the
+ *         header template, only sequence number, lengths, IP
+ *         identifier and checksums are updated
+ * @param  *ethernet         : Reference to Ethernet handle
+ * @param  *segment_template : Reference to header template
+ * @param  sequence_number   : TCP sequence number
+ * @param  *tcp_data         : TCP data / payload
+ * @param  data_length       : TCP data length
+ * @retval int8_t            : Error = 0, Success = 1
+ ****************************************************************/
+static int8_t ether_send_tcp_segment(ethernet_handle_t *ethernet,
+                                     tcp_template_t    *segment_template,
+                                     uint32_t           sequence_number,
+                                     char              *tcp_data,
+                                     uint16_t           data_length)
+{
+    int8_t func_retval = 0;
+
+    net_ip_t  *ip;
+    net_tcp_t *tcp;
+
+    uint32_t sum = 0;
+
+    if(ethernet->ether_obj == NULL || segment_template == NULL || tcp_data == NULL || \
+            data_length > TCP_SEGMENT_MAX_DATA + TCP_FRAME_SIZE - segment_template->tcp_header_length)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        ip  = (void*)&ethernet->ether_obj->data;
+
+        tcp = (void*)( (uint8_t*)ip + IP_HEADER_SIZE );
+
+        /* Restore headers, network data buffer is shared with receive path */
+        memcpy(ethernet->ether_obj, segment_template->header, sizeof(segment_template->header));
+
+        /* Patch IP frame */
+        ip->total_length = htons(IP_HEADER_SIZE + segment_template->tcp_header_length + data_length);
+
+        ip->id = htons(ethernet->ip_identifier);
+
+        ethernet->ip_identifier++;
+
+        sum = segment_template->ip_sum;
+
+        ether_sum_words(&sum, &ip->total_length, 4);
+
+        ip->header_checksum = ether_get_checksum(sum);
+
+        /* Patch TCP frame */
+        tcp->sequence_number = htonl(sequence_number);
+
+        sum = segment_template->tcp_sum;
+
+        sum += htons(segment_template->tcp_header_length + data_length);
+
+        ether_sum_words(&sum, &tcp->sequence_number, 4);
+
+        /* Data is summed while it is copied, (header length is a multiple of 4) */
+        ether_copy_sum(&sum, (uint8_t*)tcp + segment_template->tcp_header_length, tcp_data, data_length);
+
+        tcp->checksum = ether_get_checksum(sum);
+
+        /*Send TCP data */
+        func_retval = ether_send_data(ethernet,(uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + IP_HEADER_SIZE + segment_template->tcp_header_length + data_length);
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to start TCP timer, timer wheel is run
+ *         first so timeout counts from now and not from the last
+ *         poll, (uses get_time_ms operation)
+ * @param  *ethernet  : Reference to Ethernet handle
+ * @param  *timer     : Reference to network timer
+ * @param  timeout_ms : Timeout (ms)
+ * @retval int8_t     : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_start_timer(ethernet_handle_t *ethernet, net_timer_t *timer, uint32_t timeout_ms)
+{
+    int8_t func_retval = 0;
+
+    if(ethernet->ether_commands == NULL || timer == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        net_timer_run(ethernet->ether_commands->get_time_ms());
+
+        func_retval = net_timer_start(timer, timeout_ms);
+    }
+
+    return func_retval;
+}
+
+
+
+/****************************************************************
+ * @brief  Static function to send ACK for received data,
+ *         clears pending (delayed) ACK
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @retval int8_t    : Error = 0, Success = 1
+ ****************************************************************/
+static int8_t tcp_send_ack(ethernet_handle_t *ethernet, tcp_handle_t *client)
+{
+    int8_t func_retval = 0;
+
+    if(ethernet->ether_obj == NULL || client == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        func_retval = ether_send_tcp_ack(ethernet, client, TCP_ACK);
+
+        client->ack_pending = 0;
+    }
+
+    return func_retval;
+}
+
+
+
+/****************************************************************
+ * @brief  Static function to acknowledge received data, with
+ *         delayed ACK every second segment is acknowledged and
+ *         a single segment is acknowledged after TCP_ACK_DELAY
+ *         or with the next data segment (RFC 1122)
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @retval int8_t    : Error = 0, Success = 1 (ACK sent),
+ *                                          2 (ACK delayed)
+ ****************************************************************/
+static int8_t tcp_ack_data(ethernet_handle_t *ethernet, tcp_handle_t *client)
+{
+    int8_t func_retval = 0;
+
+    if(ethernet->ether_obj == NULL || client == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        client->ack_pending++;
+
+        if(ethernet->status.rx_batch)
+        {
+            /* net_poll() batch, segments are acknowledged after the batch */
+            func_retval = 2;
+        }
+        else if(client->client_flags.delayed_ack == 0 || client->ack_pending >= TCP_ACK_SEGMENTS)
+        {
+            func_retval = tcp_send_ack(ethernet, client);
+        }
+        else
+        {
+            /* Start delayed ACK timer on first unacknowledged segment */
+            if(client->ack_pending == 1)
+                tcp_start_timer(ethernet, &client->ack_timer, TCP_ACK_DELAY);
+
+            func_retval = 2;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to add SACK block to sender scoreboard,
+ *         overlapping blocks are merged, blocks kept in sequence
+ *         order, highest block is dropped if scoreboard is full
+ * @param  *client : Reference to TCP client handle
+ * @param  start   : First SACKed sequence number
+ * @param  end     : Sequence number following SACKed data
+ * @retval int8_t  : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_sack_update(tcp_handle_t *client, uint32_t start, uint32_t end)
+{
+    int8_t func_retval = 0;
+
+    tcp_sack_block_t blocks[TCP_SACK_MAX_BLOCKS + 1];
+
+    uint8_t index       = 0;
+    uint8_t block_count = 0;
+    uint8_t inserted    = 0;
+
+    if(client == NULL || TCP_SEQ_LEQ(end, start))
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        /* Merge overlapping or adjacent blocks into new block */
+        for(index = 0; index < client->sack_count; index++)
+        {
+            if(TCP_SEQ_LEQ(client->sack_scoreboard[index].start, end) && TCP_SEQ_LEQ(start, client->sack_scoreboard[index].end))
+            {
+                if(TCP_SEQ_LT(client->sack_scoreboard[index].start, start))
+                    start = client->sack_scoreboard[index].start;
+
+                if(TCP_SEQ_GT(client->sack_scoreboard[index].end, end))
+                    end = client->sack_scoreboard[index].end;
+            }
+        }
+
+        /* Rebuild scoreboard in sequence order */
+        for(index = 0; index < client->sack_count; index++)
+        {
+            /* Merged into new block */
+            if(TCP_SEQ_LEQ(start, client->sack_scoreboard[index].start) && TCP_SEQ_LEQ(client->sack_scoreboard[index].end, end))
+                continue;
+
+            if(!inserted && TCP_SEQ_LT(start, client->sack_scoreboard[index].start))
+            {
+                blocks[block_count].start = start;
+                blocks[block_count].end   = end;
+
+                block_count++;
+                inserted = 1;
+            }
+
+            blocks[block_count++] = client->sack_scoreboard[index];
+        }
+
+        if(!inserted)
+        {
+            blocks[block_count].start = start;
+            blocks[block_count].end   = end;
+
+            block_count++;
+        }
+
+        if(block_count > TCP_SACK_MAX_BLOCKS)
+            block_count = TCP_SACK_MAX_BLOCKS;
+
+        memcpy(client->sack_scoreboard, blocks, block_count * sizeof(tcp_sack_block_t));
+
+        client->sack_count = block_count;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to skip SACKed data at sequence number
+ * @param  *client  : Reference to TCP client handle
+ * @param  *seq     : Reference to sequence number, moved past
+ *                    SACKed data
+ * @retval uint32_t : Length of data not SACKed from sequence number,
+ *                    UINT32_MAX = no SACKed data follows
+ ******************************************************************/
+static uint32_t tcp_sack_next_hole(tcp_handle_t *client, uint32_t *seq)
+{
+    uint32_t func_retval = UINT32_MAX;
+
+    uint8_t index = 0;
+
+    for(index = 0; index < client->sack_count; index++)
+    {
+        /* Blocks are in sequence order */
+        if(TCP_SEQ_LEQ(client->sack_scoreboard[index].end, *seq))
+            continue;
+
+        if(TCP_SEQ_LEQ(client->sack_scoreboard[index].start, *seq))
+        {
+            *seq = client->sack_scoreboard[index].end;
+        }
+        else
+        {
+            func_retval = client->sack_scoreboard[index].start - *seq;
+
+            break;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to get SACKed data below next sequence
+ *         number, (SACKed data is not in flight)
+ * @param  *client  : Reference to TCP client handle
+ * @retval uint32_t : SACKed bytes
+ ******************************************************************/
+static uint32_t tcp_sack_bytes(tcp_handle_t *client)
+{
+    uint32_t func_retval = 0;
+
+    uint8_t index = 0;
+
+    for(index = 0; index < client->sack_count; index++)
+    {
+        if(TCP_SEQ_GEQ(client->sack_scoreboard[index].start, client->acknowledgement_number))
+            break;
+
+        if(TCP_SEQ_LT(client->sack_scoreboard[index].end, client->acknowledgement_number))
+            func_retval += client->sack_scoreboard[index].end - client->sack_scoreboard[index].start;
+        else
+            func_retval += client->acknowledgement_number - client->sack_scoreboard[index].start;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to remove SACK blocks acknowledged by
+ *         cumulative ACK from sender scoreboard
+ * @param  *client : Reference to TCP client handle
+ * @retval int8_t  : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_sack_prune(tcp_handle_t *client)
+{
+    int8_t func_retval = 0;
+
+    uint8_t index       = 0;
+    uint8_t block_count = 0;
+
+    if(client == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        for(index = 0; index < client->sack_count; index++)
+        {
+            if(TCP_SEQ_LEQ(client->sack_scoreboard[index].end, client->send_unacked))
+                continue;
+
+            if(TCP_SEQ_LT(client->sack_scoreboard[index].start, client->send_unacked))
+                client->sack_scoreboard[index].start = client->send_unacked;
+
+            client->sack_scoreboard[block_count++] = client->sack_scoreboard[index];
+        }
+
+        client->sack_count = block_count;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to check rate limit and pacing before
+ *         sending segment, pacing spreads congestion window over
+ *         smoothed RTT. Held segment is sent from pace timer
+ * @param  *ethernet       : Reference to Ethernet handle
+ * @param  *client         : Reference to TCP client handle
+ * @param  segment_length  : Segment data length
+ * @retval uint8_t         : Hold = 0, Send = 1
+ ******************************************************************/
+static uint8_t tcp_pace_segment(ethernet_handle_t *ethernet, tcp_handle_t *client, uint16_t segment_length)
+{
+    uint8_t func_retval = 0;
+
+    uint32_t time_now   = 0;
+    uint32_t delay      = 0;
+    uint32_t pace_delay = 0;
+
+    if(client->rate_limit.rate == 0 && client->client_flags.pacing == 0)
+    {
+        func_retval = 1;
+    }
+    else
+    {
+        time_now = ethernet->ether_commands->get_time_ms();
+
+        delay = net_rate_delay(&client->rate_limit, segment_length, time_now);
+
+        /* Pace once RTT is measured, smoothed RTT is scaled by 8 */
+        if(client->client_flags.pacing && client->smoothed_rtt)
+        {
+            net_rate_set(&client->pace_rate, (uint32_t)(((uint64_t)client->congestion.cwnd * 8000) / client->smoothed_rtt),
+                         TCP_PACE_SEGMENTS * tcp_get_segment_size(client));
+
+            pace_delay = net_rate_delay(&client->pace_rate, segment_length, time_now);
+
+            if(pace_delay > delay)
+                delay = pace_delay;
+        }
+
+        if(delay == 0)
+        {
+            net_rate_consume(&client->rate_limit, segment_length, time_now);
+
+            if(client->client_flags.pacing && client->smoothed_rtt)
+                net_rate_consume(&client->pace_rate, segment_length, time_now);
+
+            func_retval = 1;
+        }
+        else
+        {
+            if(!net_timer_pending(&client->pace_timer))
+                tcp_start_timer(ethernet, &client->pace_timer, delay);
+
+            func_retval = 0;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to send unsent data within congestion
+ *         and server window, with Nagle a partial segment is held
+ *         while data is unacknowledged (RFC 896)
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @retval uint16_t  : Error = 0, Success = number of segments sent
+ ******************************************************************/
+static uint16_t tcp_output(ethernet_handle_t *ethernet, tcp_handle_t *client)
+{
+    uint16_t func_retval = 0;
+
+    tcp_template_t segment_template;
+
+    uint32_t send_end     = 0;
+    uint32_t flight_size  = 0;
+    uint32_t flight_limit = 0;
+    uint32_t hole_length  = 0;
+
+    uint16_t segment_size   = 0;
+    uint16_t segment_length = 0;
+
+    int8_t sent = 0;
+
+    if(ethernet->ether_obj == NULL || client == NULL || client->send_data == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        segment_size = tcp_get_segment_size(client);
+
+        send_end    = client->send_data_seq + client->send_data_length;
+        flight_size = client->acknowledgement_number - client->send_unacked - tcp_sack_bytes(client);
+
+        flight_limit = client->congestion.cwnd;
+
+        if(client->server_window < flight_limit)
+            flight_limit = client->server_window;
+
+        while(TCP_SEQ_LT(client->acknowledgement_number, send_end))
+        {
+            /* Skip data SACKed by server, resend holes only */
+            hole_length = tcp_sack_next_hole(client, &client->acknowledgement_number);
+
+            if(TCP_SEQ_GEQ(client->acknowledgement_number, send_end))
+            {
+                client->acknowledgement_number = send_end;
+
+                break;
+            }
+
+            segment_length = segment_size;
+
+            if(send_end - client->acknowledgement_number < segment_length)
+                segment_length = send_end - client->acknowledgement_number;
+
+            if(hole_length < segment_length)
+                segment_length = hole_length;
+
+            /* Fill congestion and server window, (one segment always allowed when nothing is in flight) */
+            if(flight_size != 0 && flight_size + segment_length > flight_limit)
+                break;
+
+            /* Nagle, hold partial segment until outstanding data is acknowledged */
+            if(client->client_flags.nagle && flight_size != 0 && segment_length < segment_size)
+                break;
+
+            /* Rate limit and pacing, resumed from pace timer */
+            if(tcp_pace_segment(ethernet, client, segment_length) == 0)
+                break;
+
+            /* Build headers once, only SEQ, lengths and checksums change per segment */
+            if(func_retval == 0)
+                tcp_build_template(ethernet, client, &segment_template);
+
+            sent = ether_send_tcp_segment(ethernet, &segment_template, client->acknowledgement_number,
+                                          client->send_data + (client->acknowledgement_number - client->send_data_seq), segment_length);
+
+            /* Start retransmission timer */
+            if(flight_size == 0)
+                tcp_start_timer(ethernet, &client->retransmit_timer, client->retransmit_timeout);
+
+            /* Time one new segment per RTT without timestamps, (retransmissions are not timed, Karn) */
+            if(!client->client_flags.timestamps && !client->rtt_timing && client->acknowledgement_number == client->send_max)
+            {
+                client->rtt_timing = 1;
+                client->rtt_seq    = client->acknowledgement_number;
+                client->rtt_time   = ethernet->ether_commands->get_time_ms();
+            }
+
+            client->acknowledgement_number += segment_length;
+            flight_size                    += segment_length;
+
+            if(TCP_SEQ_GT(client->acknowledgement_number, client->send_max))
+                client->send_max = client->acknowledgement_number;
+
+            func_retval++;
+
+            /* Segment not sent (looped back frame held), resent on retransmission timeout */
+            if(sent == 0)
+                break;
+        }
+
+        /* Pending ACK sent with data */
+        if(func_retval)
+            client->ack_pending = 0;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to retransmit the oldest unacknowledged
+ *         segment
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @retval int8_t    : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_retransmit(ethernet_handle_t *ethernet, tcp_handle_t *client)
+{
+    int8_t func_retval = 0;
+
+    tcp_template_t segment_template;
+
+    uint32_t unacked_length = 0;
+    uint32_t hole_length    = 0;
+    uint32_t seq            = 0;
+    uint16_t segment_length = 0;
+
+    if(ethernet->ether_obj == NULL || client == NULL || client->send_data == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        /* Data outstanding, (excludes FIN) */
+        unacked_length = client->acknowledgement_number - client->send_unacked;
+
+        if(client->send_data_seq + client->send_data_length - client->send_unacked < unacked_length)
+            unacked_length = client->send_data_seq + client->send_data_length - client->send_unacked;
+
+        /* Oldest unacknowledged data up to next SACKed data */
+        seq = client->send_unacked;
+
+        hole_length = tcp_sack_next_hole(client, &seq);
+
+        if(hole_length < unacked_length)
+            unacked_length = hole_length;
+
+        segment_length = tcp_get_segment_size(client);
+
+        if(unacked_length < segment_length)
+            segment_length = unacked_length;
+
+        if(segment_length)
+        {
+            /* Timed segment is resent, RTT sample is ambiguous (Karn) */
+            if(client->rtt_timing && TCP_SEQ_LT(client->rtt_seq, client->send_unacked + segment_length))
+                client->rtt_timing = 0;
+
+            tcp_build_template(ethernet, client, &segment_template);
+
+            ether_send_tcp_segment(ethernet, &segment_template, client->send_unacked,
+                                   client->send_data + (client->send_unacked - client->send_data_seq), segment_length);
+
+            client->ack_pending = 0;
+
+            func_retval = 1;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static expiry function of delayed ACK timer, ACK is sent
+ *         from tcp_check_timers, (frame buffer may hold RX data)
+ * @param  *timer   : Reference to network timer
+ * @param  *context : Reference to TCP client handle
+ * @retval None
+ ******************************************************************/
+static void tcp_ack_timeout(net_timer_t *timer, void *context)
+{
+    tcp_handle_t *client = context;
+
+    (void)timer;
+
+    client->timer_events |= TCP_TIMER_ACK;
+}
+
+
+
+/******************************************************************
+ * @brief  Static expiry function of retransmission timer
+ * @param  *timer   : Reference to network timer
+ * @param  *context : Reference to TCP client handle
+ * @retval None
+ ******************************************************************/
+static void tcp_retransmit_timeout(net_timer_t *timer, void *context)
+{
+    tcp_handle_t *client = context;
+
+    (void)timer;
+
+    client->timer_events |= TCP_TIMER_RTO;
+}
+
+
+
+/******************************************************************
+ * @brief  Static expiry function of rate limit and pacing timer,
+ *         held data is sent from tcp_check_timers
+ * @param  *timer   : Reference to network timer
+ * @param  *context : Reference to TCP client handle
+ * @retval None
+ ******************************************************************/
+static void tcp_pace_timeout(net_timer_t *timer, void *context)
+{
+    tcp_handle_t *client = context;
+
+    (void)timer;
+
+    client->timer_events |= TCP_TIMER_PACE;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to stop client timers, (before client
+ *         handle is cleared)
+ * @param  *client : Reference to TCP client handle
+ * @retval int8_t  : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_stop_timers(tcp_handle_t *client)
+{
+    int8_t func_retval = 0;
+
+    if(client == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        net_timer_stop(&client->ack_timer);
+        net_timer_stop(&client->retransmit_timer);
+        net_timer_stop(&client->pace_timer);
+
+        client->timer_events = 0;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to abort connection, server is not
+ *         responding, RST is sent and timers are stopped, send,
+ *         flush and close return error
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @retval int8_t    : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_abort(ethernet_handle_t *ethernet, tcp_handle_t *client)
+{
+    int8_t func_retval = 0;
+
+    if(ethernet->ether_obj == NULL || client == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        ether_send_tcp_ack(ethernet, client, TCP_RST_ACK);
+
+        tcp_stop_timers(client);
+
+        client->ack_pending = 0;
+
+        client->client_flags.connect_established = 0;
+        client->client_flags.connect_aborted     = 1;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to service delayed ACK and
+ *         retransmission timers, runs network timer wheel
+ *         (uses get_time_ms operation)
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @retval int8_t    : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_check_timers(ethernet_handle_t *ethernet, tcp_handle_t *client)
+{
+    int8_t func_retval = 0;
+
+    uint32_t time_now = 0;
+
+    if(ethernet->ether_obj == NULL || client == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        time_now = ethernet->ether_commands->get_time_ms();
+
+        net_timer_run(time_now);
+
+        /* Delayed ACK timeout */
+        if(client->timer_events & TCP_TIMER_ACK)
+        {
+            client->timer_events &= ~TCP_TIMER_ACK;
+
+            if(client->ack_pending)
+                tcp_send_ack(ethernet, client);
+        }
+
+        /* Retransmission timeout, with exponential backoff */
+        if(client->timer_events & TCP_TIMER_RTO)
+        {
+            client->timer_events &= ~TCP_TIMER_RTO;
+
+            if(client->send_unacked != client->send_max)
+                client->retransmit_count++;
+
+            if(client->retransmit_count > TCP_MAX_RETRIES)
+            {
+                /* No ACK after max retransmissions, (data or FIN) */
+                tcp_abort(ethernet, client);
+            }
+            else if(client->send_unacked != client->send_max)
+            {
+                client->congestion.ops->timeout(&client->congestion, client->send_max - client->send_unacked, time_now);
+
+                /* Server may discard SACKed data, forget SACK blocks if timeout repeats (RFC 2018) */
+                if(client->retransmit_timeout > client->rto)
+                    client->sack_count = 0;
+
+                /* Timed segment is resent, RTT sample is ambiguous (Karn) */
+                client->rtt_timing = 0;
+
+                /* Next hop may have changed, resolve it again for resent data */
+                client->header_cache.valid = 0;
+
+                /* Leave fast recovery, no fast retransmit for data sent before timeout (RFC 6582) */
+                client->client_flags.fast_recovery = 0;
+
+                client->dup_acks = 0;
+                client->recover  = client->send_max;
+
+                client->retransmit_timeout <<= 1;
+
+                if(client->retransmit_timeout > TCP_MAX_RTO)
+                    client->retransmit_timeout = TCP_MAX_RTO;
+
+                /* Restart before resend, tcp_output starts timer only when nothing is in flight */
+                tcp_start_timer(ethernet, &client->retransmit_timer, client->retransmit_timeout);
+
+                /* Go back N, resend from oldest unacknowledged data */
+                if(client->client_flags.client_close == 0)
+                {
+                    client->acknowledgement_number = client->send_unacked;
+
+                    tcp_output(ethernet, client);
+                }
+                else if(tcp_retransmit(ethernet, client) == 0)
+                {
+                    /* Only FIN outstanding, resend FIN ACK with FIN sequence number */
+                    client->acknowledgement_number = client->send_max - 1;
+
+                    ether_send_tcp_ack(ethernet, client, TCP_FIN_ACK);
+
+                    client->acknowledgement_number = client->send_max;
+                }
+            }
+        }
+
+        /* Rate limit or pacing delay, send held data */
+        if(client->timer_events & TCP_TIMER_PACE)
+        {
+            client->timer_events &= ~TCP_TIMER_PACE;
+
+            if(client->client_flags.client_close == 0)
+                tcp_output(ethernet, client);
+        }
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to update smoothed RTT, RTT variance and
+ *         retransmission timeout from RTT sample (RFC 6298)
+ * @param  *client : Reference to TCP client handle
+ * @param  rtt     : RTT sample (ms)
+ * @retval int8_t  : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_rtt_update(tcp_handle_t *client, uint32_t rtt)
+{
+    int8_t func_retval = 0;
+
+    int32_t delta = 0;
+
+    if(client == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        if(client->smoothed_rtt == 0)
+        {
+            /* First sample, SRTT = R, RTTVAR = R/2 */
+            client->smoothed_rtt = rtt << 3;
+            client->rtt_variance = rtt << 1;
+        }
+        else
+        {
+            /* SRTT = 7/8 SRTT + 1/8 R */
+            delta = rtt - (client->smoothed_rtt >> 3);
+
+            client->smoothed_rtt += delta;
+
+            /* RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R| */
+            if(delta < 0)
+                delta = -delta;
+
+            delta -= client->rtt_variance >> 2;
+
+            client->rtt_variance += delta;
+        }
+
+        /* RTO = SRTT + 4 RTTVAR, (clock granularity is 1 ms) */
+        client->rto = (client->smoothed_rtt >> 3) + (client->rtt_variance ? client->rtt_variance : 1);
+
+        if(client->rto < TCP_MIN_RTO)
+            client->rto = TCP_MIN_RTO;
+
+        if(client->rto > TCP_MAX_RTO)
+            client->rto = TCP_MAX_RTO;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to process server ACK number, updates
+ *         server window, RTT and releases acknowledged send data
+ * @param  *ethernet  : Reference to Ethernet handle
+ * @param  *client    : Reference to TCP client handle
+ * @param  *segment   : Reference to received segment information
+ * @retval int8_t     : Error = 0, Success = 1 (new data acknowledged)
+ *                                           2 (duplicate ACK)
+ ******************************************************************/
+static int8_t tcp_process_ack(ethernet_handle_t *ethernet, tcp_handle_t *client, tcp_segment_t *segment)
+{
+    int8_t func_retval = 0;
+
+    uint32_t ack_number    = segment->ack_number;
+    uint32_t data_acked    = 0;
+    uint32_t time_now      = 0;
+    uint32_t server_window = 0;
+
+    int32_t rtt_sample = 0;
+
+    if(ethernet->ether_obj == NULL || client == NULL)
+    {
+        func_retval = 0;
+    }
+    else if(TCP_SEQ_LT(ack_number, client->send_unacked) || TCP_SEQ_GT(ack_number, client->send_max))
+    {
+        /* Old ACK or ACK for data not sent, ignore */
+        func_retval = 0;
+    }
+    else
+    {
+        server_window = client->server_window;
+
+        client->server_window = tcp_get_server_window(ethernet, client);
+
+        if(TCP_SEQ_GT(ack_number, client->send_unacked))
+        {
+            time_now = ethernet->ether_commands->get_time_ms();
+
+            segment->bytes_acked = ack_number - client->send_unacked;
+
+            /* Acknowledged bytes of send data, (excludes FIN) */
+            data_acked = ack_number - client->send_data_seq;
+
+            if(data_acked > client->send_data_length)
+                data_acked = client->send_data_length;
+
+            /* Congestion window update, (window is managed by fast recovery during recovery) */
+            if(client->client_flags.fast_recovery == 0)
+                client->congestion.ops->ack(&client->congestion, ack_number - client->send_unacked, time_now);
+
+            client->send_unacked = ack_number;
+
+            /* Remove acknowledged SACK blocks */
+            tcp_sack_prune(client);
+
+            /* ACK after go back N retransmission */
+            if(TCP_SEQ_GT(ack_number, client->acknowledgement_number))
+                client->acknowledgement_number = ack_number;
+
+            /* Release acknowledged data from send buffer */
+            if(client->send_data == client->send_buffer && data_acked)
+            {
+                memmove(client->send_buffer, client->send_buffer + data_acked, client->send_data_length - data_acked);
+
+                client->send_data_seq    += data_acked;
+                client->send_data_length -= data_acked;
+            }
+
+            /* RTT sample from echoed timestamp on every ACK, or from timed segment */
+            if(segment->timestamps && segment->ts_echo != 0)
+            {
+                rtt_sample = (int32_t)(time_now - segment->ts_echo);
+
+                /* Echo from the future or older than max RTO is not a timestamp of client */
+                if(rtt_sample >= 0 && rtt_sample <= TCP_MAX_RTO)
+                    tcp_rtt_update(client, (uint32_t)rtt_sample);
+            }
+            else if(client->rtt_timing && TCP_SEQ_GT(ack_number, client->rtt_seq))
+            {
+                tcp_rtt_update(client, time_now - client->rtt_time);
+
+                client->rtt_timing = 0;
+            }
+
+            /* Restart retransmission timer, stop when all data is acknowledged (RFC 6298) */
+            client->retransmit_timeout = client->rto;
+            client->retransmit_count   = 0;
+
+            if(client->send_unacked != client->send_max)
+                tcp_start_timer(ethernet, &client->retransmit_timer, client->retransmit_timeout);
+            else
+                net_timer_stop(&client->retransmit_timer);
+
+            func_retval = 1;
+        }
+        else
+        {
+            /* Duplicate ACK, no data and no window update while data is outstanding (RFC 5681) */
+            if(segment->data_length == 0 && client->server_window == server_window && client->send_unacked != client->send_max)
+                segment->dup_ack = 1;
+
+            func_retval = 2;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to read SACK blocks from server ACK
+ *         into sender scoreboard, (RFC 2018)
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @retval uint8_t   : Number of valid SACK blocks
+ ******************************************************************/
+static uint8_t tcp_get_sack_blocks(ethernet_handle_t *ethernet, tcp_handle_t *client)
+{
+    uint8_t func_retval = 0;
+
+    net_tcp_t *tcp;
+
+    uint8_t *option;
+    uint8_t  block_count = 0;
+    uint8_t  index       = 0;
+
+    uint32_t start = 0;
+    uint32_t end   = 0;
+
+    if(ethernet->ether_obj == NULL || client == NULL || client->client_flags.sack_permitted == 0)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        tcp = tcp_get_header(ethernet);
+
+        option = tcp_get_option(tcp, TCP_SACK);
+
+        if(option != NULL && option[1] >= 2 + TCP_SACK_BLOCK_SIZE)
+            block_count = (option[1] - 2) / TCP_SACK_BLOCK_SIZE;
+
+        for(index = 0; index < block_count; index++)
+        {
+            memcpy(&start, &option[2 + index * TCP_SACK_BLOCK_SIZE], 4);
+            memcpy(&end, &option[6 + index * TCP_SACK_BLOCK_SIZE], 4);
+
+            start = ntohl(start);
+            end   = ntohl(end);
+
+            /* Ignore blocks below cumulative ACK or for data not sent */
+            if(TCP_SEQ_LEQ(end, start) || TCP_SEQ_LEQ(end, client->send_unacked) || TCP_SEQ_GT(end, client->send_max))
+                continue;
+
+            if(TCP_SEQ_LT(start, client->send_unacked))
+                start = client->send_unacked;
+
+            tcp_sack_update(client, start, end);
+
+            func_retval++;
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function for fast retransmit and fast recovery,
+ *         oldest unacknowledged segment is resent after duplicate
+ *         ACK threshold and on partial ACKs (RFC 5681, RFC 6582)
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @param  *segment  : Reference to received segment information
+ * @retval int8_t    : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_loss_recovery(ethernet_handle_t *ethernet, tcp_handle_t *client, tcp_segment_t *segment)
+{
+    int8_t func_retval = 0;
+
+    tcp_cc_t *cc;
+
+    uint32_t flight_size = 0;
+    uint32_t time_now    = 0;
+
+    if(ethernet->ether_obj == NULL || client == NULL || segment == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        cc = &client->congestion;
+
+        time_now = ethernet->ether_commands->get_time_ms();
+
+        if(segment->dup_ack)
+        {
+            client->dup_acks++;
+
+            if(client->client_flags.fast_recovery)
+            {
+                /* Segment left the network, inflate window and send new data */
+                cc->cwnd += cc->mss;
+
+                tcp_output(ethernet, client);
+            }
+            else if(client->dup_acks == TCP_DUPACK_THRESHOLD && TCP_SEQ_GT(client->send_unacked, client->recover))
+            {
+                /* Fast retransmit, window reduced by congestion control */
+                flight_size = client->acknowledgement_number - client->send_unacked;
+
+                cc->ops->loss(cc, flight_size, time_now);
+
+                cc->cwnd = cc->ssthresh + TCP_DUPACK_THRESHOLD * cc->mss;
+
+                client->recover = client->send_max;
+
+                client->client_flags.fast_recovery = 1;
+
+                tcp_retransmit(ethernet, client);
+
+                tcp_start_timer(ethernet, &client->retransmit_timer, client->retransmit_timeout);
+            }
+        }
+        else if(segment->bytes_acked)
+        {
+            if(client->client_flags.fast_recovery)
+            {
+                if(TCP_SEQ_GEQ(client->send_unacked, client->recover))
+                {
+                    /* Full ACK, deflate window and leave recovery */
+                    flight_size = client->acknowledgement_number - client->send_unacked;
+
+                    if(flight_size < cc->mss)
+                        flight_size = cc->mss;
+
+                    if(flight_size + cc->mss < cc->ssthresh)
+                        cc->cwnd = flight_size + cc->mss;
+                    else
+                        cc->cwnd = cc->ssthresh;
+
+                    client->client_flags.fast_recovery = 0;
+                }
+                else
+                {
+                    /* Partial ACK, resend next unacknowledged segment, deflate window by data acknowledged */
+                    tcp_retransmit(ethernet, client);
+
+                    if(cc->cwnd > segment->bytes_acked)
+                        cc->cwnd -= segment->bytes_acked;
+                    else
+                        cc->cwnd = 0;
+
+                    if(segment->bytes_acked >= cc->mss || cc->cwnd < cc->mss)
+                        cc->cwnd += cc->mss;
+                }
+            }
+
+            client->dup_acks = 0;
+        }
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to read timestamps option of received
+ *         segment, updates TS.Recent and rejects old duplicate
+ *         segments (PAWS, RFC 7323)
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @param  *segment  : Reference to received segment information
+ * @retval uint8_t   : Segment rejected = 0, Success = 1
+ ******************************************************************/
+static uint8_t tcp_get_timestamps(ethernet_handle_t *ethernet, tcp_handle_t *client, tcp_segment_t *segment)
+{
+    uint8_t func_retval = 1;
+
+    net_tcp_t *tcp;
+
+    uint8_t *option;
+
+    segment->timestamps = 0;
+
+    if(client->client_flags.timestamps)
+    {
+        tcp = tcp_get_header(ethernet);
+
+        option = tcp_get_option(tcp, TCP_TIMESTAMPS);
+
+        if(option != NULL && option[1] == 10)
+        {
+            memcpy(&segment->ts_value, &option[2], 4);
+            memcpy(&segment->ts_echo, &option[6], 4);
+
+            segment->ts_value = ntohl(segment->ts_value);
+            segment->ts_echo  = ntohl(segment->ts_echo);
+
+            segment->timestamps = 1;
+
+            if(TCP_SEQ_LT(segment->ts_value, client->ts_recent) && !(segment->control_bits & TCP_RST))
+            {
+                func_retval = 0;
+            }
+            else if(TCP_SEQ_LEQ(segment->sequence_number, client->last_ack_sent))
+            {
+                /* Echo timestamp of segment that our last ACK acknowledges */
+                client->ts_recent = segment->ts_value;
+            }
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to read received TCP segment, processes
+ *         server ACK number (validates TCP checksum)
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @param  *segment  : Reference to received segment information
+ * @retval uint8_t   : Error = 0, Success = TCP control flags
+ ******************************************************************/
+static tcp_ctl_flags_t tcp_input(ethernet_handle_t *ethernet, tcp_handle_t *client, tcp_segment_t *segment)
+{
+    tcp_ctl_flags_t func_retval = (tcp_ctl_flags_t)0;
+
+    if(ethernet->ether_obj == NULL || client == NULL || segment == NULL)
+    {
+        func_retval = (tcp_ctl_flags_t)0;
+    }
+    else
+    {
+        segment->data_length = 0;
+        segment->bytes_acked = 0;
+        segment->dup_ack     = 0;
+
+        func_retval = ether_get_tcp_server_ack(ethernet, &segment->sequence_number, &segment->ack_number,
+                                               client->destination_port, client->source_port, client->server_ip);
+
+        segment->control_bits = func_retval;
+
+        if(func_retval)
+        {
+            segment->data_length = ether_get_packet(ethernet)->data_length;
+
+            /* Timestamps and PAWS check (RFC 7323) */
+            if(tcp_get_timestamps(ethernet, client, segment) == 0)
+            {
+                /* Old duplicate segment, ACK and drop */
+                tcp_send_ack(ethernet, client);
+
+                segment->data_length  = 0;
+                segment->control_bits = (tcp_ctl_flags_t)0;
+
+                func_retval = (tcp_ctl_flags_t)0;
+            }
+            else if(func_retval & TCP_ACK)
+            {
+                tcp_process_ack(ethernet, client, segment);
+
+                tcp_get_sack_blocks(ethernet, client);
+            }
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to deliver in order data to application,
+ *         data is copied to tcp_data and remaining data is held
+ *         for application read
+ * @param  *ethernet          : Reference to Ethernet handle
+ * @param  *data              : In order data
+ * @param  length             : In order data length
+ * @param  *tcp_data          : TCP data buffer, NULL to hold data
+ * @param  data_buffer_length : TCP data buffer length
+ * @param  *tcp_data_length   : TCP data length delivered
+ * @param  *data_sum          : Sum of accepted data for TCP checksum,
+ *                              (summed while copied), NULL = copy only
+ * @retval uint16_t           : Bytes accepted (copied or held)
+ ******************************************************************/
+static uint16_t tcp_deliver_data(ethernet_handle_t *ethernet,
+                                 char              *data,
+                                 uint16_t           length,
+                                 char              *tcp_data,
+                                 uint16_t           data_buffer_length,
+                                 uint16_t          *tcp_data_length,
+                                 uint32_t          *data_sum)
+{
+    uint16_t func_retval = 0;
+
+    uint16_t copy_length = 0;
+    uint32_t part_sum    = 0;
+
+    /* Copy to application buffer */
+    if(tcp_data != NULL && *tcp_data_length < data_buffer_length)
+    {
+        copy_length = data_buffer_length - *tcp_data_length;
+
+        if(copy_length > length)
+            copy_length = length;
+
+        if(data_sum != NULL)
+            ether_copy_sum(data_sum, tcp_data + *tcp_data_length, data, copy_length);
+        else
+            memcpy(tcp_data + *tcp_data_length, data, copy_length);
+
+        *tcp_data_length += copy_length;
+
+        func_retval = copy_length;
+    }
+
+    /* Hold remaining server data for application read */
+    copy_length = APP_BUFF_SIZE - ethernet->net_app_data_length;
+
+    if(copy_length > length - func_retval)
+        copy_length = length - func_retval;
+
+    if(copy_length)
+    {
+        if(data_sum != NULL)
+        {
+            ether_copy_sum(&part_sum, ethernet->net_application_data + ethernet->net_app_data_length, data + func_retval, copy_length);
+
+            ether_sum_combine(data_sum, part_sum, func_retval);
+        }
+        else
+        {
+            memcpy(ethernet->net_application_data + ethernet->net_app_data_length, data + func_retval, copy_length);
+        }
+
+        ethernet->net_app_data_length += copy_length;
+
+        ethernet->status.net_app_data_rdy = 1;
+
+        if(tcp_data == NULL)
+            *tcp_data_length += copy_length;
+
+        func_retval += copy_length;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to advance next expected sequence number,
+ *         out of order data and ranges are moved with it
+ * @param  *client : Reference to TCP client handle
+ * @param  length  : Number of bytes received in order
+ * @retval int8_t  : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_advance_recv(tcp_handle_t *client, uint16_t length)
+{
+    int8_t func_retval = 0;
+
+    uint8_t  index       = 0;
+    uint8_t  block_count = 0;
+    uint32_t queue_end   = 0;
+
+    if(client == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        client->sequence_number += length;
+
+        queue_end = client->sequence_number;
+
+        if(client->recv_block_count)
+        {
+            /* Remove received ranges, find end of queued data */
+            for(index = 0; index < client->recv_block_count; index++)
+            {
+                if(TCP_SEQ_LEQ(client->recv_blocks[index].end, client->sequence_number))
+                    continue;
+
+                if(TCP_SEQ_LT(client->recv_blocks[index].start, client->sequence_number))
+                    client->recv_blocks[index].start = client->sequence_number;
+
+                if(TCP_SEQ_GT(client->recv_blocks[index].end, queue_end))
+                    queue_end = client->recv_blocks[index].end;
+
+                client->recv_blocks[block_count++] = client->recv_blocks[index];
+            }
+
+            client->recv_block_count = block_count;
+
+            /* Out of order data is kept at offset from next expected sequence number, only queued data is moved */
+            if(block_count)
+                memmove(client->recv_buffer, client->recv_buffer + length, queue_end - client->sequence_number);
+        }
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to queue out of order data, range is
+ *         merged with overlapping ranges and reported first in
+ *         SACK blocks, oldest range is dropped if queue is full
+ * @param  *client  : Reference to TCP client handle
+ * @param  *segment : Reference to received segment information
+ * @param  *data    : Segment data
+ * @retval int8_t   : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_queue_data(tcp_handle_t *client, tcp_segment_t *segment, char *data)
+{
+    int8_t func_retval = 0;
+
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    uint32_t start  = 0;
+    uint32_t end    = 0;
+
+    uint8_t index       = 0;
+    uint8_t block_count = 0;
+
+    offset = segment->sequence_number - client->sequence_number;
+
+    /* Data outside receive window is dropped */
+    if(offset < TCP_RECV_BUFF_SIZE)
+    {
+        length = segment->data_length;
+
+        if(length > TCP_RECV_BUFF_SIZE - offset)
+            length = TCP_RECV_BUFF_SIZE - offset;
+
+        memcpy(client->recv_buffer + offset, data, length);
+
+        start = segment->sequence_number;
+        end   = start + length;
+
+        /* Merge overlapping or adjacent ranges, keep other ranges in order */
+        for(index = 0; index < client->recv_block_count; index++)
+        {
+            if(TCP_SEQ_LEQ(client->recv_blocks[index].start, end) && TCP_SEQ_LEQ(start, client->recv_blocks[index].end))
+            {
+                if(TCP_SEQ_LT(client->recv_blocks[index].start, start))
+                    start = client->recv_blocks[index].start;
+
+                if(TCP_SEQ_GT(client->recv_blocks[index].end, end))
+                    end = client->recv_blocks[index].end;
+
+                continue;
+            }
+
+            client->recv_blocks[block_count++] = client->recv_blocks[index];
+        }
+
+        /* Drop oldest range */
+        if(block_count == TCP_SACK_MAX_BLOCKS)
+            block_count--;
+
+        /* Most recent range first (RFC 2018) */
+        memmove(&client->recv_blocks[1], &client->recv_blocks[0], block_count * sizeof(tcp_sack_block_t));
+
+        client->recv_blocks[0].start = start;
+        client->recv_blocks[0].end   = end;
+
+        client->recv_block_count = block_count + 1;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to deliver queued out of order data
+ *         that is now in order
+ * @param  *ethernet          : Reference to Ethernet handle
+ * @param  *client            : Reference to TCP client handle
+ * @param  *tcp_data          : TCP data buffer, NULL to hold data
+ * @param  data_buffer_length : TCP data buffer length
+ * @param  *tcp_data_length   : TCP data length delivered
+ * @retval uint8_t            : No data = 0, Success = 1
+ ******************************************************************/
+static uint8_t tcp_reassemble(ethernet_handle_t *ethernet,
+                              tcp_handle_t      *client,
+                              char              *tcp_data,
+                              uint16_t           data_buffer_length,
+                              uint16_t          *tcp_data_length)
+{
+    uint8_t func_retval = 0;
+
+    uint8_t  index          = 0;
+    uint16_t length         = 0;
+    uint16_t accept_length  = 0;
+
+    while(index < client->recv_block_count)
+    {
+        if(client->recv_blocks[index].start != client->sequence_number)
+        {
+            index++;
+
+            continue;
+        }
+
+        length = client->recv_blocks[index].end - client->sequence_number;
+
+        accept_length = tcp_deliver_data(ethernet, client->recv_buffer, length, tcp_data, data_buffer_length, tcp_data_length, NULL);
+
+        tcp_advance_recv(client, accept_length);
+
+        func_retval = 1;
+
+        /* Application buffers full */
+        if(accept_length < length)
+            break;
+
+        /* Ranges are moved, search again */
+        index = 0;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to receive TCP data, in order data is
+ *         delivered and out of order data queued, out of order,
+ *         duplicate and gap filling segments are ACKed immediately
+ *         (RFC 5681)
+ * @param  *ethernet          : Reference to Ethernet handle
+ * @param  *client            : Reference to TCP client handle
+ * @param  *segment           : Reference to received segment information
+ * @param  *tcp_data          : TCP data buffer, NULL to hold data
+ * @param  data_buffer_length : TCP data buffer length
+ * @retval uint16_t           : TCP data length delivered
+ ******************************************************************/
+static uint16_t tcp_receive_data(ethernet_handle_t *ethernet,
+                                 tcp_handle_t      *client,
+                                 tcp_segment_t     *segment,
+                                 char              *tcp_data,
+                                 uint16_t           data_buffer_length)
+{
+    uint16_t func_retval = 0;
+
+    char    *data;
+    uint16_t length        = 0;
+    uint16_t accept_length = 0;
+    uint8_t  gap_filled    = 0;
+
+    data   = (char*)tcp_get_payload(ethernet);
+    length = segment->data_length;
+
+    if(TCP_SEQ_GT(segment->sequence_number, client->sequence_number))
+    {
+        /* Out of order, ACK with SACK blocks */
+        tcp_queue_data(client, segment, data);
+
+        tcp_send_ack(ethernet, client);
+    }
+    else if(TCP_SEQ_LEQ(segment->sequence_number + length, client->sequence_number))
+    {
+        /* Duplicate, ACK in case our ACK was lost */
+        tcp_send_ack(ethernet, client);
+    }
+    else
+    {
+        /* Trim data received before */
+        data   += client->sequence_number - segment->sequence_number;
+        length -= client->sequence_number - segment->sequence_number;
+
+        gap_filled = (client->recv_block_count != 0);
+
+        accept_length = tcp_deliver_data(ethernet, data, length, tcp_data, data_buffer_length, &func_retval, NULL);
+
+        tcp_advance_recv(client, accept_length);
+
+        if(accept_length == length)
+            tcp_reassemble(ethernet, client, tcp_data, data_buffer_length, &func_retval);
+
+        if(gap_filled)
+            tcp_send_ack(ethernet, client);
+        else if(!(segment->control_bits & TCP_FIN) || accept_length < length)
+            tcp_ack_data(ethernet, client);     /* FIN is acknowledged with data */
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to handle server FIN, server FIN is
+ *         acknowledged with FIN ACK if client has not closed
+ * @param  *ethernet : Reference to Ethernet handle
+ * @param  *client   : Reference to TCP client handle
+ * @param  *segment  : Reference to received segment information
+ * @retval int8_t    : Error = 0, Success = 1
+ ******************************************************************/
+static int8_t tcp_receive_fin(ethernet_handle_t *ethernet, tcp_handle_t *client, tcp_segment_t *segment)
+{
+    int8_t func_retval = 0;
+
+    if(ethernet->ether_obj == NULL || client == NULL || segment == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        /* FIN takes one sequence number after segment data */
+        client->sequence_number = segment->sequence_number + segment->data_length + 1;
+
+        if(client->client_flags.client_close)
+        {
+            ether_send_tcp_ack(ethernet, client, TCP_ACK);
+        }
+        else
+        {
+            ether_send_tcp_ack(ethernet, client, TCP_FIN_ACK);
+
+            client->acknowledgement_number += 1;
+            client->send_max                = client->acknowledgement_number;
+
+            if(!net_timer_pending(&client->retransmit_timer))
+                tcp_start_timer(ethernet, &client->retransmit_timer, client->retransmit_timeout);
+
+            client->client_flags.client_close = 1;
+        }
+
+        client->ack_pending = 0;
+
+        client->client_flags.server_close        = 1;
+        client->client_flags.connect_established = 0;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/************************************************************************
+ * @brief  Static function for header prediction (Van Jacobson), pure
+ *         ACK of new data and next in sequence data segment on an
+ *         established connection are handled without the general
+ *         receive path, other segments are left for the general path
+ * @param  *ethernet          : Reference to the Ethernet Handle
+ * @param  *client            : Reference to TCP client handle
+ * @param  *tcp_data          : TCP data buffer, NULL to hold data
+ * @param  data_buffer_length : TCP data buffer length
+ * @param  *tcp_data_length   : TCP data length received
+ * @retval uint8_t            : Not predicted = 0, Success = TCP control flags
+ ************************************************************************/
+static tcp_ctl_flags_t tcp_header_prediction(ethernet_handle_t *ethernet,
+                                             tcp_handle_t      *client,
+                                             char              *tcp_data,
+                                             uint16_t           data_buffer_length,
+                                             uint16_t          *tcp_data_length)
+{
+    tcp_ctl_flags_t func_retval = (tcp_ctl_flags_t)0;
+
+    net_packet_t *packet;
+    net_tcp_t    *tcp;
+
+    tcp_segment_t segment;
+
+    uint8_t *option;
+    uint8_t  header_length = TCP_FRAME_SIZE;
+    uint16_t buffer_space  = 0;
+
+    /* Data delivery undone when TCP checksum fails */
+    uint32_t data_sum      = 0;
+    uint16_t accept_length = 0;
+    uint16_t copied_length = 0;
+    uint16_t held_length   = 0;
+    uint8_t  held_rdy      = 0;
+
+    packet = ether_get_packet(ethernet);
+
+    tcp = tcp_get_header(ethernet);
+
+    option = &tcp->data;
+
+    if(client->client_flags.timestamps)
+        header_length += TCP_TS_OPTS_SIZE;
+
+    /* Cheap checks first, expected IPv4 TCP segment from server with only ACK (PSH) flags, (parsed header fields) */
+    if(client->client_flags.connect_established == 0 || client->client_flags.fast_recovery || \
+            client->recv_block_count || client->acknowledgement_number != client->send_max)
+    {
+        func_retval = (tcp_ctl_flags_t)0;
+    }
+    else if(packet->ether_type != ETHER_IPV4 || packet->ip_valid == 0 || packet->ip_protocol != IP_TCP || \
+            ethernet->status.mode_dhcp_init)
+    {
+        func_retval = (tcp_ctl_flags_t)0;
+    }
+    else if(memcmp(packet->source_ip, client->server_ip, 4) != 0 || memcmp(packet->destination_ip, ethernet->host_ip, 4) != 0 || \
+            packet->source_port != client->destination_port || packet->destination_port != client->source_port)
+    {
+        func_retval = (tcp_ctl_flags_t)0;
+    }
+    else if((tcp->control_bits & ~TCP_PSH) != TCP_ACK || packet->l4_header_length != header_length || \
+            net_load_u32(&tcp->sequence_number) != client->sequence_number || \
+            ((uint32_t)net_load_u16(&tcp->window) << client->server_window_scale) != client->server_window)
+    {
+        func_retval = (tcp_ctl_flags_t)0;
+    }
+    else if(client->client_flags.timestamps && (option[0] != TCP_NO_OPERATION || option[1] != TCP_NO_OPERATION || \
+            option[2] != TCP_TIMESTAMPS || option[3] != 10))
+    {
+        func_retval = (tcp_ctl_flags_t)0;
+    }
+    else
+    {
+        segment.sequence_number = client->sequence_number;
+        segment.ack_number      = net_load_u32(&tcp->ack_number);
+        segment.control_bits    = (tcp_ctl_flags_t)tcp->control_bits;
+        segment.data_length     = packet->data_length;
+        segment.bytes_acked     = 0;
+        segment.dup_ack         = 0;
+        segment.timestamps      = 0;
+
+        if(client->client_flags.timestamps)
+        {
+            segment.ts_value = net_load_u32(&option[4]);
+            segment.ts_echo  = net_load_u32(&option[8]);
+
+            segment.timestamps = 1;
+        }
+
+        buffer_space = APP_BUFF_SIZE - ethernet->net_app_data_length;
+
+        if(tcp_data != NULL)
+            buffer_space += data_buffer_length;
+
+        /* Predicted segments: ACK of new data without data, or data that fits without ACK of new data */
+        if(segment.data_length == 0 && \
+                (TCP_SEQ_LEQ(segment.ack_number, client->send_unacked) || TCP_SEQ_GT(segment.ack_number, client->send_max)))
+        {
+            func_retval = (tcp_ctl_flags_t)0;
+        }
+        else if(segment.data_length != 0 && (segment.ack_number != client->send_unacked || segment.data_length > buffer_space))
+        {
+            func_retval = (tcp_ctl_flags_t)0;
+        }
+        else if(segment.timestamps && TCP_SEQ_LT(segment.ts_value, client->ts_recent))
+        {
+            func_retval = (tcp_ctl_flags_t)0;
+        }
+        else if(segment.data_length == 0)
+        {
+            /* TCP checksum is validated last (IP header by parser), general path drops the segment */
+            if(ip_transport_checksum_valid(ethernet))
+            {
+                if(segment.timestamps && TCP_SEQ_LEQ(segment.sequence_number, client->last_ack_sent))
+                    client->ts_recent = segment.ts_value;
+
+                /* ACK clocked send, release data and update congestion window and RTT */
+                tcp_process_ack(ethernet, client, &segment);
+
+                client->dup_acks = 0;
+
+                func_retval = segment.control_bits;
+            }
+        }
+        else
+        {
+            copied_length = *tcp_data_length;
+            held_length   = ethernet->net_app_data_length;
+            held_rdy      = ethernet->status.net_app_data_rdy;
+
+            /* In sequence data, TCP checksum is summed while data is delivered */
+            accept_length = tcp_deliver_data(ethernet, (char*)tcp + header_length, segment.data_length,
+                                             tcp_data, data_buffer_length, tcp_data_length, &data_sum);
+
+            if(ip_transport_checksum_valid_sum(ethernet, data_sum, accept_length))
+            {
+                if(segment.timestamps && TCP_SEQ_LEQ(segment.sequence_number, client->last_ack_sent))
+                    client->ts_recent = segment.ts_value;
+
+                /* Acknowledge delivered data */
+                client->sequence_number += accept_length;
+
+                tcp_ack_data(ethernet, client);
+
+                func_retval = segment.control_bits;
+            }
+            else
+            {
+                /* Undo delivery, general path drops the segment */
+                *tcp_data_length = copied_length;
+
+                ethernet->net_app_data_length     = held_length;
+                ethernet->status.net_app_data_rdy = held_rdy;
+            }
+        }
+    }
+
+    return func_retval;
+}
+
+
+
+/************************************************************************
+ * @brief  Static function to handle network packet read by
+ *         ether_get_data(), TCP data is copied to tcp_data or held for
+ *         application read (tcp_data = NULL), ARP and ICMP are handled
+ * @param  *ethernet          : Reference to the Ethernet Handle
+ * @param  *client            : Reference to TCP client handle
+ * @param  *tcp_data          : TCP data buffer, NULL to hold data
+ * @param  data_buffer_length : TCP data buffer length
+ * @param  *tcp_data_length   : TCP data length received
+ * @retval uint8_t            : No TCP packet = 0, Success = TCP control flags
+ ************************************************************************/
+static tcp_ctl_flags_t tcp_handle_packet(ethernet_handle_t *ethernet,
+                                         tcp_handle_t      *client,
+                                         char              *tcp_data,
+                                         uint16_t           data_buffer_length,
+                                         uint16_t          *tcp_data_length)
+{
+    tcp_ctl_flags_t func_retval = (tcp_ctl_flags_t)0;
+
+    tcp_segment_t segment;
+
+    /* Header prediction, in sequence data and ACKs skip the general receive path */
+    func_retval = tcp_header_prediction(ethernet, client, tcp_data, data_buffer_length, tcp_data_length);
+
+    if(func_retval)
+    {
+        /* Segment handled */
+    }
+
+    /* handle transport layer protocol type packets */
+    else if(get_ether_protocol_type(ethernet) == ETHER_IPV4 && (get_ip_communication_type(ethernet) == 1))
+    {
+
+        /* Handle TCP packets */
+        if(get_ip_protocol_type(ethernet) == IP_TCP)
+        {
+            func_retval = tcp_input(ethernet, client, &segment);
+
+            /* Handle TCP data */
+            if(segment.data_length && client->client_flags.server_close == 0)
+                *tcp_data_length = tcp_receive_data(ethernet, client, &segment, tcp_data, data_buffer_length);
+
+            /* Handle server FIN, after all data is received */
+            if(func_retval & TCP_FIN)
+            {
+                if(segment.sequence_number + segment.data_length == client->sequence_number || client->client_flags.server_close)
+                    tcp_receive_fin(ethernet, client, &segment);
+                else
                 {
-                    ether_handle_arp_resp_req(ethernet);
+                    /* Out of order FIN, ACK next expected data */
+                    if(segment.data_length == 0)
+                        tcp_send_ack(ethernet, client);
+
+                    func_retval = (tcp_ctl_flags_t)(func_retval & ~TCP_FIN);
                 }
+            }
+
+            /* Duplicate and partial ACKs, (after data is read, frame is reused for sending) */
+            if(func_retval)
+                tcp_loss_recovery(ethernet, client, &segment);
+
+        } /* IP is TCP condition */
+
+#if ARP_ICMP_READ_HANDLE
+        /* Handle ICMP packets */
+        else if(get_ip_protocol_type(ethernet) == IP_ICMP)
+        {
+            ether_send_icmp_reply(ethernet);
+        }
+#endif
+    } /* ETHER is IP packet condition */
+
+#if ARP_ICMP_READ_HANDLE
+    /* Handle ARP requests */
+    else if(get_ether_protocol_type(ethernet) == ETHER_ARP)
+    {
+        ether_handle_arp_resp_req(ethernet);
+    }
 #endif
+
+    return func_retval;
+}
+
+
+
+/************************************************************************
+ * @brief  Static function to service TCP timers and read one network
+ *         packet, TCP data is copied to tcp_data or held for
+ *         application read (tcp_data = NULL), ARP and ICMP are handled
+ * @param  *ethernet          : Reference to the Ethernet Handle
+ * @param  *network_data      : Network data
+ * @param  *client            : Reference to TCP client handle
+ * @param  *tcp_data          : TCP data buffer, NULL to hold data
+ * @param  data_buffer_length : TCP data buffer length
+ * @param  *tcp_data_length   : TCP data length received
+ * @retval uint8_t            : No TCP packet = 0, Success = TCP control flags
+ ************************************************************************/
+static tcp_ctl_flags_t tcp_poll(ethernet_handle_t *ethernet,
+                                uint8_t           *network_data,
+                                tcp_handle_t      *client,
+                                char              *tcp_data,
+                                uint16_t           data_buffer_length,
+                                uint16_t          *tcp_data_length)
+{
+    tcp_ctl_flags_t func_retval = (tcp_ctl_flags_t)0;
+
+    *tcp_data_length = 0;
+
+    /* Delayed ACK and retransmission timers */
+    tcp_check_timers(ethernet, client);
+
+    if(ether_get_data(ethernet, network_data, ETHER_MTU_SIZE))
+    {
+        func_retval = tcp_handle_packet(ethernet, client, tcp_data, data_buffer_length, tcp_data_length);
+    }
+
+    return func_retval;
+}
+
+
+
+/************************************************************************
+ * @brief  Static TCP receive handler for net_poll(), segments of the
+ *         connection are handled as they are read, data is held for
+ *         application read, at end of batch one ACK is sent for the
+ *         data segments of the batch and timers are serviced
+ * @param  *ethernet  : Reference to the Ethernet Handle
+ * @param  *context   : Reference to TCP client handle
+ * @param  batch_end  : 0 = packet read, 1 = end of batch
+ * @retval uint8_t    : Not handled = 0, Success = 1
+ ************************************************************************/
+static uint8_t tcp_net_input(ethernet_handle_t *ethernet, void *context, uint8_t batch_end)
+{
+    uint8_t func_retval = 0;
+
+    tcp_handle_t *client = context;
+
+    uint16_t tcp_data_length = 0;
+
+    if(client == NULL || client->client_flags.connect_established == 0)
+    {
+        func_retval = 0;
+    }
+    else if(batch_end)
+    {
+        /* ACK deferred by tcp_ack_data(), delayed ACK rules for the batch */
+        if(client->ack_pending && (client->client_flags.delayed_ack == 0 || client->ack_pending >= TCP_ACK_SEGMENTS))
+            tcp_send_ack(ethernet, client);
+        else if(client->ack_pending && net_timer_pending(&client->ack_timer) == 0)
+            tcp_start_timer(ethernet, &client->ack_timer, TCP_ACK_DELAY);
+
+        tcp_check_timers(ethernet, client);
+
+        func_retval = 1;
+    }
+    else
+    {
+        func_retval = (tcp_handle_packet(ethernet, client, NULL, 0, &tcp_data_length) != 0);
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function to wait until all send data is sent
+ *         and acknowledged, server data is held for application
+ * @param  *ethernet     : Reference to the Ethernet Handle
+ * @param  *network_data : Network data
+ * @param  *client       : Reference to TCP client handle
+ * @retval int8_t        : Success = 1, 0 (Connection closed)
+ ******************************************************************/
+static int8_t tcp_flush(ethernet_handle_t *ethernet, uint8_t *network_data, tcp_handle_t *client)
+{
+    int8_t func_retval = 1;
+
+    uint16_t tcp_data_length = 0;
+
+    while(client->send_unacked != client->send_data_seq + client->send_data_length)
+    {
+        if(client->client_flags.connect_established == 0 || client->client_flags.connect_aborted)
+        {
+            func_retval = 0;
+
+            break;
+        }
+
+        tcp_output(ethernet, client);
+
+        tcp_poll(ethernet, network_data, client, NULL, 0, &tcp_data_length);
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************
+ * @brief  Static function for sending large TCP data as MSS sized
+ *         segments directly from application data, within
+ *         congestion and server window
+ * @param  *ethernet         : Reference to the Ethernet Handle
+ * @param  *network_data     : Network data
+ * @param  *client           : Reference to TCP client handle
+ * @param  *application_data : application_data
+ * @param  data_length       : application data length
+ * @retval int32_t           : Error   = -12,
+ *                             Success =  1,
+ *                                        0 (Connection closed)
+ ******************************************************************/
+static int32_t ether_tcp_send_segments(ethernet_handle_t *ethernet,
+                                       uint8_t           *network_data,
+                                       tcp_handle_t      *client,
+                                       char              *application_data,
+                                       uint32_t           data_length)
+{
+    int32_t func_retval = NET_TCP_SEND_ERROR;
+
+    if(ethernet->ether_obj == NULL || client == NULL || application_data == NULL || data_length == 0)
+    {
+        func_retval = NET_TCP_SEND_ERROR;
+    }
+    else
+    {
+        /* Send buffered data first to keep byte order */
+        func_retval = tcp_flush(ethernet, network_data, client);
+
+        if(func_retval)
+        {
+            /* Send directly from application data */
+            client->send_data        = application_data;
+            client->send_data_seq    = client->acknowledgement_number;
+            client->send_data_length = data_length;
+
+            func_retval = tcp_flush(ethernet, network_data, client);
+        }
+
+        /* Restore send buffer */
+        client->send_data        = client->send_buffer;
+        client->send_data_seq    = client->send_unacked;
+        client->send_data_length = 0;
+    }
+
+    return func_retval;
+}
+
+
+
+/************************************************************************
+ * @brief  helper function for reading TCP data
+ * @param  *ethernet         : Reference to the Ethernet Handle
+ * @param  *network_data     : Network data
+ * @param  *client           : Reference to TCP client handle
+ * @param  *application_data : application_data
+ * @param  data_length       : application data length
+ * @retval uint16_t          : Error = 0, Success = number of bytes read
+ *                                              1 = ACK received
+ ************************************************************************/
+static int32_t ether_tcp_read_data_hf(ethernet_handle_t *ethernet,
+                                      uint8_t           *network_data,
+                                      tcp_handle_t      *client,
+                                      char              *application_data,
+                                      uint16_t           data_length)
+{
+
+    int32_t func_retval      = NET_FUNC_NO_RDWR;
+    uint8_t tcp_read_loop    = 0;
+    uint16_t tcp_data_length = 0;
+
+    tcp_ctl_flags_t ack_type;
+
+    if(ethernet->ether_obj == NULL || client == NULL || data_length > UINT16_MAX || data_length > ETHER_MTU_SIZE)
+    {
+        func_retval = NET_TCP_READ_ERROR;
+    }
+    else
+    {
+        tcp_read_loop = 1;
+
+        while(tcp_read_loop)
+        {
+            /* Set loop state if blocking or non block read */
+            tcp_read_loop = client->client_flags.client_blocking;
+
+            /* Send data held by Nagle once outstanding data is acknowledged */
+            if(client->client_flags.send_nonblock)
+                tcp_output(ethernet, client);
+
+            ack_type = tcp_poll(ethernet, network_data, client, application_data, data_length, &tcp_data_length);
+
+            if(tcp_data_length)
+            {
+                tcp_read_loop = 0;
+                func_retval   = tcp_data_length;
+            }
+            else if(ack_type & TCP_FIN)
+            {
+                tcp_read_loop = 0;
+                func_retval   = 0;
+            }
+            else if(ack_type == TCP_ACK && client->client_flags.send_nonblock == 0)
+            {
+                func_retval = 1;
             }
 
         }/* while loop */
@@ -851,24 +3190,27 @@ tcp_handle_t* ether_tcp_create_client(ethernet_handle_t *ethernet,
 
     static tcp_handle_t tcp_client;
 
+    uint8_t next_hop[ETHER_IPV4_SIZE] = {0};
+
     if(server_ip == NULL)
     {
         return NULL;
     }
     else
     {
-        tcp_client.source_port      = source_port;
-        tcp_client.destination_port = destination_port;
+        /* Handle is reused, unlink timers of previous connection */
+        tcp_stop_timers(&tcp_client);
 
-        tcp_client.sequence_number        = 0;
-        tcp_client.acknowledgement_number = 0;
+        tcp_init_client(&tcp_client, source_port, destination_port, server_ip);
 
-        /* Not tested */
-        tcp_client.client_flags.client_blocking = 1;
+        /* Segments read by net_poll() */
+        ethernet->tcp_input   = tcp_net_input;
+        ethernet->tcp_context = &tcp_client;
 
-        memcpy((char*)tcp_client.server_ip, (char*)server_ip, ETHER_IPV4_SIZE);
+        /* Off link server is reached through gateway, ARP next hop */
+        ip_route_next_hop(ethernet, server_ip, next_hop);
 
-        ether_send_arp_req(ethernet, ethernet->host_ip, server_ip);
+        ether_send_arp_req(ethernet, ethernet->host_ip, next_hop);
 
         if(ether_is_arp(ethernet, network_data, 60))
         {
@@ -899,23 +3241,45 @@ uint8_t tcp_init_client(tcp_handle_t *client,
 
     uint8_t func_retval = 0;
 
-    if(server_ip == NULL)
+    if(client == NULL || server_ip == NULL)
     {
         func_retval = 0;
     }
     else
     {
+        memset(client, 0, sizeof(tcp_handle_t));
+
         client->source_port      = source_port;
         client->destination_port = destination_port;
 
         client->sequence_number        = 0;
         client->acknowledgement_number = 0;
 
+        client->server_mss          = TCP_DEFAULT_MSS;
+        client->server_window_scale = 0;
+        client->server_window       = 0;
+
+        client->send_data          = client->send_buffer;
+        client->rto                = TCP_INITIAL_RTO;
+        client->retransmit_timeout = TCP_INITIAL_RTO;
+
+        net_timer_init(&client->ack_timer, tcp_ack_timeout, client);
+        net_timer_init(&client->retransmit_timer, tcp_retransmit_timeout, client);
+        net_timer_init(&client->pace_timer, tcp_pace_timeout, client);
+
+        /* NewReno congestion control by default */
+        client->congestion.ops = &tcp_cc_newreno;
+        client->congestion.ops->init(&client->congestion, TCP_DEFAULT_MSS);
+
         /* Not tested */
         client->client_flags.client_blocking = 1;
 
+        /* Nagle is enabled by default, used with non blocking send */
+        client->client_flags.nagle = 1;
+
         memcpy(client->server_ip, server_ip, ETHER_IPV4_SIZE);
 
+        func_retval = 1;
     }
 
     return func_retval;
@@ -925,11 +3289,15 @@ uint8_t tcp_init_client(tcp_handle_t *client,
 
 
 /**********************************************************
- * @brief  Function to establish connection to TCP server
+ * @brief  Function to establish connection to TCP server,
+ *         non blocking client (TCP_READ_NONBLOCK) sends SYN
+ *         once and is called again until connected, SYN is
+ *         resent on retransmission timeout
  * @param  *ethernet     : Reference to Ethernet handle
  * @param  *network_data : Network data
  * @param  *client       : reference to TCP client handle
- * @retval int8_t        : Error = -11, Success = 1
+ * @retval int8_t        : Error = -11, Success = 1,
+ *                         0 = connect pending (non blocking)
  **********************************************************/
 int8_t ether_tcp_connect(ethernet_handle_t *ethernet, uint8_t *network_data ,tcp_handle_t *client)
 {
@@ -944,13 +3312,37 @@ int8_t ether_tcp_connect(ethernet_handle_t *ethernet, uint8_t *network_data ,tcp
     {
         func_retval = NET_TCP_CONNECT_ERROR;
     }
+    else if(client->client_flags.connect_established == 1)
+    {
+        func_retval = 1;
+    }
     else
     {
-        /* Send TCP SYN packet */
-        ether_send_tcp_syn(ethernet, client->source_port, client->destination_port, client->sequence_number,
-                           client->acknowledgement_number, client->server_ip);
+        net_timer_run(ethernet->ether_commands->get_time_ms());
+
+        /* Send TCP SYN packet, resend with backoff if SYN ACK is not received */
+        if(client->client_flags.connect_request == 0 || (client->timer_events & TCP_TIMER_RTO))
+        {
+            if(client->timer_events & TCP_TIMER_RTO)
+            {
+                client->retransmit_timeout <<= 1;
+
+                if(client->retransmit_timeout > TCP_MAX_RTO)
+                    client->retransmit_timeout = TCP_MAX_RTO;
+            }
+
+            client->timer_events &= ~TCP_TIMER_RTO;
+
+            /* New connection, headers of connection are rebuilt */
+            client->header_cache.valid = 0;
+
+            ether_send_tcp_syn(ethernet, client->source_port, client->destination_port, client->sequence_number,
+                               client->acknowledgement_number, client->server_ip);
 
-        client->client_flags.connect_request = 1;
+            tcp_start_timer(ethernet, &client->retransmit_timer, client->retransmit_timeout);
+
+            client->client_flags.connect_request = 1;
+        }
 
         /* Read response message from the TCP server */
         api_retval = ether_is_tcp(ethernet, network_data, ETHER_MTU_SIZE);
@@ -967,11 +3359,29 @@ int8_t ether_tcp_connect(ethernet_handle_t *ethernet, uint8_t *network_data ,tcp
 
                 case TCP_SYN_ACK:
 
+                    /* Get server MSS, window scale and window before frame is reused */
+                    tcp_get_syn_options(ethernet, client);
+
                     /* Increment the sequence number and pass it as acknowledgment number*/
                     client->sequence_number += 1;
 
-                    ether_send_tcp_ack(ethernet, client->source_port, client->destination_port,
-                                       client->acknowledgement_number, client->sequence_number, client->server_ip, TCP_ACK);
+                    ether_send_tcp_ack(ethernet, client, TCP_ACK);
+
+                    /* SYN acknowledged, send buffer starts at next sequence number */
+                    client->send_unacked     = client->acknowledgement_number;
+                    client->send_max         = client->acknowledgement_number;
+                    client->recover          = client->acknowledgement_number - 1;
+                    client->send_data        = client->send_buffer;
+                    client->send_data_seq    = client->acknowledgement_number;
+                    client->send_data_length = 0;
+
+                    /* Initial congestion window from segment size */
+                    client->congestion.ops->init(&client->congestion, tcp_get_segment_size(client));
+
+                    /* SYN acknowledged, stop SYN retransmission */
+                    net_timer_stop(&client->retransmit_timer);
+
+                    client->retransmit_timeout = client->rto;
 
                     /* Set flags */
                     client->client_flags.connect_request     = 0;
@@ -989,8 +3399,7 @@ int8_t ether_tcp_connect(ethernet_handle_t *ethernet, uint8_t *network_data ,tcp
                     /* Increment the sequence number and pass it as acknowledgment number*/
                     client->sequence_number += 1;
 
-                    ether_send_tcp_ack(ethernet, client->source_port, client->destination_port,
-                                       client->acknowledgement_number, client->sequence_number, client->server_ip, TCP_FIN_ACK);
+                    ether_send_tcp_ack(ethernet, client, TCP_FIN_ACK);
 
                     tcp_read_loop = 0;
 
@@ -1025,196 +3434,371 @@ int8_t ether_tcp_connect(ethernet_handle_t *ethernet, uint8_t *network_data ,tcp
 
 
 /*****************************************************************
- * @brief  Function to control TCP read behavior
- * @param  *client     : Reference to TCP handle
- * @param  app_state   : TCP read type (blocking or non blocking)
- * @retval int8_t      : Error = 0, Success = 1
+ * @brief  Function to control TCP read, send and ACK behavior
+ * @param  *client      : Reference to TCP handle
+ * @param  control_mode : TCP control mode (tcp_control_t)
+ * @retval int8_t       : Error = 0, Success = 1
  ****************************************************************/
-int8_t tcp_control(tcp_handle_t *client, tcp_read_state_t app_state)
+int8_t tcp_control(tcp_handle_t *client, tcp_control_t control_mode)
 {
     int8_t func_retval = 0;
 
-    if(client == NULL || app_state > 2 || app_state < 1)
+    if(client == NULL)
     {
         func_retval = 0;
     }
     else
     {
-        if(app_state == TCP_READ_NONBLOCK)
+        func_retval = 1;
+
+        switch(control_mode)
+        {
+
+        case TCP_READ_BLOCKING:
+
+            client->client_flags.client_blocking = 1;
+
+            break;
+
+
+        case TCP_READ_NONBLOCK:
+
             client->client_flags.client_blocking = 0;
 
-        func_retval = 1;
-    }
+            break;
 
-    return func_retval;
-}
 
+        case TCP_SEND_BLOCKING:
 
+            client->client_flags.send_nonblock = 0;
 
-/***************************************************************
- * @brief  Function for sending TCP data
- * @param  *ethernet         : Reference to the Ethernet Handle
- * @param  *network_data     : Network data
- * @param  *client           : Reference to TCP client handle
- * @param  *application_data : application_data
- * @param  data_length       : application data length
- * @retval int8_t            : Error   = -12,
- *                             Success =  1
- *                                       -14(Connection closed)
- ***************************************************************/
-int32_t ether_tcp_send_data(ethernet_handle_t *ethernet,
-                            uint8_t           *network_data,
-                            tcp_handle_t      *client,
-                            char              *application_data,
-                            uint16_t           data_length)
-{
+            break;
 
-    int32_t func_retval = NET_FUNC_NO_RDWR;
 
-    tcp_ctl_flags_t ack_type;
+        case TCP_SEND_NONBLOCK:
 
-    uint16_t tcp_data_length = 0;
+            client->client_flags.send_nonblock = 1;
 
-    uint8_t tcp_read_loop = 0;
+            break;
 
 
-    if(ethernet->ether_obj == NULL || client == NULL || data_length > UINT16_MAX || data_length > ETHER_MTU_SIZE)
-    {
-        func_retval = NET_TCP_SEND_ERROR;
-    }
-    else if(client->client_flags.connect_established == 0)
-    {
-        func_retval = 0;
-    }
-    else
-    {
-        if(client->client_flags.connect_established == 1)
-        {
-            /* Send PSH ACK packet to the server (SEQ and ACK numbers swapped) */
-            ether_send_tcp_psh_ack(ethernet, client->source_port, client->destination_port,client->acknowledgement_number,
-                                   client->sequence_number, client->server_ip, application_data, data_length);
+        case TCP_NAGLE:
+
+            client->client_flags.nagle = 1;
+
+            break;
+
+
+        case TCP_NODELAY:
+
+            client->client_flags.nagle = 0;
+
+            break;
+
+
+        case TCP_DELAYED_ACK:
+
+            client->client_flags.delayed_ack = 1;
+
+            break;
+
+
+        case TCP_QUICK_ACK:
+
+            client->client_flags.delayed_ack = 0;
+
+            break;
+
+
+        case TCP_CC_NEWRENO:
+
+            func_retval = tcp_set_congestion_control(client, &tcp_cc_newreno);
+
+            break;
+
+
+        case TCP_CC_CUBIC:
+
+            func_retval = tcp_set_congestion_control(client, &tcp_cc_cubic);
+
+            break;
+
+
+        case TCP_PACING:
+
+            /* Rate is set from congestion window and RTT per segment */
+            net_rate_init(&client->pace_rate, 0, TCP_PACE_SEGMENTS * tcp_get_segment_size(client));
+
+            client->client_flags.pacing = 1;
+
+            break;
+
+
+        case TCP_NO_PACING:
+
+            client->client_flags.pacing = 0;
+
+            break;
+
+
+        default:
+
+            func_retval = 0;
+
+            break;
 
-            func_retval = 1;
         }
+    }
 
-        tcp_read_loop = 1;
+    return func_retval;
+}
 
-        do
-        {
-            if(ether_get_data(ethernet, network_data, ETHER_MTU_SIZE))
-            {
 
-                /* handle transport layer protocol type packets */
-                if(get_ether_protocol_type(ethernet) == ETHER_IPV4 && (get_ip_communication_type(ethernet) == 1))
-                {
 
-                    /* Handle TCP packets */
-                    if(get_ip_protocol_type(ethernet) == IP_TCP)
-                    {
+/*****************************************************************
+ * @brief  Function to set TCP congestion control algorithm,
+ *         (TCP_CC_NEWRENO, TCP_CC_CUBIC or user defined)
+ * @param  *client     : Reference to TCP handle
+ * @param  *cc_ops     : Congestion control algorithm operations
+ * @retval int8_t      : Error = 0, Success = 1
+ ****************************************************************/
+int8_t tcp_set_congestion_control(tcp_handle_t *client, const tcp_cc_ops_t *cc_ops)
+{
+    int8_t func_retval = 0;
+
+    if(client == NULL || cc_ops == NULL || cc_ops->init == NULL || cc_ops->ack == NULL || \
+            cc_ops->loss == NULL || cc_ops->timeout == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        client->congestion.ops = cc_ops;
 
-                        /* Read ACK from the TCP server */
-                        ack_type = ether_get_tcp_server_ack(ethernet, &client->sequence_number, &client->acknowledgement_number,
-                                                            client->destination_port, client->source_port, client->server_ip);
+        /* Restart from initial window, (initialized again on connect) */
+        client->congestion.ops->init(&client->congestion, tcp_get_segment_size(client));
 
-                        switch(ack_type)
-                        {
+        func_retval = 1;
+    }
 
-                        case TCP_ACK:
+    return func_retval;
+}
 
-                            tcp_read_loop = 0;
-                            func_retval   = 1;
 
-                            break;
 
+/*****************************************************************
+ * @brief  Function to set TCP send rate limit (token bucket),
+ *         segments over limit are held and sent from timer
+ * @param  *client : Reference to TCP handle
+ * @param  rate    : Send rate (bytes per second), 0 = no limit
+ * @param  burst   : Max burst (bytes)
+ * @retval int8_t  : Error = 0, Success = 1
+ ****************************************************************/
+int8_t tcp_set_rate_limit(tcp_handle_t *client, uint32_t rate, uint32_t burst)
+{
+    int8_t func_retval = 0;
 
-                        case TCP_PSH_ACK:
+    if(client == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        /* One segment must fit in bucket */
+        if(rate && burst < tcp_get_segment_size(client))
+            burst = tcp_get_segment_size(client);
 
-                            /* Read PSH ACK */
-                            tcp_data_length = ether_get_tcp_psh_ack(ethernet, ethernet->net_application_data, APP_BUFF_SIZE);
+        func_retval = net_rate_init(&client->rate_limit, rate, burst);
+    }
 
-                            ethernet->status.net_app_data_rdy = 1;
+    return func_retval;
+}
 
-                            /* Increment the sequence number and pass it as acknowledgment number*/
-                            client->sequence_number += tcp_data_length;
 
-                            /* Send ACK */
-                            ether_send_tcp_ack(ethernet, client->source_port, client->destination_port, client->acknowledgement_number,
-                                               client->sequence_number, client->server_ip, TCP_ACK);
 
-                            tcp_read_loop = 0;
-                            func_retval   = 2;
+/***************************************************************
+ * @brief  Static function for sending TCP data through the send
+ *         buffer, data fragments are gathered into the send
+ *         buffer and sent by tcp_output (TCP checksum summed
+ *         when segment data is copied to network data buffer)
+ * @param  *ethernet       : Reference to the Ethernet Handle
+ * @param  *network_data   : Network data
+ * @param  *client         : Reference to TCP client handle
+ * @param  *fragments      : Application data fragments, in order
+ * @param  fragment_count  : Number of fragments
+ * @param  data_length     : Total data length, (send buffer size max)
+ * @retval int32_t         : Success = 1, server data length,
+ *                                     0 (Connection closed)
+ ***************************************************************/
+static int32_t tcp_send_buffered(ethernet_handle_t *ethernet,
+                                 uint8_t           *network_data,
+                                 tcp_handle_t      *client,
+                                 net_iovec_t       *fragments,
+                                 uint8_t            fragment_count,
+                                 uint32_t           data_length)
+{
+    int32_t func_retval = NET_FUNC_NO_RDWR;
 
-                            ethernet->net_app_data_length = tcp_data_length;
+    tcp_ctl_flags_t ack_type;
 
-                            func_retval = tcp_data_length;
+    uint16_t tcp_data_length = 0;
 
-                            break;
+    uint8_t tcp_read_loop = 0;
 
+    /* Wait for send buffer space */
+    while(client->send_data_length + data_length > TCP_SEND_BUFF_SIZE && client->client_flags.connect_established)
+    {
+        tcp_output(ethernet, client);
 
-                        case TCP_FIN_ACK:
+        tcp_poll(ethernet, network_data, client, NULL, 0, &tcp_data_length);
+    }
 
-                            /* Increment the sequence number and pass it as acknowledgment number*/
-                            client->sequence_number += 1;
+    if(client->client_flags.connect_established == 0)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        /* Gather data in send buffer */
+        client->send_data_length += ether_gather((uint8_t*)client->send_buffer + client->send_data_length, fragments, fragment_count, NULL);
 
-                            /* Send FIN ACK */
-                            ether_send_tcp_ack(ethernet, client->source_port, client->destination_port, client->acknowledgement_number,
-                                               client->sequence_number, client->server_ip, TCP_FIN_ACK);
+        tcp_output(ethernet, client);
 
-                            client->client_flags.server_close = 1;
-                            client->client_flags.connect_established = 0;
+        func_retval   = 1;
+        tcp_read_loop = 1;
+    }
 
-                            func_retval =  0;
+    /* Process received packets, non blocking send stops when no packet is pending */
 
-                            /* Read ACK in next iteration */
+    while(tcp_read_loop)
+    {
+        ack_type = tcp_poll(ethernet, network_data, client, NULL, 0, &tcp_data_length);
 
-                            break;
+        if((ack_type & TCP_FIN) || client->client_flags.connect_aborted)
+        {
+            tcp_read_loop = 0;
+            func_retval   = 0;
+        }
+        else if(client->client_flags.send_nonblock)
+        {
+            if(ack_type == 0)
+                tcp_read_loop = 0;
 
+            /* Send data released by ACK */
 
-                        case TCP_FIN_PSH_ACK:
+            tcp_output(ethernet, client);
+        }
+        else if(tcp_data_length)
+        {
+            /* Server data received with ACK, (held for application read) */
+            tcp_read_loop = 0;
+            func_retval   = tcp_data_length;
+        }
+        else if(client->send_unacked == client->acknowledgement_number && !net_timer_pending(&client->pace_timer))
+        {
+            /* Blocking send, all data acknowledged, (none held by rate limit or pacing) */
+            tcp_read_loop = 0;
+        }
 
-                            /* Increment the sequence number and pass it as acknowledgment number*/
-                            client->sequence_number += 1;
+    }/* while loop */
 
-                            /* not handled correctly*/
-                            ether_send_tcp_ack(ethernet, client->source_port, client->destination_port, client->acknowledgement_number,
-                                               client->sequence_number, client->server_ip, TCP_FIN_ACK);
+    return func_retval;
+}
 
-                            client->client_flags.server_close = 1;
-                            client->client_flags.connect_established = 0;
 
-                            func_retval   =  0;
 
-                            break;
+/***************************************************************
+ * @brief  Function for sending TCP data, data larger than the
+ *         send buffer is split into MSS sized segments.
+ *         In TCP_SEND_NONBLOCK mode small writes are buffered
+ *         and coalesced (Nagle) unless TCP_NODELAY is set
+ * @param  *ethernet         : Reference to the Ethernet Handle
+ * @param  *network_data     : Network data
+ * @param  *client           : Reference to TCP client handle
+ * @param  *application_data : application_data
+ * @param  data_length       : application data length
+ * @retval int8_t            : Error   = -12,
+ *                             Success =  1
+ *                                        0 (Connection closed)
+ ***************************************************************/
+int32_t ether_tcp_send_data(ethernet_handle_t *ethernet,
+                            uint8_t           *network_data,
+                            tcp_handle_t      *client,
+                            char              *application_data,
+                            uint32_t           data_length)
+{
 
+    int32_t func_retval = NET_FUNC_NO_RDWR;
 
-                        default:
+    net_iovec_t fragment;
 
-                            /* NOP */
 
-                            break;
+    if(ethernet->ether_obj == NULL || client == NULL || application_data == NULL)
+    {
+        func_retval = NET_TCP_SEND_ERROR;
+    }
+    else if(client->client_flags.connect_established == 0)
+    {
+        func_retval = 0;
+    }
+    else if(data_length > TCP_SEND_BUFF_SIZE)
+    {
+        /* Large write, send as MSS sized segments */
+        func_retval = ether_tcp_send_segments(ethernet, network_data, client, application_data, data_length);
+    }
+    else
+    {
+        fragment.data   = application_data;
+        fragment.length = data_length;
 
-                        }
+        func_retval = tcp_send_buffered(ethernet, network_data, client, &fragment, 1, data_length);
+    }
 
-                    } /* IP is TCP condition */
+    return func_retval;
+}
 
-                    /* Handle ICMP packets */
-                    else if(get_ip_protocol_type(ethernet) == IP_ICMP)
-                    {
-                        ether_send_icmp_reply(ethernet);
-                    }
 
-                } /* ETHER is IP packet condition */
 
-                /* Handle ARP requests */
-                else if(get_ether_protocol_type(ethernet) == ETHER_ARP)
-                {
-                    ether_handle_arp_resp_req(ethernet);
-                }
+/***************************************************************
+ * @brief  Function for sending TCP data gathered from data
+ *         fragments, (protocol headers and payload kept in
+ *         separate buffers), fragments are gathered in the
+ *         send buffer and sent as one write, total larger than
+ *         send buffer (TCP_SEND_BUFF_SIZE) is rejected, (large
+ *         writes use ether_tcp_send_data)
+ * @param  *ethernet       : Reference to the Ethernet Handle
+ * @param  *network_data   : Network data
+ * @param  *client         : Reference to TCP client handle
+ * @param  *fragments      : Application data fragments, in order
+ * @param  fragment_count  : Number of fragments
+ * @retval int32_t         : Error   = -12, (also total too large)
+ *                           Success =  1
+ *                                      0 (Connection closed)
+ ***************************************************************/
+int32_t ether_tcp_send_datav(ethernet_handle_t *ethernet,
+                             uint8_t           *network_data,
+                             tcp_handle_t      *client,
+                             net_iovec_t       *fragments,
+                             uint8_t            fragment_count)
+{
+    int32_t func_retval = NET_FUNC_NO_RDWR;
 
-            }
+    uint32_t data_length = 0;
 
-        }while(tcp_read_loop);/* while loop */
+    data_length = ether_iovec_length(fragments, fragment_count);
 
+    /* Gathered write must fit send buffer, (no segment per fragment) */
+    if(ethernet->ether_obj == NULL || client == NULL || fragments == NULL || data_length == 0 || data_length > TCP_SEND_BUFF_SIZE)
+    {
+        func_retval = NET_TCP_SEND_ERROR;
+    }
+    else if(client->client_flags.connect_established == 0)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        func_retval = tcp_send_buffered(ethernet, network_data, client, fragments, fragment_count, data_length);
     }
 
     return func_retval;
@@ -1224,6 +3808,7 @@ int32_t ether_tcp_send_data(ethernet_handle_t *ethernet,
 
 
 
+
 /************************************************************************
  * @brief  Function for reading TCP data
  * @param  *ethernet         : Reference to the Ethernet Handle
@@ -1275,6 +3860,10 @@ int32_t ether_tcp_read_data(ethernet_handle_t *ethernet,
             /* Clear associated flags */
             ethernet->status.net_app_data_rdy = 0;
 
+            /* Window update, (receiver SWS avoidance, RFC 1122 4.2.3.3) */
+            if(APP_BUFF_SIZE - client->recv_window >= APP_BUFF_SIZE / 2)
+                ether_send_tcp_ack(ethernet, client, TCP_ACK);
+
             func_retval = tcp_data_length;
 
         }
@@ -1292,17 +3881,26 @@ int32_t ether_tcp_read_data(ethernet_handle_t *ethernet,
 
 
 /***************************************************************
- * @brief  Function for close socket
+ * @brief  Function for close socket, buffered data is sent
+ *         and acknowledged before FIN, connection is
+ *         aborted (RST) if data or FIN is not acknowledged
+ *         after max retransmissions, non blocking client
+ *         (TCP_READ_NONBLOCK) reads once and is called again
+ *         until FIN is acknowledged or connect_aborted is set
  * @param  *ethernet         : Reference to the Ethernet Handle
  * @param  *network_data     : Network data
  * @param  *client           : Reference to TCP handle
- * @retval uint16_t          : Error = 0, Success = 1;
+ * @retval uint16_t          : Error = 0 (aborted), Success = 1,
+ *                             0 = close pending (non blocking)
  ***************************************************************/
 uint8_t ether_tcp_close(ethernet_handle_t *ethernet, uint8_t *network_data, tcp_handle_t *client)
 {
 
     uint8_t func_retval   = 0;
     uint8_t tcp_read_loop = 0;
+
+    uint16_t tcp_data_length = 0;
+
     tcp_ctl_flags_t ack_type;
 
 
@@ -1310,63 +3908,82 @@ uint8_t ether_tcp_close(ethernet_handle_t *ethernet, uint8_t *network_data, tcp_
     {
         func_retval = 0;
     }
+    else if(client->client_flags.server_close == 1)
+    {
+        /* Closed by server, server FIN already acknowledged */
+        func_retval = 1;
+    }
     else
     {
         tcp_read_loop = 1;
 
-        while(tcp_read_loop)
+        /* Send buffered data before FIN */
+        if(client->client_flags.connect_established == 1)
         {
-
-            if(ether_get_data(ethernet, network_data, ETHER_MTU_SIZE) && \
-                    get_ether_protocol_type(ethernet) == ETHER_IPV4 && (get_ip_communication_type(ethernet) == 1))
+            if(client->client_flags.client_blocking)
             {
-                /* Read ACK from the TCP server */
-                ack_type = ether_get_tcp_server_ack(ethernet, &client->sequence_number, &client->acknowledgement_number,
-                                                    client->destination_port, client->source_port, client->server_ip);
-
-                if(ack_type == TCP_FIN_ACK)
-                {
-
-                    /* Increment the sequence number and pass it as acknowledgment number*/
-                    client->sequence_number += 1;
-
-                    ether_send_tcp_ack(ethernet, client->source_port, client->destination_port, client->acknowledgement_number,
-                                       client->sequence_number, client->server_ip, TCP_ACK);
-
+                tcp_flush(ethernet, network_data, client);
+            }
+            else if(client->send_unacked != client->send_data_seq + client->send_data_length)
+            {
+                tcp_output(ethernet, client);
 
-                    client->client_flags.server_close        = 1;
-                    client->client_flags.connect_established = 0;
+                tcp_poll(ethernet, network_data, client, NULL, 0, &tcp_data_length);
 
+                /* FIN is sent once buffered data is acknowledged */
+                if(client->send_unacked != client->send_data_seq + client->send_data_length)
                     tcp_read_loop = 0;
-                    func_retval   = 1;
+            }
+        }
 
-                    memset(client, 0, sizeof(tcp_handle_t));
-                }
-                else if(ack_type == TCP_ACK)
-                {
-                    if(client->client_flags.connect_established == 0)
-                    {
-                        tcp_read_loop = 0;
-                        func_retval   = 1;
-                    }
+        while(tcp_read_loop)
+        {
+            /* Server FIN is acknowledged by tcp_poll */
+            ack_type = tcp_poll(ethernet, network_data, client, NULL, 0, &tcp_data_length);
 
-                }
+            if(client->client_flags.connect_aborted)
+            {
+                /* Server not responding, FIN not acknowledged */
+                tcp_read_loop = 0;
+                func_retval   = 0;
+            }
+            else if(ack_type & TCP_FIN)
+            {
+                tcp_read_loop = 0;
+                func_retval   = 1;
+
+                tcp_stop_timers(client);
 
+                memset(client, 0, sizeof(tcp_handle_t));
+            }
+            else if((ack_type & TCP_ACK) && client->client_flags.client_close == 1 && \
+                    client->send_unacked == client->acknowledgement_number)
+            {
+                /* Client FIN acknowledged */
+                tcp_read_loop = 0;
+                func_retval   = 1;
             }
 
             /* Send FIN ACK and Read server FIN ACK in next iteration */
             if(client->client_flags.connect_established == 1)
             {
-                /* Send PSH ACK packet to the server (SEQ and ACK numbers swapped) */
-                ether_send_tcp_ack(ethernet, client->source_port, client->destination_port, client->acknowledgement_number,
-                                   client->sequence_number, client->server_ip, TCP_FIN_ACK);
+                /* Send FIN ACK packet to the server */
+                ether_send_tcp_ack(ethernet, client, TCP_FIN_ACK);
+
+                /* FIN takes one sequence number */
+                client->acknowledgement_number += 1;
+                client->send_max                = client->acknowledgement_number;
+
+                if(!net_timer_pending(&client->retransmit_timer))
+                    tcp_start_timer(ethernet, &client->retransmit_timer, client->retransmit_timeout);
 
                 client->client_flags.client_close        = 1;
                 client->client_flags.connect_established = 0;
-
-                func_retval = 1;
             }
 
+            /* Non blocking client, FIN ACK is read in next call */
+            if(client->client_flags.client_blocking == 0)
+                tcp_read_loop = 0;
         }
     }
 
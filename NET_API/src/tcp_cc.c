@@ -0,0 +1,525 @@
+/**
+ ******************************************************************************
+ * @file    tcp_cc.c
+ * @author  Aditya Mall,
+ * @brief   TCP congestion control (NewReno, CUBIC) source file
+ *
+ *  Info
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * <h2><center>&copy; COPYRIGHT(c) 2019 Aditya Mall, MIT License </center></h2>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Aditya Mall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************
+ */
+
+
+
+
+/*
+ * Standard header and api header files
+ */
+#include <stdlib.h>
+
+#include "tcp_cc.h"
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                      Data Structures and Defines                           */
+/*                                                                            */
+/******************************************************************************/
+
+
+#define TCP_CC_INFINITE_SSTHRESH  0xFFFFFFFF  /*!< Initial slow start threshold              */
+#define TCP_CC_INITIAL_WINDOW     4380        /*!< Initial window upper bound (RFC 3390)      */
+
+/* CUBIC constants, C = 0.4, beta = 0.7 (RFC 9438) */
+#define CUBIC_C_SCALED            4           /*!< C scaled by 10                             */
+#define CUBIC_BETA_SCALED         7           /*!< Multiplicative decrease factor scaled by 10 */
+#define CUBIC_ALPHA_SCALED        529         /*!< Reno friendly increase 3(1-beta)/(1+beta), scaled by 1000 */
+#define CUBIC_MAX_TIME_OFFSET     100000      /*!< Limit of |t - K| (ms), keeps cube in 64 bits */
+
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                              Private Functions                             */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+
+/*****************************************************************
+ * @brief  Static function to get initial congestion window
+ *         min(4 * MSS, max(2 * MSS, 4380)) (RFC 3390)
+ * @param  mss      : Sender maximum segment size
+ * @retval uint32_t : Initial window (bytes)
+ *****************************************************************/
+static uint32_t tcp_cc_initial_window(uint16_t mss)
+{
+    uint32_t func_retval = TCP_CC_INITIAL_WINDOW;
+
+    if(func_retval < 2 * (uint32_t)mss)
+        func_retval = 2 * (uint32_t)mss;
+
+    if(func_retval > 4 * (uint32_t)mss)
+        func_retval = 4 * (uint32_t)mss;
+
+    return func_retval;
+}
+
+
+
+/*****************************************************************
+ * @brief  Static function to get slow start threshold after
+ *         loss, max(window * factor, 2 * MSS)
+ * @param  *cc      : Reference to congestion control state
+ * @param  window   : Flight size or congestion window (bytes)
+ * @param  factor   : Decrease factor scaled by 10
+ * @retval uint32_t : Slow start threshold (bytes)
+ *****************************************************************/
+static uint32_t tcp_cc_reduce(tcp_cc_t *cc, uint32_t window, uint8_t factor)
+{
+    uint32_t func_retval = 0;
+
+    func_retval = (uint32_t)(((uint64_t)window * factor) / 10);
+
+    if(func_retval < 2 * (uint32_t)cc->mss)
+        func_retval = 2 * (uint32_t)cc->mss;
+
+    return func_retval;
+}
+
+
+
+/*****************************************************************
+ * @brief  Static function for slow start, increases window by
+ *         acknowledged bytes, limited to one MSS per ACK (RFC 3465)
+ * @param  *cc         : Reference to congestion control state
+ * @param  bytes_acked : Bytes acknowledged
+ * @retval uint8_t     : Error = 0, Success = 1
+ *****************************************************************/
+static uint8_t tcp_cc_slow_start(tcp_cc_t *cc, uint32_t bytes_acked)
+{
+    if(bytes_acked > cc->mss)
+        bytes_acked = cc->mss;
+
+    cc->cwnd += bytes_acked;
+
+    return 1;
+}
+
+
+
+/*****************************************************************
+ * @brief  Static function to get integer cube root
+ * @param  value    : Input value
+ * @retval uint32_t : Cube root (rounded down)
+ *****************************************************************/
+static uint32_t tcp_cc_cube_root(uint64_t value)
+{
+    uint64_t root  = 0;
+    uint64_t term  = 0;
+    int8_t   shift = 0;
+
+    for(shift = 63; shift >= 0; shift -= 3)
+    {
+        root <<= 1;
+
+        term = 3 * root * (root + 1) + 1;
+
+        if((value >> shift) >= term)
+        {
+            value -= term << shift;
+            root++;
+        }
+    }
+
+    return (uint32_t)root;
+}
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                              NewReno Functions                             */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+
+/*****************************************************************
+ * @brief  NewReno function to initialize congestion state
+ * @param  *cc     : Reference to congestion control state
+ * @param  mss     : Sender maximum segment size
+ * @retval uint8_t : Error = 0, Success = 1
+ *****************************************************************/
+static uint8_t tcp_newreno_init(tcp_cc_t *cc, uint16_t mss)
+{
+    uint8_t func_retval = 0;
+
+    if(cc == NULL || mss == 0)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        cc->mss         = mss;
+        cc->cwnd        = tcp_cc_initial_window(mss);
+        cc->ssthresh    = TCP_CC_INFINITE_SSTHRESH;
+        cc->bytes_acked = 0;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/*****************************************************************
+ * @brief  NewReno function for new data acknowledged, slow start
+ *         below ssthresh, else one MSS per window of ACKed data
+ * @param  *cc         : Reference to congestion control state
+ * @param  bytes_acked : Bytes acknowledged
+ * @param  time_ms     : Current time (ms), unused
+ * @retval uint8_t     : Error = 0, Success = 1
+ *****************************************************************/
+static uint8_t tcp_newreno_ack(tcp_cc_t *cc, uint32_t bytes_acked, uint32_t time_ms)
+{
+    uint8_t func_retval = 0;
+
+    (void)time_ms;
+
+    if(cc == NULL)
+    {
+        func_retval = 0;
+    }
+    else if(cc->cwnd < cc->ssthresh)
+    {
+        func_retval = tcp_cc_slow_start(cc, bytes_acked);
+    }
+    else
+    {
+        /* Congestion avoidance, appropriate byte counting */
+        cc->bytes_acked += bytes_acked;
+
+        if(cc->bytes_acked >= cc->cwnd)
+        {
+            cc->bytes_acked -= cc->cwnd;
+
+            cc->cwnd += cc->mss;
+        }
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/*****************************************************************
+ * @brief  NewReno function for loss detected by duplicate ACKs,
+ *         halves the window
+ * @param  *cc         : Reference to congestion control state
+ * @param  flight_size : Data in flight (bytes)
+ * @param  time_ms     : Current time (ms), unused
+ * @retval uint8_t     : Error = 0, Success = 1
+ *****************************************************************/
+static uint8_t tcp_newreno_loss(tcp_cc_t *cc, uint32_t flight_size, uint32_t time_ms)
+{
+    uint8_t func_retval = 0;
+
+    (void)time_ms;
+
+    if(cc == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        cc->ssthresh    = tcp_cc_reduce(cc, flight_size, 5);
+        cc->cwnd        = cc->ssthresh;
+        cc->bytes_acked = 0;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/*****************************************************************
+ * @brief  NewReno function for retransmission timeout, window is
+ *         reduced to one segment (loss window)
+ * @param  *cc         : Reference to congestion control state
+ * @param  flight_size : Data in flight (bytes)
+ * @param  time_ms     : Current time (ms), unused
+ * @retval uint8_t     : Error = 0, Success = 1
+ *****************************************************************/
+static uint8_t tcp_newreno_timeout(tcp_cc_t *cc, uint32_t flight_size, uint32_t time_ms)
+{
+    uint8_t func_retval = 0;
+
+    (void)time_ms;
+
+    if(cc == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        cc->ssthresh    = tcp_cc_reduce(cc, flight_size, 5);
+        cc->cwnd        = cc->mss;
+        cc->bytes_acked = 0;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                               CUBIC Functions                              */
+/*                                                                            */
+/******************************************************************************/
+
+
+
+
+/*****************************************************************
+ * @brief  CUBIC function to initialize congestion state
+ * @param  *cc     : Reference to congestion control state
+ * @param  mss     : Sender maximum segment size
+ * @retval uint8_t : Error = 0, Success = 1
+ *****************************************************************/
+static uint8_t tcp_cubic_init(tcp_cc_t *cc, uint16_t mss)
+{
+    uint8_t func_retval = 0;
+
+    func_retval = tcp_newreno_init(cc, mss);
+
+    if(func_retval)
+    {
+        cc->epoch_started = 0;
+        cc->epoch_start   = 0;
+        cc->w_max         = 0;
+        cc->w_est         = 0;
+        cc->k             = 0;
+    }
+
+    return func_retval;
+}
+
+
+
+/*****************************************************************
+ * @brief  CUBIC function for new data acknowledged, window
+ *         follows W(t) = C(t - K)^3 + W_max, or the Reno friendly
+ *         estimate when it is larger
+ * @param  *cc         : Reference to congestion control state
+ * @param  bytes_acked : Bytes acknowledged
+ * @param  time_ms     : Current time (ms)
+ * @retval uint8_t     : Error = 0, Success = 1
+ *****************************************************************/
+static uint8_t tcp_cubic_ack(tcp_cc_t *cc, uint32_t bytes_acked, uint32_t time_ms)
+{
+    uint8_t func_retval = 0;
+
+    int64_t  time_offset = 0;
+    int64_t  target      = 0;
+    uint64_t increase    = 0;
+
+    if(cc == NULL)
+    {
+        func_retval = 0;
+    }
+    else if(cc->cwnd < cc->ssthresh)
+    {
+        func_retval = tcp_cc_slow_start(cc, bytes_acked);
+    }
+    else
+    {
+        /* Start of congestion avoidance epoch */
+        if(cc->epoch_started == 0)
+        {
+            cc->epoch_started = 1;
+            cc->epoch_start   = time_ms;
+            cc->w_est         = cc->cwnd;
+            cc->bytes_acked   = 0;
+
+            if(cc->w_max > cc->cwnd)
+            {
+                /* K = cbrt((W_max - cwnd) / C), in ms */
+                cc->k = tcp_cc_cube_root( ((uint64_t)(cc->w_max - cc->cwnd) * 10000000000ULL) / ((uint64_t)CUBIC_C_SCALED * cc->mss) );
+            }
+            else
+            {
+                cc->k     = 0;
+                cc->w_max = cc->cwnd;
+            }
+        }
+
+        time_offset = (int64_t)(time_ms - cc->epoch_start) - cc->k;
+
+        if(time_offset > CUBIC_MAX_TIME_OFFSET)
+            time_offset = CUBIC_MAX_TIME_OFFSET;
+
+        if(time_offset < -CUBIC_MAX_TIME_OFFSET)
+            time_offset = -CUBIC_MAX_TIME_OFFSET;
+
+        /* W_cubic(t) in bytes, t in ms */
+        target = (int64_t)cc->w_max + (CUBIC_C_SCALED * time_offset * time_offset * time_offset * cc->mss) / 10000000000LL;
+
+        /* Limit growth to 1.5 cwnd per RTT */
+        if(target > (int64_t)cc->cwnd + (cc->cwnd >> 1))
+            target = (int64_t)cc->cwnd + (cc->cwnd >> 1);
+
+        if(target > (int64_t)cc->cwnd)
+        {
+            /* cwnd += (target - cwnd) / cwnd per acknowledged byte */
+            increase = (uint64_t)(target - cc->cwnd) * bytes_acked + cc->bytes_acked;
+
+            cc->cwnd       += (uint32_t)(increase / cc->cwnd);
+            cc->bytes_acked = (uint32_t)(increase % cc->cwnd);
+        }
+
+        /* Reno friendly region */
+        cc->w_est += (uint32_t)( ((uint64_t)bytes_acked * cc->mss * CUBIC_ALPHA_SCALED) / ((uint64_t)cc->cwnd * 1000) );
+
+        if(cc->w_est > cc->cwnd)
+            cc->cwnd = cc->w_est;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/*****************************************************************
+ * @brief  CUBIC function for loss detected by duplicate ACKs,
+ *         window is reduced by beta, W_max with fast convergence
+ * @param  *cc         : Reference to congestion control state
+ * @param  flight_size : Data in flight (bytes), unused
+ * @param  time_ms     : Current time (ms), unused
+ * @retval uint8_t     : Error = 0, Success = 1
+ *****************************************************************/
+static uint8_t tcp_cubic_loss(tcp_cc_t *cc, uint32_t flight_size, uint32_t time_ms)
+{
+    uint8_t func_retval = 0;
+
+    (void)flight_size;
+    (void)time_ms;
+
+    if(cc == NULL)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        /* Fast convergence, release bandwidth when window is shrinking */
+        if(cc->cwnd < cc->w_max)
+            cc->w_max = (uint32_t)(((uint64_t)cc->cwnd * (10 + CUBIC_BETA_SCALED)) / 20);
+        else
+            cc->w_max = cc->cwnd;
+
+        cc->ssthresh      = tcp_cc_reduce(cc, cc->cwnd, CUBIC_BETA_SCALED);
+        cc->cwnd          = cc->ssthresh;
+        cc->epoch_started = 0;
+        cc->bytes_acked   = 0;
+
+        func_retval = 1;
+    }
+
+    return func_retval;
+}
+
+
+
+/*****************************************************************
+ * @brief  CUBIC function for retransmission timeout, window is
+ *         reduced to one segment (loss window)
+ * @param  *cc         : Reference to congestion control state
+ * @param  flight_size : Data in flight (bytes)
+ * @param  time_ms     : Current time (ms)
+ * @retval uint8_t     : Error = 0, Success = 1
+ *****************************************************************/
+static uint8_t tcp_cubic_timeout(tcp_cc_t *cc, uint32_t flight_size, uint32_t time_ms)
+{
+    uint8_t func_retval = 0;
+
+    func_retval = tcp_cubic_loss(cc, flight_size, time_ms);
+
+    if(func_retval)
+        cc->cwnd = cc->mss;
+
+    return func_retval;
+}
+
+
+
+/******************************************************************************/
+/*                                                                            */
+/*                      Congestion Control Algorithms                         */
+/*                                                                            */
+/******************************************************************************/
+
+
+/* NewReno (default) */
+const tcp_cc_ops_t tcp_cc_newreno =
+{
+ .init    = tcp_newreno_init,
+ .ack     = tcp_newreno_ack,
+ .loss    = tcp_newreno_loss,
+ .timeout = tcp_newreno_timeout,
+};
+
+
+/* CUBIC */
+const tcp_cc_ops_t tcp_cc_cubic =
+{
+ .init    = tcp_cubic_init,
+ .ack     = tcp_cubic_ack,
+ .loss    = tcp_cubic_loss,
+ .timeout = tcp_cubic_timeout,
+};
+
+
@@ -51,6 +51,7 @@
 #include "arp.h"
 
 #include "network_utilities.h"
+#include "net_rate.h"
 
 
 
@@ -62,7 +63,11 @@
 /******************************************************************************/
 
 
-#define UDP_FRAME_SIZE 8
+#define UDP_FRAME_SIZE  8
+#define UDP_RATE_LIMITS 4   /*!< Destination ports with send rate limit */
+
+/* Max UDP data that fits in network data buffer along with PHY, Ethernet, IP and UDP headers */
+#define UDP_MAX_DATA (ETHER_MTU_SIZE - ETHER_PHY_DATA_OFFSET - ETHER_FRAME_SIZE - IP_HEADER_SIZE - UDP_FRAME_SIZE)
 
 #pragma pack(1)
 
@@ -77,6 +82,21 @@ typedef struct _net_udp
 
 }net_udp_t;
 
+#pragma pack()
+
+
+/* UDP send rate limit, per destination port */
+typedef struct _udp_rate_limit
+{
+    uint16_t   destination_port;  /*!< UDP destination port, 0 = unused     */
+    net_rate_t bucket;            /*!< Token bucket for port                */
+
+}udp_rate_limit_t;
+
+
+/* Rate limits shared by all interfaces */
+static udp_rate_limit_t udp_rate_limits[UDP_RATE_LIMITS];
+
 
 
 /******************************************************************************/
@@ -87,40 +107,35 @@ typedef struct _net_udp
 
 
 
-/*******************************************************
- * @brief  Static function to validate UDP checksum
- * @param  *ip     : Reference to IP frame structure
- * @param  *udp    : Reference to UDP frame structure
- * @retval uint8_t : Error = 0, Success = 1
- ******************************************************/
-static uint8_t validate_udp_checksum(net_ip_t *ip, net_udp_t *udp)
+/**************************************************************
+ * @brief  Static function to check send rate limit of
+ *         destination port, tokens are taken once datagram
+ *         is sent (consume = 1)
+ * @param  *ethernet        : Reference to the Ethernet handle
+ * @param  destination_port : UDP destination port
+ * @param  data_length      : Length of UDP data
+ * @param  consume          : 0 = check only, 1 = take tokens
+ * @retval uint8_t          : Over limit = 0, Send = 1
+ **************************************************************/
+static uint8_t udp_rate_check(ethernet_handle_t *ethernet, uint16_t destination_port, uint16_t data_length, uint8_t consume)
 {
-    uint8_t func_retval = 0;
+    uint8_t func_retval = 1;
 
-    uint32_t sum = 0;
-    uint16_t pseudo_protocol = 0;
+    uint8_t index = 0;
 
-    if(ip == NULL || udp == NULL)
+    for(index = 0; index < UDP_RATE_LIMITS; index++)
     {
-        func_retval = 0;
-    }
-    else
-    {
-
-        /* validate UDP checksum */
-        sum = 0;
-
-        ether_sum_words(&sum, &ip->source_ip, 8);
-
-        pseudo_protocol = ip->protocol;
-
-        sum += ( (pseudo_protocol & 0xFF) << 8 );
-
-        ether_sum_words(&sum, &udp->length, 2);
-
-        ether_sum_words(&sum, udp, ntohs(udp->length));
-
-        func_retval = (ether_get_checksum(sum) == 0);
+        if(udp_rate_limits[index].destination_port == destination_port)
+        {
+            if(consume)
+                func_retval = net_rate_consume(&udp_rate_limits[index].bucket, data_length,
+                                               ethernet->ether_commands->get_time_ms());
+            else
+                func_retval = net_rate_delay(&udp_rate_limits[index].bucket, data_length,
+                                             ethernet->ether_commands->get_time_ms()) == 0;
+
+            break;
+        }
     }
 
     return func_retval;
@@ -128,16 +143,15 @@ static uint8_t validate_udp_checksum(net_ip_t *ip, net_udp_t *udp)
 
 
 
-
 /**************************************************************
  * @brief  Function get calculate UDP checksum
  *         (UDP Headers + UDP data)
  * @param  *ip         : Reference to IP frame structure
  * @param  *udp        : Reference to UDP frame structure
- * @param  data_length : Length of UDP data
+ * @param  data_sum    : Sum of UDP data (ether_copy_sum)
  * @retval uint8_t     : Error = 0, Success = checksum value
  **************************************************************/
-static uint16_t get_udp_checksum(net_ip_t *ip, net_udp_t *udp, uint16_t data_length)
+static uint16_t get_udp_checksum(net_ip_t *ip, net_udp_t *udp, uint32_t data_sum)
 {
 
     uint16_t func_retval     = 0;
@@ -166,8 +180,8 @@ static uint16_t get_udp_checksum(net_ip_t *ip, net_udp_t *udp, uint16_t data_len
         /* UDP Fixed header checksum calculation, excluding checksum field */
         ether_sum_words(&sum, udp, UDP_FRAME_SIZE - 2);
 
-        /* Add UPD data sum */
-        ether_sum_words(&sum, &udp->data, data_length);
+        /* Add UPD data sum, (summed while data was copied) */
+        sum += data_sum;
 
         func_retval = ether_get_checksum(sum);
     }
@@ -199,18 +213,10 @@ uint8_t ether_get_udp_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t
 {
     uint8_t func_retval = 0;
 
-    net_ip_t  *ip;
-    net_udp_t *udp;
+    net_packet_t *packet;
 
     uint8_t validate  = 0;
 
-    uint16_t  udp_packet_length = 0;
-    uint16_t  udp_data_length   = 0;
-
-    ip  = (void*)&ethernet->ether_obj->data;
-
-    udp = (void*)( (uint8_t*)ip + IP_HEADER_SIZE );
-
 
     if(ethernet->ether_obj == NULL || data == NULL)
     {
@@ -218,21 +224,14 @@ uint8_t ether_get_udp_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t
     }
     else
     {
-        udp_packet_length = ntohs(udp->length);
-        udp_data_length   = udp_packet_length - UDP_FRAME_SIZE;
+        packet = ether_get_packet(ethernet);
 
-        /* Check and Truncate UDP data length */
-        if(data_length > udp_data_length)
-            data_length = udp_data_length;
+        /* Check and Truncate UDP data length, (validated by packet parser) */
+        if(data_length > packet->data_length)
+            data_length = packet->data_length;
 
-        /* validate UDP checksum */
-        validate = validate_udp_checksum(ip, udp);
-
-        /* Get UDP data */
-        if(validate)
-        {
-            memcpy((char*)data, (char*)&udp->data, data_length);
-        }
+        /* Get UDP data, UDP checksum validated in the same pass */
+        validate = ip_transport_copy_data(ethernet, data, data_length);
 
         func_retval = validate;
     }
@@ -248,7 +247,8 @@ uint8_t ether_get_udp_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t
 /*******************************************************************
  * @brief  Raw Function to send UPD packets
  *         UDP data dependent upon total data allocated to
- *         ethernet object
+ *         ethernet object, send to host fails while looped
+ *         back frame is unread
  * @param  *ethernet        : Reference to the Ethernet handle
  * @param  *source_addr     : Reference to source address structure
  * @param  *destination_ip  : Destination IP address
@@ -256,7 +256,7 @@ uint8_t ether_get_udp_data(ethernet_handle_t *ethernet, uint8_t *data, uint16_t
  * @param  destination_port : UDP destination port
  * @param  *data            : UDP data
  * @param  data_length      : Length of UDP data
- * @retval int8_t           : Error = -9, Success = 0
+ * @retval int8_t           : Error = -9, -15 (over rate limit), Success = 0
  *******************************************************************/
 int8_t ether_send_udp_raw(ethernet_handle_t *ethernet, ether_source_t *source_addr, uint8_t *destination_ip,
                           uint8_t *destination_mac, uint16_t destination_port, uint8_t *data, uint16_t data_length)
@@ -267,9 +267,7 @@ int8_t ether_send_udp_raw(ethernet_handle_t *ethernet, ether_source_t *source_ad
     net_ip_t  *ip;
     net_udp_t *udp;
 
-    uint16_t  index = 0;
-
-    uint8_t  *data_copy;
+    uint32_t data_sum        = 0;
     uint16_t udp_packet_size = 0;
 
 
@@ -278,6 +276,10 @@ int8_t ether_send_udp_raw(ethernet_handle_t *ethernet, ether_source_t *source_ad
     {
         func_retval = NET_UDP_RAW_SEND_ERROR;
     }
+    else if(udp_rate_check(ethernet, destination_port, data_length, 0) == 0)
+    {
+        func_retval = NET_UDP_RATE_LIMIT;
+    }
     else
     {
 
@@ -293,13 +295,8 @@ int8_t ether_send_udp_raw(ethernet_handle_t *ethernet, ether_source_t *source_ad
         udp->length = htons(UDP_FRAME_SIZE + data_length);
 
 
-        /* Add UDP data */
-        data_copy = &udp->data;
-
-        for(index = 0; index < data_length; index++)
-        {
-            data_copy[index] = data[index];
-        }
+        /* Add UDP data, summed in the same pass for UDP checksum */
+        ether_copy_sum(&data_sum, &udp->data, data, data_length);
 
 
         /* Fill IP frame before UDP checksum calculation */
@@ -309,15 +306,18 @@ int8_t ether_send_udp_raw(ethernet_handle_t *ethernet, ether_source_t *source_ad
 
 
         /* get UDP checksum */
-        udp->checksum = get_udp_checksum(ip, udp, data_length);
+        udp->checksum = get_udp_checksum(ip, udp, data_sum);
 
 
         /* Fill Ethernet frame */
         fill_ether_frame(ethernet, destination_mac, source_addr->source_mac, ETHER_IPV4);
 
 
-        /* Send UPD data */
-        ether_send_data(ethernet,(uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + htons(ip->total_length));
+        /* Send UPD data, (loopback send fails while looped back frame is held) */
+        if(ether_send_data(ethernet,(uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + htons(ip->total_length)))
+            udp_rate_check(ethernet, destination_port, data_length, 1);
+        else
+            func_retval = NET_UDP_RAW_SEND_ERROR;
     }
 
     return func_retval;
@@ -448,9 +448,48 @@ uint8_t ether_read_udp(ethernet_handle_t *ethernet, uint8_t *network_data, char
  * @param  destination_port  : UDP destination port
  * @param  *application_data : UDP data
  * @param  data_length       : Length of UDP data
- * @retval int8_t            : Error = -10, Success = 0
+ * @retval int8_t            : Error = -10, -15 (over rate limit), Success = 0
  **************************************************************/
 int8_t ether_send_udp(ethernet_handle_t *ethernet, uint8_t *destination_ip, uint16_t destination_port, char *application_data, uint16_t data_length)
+{
+    int8_t func_retval = 0;
+
+    net_iovec_t fragment;
+
+    if(application_data == NULL)
+    {
+        func_retval = NET_UDP_SEND_ERROR;
+    }
+    else
+    {
+        fragment.data   = application_data;
+        fragment.length = data_length;
+
+        func_retval = ether_send_udpv(ethernet, destination_ip, destination_port, &fragment, 1);
+    }
+
+    return func_retval;
+}
+
+
+
+
+/**************************************************************
+ * @brief  Function to send UPD packet gathered from data
+ *         fragments, fragments are copied to network data
+ *         buffer with UDP checksum summed in the same pass,
+ *         total larger than one frame (interface MTU or
+ *         network data buffer) is rejected, send to host
+ *         fails while looped back frame is unread
+ * @param  *ethernet        : Reference to the Ethernet handle
+ * @param  *destination_ip  : Destination IP address
+ * @param  destination_port : UDP destination port
+ * @param  *fragments       : UDP data fragments, in order
+ * @param  fragment_count   : Number of fragments
+ * @retval int8_t           : Error = -10, -15 (over rate limit), Success = 0
+ **************************************************************/
+int8_t ether_send_udpv(ethernet_handle_t *ethernet, uint8_t *destination_ip, uint16_t destination_port,
+                       net_iovec_t *fragments, uint8_t fragment_count)
 {
 
     int8_t func_retval = 0;
@@ -459,8 +498,8 @@ int8_t ether_send_udp(ethernet_handle_t *ethernet, uint8_t *destination_ip, uint
     net_udp_t *udp;
 
     /* UDP related variables */
-    uint16_t index = 0;
-    uint8_t  *data_copy;
+    uint32_t data_sum        = 0;
+    uint32_t data_length     = 0;
     uint16_t udp_packet_size = 0;
 
     /*IP related variables */
@@ -470,11 +509,18 @@ int8_t ether_send_udp(ethernet_handle_t *ethernet, uint8_t *destination_ip, uint
     uint8_t  destination_mac[ETHER_MAC_SIZE] = {0};
 
 
-    if(ethernet->ether_obj == NULL || destination_ip == NULL || destination_port == 0 \
-            || application_data == NULL || data_length == 0 || data_length > UINT16_MAX)
+    data_length = ether_iovec_length(fragments, fragment_count);
+
+    /* One datagram in one frame, (no IP fragmentation) */
+    if(ethernet->ether_obj == NULL || destination_ip == NULL || destination_port == 0 || data_length == 0 \
+            || data_length > (uint32_t)(ethernet->mtu - IP_HEADER_SIZE - UDP_FRAME_SIZE) || data_length > UDP_MAX_DATA)
     {
         func_retval = NET_UDP_SEND_ERROR;
     }
+    else if(udp_rate_check(ethernet, destination_port, data_length, 0) == 0)
+    {
+        func_retval = NET_UDP_RATE_LIMIT;
+    }
     else
     {
 
@@ -490,13 +536,8 @@ int8_t ether_send_udp(ethernet_handle_t *ethernet, uint8_t *destination_ip, uint
         udp->length = htons(UDP_FRAME_SIZE + data_length);
 
 
-        /* Add UDP data */
-        data_copy = &udp->data;
-
-        for(index = 0; index < data_length; index++)
-        {
-            data_copy[index] = application_data[index];
-        }
+        /* Gather UDP data, summed in the same pass for UDP checksum */
+        ether_gather(&udp->data, fragments, fragment_count, &data_sum);
 
 
         /* Fill IP frame */
@@ -508,18 +549,21 @@ int8_t ether_send_udp(ethernet_handle_t *ethernet, uint8_t *destination_ip, uint
 
 
         /* get UDP checksum */
-        udp->checksum = get_udp_checksum(ip, udp, data_length);
+        udp->checksum = get_udp_checksum(ip, udp, data_sum);
 
 
         /* Get MAC address from ARP table */
-        ether_arp_resolve_address(ethernet, destination_mac, destination_ip);
+        ether_arp_resolve_next_hop(ethernet, destination_mac, destination_ip);
 
         /* Fill Ethernet frame */
         fill_ether_frame(ethernet, destination_mac, ethernet->host_mac, ETHER_IPV4);
 
 
-        /* Send UPD data */
-        ether_send_data(ethernet,(uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + htons(ip->total_length));
+        /* Send UPD data, (loopback send fails while looped back frame is held) */
+        if(ether_send_data(ethernet,(uint8_t*)ethernet->ether_obj, ETHER_FRAME_SIZE + htons(ip->total_length)))
+            udp_rate_check(ethernet, destination_port, data_length, 1);
+        else
+            func_retval = NET_UDP_SEND_ERROR;
 
     }
 
@@ -548,15 +592,11 @@ uint16_t ether_read_udp_raw(ethernet_handle_t *ethernet, uint8_t *network_data,
 {
     uint16_t func_retval = 0;
 
-    net_ip_t  *ip;
-    net_udp_t *udp;
+    net_packet_t *packet;
 
     uint8_t api_retval = 0;
     uint8_t validate   = 0;
 
-    uint16_t  udp_packet_length = 0;
-    uint16_t  udp_data_length   = 0;
-
 
     if(ethernet->ether_obj == NULL || network_data == NULL || net_data_length == 0 || net_data_length > UINT16_MAX)
     {
@@ -568,30 +608,21 @@ uint16_t ether_read_udp_raw(ethernet_handle_t *ethernet, uint8_t *network_data,
 
         if(api_retval)
         {
-            ip  = (void*)&ethernet->ether_obj->data;
-
-            udp = (void*)( (uint8_t*)ip + IP_HEADER_SIZE );
+            packet = ether_get_packet(ethernet);
 
             /* get source and destination port */
-            *source_port      = ntohs(udp->source_port);
-            *destination_port = ntohs(udp->destination_port);
-
-            /* Get UDP packet length and data length from header */
-            udp_packet_length = ntohs(udp->length);
-            udp_data_length   = udp_packet_length - UDP_FRAME_SIZE;
+            *source_port      = packet->source_port;
+            *destination_port = packet->destination_port;
 
-            /* Check and Truncate UDP data length */
-            if(app_data_length > udp_data_length)
-                app_data_length = udp_data_length;
+            /* Check and Truncate UDP data length, (validated by packet parser) */
+            if(app_data_length > packet->data_length)
+                app_data_length = packet->data_length;
 
-            /* validate UDP checksum */
-            validate = validate_udp_checksum(ip, udp);
+            /* Get UDP data, UDP checksum validated in the same pass */
+            validate = ip_transport_copy_data(ethernet, application_data, app_data_length);
 
-            /* Get UDP header */
             if(validate)
             {
-                memcpy((char*)application_data, (char*)&udp->data, app_data_length);
-
                 func_retval = app_data_length;
             }
 
@@ -604,4 +635,60 @@ uint16_t ether_read_udp_raw(ethernet_handle_t *ethernet, uint8_t *network_data,
 
 
 
+/**************************************************************
+ * @brief  Function to set UDP send rate limit (token bucket)
+ *         for destination port, packets over limit are not
+ *         sent (-15 from send functions)
+ * @param  destination_port : UDP destination port
+ * @param  rate             : Send rate (bytes per second),
+ *                            0 = remove limit
+ * @param  burst            : Max burst (bytes)
+ * @retval int8_t           : Error = 0, Success = 1
+ **************************************************************/
+int8_t udp_set_rate_limit(uint16_t destination_port, uint32_t rate, uint32_t burst)
+{
+    int8_t func_retval = 0;
+
+    uint8_t index      = 0;
+    uint8_t free_index = UDP_RATE_LIMITS;
+
+    if(destination_port == 0)
+    {
+        func_retval = 0;
+    }
+    else
+    {
+        for(index = 0; index < UDP_RATE_LIMITS; index++)
+        {
+            if(udp_rate_limits[index].destination_port == destination_port)
+                break;
+
+            if(udp_rate_limits[index].destination_port == 0 && free_index == UDP_RATE_LIMITS)
+                free_index = index;
+        }
+
+        if(index == UDP_RATE_LIMITS)
+            index = free_index;
+
+        if(rate == 0)
+        {
+            /* Remove limit */
+            if(index < UDP_RATE_LIMITS && udp_rate_limits[index].destination_port == destination_port)
+                udp_rate_limits[index].destination_port = 0;
+
+            func_retval = 1;
+        }
+        else if(index < UDP_RATE_LIMITS)
+        {
+            udp_rate_limits[index].destination_port = destination_port;
 
+            func_retval = net_rate_init(&udp_rate_limits[index].bucket, rate, burst);
+        }
+        else
+        {
+            func_retval = 0;
+        }
+    }
+
+    return func_retval;
+}
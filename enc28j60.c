@@ -32,6 +32,24 @@
 uint8_t nextPacketLsb = 0x00;
 uint8_t nextPacketMsb = 0x00;
 
+// size and bytes read of packet open after etherGetPacketHeader()
+uint16_t rxPacketSize = 0;
+uint16_t rxPacketRead = 0;
+
+// rx buffer from 0 to rxEnd (odd), tx buffer from txStart (even)
+uint16_t rxEnd   = ETHER_RX_BUFFER_SIZE - 1;
+uint16_t txStart = ETHER_RX_BUFFER_SIZE;
+
+// duplex mode from etherInit(), selects PAUSE frames or backpressure
+uint8_t etherMode = 0;
+
+// flow control watermarks (rx free bytes, 0 = off), state and overflow count
+uint16_t rxPauseFree  = 0;
+uint16_t rxResumeFree = 0;
+uint8_t  rxPaused     = 0;
+uint16_t rxOverflows  = 0;
+void (*rxWatermarkCallback)(uint8_t paused) = NULL;
+
 
 
 //-----------------------------------------------------------------------------
@@ -209,19 +227,21 @@ void etherInit(uint8_t mode, uint8_t *macAddress)
     etherClearReg(ECON1, RXEN);
     etherClearReg(ECON1, TXRTS);
 
-    // initialize receive buffer space
+    etherMode = mode;
+
+    // initialize receive buffer space, (size from etherSetBufferSize())
     etherSetBank(ERXSTL);
     etherWriteReg(ERXSTL, LOBYTE(0x0000));
     etherWriteReg(ERXSTH, HIBYTE(0x0000));
-    etherWriteReg(ERXNDL, LOBYTE(0x1A09));
-    etherWriteReg(ERXNDH, HIBYTE(0x1A09));
+    etherWriteReg(ERXNDL, LOBYTE(rxEnd));
+    etherWriteReg(ERXNDH, HIBYTE(rxEnd));
 
     // initialize receiver write and read ptrs
-    // at startup, will write from 0 to 1A08 only and will not overwrite rd ptr
+    // at startup, will write from 0 to rxEnd-1 only and will not overwrite rd ptr
     etherWriteReg(ERXWRPTL, LOBYTE(0x0000));
     etherWriteReg(ERXWRPTH, HIBYTE(0x0000));
-    etherWriteReg(ERXRDPTL, LOBYTE(0x1A09));
-    etherWriteReg(ERXRDPTH, HIBYTE(0x1A09));
+    etherWriteReg(ERXRDPTL, LOBYTE(rxEnd));
+    etherWriteReg(ERXRDPTH, HIBYTE(rxEnd));
     etherWriteReg(ERDPTL, LOBYTE(0x0000));
     etherWriteReg(ERDPTH, HIBYTE(0x0000));
 
@@ -261,6 +281,11 @@ void etherInit(uint8_t mode, uint8_t *macAddress)
 
     // leave collision window MACLCON2 as reset
 
+    // flow control off until rx watermark is reached, EPAUS left as reset
+    etherSetBank(EFLOCON);
+    etherWriteReg(EFLOCON, 0);
+    rxPaused = 0;
+
     setPhyMacAddr(macAddress);
 
     // initialize phy duplex
@@ -317,6 +342,80 @@ uint16_t etherGetPacket(uint8_t data[], uint16_t max_size)
     // end read from FIFO buffers
     etherReadMemStop();
 
+    etherSkipPacket();
+
+    return size;
+}
+
+// Returns first max_size characters of packet in data buffer (same format as etherGetPacket)
+// Returns packet size, rest is read by etherGetPacketRest() or discarded by etherSkipPacket()
+// Packet is released here if it fits in max_size
+uint16_t etherGetPacketHeader(uint8_t data[], uint16_t max_size)
+{
+    uint16_t i = 0, size, tmp;
+
+    etherReadMemStart();
+
+    nextPacketLsb = etherReadMem();
+    nextPacketMsb = etherReadMem();
+
+    size = etherReadMem();
+    data[i++] = size;
+    tmp = etherReadMem();
+    data[i++] = tmp;
+    size |= (tmp << 8);
+
+    if (max_size > size)
+        max_size = size;
+    while (i < max_size)
+        data[i++] = etherReadMem();
+
+    // dma rd ptr stays at next byte for etherGetPacketRest()
+    etherReadMemStop();
+
+    rxPacketSize = size;
+    rxPacketRead = i;
+
+    if (rxPacketRead >= rxPacketSize)
+        etherSkipPacket();
+    else if (rxPauseFree != 0)
+        etherCheckRxWatermark(); // free space dropped by packets received since last release
+
+    return size;
+}
+
+// Returns up to max_size more characters of packet after etherGetPacketHeader()
+// Returns number of bytes copied to buffer, packet is released
+uint16_t etherGetPacketRest(uint8_t data[], uint16_t max_size)
+{
+    uint16_t i = 0;
+
+    if (rxPacketRead < rxPacketSize)
+    {
+        if (max_size > rxPacketSize - rxPacketRead)
+            max_size = rxPacketSize - rxPacketRead;
+
+        etherReadMemStart();
+        while (i < max_size)
+            data[i++] = etherReadMem();
+        etherReadMemStop();
+
+        // advances ERXRDPT, flow control checked there
+        etherSkipPacket();
+    }
+    else if (rxPauseFree != 0)
+        etherCheckRxWatermark();
+
+    return i;
+}
+
+// Releases packet without reading the rest of it
+// Only place rx read ptr is advanced, all read paths release packets here
+void etherSkipPacket()
+{
+    rxPacketSize = 0;
+    rxPacketRead = 0;
+
     // advance read ptr
     etherSetBank(ERXRDPTL);
     etherWriteReg(ERXRDPTL, nextPacketLsb); // hw ptr
@@ -327,7 +426,16 @@ uint16_t etherGetPacket(uint8_t data[], uint16_t max_size)
     // decrement packet counter so that PKTIF is maintained correctly
     etherSetReg(ECON2, PKTDEC);
 
-    return size;
+    // rx free space changed, start or stop flow control
+    if (rxPauseFree != 0)
+        etherCheckRxWatermark();
+}
+
+// Returns number of packets waiting in rx buffer
+uint8_t etherGetPacketCount()
+{
+    etherSetBank(EPKTCNT);
+    return etherReadReg(EPKTCNT);
 }
 
 // Returns TRUE is rx buffer overflowed after correcting the problem
@@ -336,15 +444,158 @@ uint8_t etherIsOverflow()
     uint8_t err;
     err = (etherReadReg(EIR) & RXERIF) != 0;
     if (err)
+    {
         etherClearReg(EIR, RXERIF);
+        rxOverflows++;
+    }
     return err;
 }
 
-// Writes a packet
-int16_t etherPutPacket(uint8_t data[], uint16_t size)
+// Returns number of rx buffer overflows (dropped packets) seen by etherIsOverflow()
+uint16_t etherGetRxOverflowCount()
+{
+    return rxOverflows;
+}
+
+// Sets rx buffer size, rest of buffer SRAM is tx buffer
+// Call before etherInit(), size is limited to leave room for one tx frame
+void etherSetBufferSize(uint16_t rxSize)
+{
+    if (rxSize > ETHER_RX_BUFFER_SIZE)
+        rxSize = ETHER_RX_BUFFER_SIZE;
+    if (rxSize < ETHER_RX_BUFFER_MIN)
+        rxSize = ETHER_RX_BUFFER_MIN;
+
+    // rx end is odd, tx start is even
+    rxSize &= ~1;
+    rxEnd = rxSize - 1;
+    txStart = rxSize;
+}
+
+// Returns free space in rx buffer (bytes)
+uint16_t etherGetRxFreeSpace()
+{
+    uint16_t wrPtr, rdPtr;
+
+    etherSetBank(ERXWRPTL);
+    wrPtr = etherReadReg(ERXWRPTL);
+    wrPtr |= etherReadReg(ERXWRPTH) << 8;
+    rdPtr = etherReadReg(ERXRDPTL);
+    rdPtr |= etherReadReg(ERXRDPTH) << 8;
+
+    // rx buffer starts at 0
+    if (wrPtr > rdPtr)
+        return rxEnd - (wrPtr - rdPtr);
+    else if (wrPtr == rdPtr)
+        return rxEnd;
+    else
+        return rdPtr - wrPtr - 1;
+}
+
+// Starts or stops flow control
+// Full duplex sends PAUSE frames until stopped, then a zero PAUSE to resume
+// Half duplex uses backpressure (jams incoming frames)
+void etherSetFlowControl(uint8_t enable)
+{
+    etherSetBank(EFLOCON);
+    if ((etherMode & ETHER_FULLDUPLEX) != 0)
+        etherWriteReg(EFLOCON, enable ? FCEN1 : (FCEN1 | FCEN0));
+    else
+        etherWriteReg(EFLOCON, enable ? FCEN0 : 0);
+}
+
+// Sets rx free space watermarks for flow control, pauseFree = 0 turns it off
+// callback (optional) is called with 1 when pause starts and 0 when it ends
+void etherSetRxWatermark(uint16_t pauseFree, uint16_t resumeFree, void (*callback)(uint8_t paused))
+{
+    if (resumeFree < pauseFree)
+        resumeFree = pauseFree;
+
+    if (pauseFree == 0 && rxPaused)
+    {
+        rxPaused = 0;
+        etherSetFlowControl(0);
+    }
+
+    rxPauseFree = pauseFree;
+    rxResumeFree = resumeFree;
+    rxWatermarkCallback = callback;
+}
+
+// Starts flow control when rx free space falls below pause watermark and
+// stops it above resume watermark, called as packets are released
+void etherCheckRxWatermark()
+{
+    uint16_t freeSpace;
+
+    if (rxPauseFree == 0)
+        return;
+
+    etherIsOverflow();
+
+    freeSpace = etherGetRxFreeSpace();
+
+    if (!rxPaused && freeSpace < rxPauseFree)
+    {
+        rxPaused = 1;
+        etherSetFlowControl(1);
+        if (rxWatermarkCallback != NULL)
+            rxWatermarkCallback(1);
+    }
+    else if (rxPaused && freeSpace >= rxResumeFree)
+    {
+        rxPaused = 0;
+        etherSetFlowControl(0);
+        if (rxWatermarkCallback != NULL)
+            rxWatermarkCallback(0);
+    }
+}
+
+// Sets receive filter, mode uses ETHER_UNICAST, ETHER_BROADCAST, ...
+// always check CRC, use OR mode
+void etherSetRxFilter(uint8_t mode)
+{
+    etherSetBank(ERXFCON);
+    etherWriteReg(ERXFCON, (mode | 0x20) & 0xBF);
+}
+
+// Writes 64-bit multicast hash table (8 bytes, EHT0 first)
+void etherSetHashTable(uint8_t hashTable[])
+{
+    uint8_t i;
+    etherSetBank(EHT0);
+    for (i = 0; i < 8; i++)
+        etherWriteReg(EHT0 + i, hashTable[i]);
+}
+
+// Writes pattern match window offset, 64-bit byte mask (8 bytes, EPMM0 first)
+// and checksum of the selected bytes
+void etherSetPatternMatch(uint16_t offset, uint8_t mask[], uint16_t checksum)
+{
+    uint8_t i;
+    etherSetBank(EPMM0);
+    for (i = 0; i < 8; i++)
+        etherWriteReg(EPMM0 + i, mask[i]);
+    etherWriteReg(EPMCSL, LOBYTE(checksum));
+    etherWriteReg(EPMCSH, HIBYTE(checksum));
+    etherWriteReg(EPMOL, LOBYTE(offset));
+    etherWriteReg(EPMOH, HIBYTE(offset));
+}
+
+// Returns TRUE while last packet is being sent
+uint8_t etherTxBusy()
+{
+    return ((etherReadReg(ECON1) & TXRTS) != 0);
+}
+
+// Writes a packet and returns when transmit starts
+int16_t etherStartPacket(uint8_t data[], uint16_t size)
 {
     uint16_t i;
 
+    // tx buffer holds packet being sent
+    while (etherTxBusy());
+
     // clear out any tx errors
     if ((etherReadReg(EIR) & TXERIF) != 0)
     {
@@ -355,8 +606,8 @@ int16_t etherPutPacket(uint8_t data[], uint16_t size)
 
     // set DMA start address
     etherSetBank(EWRPTL);
-    etherWriteReg(EWRPTL, LOBYTE(0x1A0A));
-    etherWriteReg(EWRPTH, HIBYTE(0x1A0A));
+    etherWriteReg(EWRPTL, LOBYTE(txStart));
+    etherWriteReg(EWRPTH, HIBYTE(txStart));
 
     // start FIFO buffer write
     etherWriteMemStart();
@@ -372,15 +623,23 @@ int16_t etherPutPacket(uint8_t data[], uint16_t size)
     etherWriteMemStop();
 
     // request transmit
-    etherWriteReg(ETXSTL, LOBYTE(0x1A0A));
-    etherWriteReg(ETXSTH, HIBYTE(0x1A0A));
-    etherWriteReg(ETXNDL, LOBYTE(0x1A0A+size));
-    etherWriteReg(ETXNDH, HIBYTE(0x1A0A+size));
+    etherWriteReg(ETXSTL, LOBYTE(txStart));
+    etherWriteReg(ETXSTH, HIBYTE(txStart));
+    etherWriteReg(ETXNDL, LOBYTE(txStart+size));
+    etherWriteReg(ETXNDH, HIBYTE(txStart+size));
     etherClearReg(EIR, TXIF);
     etherSetReg(ECON1, TXRTS);
 
+    return 1;
+}
+
+// Writes a packet
+int16_t etherPutPacket(uint8_t data[], uint16_t size)
+{
+    etherStartPacket(data, size);
+
     // wait for completion
-    while ((etherReadReg(ECON1) & TXRTS) != 0);
+    while (etherTxBusy());
 
     // determine success
     return ((etherReadReg(ESTAT) & TXABORT) == 0);
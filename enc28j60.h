@@ -54,6 +54,17 @@
 #define ETHER_HALFDUPLEX     0x00
 #define ETHER_FULLDUPLEX     0x40
 
+// 8 KB buffer SRAM, rx buffer from 0 then tx buffer
+// tx buffer holds control byte, max frame and 7 byte status vector
+#define ETHER_SRAM_SIZE      0x2000
+#define ETHER_TX_BUFFER_MIN  1526
+#define ETHER_RX_BUFFER_MIN  0x0600
+#define ETHER_RX_BUFFER_SIZE (ETHER_SRAM_SIZE - ETHER_TX_BUFFER_MIN)
+
+// rx free space watermarks (bytes), pause below 2 max frames free
+#define ETHER_RX_PAUSE_FREE  3072
+#define ETHER_RX_RESUME_FREE 4608
+
 // Ether registers
 #define ERDPTL		0x00
 #define ERDPTH		0x01
@@ -85,6 +96,12 @@
 #define ECON1       0x1F
 #define RXEN    0x04
 #define TXRTS   0x08
+#define EHT0		0x20
+#define EPMM0		0x28
+#define EPMCSL		0x30
+#define EPMCSH		0x31
+#define EPMOL		0x34
+#define EPMOH		0x35
 #define ERXFCON		0x38
 #define EPKTCNT     0x39
 #define MACON1		0x40
@@ -122,6 +139,11 @@
 #define MISTAT      0x6A
 #define MIBUSY  0x01
 #define ECOCON      0x75
+#define EFLOCON     0x77
+#define FCEN0   0x01
+#define FCEN1   0x02
+#define EPAUSL      0x78
+#define EPAUSH      0x79
 
 // Ether phy registers
 #define PHCON1       0x00
@@ -165,8 +187,23 @@ void etherWritePhy(uint8_t reg, uint16_t data);
 uint16_t etherReadPhy(uint8_t reg);
 uint8_t etherKbhit();
 uint16_t etherGetPacket(uint8_t data[], uint16_t max_size);
+uint16_t etherGetPacketHeader(uint8_t data[], uint16_t max_size);
+uint16_t etherGetPacketRest(uint8_t data[], uint16_t max_size);
+void etherSkipPacket();
+uint8_t etherGetPacketCount();
 uint8_t etherIsOverflow();
+uint16_t etherGetRxOverflowCount();
+void etherSetBufferSize(uint16_t rxSize);
+uint16_t etherGetRxFreeSpace();
+void etherSetFlowControl(uint8_t enable);
+void etherSetRxWatermark(uint16_t pauseFree, uint16_t resumeFree, void (*callback)(uint8_t paused));
+void etherCheckRxWatermark();
 int16_t etherPutPacket(uint8_t data[], uint16_t size);
+int16_t etherStartPacket(uint8_t data[], uint16_t size);
+uint8_t etherTxBusy();
+void etherSetRxFilter(uint8_t mode);
+void etherSetHashTable(uint8_t hashTable[]);
+void etherSetPatternMatch(uint16_t offset, uint8_t mask[], uint16_t checksum);
 
 
 
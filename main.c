@@ -76,6 +76,7 @@
 #include "udp.h"
 #include "dhcp.h"
 #include "tcp.h"
+#include "net_task.h"
 
 #include "cl_term.h"
 #include "mqtt_client.h"
@@ -94,6 +95,7 @@
 #define UDP_TEST  0
 #define TCP_TEST  0
 #define MQTT_TEST 1
+#define TASK_TEST 0
 
 
 #define RED_LED      (*((volatile uint32_t *)(0x42000000 + (0x400253FC-0x40000000)*32 + 1*4)))
@@ -113,6 +115,21 @@ typedef enum _app_state
 }app_state_t;
 
 
+/* Application task context, (task locals are not kept across waits) */
+typedef struct _app_context
+{
+    ethernet_handle_t *ethernet;           /*!< Ethernet handle                  */
+    uint8_t           *network_data;       /*!< Network data buffer              */
+    tcp_handle_t      *client;             /*!< TCP client of TCP task           */
+    dhcp_client_t     *dhcp;               /*!< DHCP client, (dynamic IP)        */
+    uint8_t            server_ip[4];       /*!< TCP and UDP server IP            */
+    char               tcp_data[50];       /*!< TCP read buffer                  */
+    int32_t            tcp_retval;         /*!< Return value of last TCP call    */
+    uint16_t           count;              /*!< TCP messages sent                */
+
+}app_context_t;
+
+
 
 /******************************************************************************/
 /*                                                                            */
@@ -271,6 +288,103 @@ uint16_t readAdc0Ss3()
 
 
 
+// Millisecond tick counter, incremented by SysTick
+volatile uint32_t tick_ms = 0;
+
+
+void init_systick(void)
+{
+    // Configure SysTick for 1 ms interrupts from 40 MHz system clock
+    NVIC_ST_CTRL_R    = 0;
+    NVIC_ST_RELOAD_R  = 40000 - 1;
+    NVIC_ST_CURRENT_R = 0;
+    NVIC_ST_CTRL_R    = NVIC_ST_CTRL_CLK_SRC | NVIC_ST_CTRL_INTEN | NVIC_ST_CTRL_ENABLE;
+}
+
+
+void sysTickIsr(void)
+{
+    tick_ms++;
+}
+
+
+uint32_t get_tick_ms(void)
+{
+    return tick_ms;
+}
+
+
+
+// EEPROM, 32 blocks of 16 words, saved DHCP lease
+void init_eeprom(void)
+{
+    SYSCTL_RCGCEEPROM_R |= SYSCTL_RCGCEEPROM_R0;
+    while(!(SYSCTL_PREEPROM_R & SYSCTL_PREEPROM_R0));
+    while(EEPROM_EEDONE_R & EEPROM_EEDONE_WORKING);
+}
+
+
+static void eeprom_seek(uint16_t word)
+{
+    EEPROM_EEBLOCK_R  = word / 16;
+    EEPROM_EEOFFSET_R = word % 16;
+}
+
+
+uint8_t eeprom_nv_read(uint16_t offset, void *data, uint16_t length)
+{
+    uint8_t *bytes = data;
+    uint16_t index;
+    uint32_t word = 0;
+
+    for(index = 0; index < length; index++)
+    {
+        // Read word on word boundary, EEPROM is word addressed
+        if(index == 0 || ((offset + index) & 3) == 0)
+        {
+            eeprom_seek((offset + index) >> 2);
+            word = EEPROM_EERDWR_R;
+        }
+
+        bytes[index] = word >> (8 * ((offset + index) & 3));
+    }
+
+    return 1;
+}
+
+
+uint8_t eeprom_nv_write(uint16_t offset, void *data, uint16_t length)
+{
+    uint8_t *bytes = data;
+    uint16_t index;
+    uint8_t  shift;
+    uint32_t word = 0;
+
+    for(index = 0; index < length; index++)
+    {
+        shift = 8 * ((offset + index) & 3);
+
+        if(index == 0 || shift == 0)
+        {
+            eeprom_seek((offset + index) >> 2);
+            word = EEPROM_EERDWR_R;
+        }
+
+        word = (word & ~(0xFFUL << shift)) | ((uint32_t)bytes[index] << shift);
+
+        // Write word when complete, (read-modify-write partial words)
+        if(shift == 24 || index == length - 1)
+        {
+            EEPROM_EERDWR_R = word;
+            while(EEPROM_EEDONE_R & EEPROM_EEDONE_WORKING);
+        }
+    }
+
+    return 1;
+}
+
+
+
 /* wrapper Functions */
 
 uint8_t ether_open(uint8_t *mac_address)
@@ -278,10 +392,44 @@ uint8_t ether_open(uint8_t *mac_address)
 
     etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX, mac_address);
 
+    // Backpressure when rx buffer fills faster than it is read
+    etherSetRxWatermark(ETHER_RX_PAUSE_FREE, ETHER_RX_RESUME_FREE, NULL);
+
     return 0;
 }
 
 
+uint8_t ether_set_rx_filter(ether_rx_filter_t *filter)
+{
+    uint8_t mode = 0;
+
+    if(filter->flags & ETHER_FILTER_UNICAST)
+        mode |= ETHER_UNICAST;
+
+    if(filter->flags & ETHER_FILTER_BROADCAST)
+        mode |= ETHER_BROADCAST;
+
+    if(filter->flags & ETHER_FILTER_MULTICAST)
+        mode |= ETHER_MULTICAST;
+
+    if(filter->flags & ETHER_FILTER_HASH)
+    {
+        etherSetHashTable(filter->hash_table);
+        mode |= ETHER_HASHTABLE;
+    }
+
+    if(filter->flags & ETHER_FILTER_PATTERN)
+    {
+        etherSetPatternMatch(filter->pattern_offset, filter->pattern_mask, filter->pattern_checksum);
+        mode |= ETHER_PATTERNMATCH;
+    }
+
+    etherSetRxFilter(mode);
+
+    return 1;
+}
+
+
 uint8_t myUartOpen(uint32_t baud_rate)
 {
     init_uart0();
@@ -300,6 +448,127 @@ uint8_t myPutChar(char data)
 
 
 
+#if TASK_TEST
+
+/* TCP client task, connect, send and read without blocking other tasks */
+int8_t tcp_app_task(net_task_t *task, void *context)
+{
+    app_context_t *app = context;
+
+    PT_BEGIN(&task->pt);
+
+    app->client = ether_tcp_create_client(app->ethernet, app->network_data, get_random_port(app->ethernet, 6534), 7788, app->server_ip);
+
+    tcp_control(app->client, TCP_READ_NONBLOCK);
+    tcp_control(app->client, TCP_SEND_NONBLOCK);
+
+    /* SYN is resent by TCP retransmission timer while task waits */
+    PT_WAIT_UNTIL(&task->pt, ether_tcp_connect(app->ethernet, app->network_data, app->client) != 0);
+
+    for(app->count = 0; app->count < 100 && app->client->client_flags.connect_established; app->count++)
+    {
+        ether_tcp_send_data(app->ethernet, app->network_data, app->client, "hey", 3);
+
+        /* Wait for reply, other tasks run meanwhile */
+        PT_WAIT_UNTIL(&task->pt, (app->tcp_retval = ether_tcp_read_data(app->ethernet, app->network_data, app->client,
+                                                                           app->tcp_data, sizeof(app->tcp_data))) > 0 ||
+                                 app->client->client_flags.connect_established == 0);
+
+        NET_TASK_SLEEP(task, 1000);
+    }
+
+    /* FIN is resent by TCP retransmission timer while task waits */
+    PT_WAIT_UNTIL(&task->pt, ether_tcp_close(app->ethernet, app->network_data, app->client) != 0 ||
+                             app->client->client_flags.connect_aborted);
+
+    PT_END(&task->pt);
+}
+
+
+
+/* Receive task, reads waiting frames in batches while TCP connection is open */
+int8_t rx_task(net_task_t *task, void *context)
+{
+    app_context_t *app = context;
+
+    PT_BEGIN(&task->pt);
+
+    while(1)
+    {
+        PT_WAIT_UNTIL(&task->pt, app->client != NULL && app->client->client_flags.connect_established);
+
+        net_poll(app->ethernet, app->network_data, ETHER_POLL_BUDGET);
+
+        PT_YIELD(&task->pt);
+    }
+
+    PT_END(&task->pt);
+}
+
+
+
+/* UDP sampler task, sends ADC sample every 500 ms */
+int8_t udp_sample_task(net_task_t *task, void *context)
+{
+    app_context_t *app = context;
+
+    char sample[2];
+
+    PT_BEGIN(&task->pt);
+
+    while(1)
+    {
+        sample[0] = '0' + readAdc0Ss3();
+        sample[1] = '\n';
+
+        ether_send_udp(app->ethernet, app->server_ip, 8080, sample, 2);
+
+        NET_TASK_SLEEP(task, 500);
+    }
+
+    PT_END(&task->pt);
+}
+
+
+
+/* DHCP task, renews lease in background */
+int8_t dhcp_task(net_task_t *task, void *context)
+{
+    app_context_t *app = context;
+
+    PT_BEGIN(&task->pt);
+
+    while(1)
+    {
+        ether_dhcp_poll(app->dhcp, app->network_data);
+
+        PT_YIELD(&task->pt);
+    }
+
+    PT_END(&task->pt);
+}
+
+
+
+/* Status LED task */
+int8_t led_task(net_task_t *task, void *context)
+{
+    PT_BEGIN(&task->pt);
+
+    while(1)
+    {
+        BLUE_LED ^= 1;
+
+        NET_TASK_SLEEP(task, 250);
+    }
+
+    PT_END(&task->pt);
+}
+
+#endif
+
+
+
 /* Link Console operation functions */
 console_ops_t myUartOperations =
 {
@@ -316,9 +585,18 @@ ether_operations_t ether_ops =
 {
  .open                     = ether_open,
  .network_interface_status = etherKbhit,
- .ether_send_packet        = etherPutPacket,
+ .ether_send_packet        = etherStartPacket,
  .ether_recv_packet        = etherGetPacket,
  .random_gen_seed          = readAdc0Ss3,
+ .get_time_ms              = get_tick_ms,
+ .nv_read                  = eeprom_nv_read,
+ .nv_write                 = eeprom_nv_write,
+ .set_rx_filter            = ether_set_rx_filter,
+ .ether_recv_header        = etherGetPacketHeader,
+ .ether_recv_remaining     = etherGetPacketRest,
+ .ether_drop_packet        = etherSkipPacket,
+ .ether_rx_pending         = etherGetPacketCount,
+ .ether_tx_busy            = etherTxBusy,
 };
 
 
@@ -339,6 +617,9 @@ int main(void)
     cl_term_t *my_console;
     char serial_buffer[MAX_INPUT_SIZE] = {0};
 
+    dhcp_client_t dhcp_client;
+    arp_probe_t   arp_probe;
+
     /* Point Network data */
     network_hardware = (void*)data;
 
@@ -347,6 +628,10 @@ int main(void)
 
     init_adc();
 
+    init_systick();
+
+    init_eeprom();
+
     /* Console Configurations */
     my_console = console_open(&myUartOperations, 115200, serial_buffer, CONSOLE_STATIC);
 
@@ -355,26 +640,41 @@ int main(void)
     /* Create Ethernet handle */
     ethernet = create_ethernet_handle(&network_hardware->data, "02:03:04:50:60:48", "192.168.1.199", &ether_ops);
 
-    /* flash PHY LEDS */
+    /* PHY LEDS on until address is configured, (no boot delay) */
     etherWritePhy(PHLCON, 0x0880);
     RED_LED = 1;
-    waitMicrosecond(500000);
-    etherWritePhy(PHLCON, 0x0990);
-    RED_LED = 0;
-    waitMicrosecond(500000);
 
 
 #if STATIC
 
+    set_ip_address(ethernet->subnet_mask, "255.255.255.0");
     set_ip_address(ethernet->gateway_ip, "192.168.1.196");
 
+    /* Check static address is free and announce it (RFC 5227) */
+    ether_arp_probe_start(ethernet, &arp_probe, ethernet->host_ip, 1);
+
+    while(ether_arp_probe_poll(&arp_probe, (uint8_t*)network_hardware) < ARP_PROBE_BOUND);
+
+    if(arp_probe.state == ARP_PROBE_CONFLICT)
+        console_print(my_console, "IP address conflict \n");
+
+    /* Drop broadcast traffic in device, ARP requests for host pass pattern filter */
+    ether_arp_set_rx_pattern(ethernet);
+    ether_filter_broadcast(ethernet, 0);
+
 #else
 
-    /* test DHCP */
-    ether_get_dhcp_ip(ethernet, (uint8_t*)network_hardware, ethernet->host_mac, DHCP_INIT_STATE);
+    /* Get IP from DHCP server, saved lease requested first, lease is renewed by ether_dhcp_poll() */
+    ether_dhcp_start(ethernet, &dhcp_client, NULL);
+
+    while(ether_dhcp_poll(&dhcp_client, (uint8_t*)network_hardware) != DHCP_BOUND_STATE)
+        net_poll(ethernet, (uint8_t*)network_hardware, ETHER_POLL_BUDGET);
 
 #endif
 
+    etherWritePhy(PHLCON, 0x0990);
+    RED_LED = 0;
+
 
 #if ICMP_TEST
 
@@ -565,6 +865,10 @@ int main(void)
     /* Configure TCP Network IO control */
     tcp_control(test_client, TCP_READ_NONBLOCK);
 
+    /* Coalesce small PUBLISH messages (Nagle) and delay ACKs */
+    tcp_control(test_client, TCP_SEND_NONBLOCK);
+    tcp_control(test_client, TCP_DELAYED_ACK);
+
 
     /* MQTT State machine initializations */
     loop_state = FSM_RUN;
@@ -753,6 +1057,44 @@ int main(void)
     loop = 1;
     while(loop);
 
+#endif
+
+
+#if TASK_TEST
+
+    /* Test cooperative tasks, TCP client, UDP sampler and LED run concurrently */
+    app_context_t app_context;
+
+    net_task_t tcp_task;
+    net_task_t rx_net_task;
+    net_task_t udp_task;
+    net_task_t status_task;
+
+    memset(&app_context, 0, sizeof(app_context));
+
+    app_context.ethernet     = ethernet;
+    app_context.network_data = (uint8_t*)network_hardware;
+    app_context.dhcp         = &dhcp_client;
+
+    set_ip_address(app_context.server_ip, "192.168.1.13");
+
+    /* Network calls return when no packet is pending */
+    ether_control(ethernet, ETHER_READ_NONBLOCK);
+
+    net_task_create(&tcp_task, tcp_app_task, &app_context);
+    net_task_create(&rx_net_task, rx_task, &app_context);
+    net_task_create(&udp_task, udp_sample_task, &app_context);
+    net_task_create(&status_task, led_task, NULL);
+
+#if !STATIC
+    net_task_t lease_task;
+
+    net_task_create(&lease_task, dhcp_task, &app_context);
+#endif
+
+    /* Poll loop */
+    while(net_task_run(get_tick_ms()));
+
 #endif
 
     return 0;